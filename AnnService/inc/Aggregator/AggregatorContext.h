@@ -7,6 +7,7 @@
 #include "inc/Socket/Common.h"
 #include "inc/Core/VectorSet.h"
 #include "AggregatorSettings.h"
+#include "CenterRouter.h"
 
 #include <memory>
 #include <vector>
@@ -55,11 +56,15 @@ public:
 
 	const std::shared_ptr<VectorSet>& GetCenters() const;
 
+    const std::shared_ptr<CenterRouter>& GetRouter() const;
+
 private:
     std::vector<std::shared_ptr<RemoteMachine>> m_remoteServers;
 	
 	std::shared_ptr<VectorSet> m_centers;
 
+    std::shared_ptr<CenterRouter> m_router;
+
     std::shared_ptr<AggregatorSettings> m_settings;
 
     bool m_initialized;
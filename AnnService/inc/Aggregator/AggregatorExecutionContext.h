@@ -9,6 +9,7 @@
 
 #include <memory>
 #include <atomic>
+#include <mutex>
 
 namespace SPTAG
 {
@@ -33,11 +34,21 @@ public:
 
     bool IsCompletedAfterFinsh(std::uint32_t p_finishedCount);
 
+    // Stores the result of one server, false if the request has already been answered.
+    bool SetResult(std::size_t p_num, AggregatorResult p_result);
+
+    // Claims the response of the request; only the first caller gets true and no result is stored after it.
+    bool Finish();
+
 private:
     std::atomic<std::uint32_t> m_unfinishedCount;
 
     std::vector<AggregatorResult> m_results;
 
+    std::mutex m_resultsMutex;
+
+    bool m_finished;
+
     Socket::PacketHeader m_requestHeader;
 
 };
@@ -33,6 +33,24 @@ public:
 
     void Run();
 
+    // Status of every vector of a delete sent to all shards into p_merged, p_shardStatus[i] is the reply of shard i
+    // and p_shardResults[i] the status of every vector on it, empty when the reply holds for all. A vector counts as
+    // deleted when any shard deleted it, otherwise it gets the status a retry is most likely to fix: Dropped, Timeout,
+    // then Failed. Returns the status of the whole request, p_merged is cleared when it is Ok.
+    static Socket::PacketProcessStatus MergeDeleteResults(const std::vector<Socket::PacketProcessStatus>& p_shardStatus,
+                                                          const std::vector<Socket::RemoteUpdateResult>& p_shardResults,
+                                                          std::uint32_t p_vectorNum,
+                                                          Socket::RemoteUpdateResult& p_merged);
+
+    // Best K answers of every query and index across the servers into p_merged, p_shards holds the answers of
+    // the servers to one query and index, each sorted by distance. K is the largest result number among them.
+    // Answers with metadata are the same vector when their metadata is, without it only repeats from one server are.
+    static void MergeIndexResults(const std::vector<const QueryResult*>& p_shards, QueryResult& p_merged);
+
+    // Merges the replies of all servers to a search, p_results[i] is the reply of server i. Servers which did
+    // not answer in time or failed are left out, p_merged is a Timeout when none answered.
+    static void MergeSearchResults(const std::vector<AggregatorResult>& p_results, Socket::RemoteSearchResult& p_merged);
+
 private:
 
     void StartClient();
@@ -51,11 +69,28 @@ private:
 
     void AggregateResults(std::shared_ptr<AggregatorExecutionContext> p_exectionContext);
 
+    void UpdateRequestHandler(Socket::ConnectionID p_localConnectionID, Socket::Packet p_packet);
+
+    void UpdateResponseHandler(Socket::ConnectionID p_localConnectionID, Socket::Packet p_packet);
+
+    // p_routed holds, per server of the context, the positions of the inserted vectors sent to it; null for deletes.
+    // p_shardResults holds the vector status each server replied with.
+    void AggregateUpdateResults(std::shared_ptr<AggregatorExecutionContext> p_exectionContext,
+                                std::shared_ptr<std::vector<std::vector<std::uint32_t>>> p_routed,
+                                std::shared_ptr<std::vector<Socket::RemoteUpdateResult>> p_shardResults,
+                                std::uint32_t p_vectorNum);
+
+    void SendUpdateResponse(const Socket::PacketHeader& p_requestHeader,
+                            Socket::PacketProcessStatus p_status,
+                            const Socket::RemoteUpdateResult* p_result = nullptr);
+
     std::shared_ptr<AggregatorContext> GetContext();
 
 private:
     typedef std::function<void(Socket::RemoteSearchResult)> AggregatorCallback;
 
+    typedef std::function<void(Socket::PacketProcessStatus, Socket::RemoteUpdateResult)> UpdateCallback;
+
     std::shared_ptr<AggregatorContext> m_aggregatorContext;
 
     std::shared_ptr<Socket::Server> m_socketServer;
@@ -77,6 +112,8 @@ private:
     boost::asio::deadline_timer m_pendingConnectServersTimer;
 
     Socket::ResourceManager<AggregatorCallback> m_aggregatorCallbackManager;
+
+    Socket::ResourceManager<UpdateCallback> m_updateCallbackManager;
 };
 
 
@@ -23,6 +23,9 @@ struct AggregatorSettings
 
     std::uint32_t m_searchTimeout;
 
+    // Answer with the servers that have responded once m_searchTimeout fires instead of waiting for all of them.
+    bool m_partialResultOnTimeout;
+
     SizeType m_threadNum;
 
     SizeType m_socketThreadNum;
@@ -34,6 +37,11 @@ struct AggregatorSettings
 	SizeType m_topK;
 
 	DistCalcMethod m_distMethod;
+
+    // Route with a BKT index over the centers once there are at least this many, 0 always scans them.
+    SizeType m_centerIndexThreshold;
+
+    int m_centerIndexMaxCheck;
 };
 
 
@@ -0,0 +1,156 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_AGGREGATOR_CENTERROUTER_H_
+#define _SPTAG_AGGREGATOR_CENTERROUTER_H_
+
+#include "inc/Core/Common.h"
+#include "inc/Core/VectorIndex.h"
+#include "inc/Core/Common/DistanceUtils.h"
+#include "inc/Helper/StringConvert.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace SPTAG
+{
+namespace Aggregator
+{
+
+// Picks the servers whose centers are nearest to a query. Small center sets are scanned with the SIMD
+// distance kernel in blocks that stay in cache across a batch of queries; once there are at least
+// p_indexThreshold centers an in-memory BKT index built over them is searched instead.
+class CenterRouter
+{
+public:
+    CenterRouter()
+        : m_distMethod(DistCalcMethod::L2)
+    {
+    }
+
+    bool Initialize(std::shared_ptr<VectorSet> p_centers,
+                    DistCalcMethod p_distMethod,
+                    SizeType p_indexThreshold,
+                    int p_maxCheck,
+                    int p_threadNum)
+    {
+        m_centers = p_centers;
+        m_distMethod = p_distMethod;
+        m_index.reset();
+
+        if (nullptr == m_centers || m_centers->Count() == 0)
+        {
+            return false;
+        }
+
+        if (p_indexThreshold > 0 && m_centers->Count() >= p_indexThreshold)
+        {
+            m_index = VectorIndex::CreateInstance(IndexAlgoType::BKT, m_centers->GetValueType());
+            m_index->SetParameter("DistCalcMethod", Helper::Convert::ConvertToString(p_distMethod));
+            m_index->SetParameter("MaxCheck", std::to_string(p_maxCheck));
+            m_index->SetParameter("NumberOfThreads", std::to_string(max(1, p_threadNum)));
+            if (ErrorCode::Success != m_index->BuildIndex(m_centers, nullptr))
+            {
+                LOG(Helper::LogLevel::LL_Error, "Failed to build the center index, fall back to scanning the centers.\n");
+                m_index.reset();
+            }
+        }
+        return true;
+    }
+
+    bool UseIndex() const
+    {
+        return nullptr != m_index;
+    }
+
+    SizeType CenterNum() const
+    {
+        return nullptr == m_centers ? 0 : m_centers->Count();
+    }
+
+    // Routes p_num queries stored one after another: p_servers gets min(p_topK, CenterNum()) center ids
+    // per query, the nearest first.
+    void Route(const void* p_queries, SizeType p_num, int p_topK, std::vector<SizeType>& p_servers) const
+    {
+        int topK = static_cast<int>(min(static_cast<SizeType>(p_topK), CenterNum()));
+        p_servers.resize(static_cast<std::size_t>(p_num) * max(topK, 0));
+        if (topK <= 0) return;
+
+        if (UseIndex())
+        {
+            SizeType querySize = m_centers->PerVectorDataSize();
+            QueryResult result(nullptr, topK, false);
+            for (SizeType q = 0; q < p_num; q++)
+            {
+                result.SetTarget(static_cast<const std::uint8_t*>(p_queries) + querySize * q);
+                result.Reset();
+                m_index->SearchIndex(result);
+                for (int k = 0; k < topK; k++) p_servers[static_cast<std::size_t>(q) * topK + k] = result.GetResult(k)->VID;
+            }
+            return;
+        }
+
+        switch (m_centers->GetValueType())
+        {
+#define DefineVectorValueType(Name, Type) \
+        case VectorValueType::Name: \
+            Scan<Type>(static_cast<const Type*>(p_queries), p_num, topK, p_servers); \
+            break; \
+
+#include "inc/Core/DefinitionList.h"
+#undef DefineVectorValueType
+
+        default:
+            break;
+        }
+    }
+
+private:
+    static const SizeType c_centerBlock = 256;
+
+    template <typename T>
+    void Scan(const T* p_queries, SizeType p_num, int p_topK, std::vector<SizeType>& p_servers) const
+    {
+        auto distFunc = COMMON::DistanceCalcSelector<T>(m_distMethod);
+        DimensionType dim = m_centers->Dimension();
+        SizeType centerNum = m_centers->Count();
+
+        std::vector<float> dists(static_cast<std::size_t>(p_num) * centerNum);
+        for (SizeType begin = 0; begin < centerNum; begin += c_centerBlock)
+        {
+            SizeType end = min(begin + c_centerBlock, centerNum);
+            for (SizeType q = 0; q < p_num; q++)
+            {
+                const T* query = p_queries + static_cast<std::size_t>(q) * dim;
+                float* row = dists.data() + static_cast<std::size_t>(q) * centerNum;
+                for (SizeType c = begin; c < end; c++)
+                {
+                    row[c] = distFunc(query, static_cast<const T*>(m_centers->GetVector(c)), dim);
+                }
+            }
+        }
+
+        std::vector<SizeType> order(centerNum);
+        for (SizeType q = 0; q < p_num; q++)
+        {
+            const float* row = dists.data() + static_cast<std::size_t>(q) * centerNum;
+            auto closer = [row](SizeType a, SizeType b) { return row[a] < row[b] || (row[a] == row[b] && a < b); };
+            for (SizeType c = 0; c < centerNum; c++) order[c] = c;
+            std::partial_sort(order.begin(), order.begin() + p_topK, order.end(), closer);
+            std::copy(order.begin(), order.begin() + p_topK, p_servers.begin() + static_cast<std::size_t>(q) * p_topK);
+        }
+    }
+
+    std::shared_ptr<VectorSet> m_centers;
+
+    DistCalcMethod m_distMethod;
+
+    std::shared_ptr<VectorIndex> m_index;
+};
+
+} // namespace Aggregator
+} // namespace SPTAG
+
+#endif // _SPTAG_AGGREGATOR_CENTERROUTER_H_
@@ -19,6 +19,14 @@ namespace SPTAG
         template<typename T>
         inline DistanceCalcReturn<T> DistanceCalcSelector(SPTAG::DistCalcMethod p_method);
 
+        template <typename T>
+        using DistanceBatchCalcReturn = void(*)(const T*, const void*, std::size_t, int, DimensionType, float*);
+        template<typename T>
+        inline DistanceBatchCalcReturn<T> DistanceBatchCalcSelector(SPTAG::DistCalcMethod p_method);
+
+        using FastScanCalcReturn = void(*)(const std::uint8_t*, const std::uint8_t* const*, int, DimensionType, std::uint16_t*);
+        inline FastScanCalcReturn FastScanCalcSelector();
+
         class DistanceUtils
         {
         public:
@@ -95,6 +103,99 @@ namespace SPTAG
             static float ComputeCosineDistance_AVX512(const float* pX, const float* pY, DimensionType length);
 
 
+            // One query against num vectors stride bytes apart from pY, pDists[i] gets the distance to the i-th of them.
+            // Each distance is the one of the single vector kernel, the vectors a few strides ahead are prefetched meanwhile.
+            template <typename T, DistanceCalcReturn<T> Func>
+            static inline void ComputeStridedDistances(const T* pX, const void* pY, std::size_t stride, int num, DimensionType length, float* pDists)
+            {
+                const char* pVector = (const char*)pY;
+                const std::size_t vectorBytes = sizeof(T) * length;
+                for (int i = 0; i < num; i++, pVector += stride)
+                {
+                    if (i + BatchPrefetchDistance < num)
+                    {
+                        const char* pAhead = pVector + BatchPrefetchDistance * stride;
+                        for (std::size_t b = 0; b < vectorBytes; b += 64) _mm_prefetch(pAhead + b, _MM_HINT_T0);
+                    }
+                    pDists[i] = Func(pX, (const T*)pVector, length);
+                }
+            }
+
+            template <typename T>
+            static void ComputeL2DistanceBatch(const T* pX, const void* pY, std::size_t stride, int num, DimensionType length, float* pDists)
+            {
+                ComputeStridedDistances<T, &ComputeL2Distance<T>>(pX, pY, stride, num, length, pDists);
+            }
+
+            static void ComputeL2DistanceBatch_SSE(const std::int8_t* pX, const void* pY, std::size_t stride, int num, DimensionType length, float* pDists);
+            static void ComputeL2DistanceBatch_AVX(const std::int8_t* pX, const void* pY, std::size_t stride, int num, DimensionType length, float* pDists);
+            static void ComputeL2DistanceBatch_AVX512(const std::int8_t* pX, const void* pY, std::size_t stride, int num, DimensionType length, float* pDists);
+
+            static void ComputeL2DistanceBatch_SSE(const std::uint8_t* pX, const void* pY, std::size_t stride, int num, DimensionType length, float* pDists);
+            static void ComputeL2DistanceBatch_AVX(const std::uint8_t* pX, const void* pY, std::size_t stride, int num, DimensionType length, float* pDists);
+            static void ComputeL2DistanceBatch_AVX512(const std::uint8_t* pX, const void* pY, std::size_t stride, int num, DimensionType length, float* pDists);
+
+            static void ComputeL2DistanceBatch_SSE(const std::int16_t* pX, const void* pY, std::size_t stride, int num, DimensionType length, float* pDists);
+            static void ComputeL2DistanceBatch_AVX(const std::int16_t* pX, const void* pY, std::size_t stride, int num, DimensionType length, float* pDists);
+            static void ComputeL2DistanceBatch_AVX512(const std::int16_t* pX, const void* pY, std::size_t stride, int num, DimensionType length, float* pDists);
+
+            static void ComputeL2DistanceBatch_SSE(const float* pX, const void* pY, std::size_t stride, int num, DimensionType length, float* pDists);
+            static void ComputeL2DistanceBatch_AVX(const float* pX, const void* pY, std::size_t stride, int num, DimensionType length, float* pDists);
+            static void ComputeL2DistanceBatch_AVX512(const float* pX, const void* pY, std::size_t stride, int num, DimensionType length, float* pDists);
+
+            template <typename T>
+            static void ComputeCosineDistanceBatch(const T* pX, const void* pY, std::size_t stride, int num, DimensionType length, float* pDists)
+            {
+                ComputeStridedDistances<T, &ComputeCosineDistance<T>>(pX, pY, stride, num, length, pDists);
+            }
+
+            static void ComputeCosineDistanceBatch_SSE(const std::int8_t* pX, const void* pY, std::size_t stride, int num, DimensionType length, float* pDists);
+            static void ComputeCosineDistanceBatch_AVX(const std::int8_t* pX, const void* pY, std::size_t stride, int num, DimensionType length, float* pDists);
+            static void ComputeCosineDistanceBatch_AVX512(const std::int8_t* pX, const void* pY, std::size_t stride, int num, DimensionType length, float* pDists);
+
+            static void ComputeCosineDistanceBatch_SSE(const std::uint8_t* pX, const void* pY, std::size_t stride, int num, DimensionType length, float* pDists);
+            static void ComputeCosineDistanceBatch_AVX(const std::uint8_t* pX, const void* pY, std::size_t stride, int num, DimensionType length, float* pDists);
+            static void ComputeCosineDistanceBatch_AVX512(const std::uint8_t* pX, const void* pY, std::size_t stride, int num, DimensionType length, float* pDists);
+
+            static void ComputeCosineDistanceBatch_SSE(const std::int16_t* pX, const void* pY, std::size_t stride, int num, DimensionType length, float* pDists);
+            static void ComputeCosineDistanceBatch_AVX(const std::int16_t* pX, const void* pY, std::size_t stride, int num, DimensionType length, float* pDists);
+            static void ComputeCosineDistanceBatch_AVX512(const std::int16_t* pX, const void* pY, std::size_t stride, int num, DimensionType length, float* pDists);
+
+            static void ComputeCosineDistanceBatch_SSE(const float* pX, const void* pY, std::size_t stride, int num, DimensionType length, float* pDists);
+            static void ComputeCosineDistanceBatch_AVX(const float* pX, const void* pY, std::size_t stride, int num, DimensionType length, float* pDists);
+            static void ComputeCosineDistanceBatch_AVX512(const float* pX, const void* pY, std::size_t stride, int num, DimensionType length, float* pDists);
+
+            // Fast-scan of up to FastScanBlock codes of 16-centroid sub-quantizers, one byte per sub-quantizer. pLut holds
+            // 16 uint8 distances per sub-quantizer and pSums[v] gets the sum of the distances of pCodes[v].
+            static const int FastScanBlock = 32;
+
+            static void ComputeFastScan(const std::uint8_t* pLut, const std::uint8_t* const* pCodes, int count, DimensionType subvectors, std::uint16_t* pSums)
+            {
+                for (int v = 0; v < count; v++)
+                {
+                    const std::uint8_t* pLutRow = pLut;
+                    std::uint16_t sum = 0;
+                    for (DimensionType i = 0; i < subvectors; i++, pLutRow += 16) sum += pLutRow[pCodes[v][i]];
+                    pSums[v] = sum;
+                }
+            }
+
+            static void ComputeFastScan_AVX(const std::uint8_t* pLut, const std::uint8_t* const* pCodes, int count, DimensionType subvectors, std::uint16_t* pSums);
+
+            // Distances to the vectors pY + slots[i] * stride for increasing slots, consecutive slots go to the batch kernel together.
+            template <typename T>
+            static inline void ComputeSlotDistances(DistanceBatchCalcReturn<T> batchFunc, const T* pX, const void* pY, std::size_t stride,
+                const int* slots, int num, DimensionType length, float* pDists)
+            {
+                for (int i = 0; i < num;)
+                {
+                    int j = i + 1;
+                    while (j < num && slots[j] == slots[j - 1] + 1) j++;
+                    batchFunc(pX, (const char*)pY + (std::size_t)slots[i] * stride, stride, j - i, length, pDists + i);
+                    i = j;
+                }
+            }
+
             template<typename T>
             static inline float ComputeDistance(const T* p1, const T* p2, DimensionType length, SPTAG::DistCalcMethod distCalcMethod)
             {
@@ -114,6 +215,10 @@ namespace SPTAG
             {
                 return 1 - d;
             }
+
+        private:
+            // vectors ahead of the current one whose cache lines are requested by the batch kernels
+            static const int BatchPrefetchDistance = 4;
         };
         template<typename T>
         inline DistanceCalcReturn<T> DistanceCalcSelector(SPTAG::DistCalcMethod p_method)
@@ -161,6 +266,62 @@ namespace SPTAG
             }
             return nullptr;
         }
+
+        template<typename T>
+        inline DistanceBatchCalcReturn<T> DistanceBatchCalcSelector(SPTAG::DistCalcMethod p_method)
+        {
+            bool isSize4 = (sizeof(T) == 4);
+            switch (p_method)
+            {
+            case SPTAG::DistCalcMethod::InnerProduct:
+            case SPTAG::DistCalcMethod::Cosine:
+                if (InstructionSet::AVX512())
+                {
+                    return &(DistanceUtils::ComputeCosineDistanceBatch_AVX512);
+                }
+                else if (InstructionSet::AVX2() || (isSize4 && InstructionSet::AVX()))
+                {
+                    return &(DistanceUtils::ComputeCosineDistanceBatch_AVX);
+                }
+                else if (InstructionSet::SSE2() || (isSize4 && InstructionSet::SSE()))
+                {
+                    return &(DistanceUtils::ComputeCosineDistanceBatch_SSE);
+                }
+                else {
+                    return &(DistanceUtils::ComputeCosineDistanceBatch);
+                }
+
+            case SPTAG::DistCalcMethod::L2:
+                if (InstructionSet::AVX512())
+                {
+                    return &(DistanceUtils::ComputeL2DistanceBatch_AVX512);
+                }
+                else if (InstructionSet::AVX2() || (isSize4 && InstructionSet::AVX()))
+                {
+                    return &(DistanceUtils::ComputeL2DistanceBatch_AVX);
+                }
+                else if (InstructionSet::SSE2() || (isSize4 && InstructionSet::SSE()))
+                {
+                    return &(DistanceUtils::ComputeL2DistanceBatch_SSE);
+                }
+                else {
+                    return &(DistanceUtils::ComputeL2DistanceBatch);
+                }
+
+            default:
+                break;
+            }
+            return nullptr;
+        }
+
+        inline FastScanCalcReturn FastScanCalcSelector()
+        {
+            if (InstructionSet::AVX2())
+            {
+                return &(DistanceUtils::ComputeFastScan_AVX);
+            }
+            return &(DistanceUtils::ComputeFastScan);
+        }
     }
 }
 
@@ -60,6 +60,20 @@ namespace SPTAG
             {
                 return ((unsigned)(idx * 99991) + _rotl(idx, 2) + 101) & PoolSize;
             }
+
+            // exclusive locks of two ids taken in stripe order, so holders of crossing pairs cannot deadlock
+            void LockPair(SizeType first, SizeType second) {
+                unsigned a = hash_func((unsigned)first), b = hash_func((unsigned)second);
+                if (a > b) std::swap(a, b);
+                m_locks[a].lock();
+                if (a != b) m_locks[b].lock();
+            }
+
+            void UnlockPair(SizeType first, SizeType second) {
+                unsigned a = hash_func((unsigned)first), b = hash_func((unsigned)second);
+                if (a != b) m_locks[b].unlock();
+                m_locks[a].unlock();
+            }
         private:
             static const int PoolSize = 32767;
             std::unique_ptr<std::shared_timed_mutex[]> m_locks;
@@ -20,11 +20,24 @@ namespace SPTAG
 
             virtual float CosineDistance(const std::uint8_t* pX, const std::uint8_t* pY) const = 0;
 
+            // L2Distance from pX to each of the num codes pYs, quantizers with a block kernel override it
+            virtual void L2Distances(const std::uint8_t* pX, const std::uint8_t* const* pYs, int num, float* pDists) const
+            {
+                for (int i = 0; i < num; i++) pDists[i] = L2Distance(pX, pYs[i]);
+            }
+
             template <typename T>
             std::function<float(const T*, const T*, SizeType)> DistanceCalcSelector(SPTAG::DistCalcMethod p_method) const;
 
             virtual void QuantizeVector(const void* vec, std::uint8_t* vecout) const = 0;
 
+            // QuantizeVector over num vectors vecStride bytes apart, writing codes outStride bytes apart.
+            // Quantizers that can share work across vectors override it.
+            virtual void QuantizeVectors(const void* vecs, std::size_t vecStride, SizeType num, std::uint8_t* vecout, std::size_t outStride) const
+            {
+                for (SizeType i = 0; i < num; i++) QuantizeVector((const std::uint8_t*)vecs + i * vecStride, vecout + i * outStride);
+            }
+
             virtual SizeType QuantizeSize() const = 0;
 
             virtual void ReconstructVector(const std::uint8_t* qvec, void* vecout) const = 0;
@@ -0,0 +1,223 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_COMMON_INCREMENTALTRUTHSET_H_
+#define _SPTAG_COMMON_INCREMENTALTRUTHSET_H_
+
+#include "TruthSet.h"
+
+#include <algorithm>
+#include <set>
+#include <unordered_set>
+#include <vector>
+
+namespace SPTAG
+{
+    namespace COMMON
+    {
+        // Keeps the exact top K of every query while the live vectors change by batches of deletes and inserts.
+        // Every query holds its nearest K + slack live vectors, so a batch only scores the inserted vectors against
+        // the queries and drops the deleted ones from the lists. A query is rescanned over all live vectors only
+        // when deletes leave it with fewer than K known neighbors. Vector IDs index p_vectorSet.
+        template <typename T>
+        class IncrementalTruthSet
+        {
+        public:
+            IncrementalTruthSet(std::shared_ptr<VectorSet> p_querySet, std::shared_ptr<VectorSet> p_vectorSet, DistCalcMethod p_distMethod, int p_K, int p_slack)
+                : m_querySet(p_querySet), m_vectorSet(p_vectorSet), m_distMethod(p_distMethod), m_K(p_K), m_capacity(p_K + max(p_slack, 0)), m_liveNum(0)
+            {
+                m_fComputeDistance = COMMON::DistanceCalcSelector<T>(p_distMethod);
+            }
+
+            // the live vectors are [p_begin, p_end), every query is scanned over them
+            void Build(SizeType p_begin, SizeType p_end)
+            {
+                m_live.assign(m_vectorSet->Count(), 0);
+                std::fill(m_live.begin() + p_begin, m_live.begin() + p_end, 1);
+                m_liveNum = p_end - p_begin;
+
+                m_lists.assign(m_querySet->Count(), std::vector<NodeDistPair>());
+                m_complete.assign(m_querySet->Count(), 0);
+                std::vector<SizeType> queries(m_querySet->Count());
+                for (SizeType i = 0; i < m_querySet->Count(); i++) queries[i] = i;
+                Rescan(queries);
+                LOG(Helper::LogLevel::LL_Info, "Incremental truth: built top %d+%d of %d queries over %d vectors.\n", m_K, m_capacity - m_K, m_querySet->Count(), m_liveNum);
+            }
+
+            // Deletes then inserts a batch, an ID both deleted and inserted ends up live. Returns the number of
+            // queries that had to be rescanned.
+            SizeType Update(const std::vector<SizeType>& p_deletes, const std::vector<SizeType>& p_inserts)
+            {
+                std::unordered_set<SizeType> deleted;
+                for (SizeType vid : p_deletes)
+                {
+                    if (vid < 0 || vid >= (SizeType)m_live.size() || !m_live[vid]) continue;
+                    m_live[vid] = 0;
+                    m_liveNum--;
+                    deleted.insert(vid);
+                }
+
+                std::vector<SizeType> inserted;
+                inserted.reserve(p_inserts.size());
+                for (SizeType vid : p_inserts)
+                {
+                    if (vid < 0 || vid >= (SizeType)m_live.size() || m_live[vid]) continue;
+                    m_live[vid] = 1;
+                    m_liveNum++;
+                    inserted.push_back(vid);
+                }
+
+                SizeType queryNum = m_querySet->Count();
+                if (!deleted.empty())
+                {
+#pragma omp parallel for schedule(dynamic)
+                    for (SizeType i = 0; i < queryNum; i++)
+                    {
+                        std::vector<NodeDistPair>& list = m_lists[i];
+                        auto end = std::remove_if(list.begin(), list.end(), [&deleted](const NodeDistPair& p) { return deleted.count(p.node) > 0; });
+                        if (end == list.end()) continue;
+                        list.erase(end, list.end());
+                        // the vectors that were right behind the list are unknown now
+                        m_complete[i] = 0;
+                    }
+                }
+
+                // inserts are scored a tile at a time against every query while the tile is in cache
+                std::size_t vectorSize = m_vectorSet->PerVectorDataSize();
+                std::size_t tileNum = max((std::size_t)1, c_insertTileBytes / vectorSize);
+                for (std::size_t begin = 0; begin < inserted.size(); begin += tileNum)
+                {
+                    std::size_t end = min(begin + tileNum, inserted.size());
+#pragma omp parallel for schedule(dynamic)
+                    for (SizeType i = 0; i < queryNum; i++)
+                    {
+                        const T* query = (const T*)m_querySet->GetVector(i);
+                        for (std::size_t j = begin; j < end; j++)
+                        {
+                            AddCandidate(i, NodeDistPair(inserted[j], m_fComputeDistance(query, (const T*)m_vectorSet->GetVector(inserted[j]), m_vectorSet->Dimension())));
+                        }
+                    }
+                }
+
+                // every query needs K known neighbors, or all the live ones when there are fewer
+                std::vector<SizeType> rescans;
+                SizeType need = min((SizeType)m_K, m_liveNum);
+                for (SizeType i = 0; i < queryNum; i++)
+                {
+                    if ((SizeType)m_lists[i].size() < need) rescans.push_back(i);
+                }
+                Rescan(rescans);
+
+                LOG(Helper::LogLevel::LL_Info, "Incremental truth: %zu deleted, %zu inserted, %d live, %zu of %d queries rescanned.\n",
+                    deleted.size(), inserted.size(), m_liveNum, rescans.size(), queryNum);
+                return (SizeType)rescans.size();
+            }
+
+            void GetTruth(std::vector<std::set<SizeType>>& p_truth) const
+            {
+                p_truth.clear();
+                p_truth.resize(m_lists.size());
+                for (std::size_t i = 0; i < m_lists.size(); i++)
+                {
+                    int num = min(m_K, (int)m_lists[i].size());
+                    for (int k = 0; k < num; k++) p_truth[i].insert(m_lists[i][k].node);
+                }
+            }
+
+            // writes the current top K in a format TruthSet::LoadTruth reads back, missing neighbors are -1
+            void Save(const std::string& p_truthFile, TruthFileType p_truthFileType) const
+            {
+                std::vector<std::vector<SizeType>> truthset(m_lists.size(), std::vector<SizeType>(m_K, -1));
+                std::vector<std::vector<float>> distset(m_lists.size(), std::vector<float>(m_K, MaxDist));
+                for (std::size_t i = 0; i < m_lists.size(); i++)
+                {
+                    int num = min(m_K, (int)m_lists[i].size());
+                    for (int k = 0; k < num; k++)
+                    {
+                        truthset[i][k] = m_lists[i][k].node;
+                        distset[i][k] = m_lists[i][k].distance;
+                    }
+                }
+                TruthSet::writeTruthFile(p_truthFile, (SizeType)m_lists.size(), m_K, truthset, distset, p_truthFileType);
+            }
+
+            inline SizeType LiveNum() const { return m_liveNum; }
+
+        private:
+            static const std::size_t c_insertTileBytes = 256 * 1024;
+
+            // the same order TruthSet uses, ties go to the smaller ID
+            static inline bool Closer(const NodeDistPair& a, const NodeDistPair& b)
+            {
+                return a.distance < b.distance || (a.distance == b.distance && a.node < b.node);
+            }
+
+            // Keeps a list the exact nearest live vectors of its query. A candidate behind an incomplete list may have
+            // unknown live vectors in front of it, so it is only taken when it lands inside the list.
+            inline void AddCandidate(SizeType p_query, const NodeDistPair& p_candidate)
+            {
+                std::vector<NodeDistPair>& list = m_lists[p_query];
+                bool inside = !list.empty() && Closer(p_candidate, list.back());
+                if ((int)list.size() < m_capacity)
+                {
+                    if (!inside && !m_complete[p_query]) return;
+                }
+                else if (!inside) return;
+
+                list.insert(std::upper_bound(list.begin(), list.end(), p_candidate, Closer), p_candidate);
+                if ((int)list.size() > m_capacity) list.pop_back();
+            }
+
+            // the tiled truth scan over the live vectors, each query keeps its nearest K + slack
+            void Rescan(const std::vector<SizeType>& p_queries)
+            {
+                if (p_queries.empty()) return;
+
+                std::vector<std::unique_ptr<QueryResultSet<T>>> heaps(p_queries.size());
+                for (std::size_t q = 0; q < p_queries.size(); q++)
+                {
+                    heaps[q].reset(new QueryResultSet<T>((const T*)m_querySet->GetVector(p_queries[q]), m_capacity));
+                }
+                TruthSet::ScanTruthBlock<T>(heaps, m_vectorSet, 0, m_distMethod, nullptr, m_live.data());
+
+                for (std::size_t q = 0; q < p_queries.size(); q++)
+                {
+                    QueryResultSet<T>& heap = *heaps[q];
+                    heap.SortResult();
+                    std::vector<NodeDistPair>& list = m_lists[p_queries[q]];
+                    list.clear();
+                    for (int k = 0; k < m_capacity && heap.GetResult(k)->VID >= 0; k++)
+                    {
+                        list.emplace_back(heap.GetResult(k)->VID, heap.GetResult(k)->Dist);
+                    }
+                    m_complete[p_queries[q]] = 1;
+                }
+            }
+
+            std::shared_ptr<VectorSet> m_querySet;
+
+            std::shared_ptr<VectorSet> m_vectorSet;
+
+            DistCalcMethod m_distMethod;
+
+            int m_K;
+
+            int m_capacity;
+
+            SizeType m_liveNum;
+
+            // one byte per vector, bit packing would make the parallel scans race with nothing to gain
+            std::vector<std::uint8_t> m_live;
+
+            // per query its nearest live vectors, closest first
+            std::vector<std::vector<NodeDistPair>> m_lists;
+
+            // whether nothing live outside a list is closer than its last entry, or a short list holds every live vector
+            std::vector<std::uint8_t> m_complete;
+
+            DistanceCalcReturn<T> m_fComputeDistance;
+        };
+    }
+}
+
+#endif // _SPTAG_COMMON_INCREMENTALTRUTHSET_H_
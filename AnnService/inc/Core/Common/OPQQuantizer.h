@@ -4,6 +4,7 @@
 #define _SPTAG_COMMON_OPQQUANTIZER_H_
 
 #include "PQQuantizer.h"
+#include <vector>
 
 #if (__cplusplus < 201703L)
 #define ISNOTSAME(A, B) if (!std::is_same<A, B>::value)
@@ -28,6 +29,8 @@ namespace SPTAG
 
             virtual void QuantizeVector(const void* vec, std::uint8_t* vecout) const;
 
+            virtual void QuantizeVectors(const void* vecs, std::size_t vecStride, SizeType num, std::uint8_t* vecout, std::size_t outStride) const;
+
             void ReconstructVector(const std::uint8_t* qvec, void* vecout) const;
 
             virtual ErrorCode SaveQuantizer(std::shared_ptr<Helper::DiskIO> p_out) const;
@@ -63,8 +66,20 @@ namespace SPTAG
             const std::function<float(const OPQMatrixType*, const OPQMatrixType*, DimensionType)> m_fdot = SPTAG::COMMON::DistanceCalcSelector<OPQMatrixType>(SPTAG::DistCalcMethod::Cosine);
             const int m_base = COMMON::Utils::GetBase<OPQMatrixType>() * COMMON::Utils::GetBase<OPQMatrixType>();
 
+            // vectors rotated together, each matrix strip is reused across all of them
+            static const int RotateBatch = 64;
+
+            // register block of the rotation: vectors x matrix columns
+            static const int RotateRows = 8;
+            static const int RotateCols = 16;
+
             void m_InitMatrixTranspose();
 
+            void m_RotateVectors(const void* vecs, std::size_t vecStride, int num, OPQMatrixType* rotated) const;
+
+            template <int Rows>
+            inline void m_RotateBlock(const OPQMatrixType* const* inputs, int colBegin, int cols, OPQMatrixType* rotated) const;
+
             template <typename O>
             inline void m_VectorMatrixMultiply(OPQMatrixType* mat, const OPQMatrixType* vec, O* mat_vec) const;
 
@@ -96,38 +111,94 @@ namespace SPTAG
         template <typename T>
         void OPQQuantizer<T>::QuantizeVector(const void* vec, std::uint8_t* vecout) const
         {
-            OPQMatrixType* mat_vec = (OPQMatrixType*) ALIGN_ALLOC(sizeof(OPQMatrixType) * m_matrixDim);
-            OPQMatrixType* typed_vec;
+            QuantizeVectors(vec, sizeof(T) * m_matrixDim, 1, vecout, QuantizeSize());
+        }
+
+        template <typename T>
+        void OPQQuantizer<T>::QuantizeVectors(const void* vecs, std::size_t vecStride, SizeType num, std::uint8_t* vecout, std::size_t outStride) const
+        {
+            static thread_local std::vector<OPQMatrixType> rotated;
+            rotated.resize((std::size_t)RotateBatch * m_matrixDim);
+            for (SizeType begin = 0; begin < num; begin += RotateBatch) {
+                int count = (int)min((SizeType)RotateBatch, num - begin);
+                m_RotateVectors((const std::uint8_t*)vecs + begin * vecStride, vecStride, count, rotated.data());
+                for (int i = 0; i < count; i++) {
+                    PQQuantizer<OPQMatrixType>::QuantizeVector(rotated.data() + (std::size_t)i * m_matrixDim, vecout + (begin + i) * outStride);
+                }
+            }
+        }
+
+        template <typename T>
+        void OPQQuantizer<T>::m_RotateVectors(const void* vecs, std::size_t vecStride, int num, OPQMatrixType* rotated) const
+        {
+            static thread_local std::vector<OPQMatrixType> typed;
+            const OPQMatrixType* inputs[RotateBatch];
             ISNOTSAME(T, OPQMatrixType)
             {
-                typed_vec = (OPQMatrixType*)ALIGN_ALLOC(sizeof(OPQMatrixType) * m_matrixDim);
-                for (int i = 0; i < m_matrixDim; i++)
-                {
-                    typed_vec[i] = (OPQMatrixType)((T*)vec)[i];
+                typed.resize((std::size_t)RotateBatch * m_matrixDim);
+                for (int i = 0; i < num; i++) {
+                    const T* vec = (const T*)((const std::uint8_t*)vecs + i * vecStride);
+                    OPQMatrixType* typed_vec = typed.data() + (std::size_t)i * m_matrixDim;
+                    for (int j = 0; j < m_matrixDim; j++) typed_vec[j] = (OPQMatrixType)vec[j];
+                    inputs[i] = typed_vec;
                 }
             }
             else {
-                typed_vec = (OPQMatrixType*)vec;
+                for (int i = 0; i < num; i++) inputs[i] = (const OPQMatrixType*)((const std::uint8_t*)vecs + i * vecStride);
             }
 
-            m_VectorMatrixMultiply<OPQMatrixType>(m_OPQMatrix_T.get(), typed_vec, mat_vec);
-            PQQuantizer<OPQMatrixType>::QuantizeVector(mat_vec, vecout);
-            ALIGN_FREE(mat_vec);
+            // rotated = inputs x OPQMatrix, a strip of RotateCols matrix columns at a time against every vector of the
+            // batch, so the strip stays in cache and the matrix is read from memory once per batch instead of once
+            // per vector. The vectors left over from whole register blocks go one by one, every output is summed
+            // in the same order either way.
+            for (int colBegin = 0; colBegin < m_matrixDim; colBegin += RotateCols) {
+                int cols = min(RotateCols, (int)m_matrixDim - colBegin);
+                int i = 0;
+                for (; i + RotateRows <= num; i += RotateRows) {
+                    m_RotateBlock<RotateRows>(inputs + i, colBegin, cols, rotated + (std::size_t)i * m_matrixDim);
+                }
+                for (; i < num; i++) {
+                    m_RotateBlock<1>(inputs + i, colBegin, cols, rotated + (std::size_t)i * m_matrixDim);
+                }
+            }
+        }
 
-            ISNOTSAME(T, OPQMatrixType)
-            {
-                ALIGN_FREE(typed_vec);
+        template <typename T>
+        template <int Rows>
+        inline void OPQQuantizer<T>::m_RotateBlock(const OPQMatrixType* const* inputs, int colBegin, int cols, OPQMatrixType* rotated) const
+        {
+            // Rows x RotateCols accumulators stay in registers across the whole dot product
+            OPQMatrixType acc[Rows][RotateCols] = {};
+            const OPQMatrixType* mat = m_OPQMatrix.get() + colBegin;
+            if (cols == RotateCols) {
+                for (int j = 0; j < m_matrixDim; j++, mat += m_matrixDim) {
+                    for (int i = 0; i < Rows; i++) {
+                        OPQMatrixType xj = inputs[i][j];
+                        for (int k = 0; k < RotateCols; k++) acc[i][k] += xj * mat[k];
+                    }
+                }
+            }
+            else {
+                for (int j = 0; j < m_matrixDim; j++, mat += m_matrixDim) {
+                    for (int i = 0; i < Rows; i++) {
+                        OPQMatrixType xj = inputs[i][j];
+                        for (int k = 0; k < cols; k++) acc[i][k] += xj * mat[k];
+                    }
+                }
+            }
+            for (int i = 0; i < Rows; i++) {
+                memcpy(rotated + (std::size_t)i * m_matrixDim + colBegin, acc[i], sizeof(OPQMatrixType) * cols);
             }
         }
 
         template <typename T>
         void OPQQuantizer<T>::ReconstructVector(const std::uint8_t* qvec, void* vecout) const
         {
-            OPQMatrixType* pre_mat_vec = (OPQMatrixType*) ALIGN_ALLOC(sizeof(OPQMatrixType) * m_matrixDim);
-            PQQuantizer<OPQMatrixType>::ReconstructVector(qvec, pre_mat_vec);
+            static thread_local std::vector<OPQMatrixType> pre_mat_vec;
+            pre_mat_vec.resize(m_matrixDim);
+            PQQuantizer<OPQMatrixType>::ReconstructVector(qvec, pre_mat_vec.data());
             // OPQ Matrix is orthonormal, so inverse = transpose
-            m_VectorMatrixMultiply<T>(m_OPQMatrix.get(), pre_mat_vec, (T*)vecout);
-            ALIGN_FREE(pre_mat_vec);
+            m_VectorMatrixMultiply<T>(m_OPQMatrix.get(), pre_mat_vec.data(), (T*)vecout);
         }
 
         template <typename T>
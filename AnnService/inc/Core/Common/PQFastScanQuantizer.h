@@ -0,0 +1,186 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_COMMON_PQFASTSCANQUANTIZER_H_
+#define _SPTAG_COMMON_PQFASTSCANQUANTIZER_H_
+
+#include "PQQuantizer.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace SPTAG
+{
+    namespace COMMON
+    {
+        // PQ with 16 centroids per sub-quantizer. Codes are stored one byte per sub-quantizer like PQQuantizer ones,
+        // the ADC table of a query holds uint8 distances instead of floats: a float bias and scale, then 16 bytes per
+        // sub-quantizer. L2Distances transposes blocks of 32 codes in registers and looks them up with byte shuffles.
+        template <typename T>
+        class PQFastScanQuantizer : public PQQuantizer<T>
+        {
+        public:
+            static const SizeType KsPerSubvector = 16;
+
+            PQFastScanQuantizer();
+
+            PQFastScanQuantizer(DimensionType NumSubvectors, DimensionType DimPerSubvector, bool EnableADC, std::unique_ptr<T[]>&& Codebooks);
+
+            virtual float L2Distance(const std::uint8_t* pX, const std::uint8_t* pY) const;
+
+            virtual void L2Distances(const std::uint8_t* pX, const std::uint8_t* const* pYs, int num, float* pDists) const;
+
+            virtual void QuantizeVector(const void* vec, std::uint8_t* vecout) const;
+
+            virtual SizeType QuantizeSize() const;
+
+            virtual ErrorCode LoadQuantizer(std::shared_ptr<Helper::DiskIO> p_in);
+
+            virtual ErrorCode LoadQuantizer(std::uint8_t* raw_bytes);
+
+            QuantizerType GetQuantizerType() const {
+                return QuantizerType::PQFastScanQuantizer;
+            }
+
+        protected:
+            using PQQuantizer<T>::m_NumSubvectors;
+            using PQQuantizer<T>::m_KsPerSubvector;
+            using PQQuantizer<T>::m_DimPerSubvector;
+            using PQQuantizer<T>::m_codebooks;
+
+            // bias and scale of the uint8 table, padded so the table rows stay 16 byte aligned
+            static const int TableHeaderSize = 16;
+
+            // the float distance of a sum of table bytes, shared by both lookups
+            static inline float TableDistance(const std::uint8_t* pX, std::uint16_t sum)
+            {
+                const float* header = (const float*)pX;
+                return header[0] + header[1] * (float)sum;
+            }
+
+            ErrorCode CheckLayout() const;
+
+            FastScanCalcReturn m_fastScan = FastScanCalcSelector();
+        };
+
+        template <typename T>
+        PQFastScanQuantizer<T>::PQFastScanQuantizer() : PQQuantizer<T>::PQQuantizer()
+        {
+        }
+
+        template <typename T>
+        PQFastScanQuantizer<T>::PQFastScanQuantizer(DimensionType NumSubvectors, DimensionType DimPerSubvector, bool EnableADC, std::unique_ptr<T[]>&& Codebooks)
+            : PQQuantizer<T>::PQQuantizer(NumSubvectors, KsPerSubvector, DimPerSubvector, EnableADC, std::move(Codebooks))
+        {
+        }
+
+        template <typename T>
+        float PQFastScanQuantizer<T>::L2Distance(const std::uint8_t* pX, const std::uint8_t* pY) const
+            // pX must be query distance table for ADC
+        {
+            if (!this->GetEnableADC()) return PQQuantizer<T>::L2Distance(pX, pY);
+
+            const std::uint8_t* lut = pX + TableHeaderSize;
+            std::uint16_t sum = 0;
+            for (int i = 0; i < m_NumSubvectors; i++, lut += KsPerSubvector) {
+                sum += lut[pY[i]];
+            }
+            return TableDistance(pX, sum);
+        }
+
+        template <typename T>
+        void PQFastScanQuantizer<T>::L2Distances(const std::uint8_t* pX, const std::uint8_t* const* pYs, int num, float* pDists) const
+        {
+            if (!this->GetEnableADC()) {
+                PQQuantizer<T>::L2Distances(pX, pYs, num, pDists);
+                return;
+            }
+
+            std::uint16_t sums[DistanceUtils::FastScanBlock];
+            for (int begin = 0; begin < num; begin += DistanceUtils::FastScanBlock) {
+                int count = min(DistanceUtils::FastScanBlock, num - begin);
+                m_fastScan(pX + TableHeaderSize, pYs + begin, count, m_NumSubvectors, sums);
+                for (int v = 0; v < count; v++) pDists[begin + v] = TableDistance(pX, sums[v]);
+            }
+        }
+
+        template <typename T>
+        void PQFastScanQuantizer<T>::QuantizeVector(const void* vec, std::uint8_t* vecout) const
+        {
+            if (!this->GetEnableADC()) {
+                PQQuantizer<T>::QuantizeVector(vec, vecout);
+                return;
+            }
+
+            // the float table first, every sub-quantizer is then shifted to its minimum and all share one scale
+            static thread_local std::vector<float> dists;
+            dists.resize((std::size_t)m_NumSubvectors * KsPerSubvector);
+            auto distCalc = DistanceCalcSelector<T>(DistCalcMethod::L2);
+            const T* subvec = (const T*)vec;
+            const T* subcodebooks = m_codebooks.get();
+            float bias = 0, range = 0;
+            for (int i = 0; i < m_NumSubvectors; i++, subvec += m_DimPerSubvector) {
+                float* row = dists.data() + i * KsPerSubvector;
+                for (int j = 0; j < KsPerSubvector; j++, subcodebooks += m_DimPerSubvector) {
+                    row[j] = distCalc(subvec, subcodebooks, m_DimPerSubvector);
+                }
+                float minDist = *std::min_element(row, row + KsPerSubvector);
+                float maxDist = *std::max_element(row, row + KsPerSubvector);
+                for (int j = 0; j < KsPerSubvector; j++) row[j] -= minDist;
+                bias += minDist;
+                range = max(range, maxDist - minDist);
+            }
+            float scale = (range > 0) ? range / 255 : 1;
+
+            float* header = (float*)vecout;
+            header[0] = bias;
+            header[1] = scale;
+            memset(vecout + 2 * sizeof(float), 0, TableHeaderSize - 2 * sizeof(float));
+            std::uint8_t* lut = vecout + TableHeaderSize;
+            for (int i = 0; i < m_NumSubvectors * KsPerSubvector; i++) {
+                lut[i] = (std::uint8_t)min(255.0f, std::round(dists[i] / scale));
+            }
+        }
+
+        template <typename T>
+        SizeType PQFastScanQuantizer<T>::QuantizeSize() const
+        {
+            if (this->GetEnableADC())
+            {
+                return TableHeaderSize + m_NumSubvectors * KsPerSubvector;
+            }
+            else
+            {
+                return m_NumSubvectors;
+            }
+        }
+
+        template <typename T>
+        ErrorCode PQFastScanQuantizer<T>::LoadQuantizer(std::shared_ptr<Helper::DiskIO> p_in)
+        {
+            ErrorCode ret = PQQuantizer<T>::LoadQuantizer(p_in);
+            return (ret != ErrorCode::Success) ? ret : CheckLayout();
+        }
+
+        template <typename T>
+        ErrorCode PQFastScanQuantizer<T>::LoadQuantizer(std::uint8_t* raw_bytes)
+        {
+            ErrorCode ret = PQQuantizer<T>::LoadQuantizer(raw_bytes);
+            return (ret != ErrorCode::Success) ? ret : CheckLayout();
+        }
+
+        template <typename T>
+        ErrorCode PQFastScanQuantizer<T>::CheckLayout() const
+        {
+            // the block kernel adds up to 255 per sub-quantizer in 16 bits
+            if (m_KsPerSubvector != KsPerSubvector || m_NumSubvectors > 256) {
+                LOG(Helper::LogLevel::LL_Error, "Fast-scan quantizer needs %d centroids and at most 256 subvectors, got %d and %d\n",
+                    KsPerSubvector, m_KsPerSubvector, m_NumSubvectors);
+                return ErrorCode::Fail;
+            }
+            return ErrorCode::Success;
+        }
+    }
+}
+
+#endif // _SPTAG_COMMON_PQFASTSCANQUANTIZER_H_
@@ -226,7 +226,7 @@ namespace SPTAG
         template <typename T>
         ErrorCode PQQuantizer<T>::SaveQuantizer(std::shared_ptr<Helper::DiskIO> p_out) const
         {
-            QuantizerType qtype = QuantizerType::PQQuantizer;
+            QuantizerType qtype = GetQuantizerType();
             VectorValueType rtype = GetEnumValueType<T>();
             IOBINARY(p_out, WriteBinary, sizeof(QuantizerType), (char*)&qtype);
             IOBINARY(p_out, WriteBinary, sizeof(VectorValueType), (char*)&rtype);
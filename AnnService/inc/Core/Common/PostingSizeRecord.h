@@ -5,6 +5,7 @@
 #define _SPTAG_COMMON_POSTINGSIZERECORD_H_
 
 #include <atomic>
+#include <functional>
 #include "Dataset.h"
 
 namespace SPTAG
@@ -15,6 +16,7 @@ namespace SPTAG
         {
         private:
             Dataset<int> m_data;
+            std::function<void(const SizeType&, int)> m_onUpdate;//observes every new size, e.g. for the write-ahead log
             
         public:
             PostingSizeRecord() 
@@ -37,6 +39,7 @@ namespace SPTAG
                 while (true) {
                     int oldSize = GetSize(headID);
                     if (InterlockedCompareExchange((unsigned*)m_data[headID], (unsigned)newSize, (unsigned)oldSize) == oldSize) {
+                        if (m_onUpdate) m_onUpdate(headID, newSize);
                         return true;
                     }
                 }
@@ -48,11 +51,24 @@ namespace SPTAG
                     int oldSize = GetSize(headID);
                     int newSize = oldSize + appendNum;
                     if (InterlockedCompareExchange((unsigned*)m_data[headID], (unsigned)newSize, (unsigned)oldSize) == oldSize) {
+                        if (m_onUpdate) m_onUpdate(headID, newSize);
                         return true;
                     }
                 }
             }
             
+            // raw assignment used when replaying logged sizes, grows the record when headID is beyond it
+            inline void SetSize(const SizeType& headID, int size)
+            {
+                if (headID >= m_data.R()) m_data.AddBatch(headID + 1 - m_data.R());
+                *m_data[headID] = size;
+            }
+
+            inline void SetUpdateCallback(std::function<void(const SizeType&, int)> callback)
+            {
+                m_onUpdate = std::move(callback);
+            }
+
             inline SizeType GetPostingNum()
             {
                 return m_data.R();
@@ -5,6 +5,7 @@
 #define _SPTAG_COMMON_TRUTHSET_H_
 
 #include "inc/Core/VectorIndex.h"
+#include "inc/Helper/VectorSetReader.h"
 #include "QueryResultSet.h"
 
 namespace SPTAG
@@ -166,10 +167,42 @@ namespace SPTAG
                 }
             }
 
+            static void writeTruthDistFile(const std::string truthFile, SizeType queryNumber, const int K, std::vector<std::vector<SPTAG::SizeType>>& truthset, std::vector<std::vector<float>>& distset) {
+                auto ptr = SPTAG::f_createIO();
+                if (ptr == nullptr || !ptr->Initialize((truthFile + ".dist.bin").c_str(), std::ios::out | std::ios::binary)) {
+                    LOG(Helper::LogLevel::LL_Error, "Fail to create the file:%s\n", (truthFile + ".dist.bin").c_str());
+                    exit(1);
+                }
+
+                int int32_queryNumber = (int)queryNumber;
+                ptr->WriteBinary(4, (char*)&int32_queryNumber);
+                ptr->WriteBinary(4, (char*)&K);
+
+                for (size_t i = 0; i < int32_queryNumber; i++)
+                {
+                    for (int k = 0; k < K; k++) {
+                        if (ptr->WriteBinary(4, (char*)(&(truthset[i][k]))) != 4) {
+                            LOG(Helper::LogLevel::LL_Error, "Fail to write the truth dist file!\n");
+                            exit(1);
+                        }
+                        if (ptr->WriteBinary(4, (char*)(&(distset[i][k]))) != 4) {
+                            LOG(Helper::LogLevel::LL_Error, "Fail to write the truth dist file!\n");
+                            exit(1);
+                        }
+                    }
+                }
+            }
+
             template<typename T>
             static void GenerateTruth(std::shared_ptr<VectorSet> querySet, std::shared_ptr<VectorSet> vectorSet, const std::string truthFile,
                 const SPTAG::DistCalcMethod distMethod, const int K, const SPTAG::TruthFileType p_truthFileType, const std::shared_ptr<IQuantizer>& quantizer);
 
+            // Same truth as above, but the doc vectors are read from vectorReader p_blockVectors at a time, so a base
+            // larger than memory only needs two blocks of it loaded.
+            template<typename T>
+            static void GenerateTruth(std::shared_ptr<VectorSet> querySet, std::shared_ptr<Helper::VectorSetReader> vectorReader, SizeType p_blockVectors, const std::string truthFile,
+                const SPTAG::DistCalcMethod distMethod, const int K, const SPTAG::TruthFileType p_truthFileType, const std::shared_ptr<IQuantizer>& quantizer);
+
             template <typename T>
             static float CalculateRecall(VectorIndex* index, std::vector<QueryResult>& results, const std::vector<std::set<SizeType>>& truth, int K, int truthK, std::shared_ptr<SPTAG::VectorSet> querySet, std::shared_ptr<SPTAG::VectorSet> vectorSet, SizeType NumQuerys, std::ofstream* log = nullptr, bool debug = false, float* MRR = nullptr)
             {
@@ -290,6 +323,24 @@ namespace SPTAG
 
                 return recalls / K;
             }
+
+            // one top K heap per query, targets set for the scans below
+            template<typename T>
+            static void InitTruthQueries(std::shared_ptr<VectorSet> querySet, const int K, const std::shared_ptr<IQuantizer>& quantizer, std::vector<std::unique_ptr<QueryResultSet<T>>>& queries);
+
+            // adds the doc vectors of block, whose first one has ID blockBegin, to the heaps of all queries. With live
+            // given, only the IDs whose byte in it is set are added.
+            template<typename T>
+            static void ScanTruthBlock(std::vector<std::unique_ptr<QueryResultSet<T>>>& queries, std::shared_ptr<VectorSet> block, SizeType blockBegin,
+                const SPTAG::DistCalcMethod distMethod, const std::shared_ptr<IQuantizer>& quantizer, const std::uint8_t* live = nullptr);
+
+        private:
+            // queries scanned together against each doc tile, and the doc bytes per tile, sized to stay in L2
+            static const SizeType c_truthQueryTile = 64;
+            static const std::size_t c_truthDocTileBytes = 256 * 1024;
+
+            template<typename T>
+            static void WriteTruth(std::vector<std::unique_ptr<QueryResultSet<T>>>& queries, const std::string truthFile, const int K, const SPTAG::TruthFileType p_truthFileType);
         };
     }
 }
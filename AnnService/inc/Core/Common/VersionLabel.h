@@ -5,6 +5,7 @@
 #define _SPTAG_COMMON_VERSIONLABEL_H_
 
 #include <atomic>
+#include <functional>
 #include "Dataset.h"
 
 namespace SPTAG
@@ -16,6 +17,7 @@ namespace SPTAG
         private:
             std::atomic<SizeType> m_deleted;
             Dataset<std::uint8_t> m_data;//each element is [deleted, ver], deleted is 1 bit and ver is 7 bits
+            std::function<void(const SizeType&, std::uint8_t)> m_onUpdate;//observes every new label, e.g. for the write-ahead log
             
         public:
             VersionLabel() 
@@ -43,9 +45,26 @@ namespace SPTAG
                 uint8_t oldvalue = (uint8_t)InterlockedExchange8((char*)(m_data[key]), (char)0xfe);//assign 0xfe to address m_data[key] and return the old value in m_data[key]
                 if (oldvalue == 0xfe) return false;
                 m_deleted++;
+                if (m_onUpdate) m_onUpdate(key, 0xfe);
                 return true;
             }
 
+            // keeps the p_num (VID, version) entries p_stride bytes apart that carry the current version of their VID,
+            // deleted labels never match a stored 7-bit version. The kept positions go to p_slots and their VIDs to
+            // p_ids without branching on the outcome, returns how many were kept.
+            inline int FilterCurrent(const char* p_entries, std::size_t p_stride, int p_num, int* p_slots, SizeType* p_ids) const
+            {
+                int kept = 0;
+                for (int i = 0; i < p_num; i++, p_entries += p_stride) {
+                    SizeType key = *(reinterpret_cast<const int*>(p_entries));
+                    std::uint8_t version = *(reinterpret_cast<const std::uint8_t*>(p_entries + sizeof(int)));
+                    p_slots[kept] = i;
+                    p_ids[kept] = key;
+                    kept += (*m_data[key] == version);
+                }
+                return kept;
+            }
+
             inline uint8_t GetVersion(const SizeType& key)
             {
                 return *m_data[key];
@@ -58,11 +77,26 @@ namespace SPTAG
                     uint8_t oldVersion = GetVersion(key);
                     *newVersion = (oldVersion+1) & 0x7f;
                     if (((uint8_t)InterlockedCompareExchange((char*)m_data[key], (char)*newVersion, (char)oldVersion)) == oldVersion) {
+                        if (m_onUpdate) m_onUpdate(key, *newVersion);
                         return true;
                     }
                 }
             }
 
+            // raw assignment used when replaying logged labels, grows the map when key is beyond it
+            inline void SetVersion(const SizeType& key, std::uint8_t version)
+            {
+                if (key >= m_data.R()) m_data.AddBatch(key + 1 - m_data.R());
+                uint8_t oldvalue = (uint8_t)InterlockedExchange8((char*)(m_data[key]), (char)version);
+                if (oldvalue != 0xfe && version == 0xfe) m_deleted++;
+                else if (oldvalue == 0xfe && version != 0xfe) m_deleted--;
+            }
+
+            inline void SetUpdateCallback(std::function<void(const SizeType&, std::uint8_t)> callback)
+            {
+                m_onUpdate = std::move(callback);
+            }
+
             inline SizeType GetVectorNum()
             {
                 return m_data.R();
@@ -107,7 +141,11 @@ namespace SPTAG
 
             inline ErrorCode AddBatch(SizeType num)
             {
-                return m_data.AddBatch(num);
+                ErrorCode ret = m_data.AddBatch(num);
+                if (ret == ErrorCode::Success && m_onUpdate) {
+                    for (SizeType key = m_data.R() - num; key < m_data.R(); key++) m_onUpdate(key, *m_data[key]);
+                }
+                return ret;
             }
 
             inline std::uint64_t BufferSize() const 
@@ -9,6 +9,7 @@
 #include "Heap.h"
 
 #include <stdarg.h>
+#include <functional>
 
 namespace SPTAG
 {
@@ -220,6 +221,8 @@ namespace SPTAG
                 m_iNumberOfTreeCheckedLeaves = 0;
                 m_iNumberOfCheckedLeaves = 0;
                 m_iMaxCheck = maxCheck;
+                m_iProgressInterval = 0;
+                m_iNextProgress = 0;
             }
 
             void Initialize(va_list& arg)
@@ -241,6 +244,17 @@ namespace SPTAG
                 m_iNumberOfTreeCheckedLeaves = 0;
                 m_iNumberOfCheckedLeaves = 0;
                 m_iMaxCheck = maxCheck;
+                m_iProgressInterval = 0;
+                m_iNextProgress = 0;
+                m_progress = nullptr;
+            }
+
+            // report the partial results every p_interval checked leaves during the next search
+            void SetProgress(int p_interval, std::function<void(QueryResult&, float)> p_progress)
+            {
+                m_iProgressInterval = max(1, p_interval);
+                m_iNextProgress = m_iProgressInterval;
+                m_progress = std::move(p_progress);
             }
 
             inline bool CheckAndSet(SizeType idx)
@@ -264,6 +278,12 @@ namespace SPTAG
             int m_iNumberOfCheckedLeaves;
             int m_iMaxCheck;
 
+            // progress callback of the search: the unsorted partial results and the distance of
+            // the closest node still to be expanded, results nearer than that are unlikely to change
+            int m_iProgressInterval;
+            int m_iNextProgress;
+            std::function<void(QueryResult&, float)> m_progress;
+
             // Prioriy queue used for neighborhood graph
             Heap<NodeDistPair> m_NGQueue;
 
@@ -44,6 +44,7 @@ DefineDistCalcMethod(InnerProduct)
 DefineQuantizerType(None, std::shared_ptr<void>)
 DefineQuantizerType(PQQuantizer, std::shared_ptr<SPTAG::COMMON::PQQuantizer>)
 DefineQuantizerType(OPQQuantizer, std::shared_ptr<SPTAG::COMMON::OPQQuantizer>)
+DefineQuantizerType(PQFastScanQuantizer, std::shared_ptr<SPTAG::COMMON::PQFastScanQuantizer>)
 
 #endif // DefineQuantizerType
 
@@ -0,0 +1,161 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_SPANN_ALIGNEDPOSTINGIO_H_
+#define _SPTAG_SPANN_ALIGNEDPOSTINGIO_H_
+
+#include "inc/Core/Common.h"
+#include "inc/Helper/KeyValueIO.h"
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace SPTAG {
+    namespace SPANN {
+        // Stores postings as a run of segments while its users keep seeing [VID][version][vector] records.
+        // A segment is [uint32 vectorNum][uint32 segmentBytes][vectorNum x (VID, version)] padded to the
+        // alignment, then vectorNum vectors each padded to the alignment. Every segment is a multiple of the
+        // alignment, so an append is one more segment merged after the others and the vectors stay aligned
+        // in page aligned read buffers. A Put writes all the vectors of the posting as a single segment.
+        // Every segment costs a header and padding, so with a storage limit of p_maxBytes (0: none) a Merge
+        // that would not fit rewrites the posting as one segment instead.
+        class AlignedKeyValueIO : public Helper::KeyValueIO
+        {
+        public:
+            AlignedKeyValueIO(std::shared_ptr<Helper::KeyValueIO> p_storage, int p_metaDataSize, int p_vectorInfoSize, int p_alignment, std::size_t p_maxBytes = 0)
+                : m_storage(p_storage), m_metaDataSize(p_metaDataSize), m_vectorInfoSize(p_vectorInfoSize), m_alignment(p_alignment), m_maxBytes(p_maxBytes)
+            {
+                m_vectorStride = AlignUp(p_vectorInfoSize - p_metaDataSize);
+            }
+
+            ~AlignedKeyValueIO() {}
+
+            void ShutDown() override { m_storage->ShutDown(); }
+
+            ErrorCode Get(SizeType key, std::string* value) override
+            {
+                std::string segments;
+                ErrorCode ret = m_storage->Get(key, &segments);
+                if (ret == ErrorCode::Success) Decode(segments.data(), segments.size(), value);
+                return ret;
+            }
+
+            ErrorCode MultiGet(const std::vector<SizeType>& keys, std::vector<std::string>* values, const std::chrono::microseconds &timeout = std::chrono::microseconds::max()) override
+            {
+                std::vector<std::string> segments;
+                ErrorCode ret = m_storage->MultiGet(keys, &segments, timeout);
+                values->resize(segments.size());
+                for (std::size_t i = 0; i < segments.size(); i++) Decode(segments[i].data(), segments[i].size(), &((*values)[i]));
+                return ret;
+            }
+
+            ErrorCode Put(SizeType key, const std::string& value) override
+            {
+                std::string segment;
+                Encode(value, &segment);
+                return m_storage->Put(key, segment);
+            }
+
+            ErrorCode Merge(SizeType key, const std::string& value) override
+            {
+                std::string segment;
+                Encode(value, &segment);
+                std::size_t stored = 0;
+                if (m_maxBytes > 0 && m_storage->GetSize(key, &stored) == ErrorCode::Success && stored + segment.size() > m_maxBytes) {
+                    std::string records;
+                    ErrorCode ret = Get(key, &records);
+                    if (ret != ErrorCode::Success) return ret;
+                    records += value;
+                    return Put(key, records);
+                }
+                return m_storage->Merge(key, segment);
+            }
+
+            ErrorCode GetSize(SizeType key, std::size_t* size) override { return m_storage->GetSize(key, size); }
+
+            ErrorCode Delete(SizeType key) override { return m_storage->Delete(key); }
+
+            void ForceCompaction() override { m_storage->ForceCompaction(); }
+
+            void GetStat() override { m_storage->GetStat(); }
+
+            bool Initialize(bool debug = false) override { return m_storage->Initialize(debug); }
+
+            bool ExitBlockController(bool debug = false) override { return m_storage->ExitBlockController(debug); }
+
+            inline std::size_t VectorStride() const { return m_vectorStride; }
+
+            // stored bytes of a single segment holding p_num vectors
+            inline std::size_t SegmentSize(std::size_t p_num) const { return AlignUp(HeaderSize + p_num * m_metaDataSize) + p_num * m_vectorStride; }
+
+            void Encode(const std::string& p_records, std::string* p_segment) const
+            {
+                std::size_t num = p_records.size() / m_vectorInfoSize;
+                if (num == 0) {
+                    p_segment->clear();
+                    return;
+                }
+                std::size_t vectorOffset = AlignUp(HeaderSize + num * m_metaDataSize);
+                p_segment->assign(vectorOffset + num * m_vectorStride, 0);
+                char* dst = &(*p_segment)[0];
+                std::uint32_t header[2] = { (std::uint32_t)num, (std::uint32_t)p_segment->size() };
+                memcpy(dst, header, HeaderSize);
+
+                const char* src = p_records.data();
+                for (std::size_t i = 0; i < num; i++, src += m_vectorInfoSize) {
+                    memcpy(dst + HeaderSize + i * m_metaDataSize, src, m_metaDataSize);
+                    memcpy(dst + vectorOffset + i * m_vectorStride, src + m_metaDataSize, m_vectorInfoSize - m_metaDataSize);
+                }
+            }
+
+            void Decode(const char* p_segments, std::size_t p_size, std::string* p_records) const
+            {
+                p_records->clear();
+                ForEachSegment(p_segments, p_size, [&](const char* p_meta, const char* p_vectors, int p_num) {
+                    std::size_t offset = p_records->size();
+                    p_records->resize(offset + (std::size_t)p_num * m_vectorInfoSize);
+                    char* dst = &(*p_records)[offset];
+                    for (int i = 0; i < p_num; i++, dst += m_vectorInfoSize) {
+                        memcpy(dst, p_meta + (std::size_t)i * m_metaDataSize, m_metaDataSize);
+                        memcpy(dst + m_metaDataSize, p_vectors + (std::size_t)i * m_vectorStride, m_vectorInfoSize - m_metaDataSize);
+                    }
+                });
+            }
+
+            // calls p_visit(metadata, vectors, vectorNum) for every segment of a stored posting, the metadata are
+            // m_metaDataSize apart and the vectors VectorStride() apart. false if a segment runs past p_size.
+            template <typename F>
+            bool ForEachSegment(const char* p_segments, std::size_t p_size, F p_visit) const
+            {
+                std::size_t offset = 0;
+                while (offset + HeaderSize <= p_size) {
+                    std::uint32_t header[2];
+                    memcpy(header, p_segments + offset, HeaderSize);
+                    if (header[1] == 0 || offset + header[1] > p_size || SegmentSize(header[0]) != header[1]) {
+                        LOG(Helper::LogLevel::LL_Error, "AlignedKeyValueIO: broken segment at %zu of %zu bytes\n", offset, p_size);
+                        return false;
+                    }
+                    const char* segment = p_segments + offset;
+                    p_visit(segment + HeaderSize, segment + AlignUp(HeaderSize + (std::size_t)header[0] * m_metaDataSize), (int)header[0]);
+                    offset += header[1];
+                }
+                return true;
+            }
+
+        private:
+            static const std::size_t HeaderSize = 2 * sizeof(std::uint32_t);
+
+            inline std::size_t AlignUp(std::size_t p_size) const { return (p_size + m_alignment - 1) / m_alignment * m_alignment; }
+
+            std::shared_ptr<Helper::KeyValueIO> m_storage;
+            int m_metaDataSize;
+            int m_vectorInfoSize;
+            std::size_t m_alignment;
+            std::size_t m_vectorStride;
+            std::size_t m_maxBytes;
+        };
+    }
+}
+
+#endif // _SPTAG_SPANN_ALIGNEDPOSTINGIO_H_
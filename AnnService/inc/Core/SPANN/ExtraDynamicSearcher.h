@@ -10,10 +10,15 @@
 #include "ExtraStaticSearcher.h"
 #include "inc/Core/Common/TruthSet.h"
 #include "inc/Helper/KeyValueIO.h"
+#include "inc/Helper/PriorityThreadPool.h"
 #include "inc/Core/Common/FineGrainedLock.h"
 #include "PersistentBuffer.h"
 #include "inc/Core/Common/PostingSizeRecord.h"
 #include "ExtraSPDKController.h"
+#include "WriteAheadLog.h"
+#include "PostingDeltaBuffer.h"
+#include "QuantizedPostingIO.h"
+#include "AlignedPostingIO.h"
 #include <chrono>
 #include <map>
 #include <cmath>
@@ -102,6 +107,44 @@ namespace SPTAG::SPANN {
             }
         };
 
+        class FlushDeltaAsyncJob : public Helper::ThreadPool::Job
+        {
+        private:
+            ExtraDynamicSearcher<ValueType>* m_extraIndex;
+            SizeType headID;
+        public:
+            FlushDeltaAsyncJob(ExtraDynamicSearcher<ValueType>* extraIndex, SizeType headID)
+                : m_extraIndex(extraIndex), headID(headID) {}
+
+            ~FlushDeltaAsyncJob() {}
+
+            inline void exec(IAbortOperation* p_abort) override {
+                std::unique_lock<std::shared_timed_mutex> lock(m_extraIndex->m_rwLocks[headID]);
+                m_extraIndex->FlushDelta(headID);
+            }
+        };
+
+        class PrefetchAsyncJob : public Helper::ThreadPool::Job
+        {
+        private:
+            ExtraDynamicSearcher<ValueType>* m_extraIndex;
+            ExtraWorkSpace* m_exWorkSpace;
+            std::vector<SizeType> m_keys;
+            std::size_t m_offset;
+            std::promise<double> m_done;
+        public:
+            PrefetchAsyncJob(ExtraDynamicSearcher<ValueType>* extraIndex, ExtraWorkSpace* exWorkSpace, std::vector<SizeType> keys, std::size_t offset)
+                : m_extraIndex(extraIndex), m_exWorkSpace(exWorkSpace), m_keys(std::move(keys)), m_offset(offset) {}
+
+            ~PrefetchAsyncJob() {}
+
+            std::future<double> GetFuture() { return m_done.get_future(); }
+
+            inline void exec(IAbortOperation* p_abort) override {
+                m_done.set_value(m_extraIndex->ReadPrefetch(m_exWorkSpace, m_keys, m_offset));
+            }
+        };
+
         class SPDKThreadPool : public Helper::ThreadPool
         {
         public:
@@ -136,20 +179,47 @@ namespace SPTAG::SPANN {
     private:
         std::shared_ptr<Helper::KeyValueIO> db;
 
+        // the storage below db, it holds the codes when postings are quantized and is db itself otherwise
+        std::shared_ptr<Helper::KeyValueIO> m_rawDB;
+        // tags the page buffers m_rawDB hands to workspaces, they are freed with the storage
+        std::uint64_t m_ioBufferSource = ++ExtraWorkSpace::g_ioBufferSources;
+
+        // db itself when postings are stored in the PostingAlignment layout
+        std::shared_ptr<AlignedKeyValueIO> m_alignedIO;
+
+        // db itself when postings are stored as PostingQuantizerFile codes
+        std::shared_ptr<QuantizedKeyValueIO> m_quantizedIO;
+
+        std::shared_ptr<COMMON::IQuantizer> m_postingQuantizer;
+        std::shared_ptr<COMMON::IQuantizer> m_adcQuantizer;
+        std::shared_ptr<FullVectorStore> m_fullVectorStore;
+
         COMMON::VersionLabel* m_versionMap;
         COMMON::PostingVersionLabel* m_postingVersionMap;
         Options* m_opt;
 
         std::mutex m_dataAddLock;
 
-        std::mutex m_mergeLock;
-
         COMMON::FineGrainedRWLock m_rwLocks;
 
         COMMON::PostingSizeRecord m_postingSizes;
 
-        std::shared_ptr<SPDKThreadPool> m_splitThreadPool;
-        std::shared_ptr<SPDKThreadPool> m_reassignThreadPool;
+        // split, merge, reassign and GC jobs share one scheduler, served in that priority order
+        enum class JobClass : int { Split = 0, Merge, Reassign, GC, Count };
+        std::shared_ptr<Helper::PriorityThreadPool> m_backgroundPool;
+
+        PostingDeltaBuffer m_deltaBuffer;
+        std::atomic<bool> m_evictingDeltas{ false };
+        std::shared_ptr<SPDKThreadPool> m_flushThreadPool;
+
+        // AddIndexBatch calls in flight, they split m_iSSDNumberOfThreads between their head searches
+        std::atomic_int m_batchInserters{ 0 };
+
+        std::shared_ptr<SPDKThreadPool> m_prefetchThreadPool;
+
+        // vectors of a posting filtered before one batch distance call, the batched search compares them
+        // with every query before the next ones are touched
+        static const int ScanBlock = 64;
 
         IndexStats m_stat;
 
@@ -160,10 +230,19 @@ namespace SPTAG::SPANN {
 
         tbb::concurrent_hash_map<SizeType, SizeType> m_mergeList;
 
+        std::shared_ptr<WriteAheadLog> m_wal;
+
+        // the SPDK postings, version map and posting sizes were loaded from a snapshot and the log of an earlier run
+        bool m_recovered = false;
+
+        // largest posting the storage can hold, search buffers are at least this large (0: unbounded)
+        std::size_t m_postingBufferSize = 0;
+
     public:
         ExtraDynamicSearcher(const char* dbPath, int dim, int postingBlockLimit, bool useDirectIO, float searchLatencyHardLimit, int mergeThreshold, bool useSPDK = false, int batchSize = 64, int bufferLength = 3) {
             if (useSPDK) {
-                db.reset(new SPDKIO(dbPath, 1024 * 1024, MaxSize, postingBlockLimit + bufferLength, 1024, batchSize));
+                db.reset(new SPDKIO(dbPath, 1024 * 1024, MaxSize, postingBlockLimit + bufferLength, batchSize));
+                m_postingBufferSize = ((std::size_t)(postingBlockLimit + bufferLength)) << PageSizeEx;
                 m_postingSizeLimit = postingBlockLimit * PageSize / (sizeof(ValueType) * dim + sizeof(int) + sizeof(uint8_t));
             } else {
 #ifdef ROCKSDB
@@ -173,12 +252,21 @@ namespace SPTAG::SPANN {
             }
             m_metaDataSize = sizeof(int) + sizeof(uint8_t);
             m_vectorInfoSize = dim * sizeof(ValueType) + m_metaDataSize;
+            m_storedInfoSize = m_vectorInfoSize;
+            m_rawDB = db;
+            if (useSPDK) m_appendBatchLimit = max(1, (bufferLength * PageSize) / m_vectorInfoSize);
             m_hardLatencyLimit = std::chrono::microseconds((int)searchLatencyHardLimit * 1000);
             m_mergeThreshold = mergeThreshold;
             LOG(Helper::LogLevel::LL_Info, "Posting size limit: %d, search limit: %f, merge threshold: %d\n", m_postingSizeLimit, searchLatencyHardLimit, m_mergeThreshold);
         }
 
-        ~ExtraDynamicSearcher() {}
+        ~ExtraDynamicSearcher() {
+            if (m_wal) {
+                m_versionMap->SetUpdateCallback(nullptr);
+                m_postingSizes.SetUpdateCallback(nullptr);
+                m_wal->Close();
+            }
+        }
 
         //headCandidates: search data structrue for "vid" vector
         //headID: the head vector that stands for vid
@@ -349,7 +437,8 @@ namespace SPTAG::SPANN {
         inline void Serialize(char* ptr, SizeType VID, std::uint8_t version, const void* vector) {
             memcpy(ptr, &VID, sizeof(VID));
             memcpy(ptr + sizeof(VID), &version, sizeof(version));
-            memcpy(ptr + m_metaDataSize, vector, m_vectorInfoSize - m_metaDataSize);
+            memcpy(ptr + m_metaDataSize, vector, sizeof(ValueType) * m_opt->m_dim);
+            if (m_quantizedIO) m_quantizedIO->FillCode(ptr);
         }
 
         void CalculatePostingDistribution(VectorIndex* p_index)
@@ -471,6 +560,7 @@ namespace SPTAG::SPANN {
                 auto splitGetBegin = std::chrono::high_resolution_clock::now();
                 //the modification mark
                 //lock.lock();
+                FlushDelta(headID);
                 if (db->Get(headID, &postingList) != ErrorCode::Success) {//read posting data from ssd storage, data is stored in postingList
                     LOG(Helper::LogLevel::LL_Info, "Split fail to get oversized postings\n");
                     exit(0);
@@ -488,6 +578,7 @@ namespace SPTAG::SPANN {
                 //std::vector<int> localIndicesInsert(postVectorNum);  // smallSample[i] = j <-> localindices[j] = i
                 //std::vector<uint8_t> localIndicesInsertVersion(postVectorNum);
                 std::vector<int> localIndices(postVectorNum);
+                std::unordered_set<SizeType> vectorIdSet;
                 int index = 0;
                 uint8_t* vectorId = postingP;
                 for (int j = 0; j < postVectorNum; j++, vectorId += m_vectorInfoSize)//the loop is to get the all vectors of the target posting that not be deleted or updated(holds a lower version value)
@@ -497,6 +588,8 @@ namespace SPTAG::SPANN {
                     uint8_t version = *(vectorId + sizeof(SizeType));
                     int VID = *((int*)(vectorId));
                     if (m_versionMap->Deleted(VID) || m_versionMap->GetVersion(VID) != version) continue;
+                    // appends through db->Merge may leave the same VID more than once in a posting
+                    if (!vectorIdSet.insert(VID).second) continue;
 
                     //localIndicesInsert[index] = VID;
                     //localIndicesInsertVersion[index] = version;
@@ -719,6 +812,7 @@ namespace SPTAG::SPANN {
 
                 std::string postingList;
                 auto splitGetBegin = std::chrono::high_resolution_clock::now();
+                FlushDelta(headID);
                 if (db->Get(headID, &postingList) != ErrorCode::Success) {//read posting data from ssd storage, data is stored in postingList
                     LOG(Helper::LogLevel::LL_Info, "Split fail to get oversized postings\n");
                     exit(0);
@@ -735,6 +829,7 @@ namespace SPTAG::SPANN {
                 //std::vector<int> localIndicesInsert(postVectorNum);  // smallSample[i] = j <-> localindices[j] = i
                 //std::vector<uint8_t> localIndicesInsertVersion(postVectorNum);
                 std::vector<int> localIndices(postVectorNum);
+                std::unordered_set<SizeType> vectorIdSet;
                 int index = 0;
                 uint8_t* vectorId = postingP;
                 for (int j = 0; j < postVectorNum; j++, vectorId += m_vectorInfoSize)//the loop is to get the all vectors that not be deleted or updated(holds a lower version value)
@@ -745,6 +840,8 @@ namespace SPTAG::SPANN {
                     uint8_t version = *(vectorId + sizeof(int));
                     int VID = *((int*)(vectorId));
                     if (m_versionMap->Deleted(VID) || m_versionMap->GetVersion(VID) != version) continue;
+                    // appends through db->Merge may leave the same VID more than once in a posting
+                    if (!vectorIdSet.insert(VID).second) continue;
 
                     //localIndicesInsert[index] = VID;
                     //localIndicesInsertVersion[index] = version;
@@ -904,166 +1001,169 @@ namespace SPTAG::SPANN {
             return ErrorCode::Success;
         }
 
+        // the live, deduplicated vectors of a posting, the caller holds the posting lock
+        int GetLivePosting(SizeType headID, std::string* p_livePosting)
+        {
+            std::string postingList;
+            FlushDelta(headID);
+            if (db->Get(headID, &postingList) != ErrorCode::Success) {
+                LOG(Helper::LogLevel::LL_Info, "Fail to get to be merged postings: %d\n", headID);
+                exit(0);
+            }
+
+            std::set<SizeType> vectorIdSet;
+            p_livePosting->clear();
+            int liveLength = 0;
+            uint8_t* vectorId = reinterpret_cast<uint8_t*>(&postingList.front());
+            size_t postVectorNum = postingList.size() / m_vectorInfoSize;
+            for (int j = 0; j < postVectorNum; j++, vectorId += m_vectorInfoSize)
+            {
+                int VID = *((int*)(vectorId));
+                uint8_t version = *(vectorId + sizeof(int));
+                if (m_versionMap->Deleted(VID) || m_versionMap->GetVersion(VID) != version) continue;
+                if (!vectorIdSet.insert(VID).second) continue;
+                p_livePosting->append((char*)vectorId, m_vectorInfoSize);
+                liveLength++;
+            }
+            return liveLength;
+        }
+
+        // Merges run concurrently: the posting is compacted under its own lock, the neighbor search holds
+        // no lock, and the pair is then locked in stripe order and re-read before the merged list is written.
         ErrorCode MergePostings(VectorIndex* p_index, SizeType headID, bool reassign = false)
         {
+            auto mergeBegin = std::chrono::high_resolution_clock::now();
+
+            std::string currentPostingList;
+            int currentLength = 0;
             {
-                if (!m_mergeLock.try_lock()) {
-                    auto* curJob = new MergeAsyncJob(p_index, this, headID, reassign, nullptr);
-                    m_splitThreadPool->add(curJob);
-                    return ErrorCode::Success;
-                }
                 std::unique_lock<std::shared_timed_mutex> lock(m_rwLocks[headID]);
 
                 if (!p_index->ContainSample(headID)) {
-                    m_mergeLock.unlock();
+                    m_mergeList.erase(headID);
                     return ErrorCode::Success;
                 }
 
-                std::string mergedPostingList;
-                std::set<SizeType> vectorIdSet;
-
-                std::string currentPostingList;
-                if (db->Get(headID, &currentPostingList) != ErrorCode::Success) {
-                    LOG(Helper::LogLevel::LL_Info, "Fail to get to be merged postings: %d\n", headID);
+                currentLength = GetLivePosting(headID, &currentPostingList);
+                m_postingSizes.UpdateSize(headID, currentLength);
+                if (db->Put(headID, currentPostingList) != ErrorCode::Success) {
+                    LOG(Helper::LogLevel::LL_Info, "Merge Fail to write back postings\n");
                     exit(0);
                 }
+                if (currentLength > m_mergeThreshold) {
+                    m_mergeList.erase(headID);
+                    return ErrorCode::Success;
+                }
+            }
 
-                auto* postingP = reinterpret_cast<uint8_t*>(&currentPostingList.front());
-                size_t postVectorNum = currentPostingList.size() / m_vectorInfoSize;
-                int currentLength = 0;
-                uint8_t* vectorId = postingP;
-                for (int j = 0; j < postVectorNum; j++, vectorId += m_vectorInfoSize)
+            QueryResult queryResults(p_index->GetSample(headID), m_opt->m_internalResultNum, false);
+            p_index->SearchIndex(queryResults);
+
+            std::string nextPostingList;
+
+            for (int i = 1; i < queryResults.GetResultNum(); ++i)
+            {
+                BasicResult* queryResult = queryResults.GetResult(i);
+                SizeType nextID = queryResult->VID;
+                if (nextID < 0 || nextID == headID) continue;
+                if (currentLength + m_postingSizes.GetSize(nextID) >= m_postingSizeLimit) continue;
                 {
-                    int VID = *((int*)(vectorId));
-                    uint8_t version = *(vectorId + sizeof(int));
-                    if (m_versionMap->Deleted(VID) || m_versionMap->GetVersion(VID) != version) continue;
-                    vectorIdSet.insert(VID);
-                    mergedPostingList += currentPostingList.substr(j * m_vectorInfoSize, m_vectorInfoSize);
-                    currentLength++;
+                    // a neighbor with its own merge pending is left to that merge
+                    tbb::concurrent_hash_map<SizeType, SizeType>::const_accessor headIDAccessor;
+                    if (m_mergeList.find(headIDAccessor, nextID)) continue;
                 }
-                int totalLength = currentLength;
 
-                if (currentLength > m_mergeThreshold)
-                {
-                    m_postingSizes.UpdateSize(headID, currentLength);
-                    if (db->Put(headID, mergedPostingList) != ErrorCode::Success) {
-                        LOG(Helper::LogLevel::LL_Info, "Merge Fail to write back postings\n");
-                        exit(0);
-                    }
+                int nextLength = 0;
+                int totalLength = 0;
+                m_rwLocks.LockPair(headID, nextID);
+                if (!p_index->ContainSample(headID)) {
+                    m_rwLocks.UnlockPair(headID, nextID);
                     m_mergeList.erase(headID);
-                    m_mergeLock.unlock();
                     return ErrorCode::Success;
                 }
+                if (!p_index->ContainSample(nextID)) {
+                    m_rwLocks.UnlockPair(headID, nextID);
+                    continue;
+                }
 
-                QueryResult queryResults(p_index->GetSample(headID), m_opt->m_internalResultNum, false);
-                p_index->SearchIndex(queryResults);
+                // both may have taken appends since the compaction above
+                currentLength = GetLivePosting(headID, &currentPostingList);
+                nextLength = GetLivePosting(nextID, &nextPostingList);
+                if (currentLength + nextLength >= m_postingSizeLimit) {
+                    m_rwLocks.UnlockPair(headID, nextID);
+                    continue;
+                }
 
-                std::string nextPostingList;
+                std::string mergedPostingList = currentPostingList;
+                std::set<SizeType> vectorIdSet;
+                for (int j = 0; j < currentLength; j++) vectorIdSet.insert(*((int*)(&currentPostingList[j * m_vectorInfoSize])));
+                totalLength = currentLength;
+                for (int j = 0; j < nextLength; j++) {
+                    if (vectorIdSet.insert(*((int*)(&nextPostingList[j * m_vectorInfoSize]))).second) {
+                        mergedPostingList.append(nextPostingList, j * m_vectorInfoSize, m_vectorInfoSize);
+                        totalLength++;
+                    }
+                }
 
-                for (int i = 1; i < queryResults.GetResultNum(); ++i)
+                if (currentLength > nextLength)
                 {
-                    BasicResult* queryResult = queryResults.GetResult(i);
-                    int nextLength = m_postingSizes.GetSize(queryResult->VID);
-                    tbb::concurrent_hash_map<SizeType, SizeType>::const_accessor headIDAccessor;
-                    if (currentLength + nextLength < m_postingSizeLimit && !m_mergeList.find(headIDAccessor, queryResult->VID))
-                    {
-                        {
-                            std::unique_lock<std::shared_timed_mutex> anotherLock(m_rwLocks[queryResult->VID], std::defer_lock);
-                            // LOG(Helper::LogLevel::LL_Info,"Locked: %d, to be lock: %d\n", headID, queryResult->VID);
-                            if (m_rwLocks.hash_func(queryResult->VID) != m_rwLocks.hash_func(headID)) anotherLock.lock();
-                            if (!p_index->ContainSample(queryResult->VID)) continue;
-                            if (db->Get(queryResult->VID, &nextPostingList) != ErrorCode::Success) {
-                                LOG(Helper::LogLevel::LL_Info, "Fail to get to be merged postings: %d\n", queryResult->VID);
-                                exit(0);
-                            }
+                    p_index->DeleteIndex(nextID);
+                    if (db->Put(headID, mergedPostingList) != ErrorCode::Success) {
+                        LOG(Helper::LogLevel::LL_Info, "Split fail to override postings after merge\n");
+                        exit(0);
+                    }
+                    m_postingSizes.UpdateSize(nextID, 0);
+                    m_postingSizes.UpdateSize(headID, totalLength);
+                } else
+                {
+                    p_index->DeleteIndex(headID);
+                    if (db->Put(nextID, mergedPostingList) != ErrorCode::Success) {
+                        LOG(Helper::LogLevel::LL_Info, "Split fail to override postings after merge\n");
+                        exit(0);
+                    }
+                    m_postingSizes.UpdateSize(nextID, totalLength);
+                    m_postingSizes.UpdateSize(headID, 0);
+                }
+                m_rwLocks.UnlockPair(headID, nextID);
 
-                            postingP = reinterpret_cast<uint8_t*>(&nextPostingList.front());
-                            postVectorNum = nextPostingList.size() / m_vectorInfoSize;
-                            nextLength = 0;
-                            vectorId = postingP;
-                            for (int j = 0; j < postVectorNum; j++, vectorId += m_vectorInfoSize)
-                            {
-                                int VID = *((int*)(vectorId));
-                                uint8_t version = *(vectorId + sizeof(int));
-                                if (m_versionMap->Deleted(VID) || m_versionMap->GetVersion(VID) != version) continue;
-                                if (vectorIdSet.find(VID) == vectorIdSet.end()) {
-                                    mergedPostingList += nextPostingList.substr(j * m_vectorInfoSize, m_vectorInfoSize);
-                                    totalLength++;
-                                }
-                                nextLength++;
-                            }
-                            if (currentLength > nextLength) 
-                            {
-                                p_index->DeleteIndex(queryResult->VID);
-                                if (db->Put(headID, mergedPostingList) != ErrorCode::Success) {
-                                    LOG(Helper::LogLevel::LL_Info, "Split fail to override postings after merge\n");
-                                    exit(0);
-                                }
-                                m_postingSizes.UpdateSize(queryResult->VID, 0);
-                                m_postingSizes.UpdateSize(headID, totalLength);
-                            } else
-                            {
-                                p_index->DeleteIndex(headID);
-                                if (db->Put(queryResult->VID, mergedPostingList) != ErrorCode::Success) {
-                                    LOG(Helper::LogLevel::LL_Info, "Split fail to override postings after merge\n");
-                                    exit(0);
-                                }
-                                m_postingSizes.UpdateSize(queryResult->VID, totalLength);
-                                m_postingSizes.UpdateSize(headID, 0);
-                            }
-                            if (m_rwLocks.hash_func(queryResult->VID) != m_rwLocks.hash_func(headID)) anotherLock.unlock();
+                if (reassign) 
+                {
+                    /* ReAssign */
+                    if (currentLength > nextLength) 
+                    {
+                        /* ReAssign nextID*/
+                        uint8_t* postingP = reinterpret_cast<uint8_t*>(&nextPostingList.front());
+                        for (int j = 0; j < nextLength; j++) {
+                            uint8_t* vectorId = postingP + j * m_vectorInfoSize;
+                            ValueType* vector = reinterpret_cast<ValueType*>(vectorId + m_metaDataSize);
+                            float origin_dist = p_index->ComputeDistance(p_index->GetSample(nextID), vector);
+                            float current_dist = p_index->ComputeDistance(p_index->GetSample(headID), vector);
+                            if (current_dist > origin_dist)
+                                ReassignAsync(p_index, std::make_shared<std::string>((char*)vectorId, m_vectorInfoSize), headID);
                         }
-
-                        // LOG(Helper::LogLevel::LL_Info,"Release: %d, Release: %d\n", headID, queryResult->VID);
-                        lock.unlock();
-                        m_mergeLock.unlock();
-
-                        if (reassign) 
-                        {
-                            /* ReAssign */
-                            if (currentLength > nextLength) 
-                            {
-                                /* ReAssign queryResult->VID*/
-                                postingP = reinterpret_cast<uint8_t*>(&nextPostingList.front());
-                                for (int j = 0; j < nextLength; j++) {
-                                    uint8_t* vectorId = postingP + j * m_vectorInfoSize;
-                                    // SizeType vid = *(reinterpret_cast<SizeType*>(vectorId));
-                                    ValueType* vector = reinterpret_cast<ValueType*>(vectorId + m_metaDataSize);
-                                    float origin_dist = p_index->ComputeDistance(p_index->GetSample(queryResult->VID), vector);
-                                    float current_dist = p_index->ComputeDistance(p_index->GetSample(headID), vector);
-                                    if (current_dist > origin_dist)
-                                        ReassignAsync(p_index, std::make_shared<std::string>((char*)vectorId, m_vectorInfoSize), headID);
-                                }
-                            } else
-                            {
-                                /* ReAssign headID*/
-                                postingP = reinterpret_cast<uint8_t*>(&currentPostingList.front());
-                                for (int j = 0; j < currentLength; j++) {
-                                    uint8_t* vectorId = postingP + j * m_vectorInfoSize;
-                                    // SizeType vid = *(reinterpret_cast<SizeType*>(vectorId));
-                                    ValueType* vector = reinterpret_cast<ValueType*>(vectorId + m_metaDataSize);
-                                    float origin_dist = p_index->ComputeDistance(p_index->GetSample(headID), vector);
-                                    float current_dist = p_index->ComputeDistance(p_index->GetSample(queryResult->VID), vector);
-                                    if (current_dist > origin_dist)
-                                        ReassignAsync(p_index, std::make_shared<std::string>((char*)vectorId, m_vectorInfoSize), queryResult->VID);
-                                }
-                            }
+                    } else
+                    {
+                        /* ReAssign headID*/
+                        uint8_t* postingP = reinterpret_cast<uint8_t*>(&currentPostingList.front());
+                        for (int j = 0; j < currentLength; j++) {
+                            uint8_t* vectorId = postingP + j * m_vectorInfoSize;
+                            ValueType* vector = reinterpret_cast<ValueType*>(vectorId + m_metaDataSize);
+                            float origin_dist = p_index->ComputeDistance(p_index->GetSample(headID), vector);
+                            float current_dist = p_index->ComputeDistance(p_index->GetSample(nextID), vector);
+                            if (current_dist > origin_dist)
+                                ReassignAsync(p_index, std::make_shared<std::string>((char*)vectorId, m_vectorInfoSize), nextID);
                         }
-
-                        m_mergeList.erase(headID);
-                        m_stat.m_mergeNum++;
-
-                        return ErrorCode::Success;
                     }
                 }
-                m_postingSizes.UpdateSize(headID, currentLength);
-                if (db->Put(headID, mergedPostingList) != ErrorCode::Success) {
-                    LOG(Helper::LogLevel::LL_Info, "Merge Fail to write back postings\n");
-                    exit(0);
-                }
+
                 m_mergeList.erase(headID);
-                m_mergeLock.unlock();
+                m_stat.m_mergeNum++;
+                auto mergeEnd = std::chrono::high_resolution_clock::now();
+                m_stat.m_mergeCost += std::chrono::duration_cast<std::chrono::milliseconds>(mergeEnd - mergeBegin).count();
+
+                return ErrorCode::Success;
             }
+            m_mergeList.erase(headID);
             return ErrorCode::Success;
         }
 
@@ -1087,10 +1187,31 @@ namespace SPTAG::SPANN {
             }
 
             auto* curJob = new SplitAsyncJob(p_index, this, headID, m_opt->m_disableReassign, p_callback);
-            m_splitThreadPool->add(curJob);
+            m_backgroundPool->add(curJob, (int)JobClass::Split);
             // LOG(Helper::LogLevel::LL_Info, "Add to thread pool\n");
         }
 
+        // more than GCGarbageRatio of the scanned entries are deleted vectors or stale replicas
+        inline bool IsGarbageHeavy(int p_currentNum, int p_scannedNum) const
+        {
+            return m_opt->m_gcGarbageRatio > 0 && p_scannedNum > 0 && p_scannedNum - p_currentNum > p_scannedNum * m_opt->m_gcGarbageRatio;
+        }
+
+        // rewrites the posting with its current vectors only, a Split that finds the posting within the size
+        // limit after dropping the garbage does exactly that. Queued as GC work and shares the split dedup.
+        inline void GCAsync(VectorIndex* p_index, SizeType headID)
+        {
+            if (!m_opt->m_update) return;
+            {
+                std::lock_guard<std::mutex> tmplock(m_runningLock);
+                if (m_splitList.find(headID) != m_splitList.end()) return;
+                m_splitList.insert(headID);
+            }
+
+            auto* curJob = new SplitAsyncJob(p_index, this, headID, m_opt->m_disableReassign, nullptr);
+            m_backgroundPool->add(curJob, (int)JobClass::GC);
+        }
+
         inline void MergeAsync(VectorIndex* p_index, SizeType headID, std::function<void()> p_callback = nullptr)
         {
             if (!m_opt->m_update) return;
@@ -1102,13 +1223,59 @@ namespace SPTAG::SPANN {
             m_mergeList.insert(workPair);
 
             auto* curJob = new MergeAsyncJob(p_index, this, headID, m_opt->m_disableReassign, p_callback);
-            m_splitThreadPool->add(curJob);
+            m_backgroundPool->add(curJob, (int)JobClass::Merge);
+        }
+
+        inline void FlushDeltaAsync(SizeType headID)
+        {
+            auto* curJob = new FlushDeltaAsyncJob(this, headID);
+            m_flushThreadPool->add(curJob);
+        }
+
+        // write the buffered vectors of headID to storage, the caller holds the posting lock
+        void FlushDelta(SizeType headID)
+        {
+            std::string delta;
+            if (!m_deltaBuffer.Enabled() || !m_deltaBuffer.Get(headID, &delta)) return;
+            if (db->Merge(headID, delta) != ErrorCode::Success) {
+                LOG(Helper::LogLevel::LL_Error, "Delta flush failed! Posting Size:%d, limit: %d\n", m_postingSizes.GetSize(headID), m_postingSizeLimit);
+                GetDBStats();
+                exit(1);
+            }
+            m_deltaBuffer.Erase(headID);
+        }
+
+        // flushes the largest deltas until the buffer is an eighth below its budget, one thread evicts at a time
+        // while the others keep appending. The caller must not hold any posting lock.
+        void EvictDeltas()
+        {
+            bool evicting = false;
+            if (!m_evictingDeltas.compare_exchange_strong(evicting, true)) return;
+            std::vector<SizeType> headIDs;
+            std::size_t budget = ((std::size_t)m_opt->m_deltaBufferMB) << 20;
+            m_deltaBuffer.GetEvictionCandidates(budget - budget / 8, headIDs);
+            for (SizeType headID : headIDs) {
+                std::unique_lock<std::shared_timed_mutex> lock(m_rwLocks[headID]);
+                FlushDelta(headID);
+            }
+            m_evictingDeltas = false;
+        }
+
+        void FlushAllDeltas()
+        {
+            if (!m_deltaBuffer.Enabled()) return;
+            std::vector<SizeType> headIDs;
+            m_deltaBuffer.GetKeys(headIDs);
+            for (SizeType headID : headIDs) {
+                std::unique_lock<std::shared_timed_mutex> lock(m_rwLocks[headID]);
+                FlushDelta(headID);
+            }
         }
 
         inline void ReassignAsync(VectorIndex* p_index, std::shared_ptr<std::string> vectorInfo, SizeType HeadPrev, std::function<void()> p_callback = nullptr)
         {
             auto* curJob = new ReassignAsyncJob(p_index, this, std::move(vectorInfo), HeadPrev, p_callback);
-            m_splitThreadPool->add(curJob);
+            m_backgroundPool->add(curJob, (int)JobClass::Reassign);
         }
 
         ErrorCode CollectReAssign(VectorIndex* p_index, SizeType headID, std::vector<std::string>& postingLists, std::vector<SizeType>& newHeadsID) {
@@ -1255,6 +1422,7 @@ namespace SPTAG::SPANN {
                 return ErrorCode::Undefined;
             }
             double appendIOSeconds = 0;
+            bool evictDeltas = false;
             {
                 //std::shared_lock<std::shared_timed_mutex> lock(m_rwLocks[headID]); //ROCKSDB
                 std::unique_lock<std::shared_timed_mutex> lock(m_rwLocks[headID]); //SPDK
@@ -1262,70 +1430,79 @@ namespace SPTAG::SPANN {
                     goto checkDeleted;
                 }
                 auto appendIOBegin = std::chrono::high_resolution_clock::now();
-                // if (db->Merge(headID, appendPosting) != ErrorCode::Success) {
-                //     LOG(Helper::LogLevel::LL_Error, "Merge failed! Posting Size:%d, limit: %d\n", m_postingSizes.GetSize(headID), m_postingSizeLimit);
-                //     GetDBStats();
-                //     exit(1);
-                // }
-
-                std::string oldPostingList;
-                if (db->Get(headID, &oldPostingList) != ErrorCode::Success) {
-                    LOG(Helper::LogLevel::LL_Info, "Get old posting value failed!\n");
-                    exit(0);
+                int appendedNum = appendNum;
+                if (m_deltaBuffer.Enabled()) {
+                    // write-back: the vectors stay in memory until the delta fills a page, the posting is split/merged or the budget runs out
+                    std::size_t buffered = m_deltaBuffer.Append(headID, appendPosting);
+                    if (m_deltaBuffer.OverBudget()) evictDeltas = true;
+                    else if (buffered < PageSize && buffered + appendPosting.size() >= PageSize) FlushDeltaAsync(headID);
+                }
+                else if (m_opt->m_appendThroughMerge) {
+                    // only the appended bytes hit the storage, duplicated VIDs are dropped lazily by search (deduper) and split/merge (GC)
+                    if (db->Merge(headID, appendPosting) != ErrorCode::Success) {
+                        LOG(Helper::LogLevel::LL_Error, "Merge failed! Posting Size:%d, limit: %d\n", m_postingSizes.GetSize(headID), m_postingSizeLimit);
+                        GetDBStats();
+                        exit(1);
+                    }
                 }
+                else {
+                    std::string oldPostingList;
+                    if (db->Get(headID, &oldPostingList) != ErrorCode::Success) {
+                        LOG(Helper::LogLevel::LL_Info, "Get old posting value failed!\n");
+                        exit(0);
+                    }
 
-                std::set<SizeType> vectorIdSet;
-                std::string filtered_posting;
-                int filtered_num = 0;
+                    std::set<SizeType> vectorIdSet;
+                    std::string filtered_posting;
+                    int filtered_num = 0;
 
-                int old_size = oldPostingList.size() / m_vectorInfoSize;
+                    int old_size = oldPostingList.size() / m_vectorInfoSize;
 
-                uint8_t* addr = reinterpret_cast<uint8_t*>(&oldPostingList.front());
-                for(int a = 0; a < old_size; a++){
-                    uint8_t* c_addr = addr + a * m_vectorInfoSize;
-                    //uint8_t version = *(c_addr + sizeof(SizeType));
-                    int VID = *((int*)(c_addr));
+                    uint8_t* addr = reinterpret_cast<uint8_t*>(&oldPostingList.front());
+                    for(int a = 0; a < old_size; a++){
+                        uint8_t* c_addr = addr + a * m_vectorInfoSize;
+                        //uint8_t version = *(c_addr + sizeof(SizeType));
+                        int VID = *((int*)(c_addr));
 
-                    //if (m_versionMap->Deleted(VID) || m_versionMap->GetVersion(VID) != version)
-                    vectorIdSet.insert(VID);
-                }
+                        //if (m_versionMap->Deleted(VID) || m_versionMap->GetVersion(VID) != version)
+                        vectorIdSet.insert(VID);
+                    }
 
-                addr = reinterpret_cast<uint8_t*>(&appendPosting.front());
-                for(int i = 0; i < appendNum; i++){
-                    uint8_t* c_addr = addr + i * m_vectorInfoSize;
-                    //uint8_t version = *(c_addr + sizeof(SizeType));
-                    int VID = *((int*)(c_addr));
+                    addr = reinterpret_cast<uint8_t*>(&appendPosting.front());
+                    for(int i = 0; i < appendNum; i++){
+                        uint8_t* c_addr = addr + i * m_vectorInfoSize;
+                        //uint8_t version = *(c_addr + sizeof(SizeType));
+                        int VID = *((int*)(c_addr));
                     
-                    if(vectorIdSet.find(VID) == vectorIdSet.end()){
-                        vectorIdSet.insert(VID);
+                        if(vectorIdSet.find(VID) == vectorIdSet.end()){
+                            vectorIdSet.insert(VID);
 
-                        std::string cur_vec_info(m_vectorInfoSize, '\0');
-                        char* cur_p = (char*)(cur_vec_info.c_str());
-                        memcpy(cur_p, c_addr, m_vectorInfoSize);
+                            std::string cur_vec_info(m_vectorInfoSize, '\0');
+                            char* cur_p = (char*)(cur_vec_info.c_str());
+                            memcpy(cur_p, c_addr, m_vectorInfoSize);
 
-                        filtered_posting.append(cur_vec_info);
-                        filtered_num++;
+                            filtered_posting.append(cur_vec_info);
+                            filtered_num++;
+                        }
                     }
-                }
 
-                //LOG(Helper::LogLevel::LL_Info, "appendNum: %d, filteredNum: %d\n", appendNum, filtered_num);
-                //if (db->Merge(headID, appendPosting) != ErrorCode::Success) {
-                //    LOG(Helper::LogLevel::LL_Error, "Merge failed! Posting Size:%d, limit: %d\n", m_postingSizes.GetSize(headID), m_postingSizeLimit);
-                //    GetDBStats();
-                //    exit(1);
-                //}
-                if (db->Put(headID, oldPostingList.append(filtered_posting)) != ErrorCode::Success) {
-                    LOG(Helper::LogLevel::LL_Error, "Merge failed! Posting Size:%d, limit: %d\n", m_postingSizes.GetSize(headID), m_postingSizeLimit);
-                    GetDBStats();
-                    exit(1);
+                    //LOG(Helper::LogLevel::LL_Info, "appendNum: %d, filteredNum: %d\n", appendNum, filtered_num);
+                    if (db->Put(headID, oldPostingList.append(filtered_posting)) != ErrorCode::Success) {
+                        LOG(Helper::LogLevel::LL_Error, "Merge failed! Posting Size:%d, limit: %d\n", m_postingSizes.GetSize(headID), m_postingSizeLimit);
+                        GetDBStats();
+                        exit(1);
+                    }
+                    appendedNum = filtered_num;
                 }
 
                 auto appendIOEnd = std::chrono::high_resolution_clock::now();
                 appendIOSeconds = std::chrono::duration_cast<std::chrono::microseconds>(appendIOEnd - appendIOBegin).count();
                 //the modification mark
                 //std::lock_guard<std::mutex> tmplock(m_dataAddLock);
-                m_postingSizes.IncSize(headID, filtered_num/*appendNum*/);//CAS operation that modifies the postingSize
+                m_postingSizes.IncSize(headID, appendedNum);//CAS operation that modifies the postingSize
             }
+            // the victims are locked one at a time, never while holding the lock of headID
+            if (evictDeltas) EvictDeltas();
             if (m_postingSizes.GetSize(headID) > (m_postingSizeLimit + reassignThreshold)) {
                 // SizeType VID = *(int*)(&appendPosting[0]);
                 // LOG(Helper::LogLevel::LL_Error, "Split Triggered by inserting VID: %d, reAssign: %d\n", VID, reassignThreshold);
@@ -1400,6 +1577,7 @@ namespace SPTAG::SPANN {
         bool LoadIndex(Options& p_opt, COMMON::VersionLabel& p_versionMap) override {
             m_versionMap = &p_versionMap;
             m_opt = &p_opt;
+            if (!InitPostingQuantizer() || !InitAlignedPostings()) return false;
             LOG(Helper::LogLevel::LL_Info, "DataBlockSize: %d, Capacity: %d\n", m_opt->m_datasetRowsInBlock, m_opt->m_datasetCapacity);
 
             if (!m_opt->m_useSPDK) {
@@ -1409,15 +1587,47 @@ namespace SPTAG::SPANN {
                 LOG(Helper::LogLevel::LL_Info, "Current posting num: %d.\n", m_postingSizes.GetPostingNum());
                 ShowPostingDistribution(m_opt->m_startNum - m_opt->m_step, true);
             }
+            else if (m_opt->m_enableWAL && m_postingSizes.GetPostingNum() == 0 && fileexists(m_opt->m_spdkMappingPath.c_str())) {
+                // the mapping is only saved together with the version map and posting sizes, the log goes on top of them
+                if (m_versionMap->Load(m_opt->m_deleteIDFile, m_opt->m_datasetRowsInBlock, m_opt->m_datasetCapacity) != ErrorCode::Success ||
+                    m_postingSizes.Load(m_opt->m_ssdInfoFile, m_opt->m_datasetRowsInBlock, m_opt->m_datasetCapacity) != ErrorCode::Success) {
+                    LOG(Helper::LogLevel::LL_Error, "Fail to load the version map %s or the posting sizes %s of mapping %s\n",
+                        m_opt->m_deleteIDFile.c_str(), m_opt->m_ssdInfoFile.c_str(), m_opt->m_spdkMappingPath.c_str());
+                    return false;
+                }
+                m_recovered = true;
+                LOG(Helper::LogLevel::LL_Info, "SPFresh: recover SPDK postings, vector num: %d, posting num: %d\n", m_versionMap->GetVectorNum(), m_postingSizes.GetPostingNum());
+            }
+
+            if (m_opt->m_enableWAL) {
+                // SPDK postings without a snapshot are still to be copied from the static index, FinishCopy starts the log
+                if (!m_opt->m_useSPDK || m_recovered) OpenWriteAheadLog(true);
+                else if (m_postingSizes.GetPostingNum() > 0) OpenWriteAheadLog(false);
+            }
 
             if (m_opt->m_update) {
-                LOG(Helper::LogLevel::LL_Info, "SPFresh: initialize thread pools, append: %d, reassign %d\n", m_opt->m_appendThreadNum, m_opt->m_reassignThreadNum);
-                m_splitThreadPool = std::make_shared<SPDKThreadPool>();
-                m_splitThreadPool->initSPDK(m_opt->m_appendThreadNum, this);
-                m_reassignThreadPool = std::make_shared<SPDKThreadPool>();
-                m_reassignThreadPool->initSPDK(m_opt->m_reassignThreadNum, this);
+                LOG(Helper::LogLevel::LL_Info, "SPFresh: initialize thread pools, append: %d, reassign %d, gc %d, latency target: %.3f ms\n",
+                    m_opt->m_appendThreadNum, m_opt->m_reassignThreadNum, m_opt->m_gcThreadNum, m_opt->m_backgroundLatencyTarget);
+                // splits may use every thread, the other classes are capped by their own thread numbers
+                int backgroundThreads = m_opt->m_appendThreadNum + m_opt->m_reassignThreadNum;
+                std::vector<int> classLimits = { backgroundThreads, m_opt->m_appendThreadNum, m_opt->m_reassignThreadNum, m_opt->m_gcThreadNum };
+                m_backgroundPool = std::make_shared<Helper::PriorityThreadPool>();
+                m_backgroundPool->SetLatencyTarget(m_opt->m_backgroundLatencyTarget);
+                m_backgroundPool->init(backgroundThreads, classLimits, [this]() { Initialize(); }, [this]() { ExitBlockController(); });
+                if (m_opt->m_deltaBufferMB > 0) {
+                    LOG(Helper::LogLevel::LL_Info, "SPFresh: delta buffer %d MB, flush threads: %d\n", m_opt->m_deltaBufferMB, m_opt->m_deltaFlushThreadNum);
+                    m_deltaBuffer.Initialize(((std::size_t)m_opt->m_deltaBufferMB) << 20);
+                    m_flushThreadPool = std::make_shared<SPDKThreadPool>();
+                    m_flushThreadPool->initSPDK(max(1, m_opt->m_deltaFlushThreadNum), this);
+                }
                 LOG(Helper::LogLevel::LL_Info, "SPFresh: finish initialization\n");
             }
+
+            if (m_opt->m_asyncHeadSearch) {
+                LOG(Helper::LogLevel::LL_Info, "SPFresh: prefetch postings during head search, threads: %d\n", m_opt->m_prefetchThreadNum);
+                m_prefetchThreadPool = std::make_shared<SPDKThreadPool>();
+                m_prefetchThreadPool->initSPDK(max(1, m_opt->m_prefetchThreadNum), this);
+            }
             return true;
         }
 
@@ -1434,7 +1644,7 @@ namespace SPTAG::SPANN {
 
             auto exSetUpEnd = std::chrono::high_resolution_clock::now();
 
-            p_stats->m_exSetUpLatency = ((double)std::chrono::duration_cast<std::chrono::microseconds>(exSetUpEnd - exStart).count()) / 1000;
+            if (p_stats) p_stats->m_exSetUpLatency = ((double)std::chrono::duration_cast<std::chrono::microseconds>(exSetUpEnd - exStart).count()) / 1000;
 
             COMMON::QueryResultSet<ValueType>& queryResults = *((COMMON::QueryResultSet<ValueType>*) & p_queryResults);
 
@@ -1445,59 +1655,258 @@ namespace SPTAG::SPANN {
             double compLatency = 0;
             double readLatency = 0;
 
-            std::vector<std::string> postingLists;
-
-            std::chrono::microseconds remainLimit = m_hardLatencyLimit - std::chrono::microseconds((int)p_stats->m_totalLatency);
+            std::chrono::microseconds remainLimit = m_hardLatencyLimit - std::chrono::microseconds(p_stats ? (int)p_stats->m_totalLatency : 0);
 
-            auto readStart = std::chrono::high_resolution_clock::now();
-            db->MultiGet(p_exWorkSpace->m_postingIDs, &postingLists, remainLimit);
-            auto readEnd = std::chrono::high_resolution_clock::now();
+            if (p_exWorkSpace->m_ioBufferSource != m_ioBufferSource) PrepareIOBuffers(p_exWorkSpace);
+            std::size_t bufferSize = p_exWorkSpace->m_pageBuffers[0].GetPageSize();
+            std::vector<std::size_t>& postingSizes = p_exWorkSpace->m_readSizes;
 
-            for (uint32_t pi = 0; pi < postingLists.size(); ++pi) {
-                diskIO += ((postingLists[pi].size() + PageSize - 1) >> PageSizeEx);
+            // Quantized postings are scanned with the ADC table of the query. With re-rank the approximate
+            // distances only pick the candidates, their full vectors decide the final order.
+            static thread_local std::vector<std::uint8_t> adcTable;
+            std::unique_ptr<COMMON::QueryResultSet<ValueType>> candidates;
+            COMMON::QueryResultSet<ValueType>* codedResults = &queryResults;
+            if (m_postingQuantizer) {
+                adcTable.resize(m_adcQuantizer->QuantizeSize());
+                m_adcQuantizer->QuantizeVector(queryResults.GetTarget(), adcTable.data());
+                if (m_fullVectorStore) {
+                    candidates.reset(new COMMON::QueryResultSet<ValueType>(queryResults.GetTarget(), max(m_opt->m_postingRerankNum, queryResults.GetResultNum())));
+                    codedResults = candidates.get();
+                }
             }
 
-            readLatency += ((double)std::chrono::duration_cast<std::chrono::microseconds>(readEnd - readStart).count());
-            for (uint32_t pi = 0; pi < postingLists.size(); ++pi) {
-                auto curPostingID = p_exWorkSpace->m_postingIDs[pi];
-                std::string& postingList = postingLists[pi];
-
-                int vectorNum = (int)(postingList.size() / m_vectorInfoSize);
-
-                int realNum = vectorNum;
-
-                diskRead += (int)(postingList.size());
-                listElements += vectorNum;
+            // Full vectors go to the strided batch kernel selected here once, a head index with its own quantizer
+            // compares them through its distance function.
+            COMMON::DistanceBatchCalcReturn<ValueType> distBatch = (p_index->m_pQuantizer == nullptr) ? COMMON::DistanceBatchCalcSelector<ValueType>(p_index->GetDistCalcMethod()) : nullptr;
+            const ValueType* target = (const ValueType*)queryResults.GetQuantizedTarget();
+            int currentSlots[ScanBlock];
+            SizeType currentIDs[ScanBlock];
+            int slots[ScanBlock];
+            SizeType slotIDs[ScanBlock];
+            float slotDists[ScanBlock];
+            const std::uint8_t* codes[ScanBlock];
+            int scannedNum = 0;
+
+            // returns the number of current vectors and adds all of them to scannedNum, the i-th has its ID and
+            // version at ids + i * idStride and its vector at vectors + i * vectorStride. Coded lists hold quantized
+            // vectors. Deleted vectors and stale replicas are dropped by the version filter before any distance.
+            auto scanVectors = [&](SizeType curPostingID, const char* ids, std::size_t idStride, const char* vectors, std::size_t vectorStride, int vectorNum, bool coded) {
+                int realNum = 0;
+                scannedNum += vectorNum;
 
                 auto compStart = std::chrono::high_resolution_clock::now();
-                for (int i = 0; i < vectorNum; i++) {
-                    char* vectorInfo = postingList.data() + i * m_vectorInfoSize;
-                    int vectorID = *(reinterpret_cast<int*>(vectorInfo));
-                    if (m_versionMap->Deleted(vectorID)) {
-                        realNum--;
-                        listElements--;
-                        continue;
+                for (int begin = 0; begin < vectorNum; begin += ScanBlock) {
+                    int end = min(begin + ScanBlock, vectorNum);
+                    int current = m_versionMap->FilterCurrent(ids + begin * idStride, idStride, end - begin, currentSlots, currentIDs);
+                    realNum += current;
+                    listElements += current;
+                    int live = 0;
+                    for (int c = 0; c < current; c++) {
+                        int i = begin + currentSlots[c];
+                        int vectorID = currentIDs[c];
+                        if(p_exWorkSpace->m_deduper.CheckAndSet(vectorID)) {
+                            listElements--;
+                            continue;
+                        }
+                        if (distBatch == nullptr && !coded) {
+                            queryResults.AddPoint(vectorID, p_index->ComputeDistance(target, vectors + i * vectorStride));
+                            continue;
+                        }
+                        slots[live] = i - begin;
+                        slotIDs[live++] = vectorID;
                     }
-                    if(p_exWorkSpace->m_deduper.CheckAndSet(vectorID)) {
-                        listElements--;
+                    if (live == 0) continue;
+
+                    if (coded) {
+                        for (int j = 0; j < live; j++) codes[j] = (const std::uint8_t*)(vectors + (begin + slots[j]) * vectorStride);
+                        m_adcQuantizer->L2Distances(adcTable.data(), codes, live, slotDists);
+                        for (int j = 0; j < live; j++) codedResults->AddPoint(slotIDs[j], slotDists[j]);
                         continue;
                     }
-                    auto distance2leaf = p_index->ComputeDistance(queryResults.GetQuantizedTarget(), vectorInfo + m_metaDataSize);
-                    queryResults.AddPoint(vectorID, distance2leaf);
+                    COMMON::DistanceUtils::ComputeSlotDistances(distBatch, target, vectors + begin * vectorStride, vectorStride, slots, live, m_opt->m_dim, slotDists);
+                    for (int j = 0; j < live; j++) queryResults.AddPoint(slotIDs[j], slotDists[j]);
                 }
                 auto compEnd = std::chrono::high_resolution_clock::now();
-                if (realNum <= m_mergeThreshold && !m_opt->m_inPlace) MergeAsync(p_index.get(), curPostingID);
 
                 compLatency += ((double)std::chrono::duration_cast<std::chrono::microseconds>(compEnd - compStart).count());
 
                 if (truth) {
                     for (int i = 0; i < vectorNum; ++i) {
-                        char* vectorInfo = postingList.data() + i * m_vectorInfoSize;
-                        int vectorID = *(reinterpret_cast<int*>(vectorInfo));
+                        int vectorID = *(reinterpret_cast<const int*>(ids + i * idStride));
                         if (truth->count(vectorID) != 0)
                             (*found)[curPostingID].insert(vectorID);
                     }
                 }
+                return realNum;
+            };
+
+            // Postings prefetched during the head search are scanned from the prefetch buffers,
+            // only the others are read below: readIDs[j] is m_postingIDs[readIndex[j]].
+            uint32_t postingCount = (uint32_t)p_exWorkSpace->m_postingIDs.size();
+            static thread_local std::vector<int> prefetchSlots;
+            static thread_local std::vector<SizeType> readIDs;
+            static thread_local std::vector<uint32_t> readIndex;
+            prefetchSlots.assign(postingCount, -1);
+            readIDs.clear();
+            readIndex.clear();
+
+            int prefetchCount = 0;
+            int prefetchHit = 0;
+            double prefetchIOLatency = 0;
+            double prefetchWaitLatency = 0;
+            if (!p_exWorkSpace->m_prefetchReads.empty()) {
+                bool prefetched = true;
+                auto waitStart = std::chrono::high_resolution_clock::now();
+                for (auto& read : p_exWorkSpace->m_prefetchReads) {
+                    try {
+                        prefetchIOLatency += read.get();
+                    }
+                    catch (std::exception&) {
+                        prefetched = false;
+                    }
+                }
+                auto waitEnd = std::chrono::high_resolution_clock::now();
+                prefetchWaitLatency = ((double)std::chrono::duration_cast<std::chrono::microseconds>(waitEnd - waitStart).count());
+
+                prefetchCount = (int)p_exWorkSpace->m_prefetchIDs.size();
+                if (prefetched) {
+                    for (uint32_t pi = 0; pi < postingCount; ++pi) {
+                        auto iter = std::find(p_exWorkSpace->m_prefetchIDs.begin(), p_exWorkSpace->m_prefetchIDs.end(), p_exWorkSpace->m_postingIDs[pi]);
+                        if (iter == p_exWorkSpace->m_prefetchIDs.end()) continue;
+                        prefetchSlots[pi] = (int)(iter - p_exWorkSpace->m_prefetchIDs.begin());
+                        prefetchHit++;
+                    }
+                }
+                p_exWorkSpace->m_prefetchReads.clear();
+                p_exWorkSpace->m_prefetchIDs.clear();
+            }
+            for (uint32_t pi = 0; pi < postingCount; ++pi) {
+                if (prefetchSlots[pi] >= 0) continue;
+                readIDs.push_back(p_exWorkSpace->m_postingIDs[pi]);
+                readIndex.push_back(pi);
+            }
+
+            // Buffered vectors are copied before the postings are read: a flush writes the storage before it
+            // drops the delta, so every vector is seen at least once and the deduper hides the second copy.
+            // The copies of prefetched postings were taken before their reads were issued.
+            static thread_local std::vector<std::string> deltas;
+            if (m_deltaBuffer.Enabled()) {
+                deltas.resize(postingCount);
+                for (uint32_t pi = 0; pi < postingCount; ++pi) {
+                    deltas[pi].clear();
+                    if (prefetchSlots[pi] >= 0) deltas[pi].swap(p_exWorkSpace->m_prefetchDeltas[prefetchSlots[pi]]);
+                    else m_deltaBuffer.Get(p_exWorkSpace->m_postingIDs[pi], &deltas[pi]);
+                }
+            }
+
+            auto scanPosting = [&](uint32_t pi, char* postingList, std::size_t postingSize) {
+                auto curPostingID = p_exWorkSpace->m_postingIDs[pi];
+                diskRead += (int)(postingSize);
+
+                int realNum = 0;
+                scannedNum = 0;
+                if (m_alignedIO) {
+                    m_alignedIO->ForEachSegment(postingList, postingSize, [&](const char* ids, const char* vectors, int vectorNum) {
+                        realNum += scanVectors(curPostingID, ids, m_metaDataSize, vectors, m_alignedIO->VectorStride(), vectorNum, false);
+                    });
+                }
+                else {
+                    realNum = scanVectors(curPostingID, postingList, m_storedInfoSize, postingList + m_metaDataSize, m_storedInfoSize, (int)(postingSize / m_storedInfoSize), m_postingQuantizer != nullptr);
+                }
+                if (m_deltaBuffer.Enabled() && !deltas[pi].empty()) {
+                    const char* delta = deltas[pi].data();
+                    realNum += scanVectors(curPostingID, delta, m_vectorInfoSize, delta + m_metaDataSize, m_vectorInfoSize, (int)(deltas[pi].size() / m_vectorInfoSize), false);
+                }
+                if (realNum <= m_mergeThreshold && !m_opt->m_inPlace) MergeAsync(p_index.get(), curPostingID);
+                else if (IsGarbageHeavy(realNum, scannedNum)) GCAsync(p_index.get(), curPostingID);
+            };
+
+            std::string overflowPosting;
+            auto scanOverflow = [&](uint32_t pi) {
+                // only postings beyond the storage limit take this copy
+                m_rawDB->Get(p_exWorkSpace->m_postingIDs[pi], &overflowPosting);
+                scanPosting(pi, (char*)overflowPosting.data(), overflowPosting.size());
+            };
+
+            std::vector<bool> scanned(postingCount, false);
+            for (uint32_t pi = 0; pi < postingCount; ++pi) {
+                if (prefetchSlots[pi] < 0) continue;
+                std::size_t postingSize = p_exWorkSpace->m_prefetchSizes[prefetchSlots[pi]];
+                diskIO += (int)((postingSize + PageSize - 1) >> PageSizeEx);
+                if (postingSize > bufferSize) scanOverflow(pi);
+                else scanPosting(pi, (char*)(p_exWorkSpace->m_prefetchBuffers[prefetchSlots[pi]]), postingSize);
+                scanned[pi] = true;
+            }
+
+            postingSizes.clear();
+            if (!readIDs.empty() && !m_opt->m_pipelinedSearch) {
+                auto readStart = std::chrono::high_resolution_clock::now();
+                m_rawDB->MultiGet(readIDs, p_exWorkSpace->m_readBuffers, bufferSize, &postingSizes, remainLimit);
+                auto readEnd = std::chrono::high_resolution_clock::now();
+
+                for (uint32_t j = 0; j < postingSizes.size(); ++j) {
+                    diskIO += ((postingSizes[j] + PageSize - 1) >> PageSizeEx);
+                }
+
+                readLatency += ((double)std::chrono::duration_cast<std::chrono::microseconds>(readEnd - readStart).count());
+                for (uint32_t j = 0; j < postingSizes.size(); ++j) {
+                    if (postingSizes[j] > bufferSize) scanOverflow(readIndex[j]);
+                    else scanPosting(readIndex[j], (char*)(p_exWorkSpace->m_readBuffers[j]), postingSizes[j]);
+                }
+            }
+            else if (!readIDs.empty()) {
+                // Postings are scanned in completion order while the remaining reads are in flight.
+                // m_postingIDs is sorted by head distance, so once the closest unscanned head is
+                // farther than EarlyStopDistRatio times the current worst result the rest are skipped.
+                bool useEarlyStop = m_opt->m_earlyStopDistRatio > 0 && p_exWorkSpace->m_postingDists.size() == postingCount;
+                uint32_t firstUnscanned = 0;
+                while (firstUnscanned < postingCount && scanned[firstUnscanned]) firstUnscanned++;
+                bool stopped = false;
+                double scanLatency = compLatency;
+
+                auto readStart = std::chrono::high_resolution_clock::now();
+                m_rawDB->MultiGet(readIDs, p_exWorkSpace->m_readBuffers, bufferSize, &postingSizes, remainLimit,
+                    [&](std::size_t j) -> bool {
+                        // an oversized posting needs another read, which must wait until the batch is drained
+                        if (postingSizes[j] > bufferSize) return true;
+
+                        uint32_t pi = readIndex[j];
+                        scanPosting(pi, (char*)(p_exWorkSpace->m_readBuffers[j]), postingSizes[j]);
+                        scanned[pi] = true;
+                        while (firstUnscanned < postingCount && scanned[firstUnscanned]) firstUnscanned++;
+
+                        if (useEarlyStop && firstUnscanned < postingCount && queryResults.worstDist() < MaxDist &&
+                            p_exWorkSpace->m_postingDists[firstUnscanned] > queryResults.worstDist() * m_opt->m_earlyStopDistRatio) {
+                            stopped = true;
+                            return false;
+                        }
+                        return true;
+                    });
+                auto readEnd = std::chrono::high_resolution_clock::now();
+
+                for (uint32_t j = 0; j < postingSizes.size(); ++j) {
+                    diskIO += ((postingSizes[j] + PageSize - 1) >> PageSizeEx);
+                }
+
+                // time spent scanning inside the callbacks is not read latency
+                readLatency += ((double)std::chrono::duration_cast<std::chrono::microseconds>(readEnd - readStart).count()) - (compLatency - scanLatency);
+                if (!stopped) {
+                    for (uint32_t j = 0; j < postingSizes.size(); ++j) {
+                        if (!scanned[readIndex[j]] && postingSizes[j] > bufferSize) scanOverflow(readIndex[j]);
+                    }
+                }
+            }
+
+            if (candidates) {
+                static thread_local std::vector<ValueType> fullVector;
+                fullVector.resize(m_opt->m_dim);
+                for (int i = 0; i < candidates->GetResultNum(); i++) {
+                    BasicResult* candidate = candidates->GetResult(i);
+                    if (candidate->VID < 0 || m_fullVectorStore->Get(candidate->VID, fullVector.data()) != ErrorCode::Success) continue;
+                    queryResults.AddPoint(candidate->VID, p_index->ComputeDistance(queryResults.GetQuantizedTarget(), fullVector.data()));
+                    diskRead += (int)(m_opt->m_dim * sizeof(ValueType));
+                    diskIO++;
+                }
             }
 
             if (p_stats)
@@ -1507,9 +1916,261 @@ namespace SPTAG::SPANN {
                 p_stats->m_totalListElementsCount = listElements;
                 p_stats->m_diskIOCount = diskIO;
                 p_stats->m_diskAccessCount = diskRead / 1024;
+                p_stats->m_headPrefetchCount = prefetchCount;
+                p_stats->m_headPrefetchHit = prefetchHit;
+                p_stats->m_prefetchIOLatency = prefetchIOLatency / 1000;
+                p_stats->m_prefetchWaitLatency = prefetchWaitLatency / 1000;
+                p_stats->m_headOverlapLatency = max(0.0, prefetchIOLatency - prefetchWaitLatency) / 1000;
+            }
+
+            if (m_backgroundPool) {
+                auto exEnd = std::chrono::high_resolution_clock::now();
+                m_backgroundPool->ReportLatency(RequestLatency(p_stats, ((double)std::chrono::duration_cast<std::chrono::microseconds>(exEnd - exStart).count()) / 1000));
             }
         }
 
+        // latency of a query in ms since its stamped request time, p_exLatency of the posting search alone when unstamped
+        static double RequestLatency(const SearchStats* p_stats, double p_exLatency)
+        {
+            if (p_stats == nullptr || p_stats->m_searchRequestTime.time_since_epoch().count() == 0) return p_exLatency;
+            return ((double)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - p_stats->m_searchRequestTime).count()) / 1000;
+        }
+
+        // Reads every posting of the batch once and scans it against all the queries that selected it. The live
+        // vectors of a posting are taken in ScanBlock blocks that stay in cache while each interested query goes over them.
+        void SearchIndexBatch(ExtraWorkSpace* p_exWorkSpace,
+            std::vector<QueryResult*>& p_queryResults,
+            const std::vector<std::vector<SizeType>>& p_postingIDs,
+            std::shared_ptr<VectorIndex> p_index,
+            SearchStats* p_stats) override
+        {
+            // quantized postings are scanned with an ADC table and a candidate set of their own query
+            if (m_postingQuantizer || p_queryResults.size() <= 1) {
+                IExtraSearcher::SearchIndexBatch(p_exWorkSpace, p_queryResults, p_postingIDs, p_index, p_stats);
+                return;
+            }
+
+            auto exStart = std::chrono::high_resolution_clock::now();
+            int queryNum = (int)p_queryResults.size();
+
+            // (posting, query) pairs sorted by posting, the queries of postings[k] are requests[firstRequest[k]..firstRequest[k + 1])
+            static thread_local std::vector<std::pair<SizeType, int>> requests;
+            static thread_local std::vector<SizeType> postings;
+            static thread_local std::vector<std::size_t> firstRequest;
+            requests.clear();
+            for (int q = 0; q < queryNum; q++) {
+                for (SizeType postingID : p_postingIDs[q]) requests.emplace_back(postingID, q);
+            }
+            std::sort(requests.begin(), requests.end());
+            requests.erase(std::unique(requests.begin(), requests.end()), requests.end());
+            postings.clear();
+            firstRequest.clear();
+            for (std::size_t r = 0; r < requests.size(); r++) {
+                if (r > 0 && requests[r].first == requests[r - 1].first) continue;
+                postings.push_back(requests[r].first);
+                firstRequest.push_back(r);
+            }
+            firstRequest.push_back(requests.size());
+
+            static thread_local std::vector<std::unique_ptr<COMMON::OptHashPosVector>> dedupers;
+            while (dedupers.size() < (std::size_t)queryNum) {
+                dedupers.emplace_back(new COMMON::OptHashPosVector());
+                dedupers.back()->Init(m_opt->m_maxCheck, m_opt->m_hashExp);
+            }
+            for (int q = 0; q < queryNum; q++) dedupers[q]->clear();
+
+            int diskRead = 0;
+            int diskIO = 0;
+            int listElements = 0;
+
+            double compLatency = 0;
+            double readLatency = 0;
+
+            if (p_exWorkSpace->m_ioBufferSource != m_ioBufferSource) PrepareIOBuffers(p_exWorkSpace);
+            std::size_t bufferSize = p_exWorkSpace->m_pageBuffers[0].GetPageSize();
+            std::size_t bufferNum = p_exWorkSpace->m_readBuffers.size();
+            std::vector<std::size_t>& postingSizes = p_exWorkSpace->m_readSizes;
+
+            COMMON::DistanceBatchCalcReturn<ValueType> distBatch = (p_index->m_pQuantizer == nullptr) ? COMMON::DistanceBatchCalcSelector<ValueType>(p_index->GetDistCalcMethod()) : nullptr;
+            int blockSlots[ScanBlock];
+            SizeType blockIDs[ScanBlock];
+            int querySlots[ScanBlock];
+            SizeType queryIDs[ScanBlock];
+            float queryDists[ScanBlock];
+
+            int scannedNum = 0;
+
+            // returns the number of current vectors and adds all of them to scannedNum, laid out as in SearchIndex
+            auto scanVectors = [&](std::size_t k, const char* ids, std::size_t idStride, const char* vectors, std::size_t vectorStride, int vectorNum) {
+                int realNum = 0;
+                scannedNum += vectorNum;
+                auto compStart = std::chrono::high_resolution_clock::now();
+                for (int begin = 0; begin < vectorNum; begin += ScanBlock) {
+                    int end = min(begin + ScanBlock, vectorNum);
+                    const char* blockVectors = vectors + (std::size_t)begin * vectorStride;
+                    int live = m_versionMap->FilterCurrent(ids + (std::size_t)begin * idStride, idStride, end - begin, blockSlots, blockIDs);
+                    realNum += live;
+
+                    for (std::size_t r = firstRequest[k]; r < firstRequest[k + 1]; r++) {
+                        int q = requests[r].second;
+                        COMMON::QueryResultSet<ValueType>& queryResults = *((COMMON::QueryResultSet<ValueType>*)p_queryResults[q]);
+                        const ValueType* target = (const ValueType*)queryResults.GetQuantizedTarget();
+                        COMMON::OptHashPosVector& deduper = *(dedupers[q]);
+                        int fresh = 0;
+                        for (int i = 0; i < live; i++) {
+                            if (deduper.CheckAndSet(blockIDs[i])) continue;
+                            if (distBatch == nullptr) {
+                                queryResults.AddPoint(blockIDs[i], p_index->ComputeDistance(target, blockVectors + (std::size_t)blockSlots[i] * vectorStride));
+                                listElements++;
+                                continue;
+                            }
+                            querySlots[fresh] = blockSlots[i];
+                            queryIDs[fresh++] = blockIDs[i];
+                        }
+                        if (fresh == 0) continue;
+
+                        COMMON::DistanceUtils::ComputeSlotDistances(distBatch, target, blockVectors, vectorStride, querySlots, fresh, m_opt->m_dim, queryDists);
+                        for (int i = 0; i < fresh; i++) queryResults.AddPoint(queryIDs[i], queryDists[i]);
+                        listElements += fresh;
+                    }
+                }
+                auto compEnd = std::chrono::high_resolution_clock::now();
+                compLatency += ((double)std::chrono::duration_cast<std::chrono::microseconds>(compEnd - compStart).count());
+                return realNum;
+            };
+
+            static thread_local std::vector<SizeType> readIDs;
+            static thread_local std::vector<std::string> deltas;
+            auto scanPosting = [&](std::size_t k, char* postingList, std::size_t postingSize) {
+                diskRead += (int)(postingSize);
+                int realNum = 0;
+                scannedNum = 0;
+                if (m_alignedIO) {
+                    m_alignedIO->ForEachSegment(postingList, postingSize, [&](const char* ids, const char* vectors, int vectorNum) {
+                        realNum += scanVectors(k, ids, m_metaDataSize, vectors, m_alignedIO->VectorStride(), vectorNum);
+                    });
+                }
+                else {
+                    realNum = scanVectors(k, postingList, m_vectorInfoSize, postingList + m_metaDataSize, m_vectorInfoSize, (int)(postingSize / m_vectorInfoSize));
+                }
+                std::string& delta = deltas[k % bufferNum];
+                if (m_deltaBuffer.Enabled() && !delta.empty()) {
+                    realNum += scanVectors(k, delta.data(), m_vectorInfoSize, delta.data() + m_metaDataSize, m_vectorInfoSize, (int)(delta.size() / m_vectorInfoSize));
+                }
+                if (realNum <= m_mergeThreshold && !m_opt->m_inPlace) MergeAsync(p_index.get(), postings[k]);
+                else if (IsGarbageHeavy(realNum, scannedNum)) GCAsync(p_index.get(), postings[k]);
+            };
+
+            // the distinct postings are read in rounds of one posting per read buffer, each one scanned as its read completes
+            std::string overflowPosting;
+            deltas.resize(bufferNum);
+            for (std::size_t begin = 0; begin < postings.size(); begin += bufferNum) {
+                std::size_t end = min(begin + bufferNum, postings.size());
+                readIDs.assign(postings.begin() + begin, postings.begin() + end);
+                // copied before the read for the same reason as in SearchIndex
+                if (m_deltaBuffer.Enabled()) {
+                    for (std::size_t k = begin; k < end; k++) {
+                        deltas[k - begin].clear();
+                        m_deltaBuffer.Get(postings[k], &deltas[k - begin]);
+                    }
+                }
+
+                double scanLatency = compLatency;
+                auto readStart = std::chrono::high_resolution_clock::now();
+                m_rawDB->MultiGet(readIDs, p_exWorkSpace->m_readBuffers, bufferSize, &postingSizes, m_hardLatencyLimit,
+                    [&](std::size_t j) -> bool {
+                        if (postingSizes[j] <= bufferSize) scanPosting(begin + j, (char*)(p_exWorkSpace->m_readBuffers[j]), postingSizes[j]);
+                        return true;
+                    });
+                auto readEnd = std::chrono::high_resolution_clock::now();
+                readLatency += ((double)std::chrono::duration_cast<std::chrono::microseconds>(readEnd - readStart).count()) - (compLatency - scanLatency);
+
+                for (std::size_t j = 0; j < postingSizes.size(); ++j) {
+                    diskIO += (int)((postingSizes[j] + PageSize - 1) >> PageSizeEx);
+                    if (postingSizes[j] <= bufferSize) continue;
+                    m_rawDB->Get(postings[begin + j], &overflowPosting);
+                    scanPosting(begin + j, (char*)overflowPosting.data(), overflowPosting.size());
+                }
+            }
+
+            auto exEnd = std::chrono::high_resolution_clock::now();
+            double exLatency = ((double)std::chrono::duration_cast<std::chrono::microseconds>(exEnd - exStart).count()) / 1000;
+            if (p_stats)
+            {
+                p_stats->m_compLatency += compLatency / 1000;
+                p_stats->m_diskReadLatency += readLatency / 1000;
+                p_stats->m_totalListElementsCount += listElements;
+                p_stats->m_diskIOCount += diskIO;
+                p_stats->m_diskAccessCount += diskRead / 1024;
+            }
+            // every query of the batch waited for the whole of it
+            if (m_backgroundPool) {
+                double latency = RequestLatency(p_stats, exLatency);
+                for (int q = 0; q < queryNum; q++) m_backgroundPool->ReportLatency(latency);
+            }
+        }
+
+        bool PrefetchPostings(ExtraWorkSpace* p_exWorkSpace, const std::vector<SizeType>& p_postingIDs) override {
+            if (m_prefetchThreadPool == nullptr) return false;
+            if (p_exWorkSpace->m_ioBufferSource != m_ioBufferSource) PrepareIOBuffers(p_exWorkSpace);
+
+            std::size_t offset = p_exWorkSpace->m_prefetchIDs.size();
+            std::size_t count = min(p_postingIDs.size(), p_exWorkSpace->m_prefetchBuffers.size() - offset);
+            if (count == 0) return false;
+
+            std::vector<SizeType> keys(p_postingIDs.begin(), p_postingIDs.begin() + count);
+            p_exWorkSpace->m_prefetchIDs.insert(p_exWorkSpace->m_prefetchIDs.end(), keys.begin(), keys.end());
+            if (m_deltaBuffer.Enabled()) {
+                for (std::size_t i = 0; i < count; i++) {
+                    p_exWorkSpace->m_prefetchDeltas[offset + i].clear();
+                    m_deltaBuffer.Get(keys[i], &(p_exWorkSpace->m_prefetchDeltas[offset + i]));
+                }
+            }
+
+            PrefetchAsyncJob* curJob = new PrefetchAsyncJob(this, p_exWorkSpace, std::move(keys), offset);
+            p_exWorkSpace->m_prefetchReads.emplace_back(curJob->GetFuture());
+            m_prefetchThreadPool->add(curJob);
+            return true;
+        }
+
+        // runs on a prefetch thread, returns the read time in microseconds
+        double ReadPrefetch(ExtraWorkSpace* p_exWorkSpace, const std::vector<SizeType>& p_keys, std::size_t p_offset) {
+            std::vector<std::uint8_t*> buffers(p_exWorkSpace->m_prefetchBuffers.begin() + p_offset, p_exWorkSpace->m_prefetchBuffers.begin() + p_offset + p_keys.size());
+            std::vector<std::size_t> sizes;
+
+            auto readStart = std::chrono::high_resolution_clock::now();
+            m_rawDB->MultiGet(p_keys, buffers, p_exWorkSpace->m_pageBuffers[0].GetPageSize(), &sizes, m_hardLatencyLimit);
+            auto readEnd = std::chrono::high_resolution_clock::now();
+
+            std::copy(sizes.begin(), sizes.end(), p_exWorkSpace->m_prefetchSizes.begin() + p_offset);
+            return ((double)std::chrono::duration_cast<std::chrono::microseconds>(readEnd - readStart).count());
+        }
+
+        // swap the workspace page buffers for ones allocated by the storage, MultiGet then reads into them in place
+        void PrepareIOBuffers(ExtraWorkSpace* p_exWorkSpace) {
+            std::size_t bufferSize = max(p_exWorkSpace->m_pageBuffers[0].GetPageSize(), m_postingBufferSize);
+            p_exWorkSpace->m_readBuffers.resize(p_exWorkSpace->m_pageBuffers.size());
+            for (std::size_t pi = 0; pi < p_exWorkSpace->m_pageBuffers.size(); pi++) {
+                p_exWorkSpace->m_pageBuffers[pi].SetPointer(m_rawDB->AllocateBuffer(bufferSize), bufferSize);
+                p_exWorkSpace->m_readBuffers[pi] = p_exWorkSpace->m_pageBuffers[pi].GetBuffer();
+            }
+            p_exWorkSpace->m_readSizes.reserve(p_exWorkSpace->m_pageBuffers.size());
+            if (m_prefetchThreadPool != nullptr) {
+                // sized once, the prefetch threads write into their own slots while more are handed out
+                std::size_t slots = p_exWorkSpace->m_pageBuffers.size();
+                p_exWorkSpace->m_prefetchPageBuffers.resize(slots);
+                p_exWorkSpace->m_prefetchBuffers.resize(slots);
+                for (std::size_t pi = 0; pi < slots; pi++) {
+                    p_exWorkSpace->m_prefetchPageBuffers[pi].SetPointer(m_rawDB->AllocateBuffer(bufferSize), bufferSize);
+                    p_exWorkSpace->m_prefetchBuffers[pi] = p_exWorkSpace->m_prefetchPageBuffers[pi].GetBuffer();
+                }
+                p_exWorkSpace->m_prefetchSizes.assign(slots, 0);
+                p_exWorkSpace->m_prefetchDeltas.resize(slots);
+                p_exWorkSpace->m_prefetchIDs.reserve(slots);
+            }
+            p_exWorkSpace->m_ioBufferSource = m_ioBufferSource;
+        }
+
         bool BuildIndex(std::shared_ptr<Helper::VectorSetReader>& p_reader, std::shared_ptr<VectorIndex> p_headIndex, Options& p_opt, COMMON::VersionLabel& p_versionMap, SizeType upperBound = -1) override {
             m_versionMap = &p_versionMap;
             m_opt = &p_opt;
@@ -1543,11 +2204,13 @@ namespace SPTAG::SPANN {
                 auto fullVectors = p_reader->GetVectorSet();
                 fullCount = fullVectors->Count();
                 m_vectorInfoSize = fullVectors->PerVectorDataSize() + m_metaDataSize;
+                m_storedInfoSize = m_vectorInfoSize;
             }
             if (upperBound > 0) fullCount = upperBound;
 
             // m_metaDataSize = sizeof(int) + sizeof(uint8_t) + sizeof(float);
             m_metaDataSize = sizeof(int) + sizeof(uint8_t);
+            if (!InitPostingQuantizer() || !InitAlignedPostings()) return false;
 
             LOG(Helper::LogLevel::LL_Info, "Build SSD Index.\n");
 
@@ -1647,8 +2310,9 @@ namespace SPTAG::SPANN {
             auto t3 = std::chrono::high_resolution_clock::now();
             LOG(Helper::LogLevel::LL_Info, "Time to sort selections:%.2lf sec.\n", ((double)std::chrono::duration_cast<std::chrono::seconds>(t3 - t2).count()) + ((double)std::chrono::duration_cast<std::chrono::milliseconds>(t3 - t2).count()) / 1000);
 
+            // the storage limit already counts aligned segments and quantized codes, in-place KV postings have none
             auto postingSizeLimit = m_postingSizeLimit;
-            if (m_opt->m_postingPageLimit > 0)
+            if (m_opt->m_postingPageLimit > 0 && m_postingSizeLimit == INT_MAX)
             {
                 postingSizeLimit = static_cast<int>(m_opt->m_postingPageLimit * PageSize / m_vectorInfoSize);
             }
@@ -1744,6 +2408,10 @@ namespace SPTAG::SPANN {
 
             std::vector<int> postingListSize_int(postingListSize.begin(), postingListSize.end());
 
+            if (m_fullVectorStore) {
+                for (SizeType i = 0; i < fullCount; i++) m_fullVectorStore->Put(i, fullVectors->GetVector(i));
+            }
+
             WriteDownAllPostingToDB(postingListSize_int, selections, fullVectors);
 
             m_postingSizes.Initialize((SizeType)(postingListSize.size()), p_headIndex->m_iDataBlockSize, p_headIndex->m_iDataCapacity);
@@ -1759,6 +2427,90 @@ namespace SPTAG::SPANN {
             return true;
         }
 
+        // Wrap the storage so postings are kept as PostingQuantizerFile codes. The records of the update paths carry
+        // the codes after the vector, so splits, merges and reassigns move them instead of quantizing again. The
+        // ADC flag of a quantizer instance decides what QuantizeVector produces, so two instances are loaded: one
+        // encodes/decodes postings, the other builds query tables.
+        bool InitPostingQuantizer() {
+            if (m_opt->m_postingQuantizerFile.empty() || m_postingQuantizer) return true;
+
+            std::shared_ptr<COMMON::IQuantizer> quantizers[2];
+            for (auto& quantizer : quantizers) {
+                auto ptr = SPTAG::f_createIO();
+                if (ptr == nullptr || !ptr->Initialize(m_opt->m_postingQuantizerFile.c_str(), std::ios::binary | std::ios::in)) {
+                    LOG(Helper::LogLevel::LL_Error, "Failed to open posting quantizer file %s\n", m_opt->m_postingQuantizerFile.c_str());
+                    return false;
+                }
+                quantizer = COMMON::IQuantizer::LoadIQuantizer(ptr);
+                if (!quantizer) {
+                    LOG(Helper::LogLevel::LL_Error, "Failed to load posting quantizer %s\n", m_opt->m_postingQuantizerFile.c_str());
+                    return false;
+                }
+            }
+            if (quantizers[0]->GetReconstructType() != GetEnumValueType<ValueType>() || quantizers[0]->ReconstructDim() != m_opt->m_dim) {
+                LOG(Helper::LogLevel::LL_Error, "Posting quantizer reconstructs %s vectors of dim %d, index has %s vectors of dim %d\n",
+                    Helper::Convert::ConvertToString(quantizers[0]->GetReconstructType()).c_str(), quantizers[0]->ReconstructDim(),
+                    Helper::Convert::ConvertToString(GetEnumValueType<ValueType>()).c_str(), m_opt->m_dim);
+                return false;
+            }
+            if (m_opt->m_distCalcMethod != DistCalcMethod::L2) {
+                LOG(Helper::LogLevel::LL_Error, "Posting codes approximate L2 distance only, %s index cannot use PostingQuantizerFile\n",
+                    Helper::Convert::ConvertToString(m_opt->m_distCalcMethod).c_str());
+                return false;
+            }
+            m_postingQuantizer = quantizers[0];
+            m_postingQuantizer->SetEnableADC(false);
+            m_adcQuantizer = quantizers[1];
+            m_adcQuantizer->SetEnableADC(true);
+
+            m_codeInfoSize = m_metaDataSize + m_postingQuantizer->GetNumSubvectors();
+            m_storedInfoSize = m_codeInfoSize;
+            m_vectorInfoSize += m_postingQuantizer->GetNumSubvectors();
+            m_quantizedIO.reset(new QuantizedKeyValueIO(m_rawDB, m_postingQuantizer, m_metaDataSize, m_vectorInfoSize, m_codeInfoSize));
+            db = m_quantizedIO;
+            if (m_postingSizeLimit != INT_MAX) m_postingSizeLimit = m_opt->m_postingPageLimit * PageSize / m_codeInfoSize;
+
+            if (m_opt->m_postingRerankNum > 0) {
+                std::string path = m_opt->m_fullVectorStorePath.empty() ? m_opt->m_indexDirectory + FolderSep + "fullvectors.bin" : m_opt->m_fullVectorStorePath;
+                m_fullVectorStore = std::make_shared<FullVectorStore>();
+                if (!m_fullVectorStore->Open(path, sizeof(ValueType) * m_opt->m_dim)) return false;
+            }
+            LOG(Helper::LogLevel::LL_Info, "Quantized postings: %d bytes per vector instead of %d, posting size limit: %d, re-rank: %d\n",
+                m_codeInfoSize, (int)(m_metaDataSize + sizeof(ValueType) * m_opt->m_dim), m_postingSizeLimit, m_opt->m_postingRerankNum);
+            return true;
+        }
+
+        // Wrap the storage so postings keep their IDs and versions ahead of PostingAlignment aligned vectors. The
+        // update paths still see records through the wrapper, search walks the stored segments in place.
+        bool InitAlignedPostings() {
+            if (m_opt->m_postingAlignment <= 0 || m_alignedIO) return true;
+            if (m_postingQuantizer) {
+                LOG(Helper::LogLevel::LL_Warning, "PostingAlignment is ignored for quantized postings\n");
+                return true;
+            }
+            if (m_opt->m_postingAlignment != 32 && m_opt->m_postingAlignment != 64) {
+                LOG(Helper::LogLevel::LL_Error, "PostingAlignment must be 0, 32 or 64, got %d\n", m_opt->m_postingAlignment);
+                return false;
+            }
+
+            // SPDK postings hold less than BufferLength pages more than PostingPageLimit. A posting written as one
+            // segment may fill PostingPageLimit pages, an append batch the BufferLength pages, and appended
+            // segments that would overflow are compacted by the wrapper.
+            std::size_t maxBytes = m_opt->m_useSPDK ? m_postingBufferSize - PageSize : 0;
+            m_alignedIO.reset(new AlignedKeyValueIO(m_rawDB, m_metaDataSize, m_vectorInfoSize, m_opt->m_postingAlignment, maxBytes));
+            db = m_alignedIO;
+            int rawLimit = m_postingSizeLimit;
+            if (m_opt->m_useSPDK) {
+                std::size_t postingBytes = (std::size_t)m_opt->m_postingPageLimit * PageSize, appendBytes = (std::size_t)m_opt->m_bufferLength * PageSize;
+                while (m_postingSizeLimit > 1 && m_alignedIO->SegmentSize(m_postingSizeLimit) > postingBytes) m_postingSizeLimit--;
+                while (m_appendBatchLimit > 1 && m_alignedIO->SegmentSize(m_appendBatchLimit) > appendBytes) m_appendBatchLimit--;
+            }
+            // the padding is the price of the alignment: fewer vectors fit the pages of a posting
+            LOG(Helper::LogLevel::LL_Info, "Aligned postings: %d byte alignment, %zu bytes per vector instead of %d, posting size limit: %d instead of %d, append batch limit: %d\n",
+                m_opt->m_postingAlignment, m_alignedIO->VectorStride() + m_metaDataSize, m_vectorInfoSize, m_postingSizeLimit, rawLimit, m_appendBatchLimit);
+            return true;
+        }
+
         void SavePostingSizesAndVersionMap(){
             LOG(Helper::LogLevel::LL_Info, "SPFresh: Writing SSD Info\n");
             m_postingSizes.Save(m_opt->m_ssdInfoFile);//ssdInfoFile stores the memory postings' ids and sizes
@@ -1810,6 +2562,8 @@ namespace SPTAG::SPANN {
         ErrorCode AddIndex(std::shared_ptr<VectorSet>& p_vectorSet,
             std::shared_ptr<VectorIndex> p_index, SizeType begin) override {
 
+            if (p_vectorSet->Count() > 1) return AddIndexBatch(p_vectorSet, p_index, begin);
+
             for (int v = 0; v < p_vectorSet->Count(); v++) {
                 SizeType VID = begin + v;
                 std::vector<Edge> selections(static_cast<size_t>(m_opt->m_replicaCount));
@@ -1817,6 +2571,7 @@ namespace SPTAG::SPANN {
                 RNGSelection(selections, (ValueType*)(p_vectorSet->GetVector(v)), p_index.get(), VID, replicaCount);
 
                 uint8_t version = m_versionMap->GetVersion(VID);
+                if (m_fullVectorStore) m_fullVectorStore->Put(VID, p_vectorSet->GetVector(v));
                 std::string appendPosting(m_vectorInfoSize, '\0');
                 Serialize((char*)(appendPosting.c_str()), VID, version, p_vectorSet->GetVector(v));//copy VID, version and raw vector data to variable appendPosting
                 for (int i = 0; i < replicaCount; i++)
@@ -1828,6 +2583,54 @@ namespace SPTAG::SPANN {
             return ErrorCode::Success;
         }
 
+        // Head search runs for the whole batch in parallel, then the vectors are grouped by target posting
+        // and every posting gets one Append. Postings are visited in ascending head ID and Append holds a
+        // single posting lock at a time, so concurrent batches cannot deadlock on each other.
+        // Batches usually come from several insert threads at once, so the head search only gets this
+        // caller's share of m_iSSDNumberOfThreads, and runs serially inside an enclosing parallel region.
+        ErrorCode AddIndexBatch(std::shared_ptr<VectorSet>& p_vectorSet,
+            std::shared_ptr<VectorIndex> p_index, SizeType begin) {
+
+            int vectorNum = (int)p_vectorSet->Count();
+            std::vector<std::vector<Edge>> selections(vectorNum, std::vector<Edge>(static_cast<size_t>(m_opt->m_replicaCount)));
+            std::vector<int> replicaCounts(vectorNum, 0);
+            int inserters = ++m_batchInserters;
+            int numThreads = omp_in_parallel() ? 1 : max(1, min(m_opt->m_iSSDNumberOfThreads / inserters, vectorNum));
+#pragma omp parallel for schedule(dynamic) num_threads(numThreads)
+            for (int v = 0; v < vectorNum; v++) {
+                RNGSelection(selections[v], (ValueType*)(p_vectorSet->GetVector(v)), p_index.get(), begin + v, replicaCounts[v]);
+            }
+            m_batchInserters--;
+
+            std::map<SizeType, std::pair<int, std::string>> appendPostings;
+            std::string vectorInfo(m_vectorInfoSize, '\0');
+            for (int v = 0; v < vectorNum; v++) {
+                SizeType VID = begin + v;
+                uint8_t version = m_versionMap->GetVersion(VID);
+                if (m_fullVectorStore) m_fullVectorStore->Put(VID, p_vectorSet->GetVector(v));
+                Serialize((char*)(vectorInfo.c_str()), VID, version, p_vectorSet->GetVector(v));
+                for (int i = 0; i < replicaCounts[v]; i++) {
+                    auto& appendPosting = appendPostings[selections[v][i].node];
+                    appendPosting.first++;
+                    appendPosting.second.append(vectorInfo);
+                }
+            }
+
+            for (auto& iter : appendPostings) {
+                int appendNum = iter.second.first;
+                if (appendNum <= m_appendBatchLimit) {
+                    Append(p_index.get(), iter.first, appendNum, iter.second.second);
+                    continue;
+                }
+                for (int start = 0; start < appendNum; start += m_appendBatchLimit) {
+                    int num = min(m_appendBatchLimit, appendNum - start);
+                    std::string appendPosting = iter.second.second.substr((size_t)start * m_vectorInfoSize, (size_t)num * m_vectorInfoSize);
+                    Append(p_index.get(), iter.first, num, appendPosting);
+                }
+            }
+            return ErrorCode::Success;
+        }
+
         SizeType SearchVector(std::shared_ptr<VectorSet>& p_vectorSet,
             std::shared_ptr<VectorIndex> p_index, int testNum = 64, SizeType VID = -1) override {
             
@@ -1839,6 +2642,7 @@ namespace SPTAG::SPANN {
             for (int i = 0; i < queryResults.GetResultNum(); ++i)
             {
                 db->Get(queryResults.GetResult(i)->VID, &postingList);
+                m_deltaBuffer.Get(queryResults.GetResult(i)->VID, &postingList);
                 int vectorNum = (int)(postingList.size() / m_vectorInfoSize);
 
                 for (int j = 0; j < vectorNum; j++) {
@@ -1863,11 +2667,81 @@ namespace SPTAG::SPANN {
             }
         }
 
-        bool AllFinished() { return m_splitThreadPool->allClear() && m_reassignThreadPool->allClear(); }
-        void ForceCompaction() override { db->ForceCompaction(); }
+        bool AllFinished() { return m_backgroundPool->allClear() && (!m_flushThreadPool || m_flushThreadPool->allClear()); }
+        std::size_t PendingUpdateJobs() override {
+            // without m_update no background pool is started and nothing is queued
+            if (m_backgroundPool == nullptr) return 0;
+            return m_backgroundPool->jobsize((int)JobClass::Split) + m_backgroundPool->jobsize((int)JobClass::Reassign);
+        }
+        void ForceCompaction() override {
+            FlushAllDeltas();
+            if (m_wal) {
+                // everything logged before the snapshot is covered by it
+                m_wal->Truncate([this]() {
+                    db->ForceCompaction();
+                    SavePostingSizesAndVersionMap();
+                    return ErrorCode::Success;
+                });
+                return;
+            }
+            db->ForceCompaction();
+        }
+
+        // Replays the log on top of the loaded snapshots, then logs every later mapping/version/size update. Without
+        // p_replay the current state is snapshotted instead, a log left by a build or copy that never finished is dropped.
+        void OpenWriteAheadLog(bool p_replay) {
+            std::string prefix = m_opt->m_walPath.empty() ? m_opt->m_indexDirectory + FolderSep + "wal" : m_opt->m_walPath;
+            m_wal = std::make_shared<WriteAheadLog>();
+            if (m_wal->Open(prefix, m_opt->m_walGroupCommitMicros, ((std::uint64_t)m_opt->m_walCheckpointMB) << 20) != ErrorCode::Success) {
+                LOG(Helper::LogLevel::LL_Error, "Fail to open write-ahead log %s\n", prefix.c_str());
+                exit(1);
+            }
+
+            SPDKIO* spdkIO = dynamic_cast<SPDKIO*>(m_rawDB.get());
+            if (p_replay) {
+                m_wal->Replay([&](WriteAheadLog::RecordType type, SizeType key, const char* payload, std::uint16_t length) {
+                    switch (type) {
+                    case WriteAheadLog::RecordType::Version:
+                        m_versionMap->SetVersion(key, *((std::uint8_t*)payload));
+                        break;
+                    case WriteAheadLog::RecordType::PostingSize:
+                        m_postingSizes.SetSize(key, *((int*)payload));
+                        break;
+                    default:
+                        if (spdkIO != nullptr) spdkIO->ReplayRecord(type, key, payload, length);
+                    }
+                });
+            }
+
+            WriteAheadLog* wal = m_wal.get();
+            m_versionMap->SetUpdateCallback([wal](const SizeType& key, std::uint8_t version) {
+                wal->Append(WriteAheadLog::RecordType::Version, key, &version, sizeof(version));
+            });
+            m_postingSizes.SetUpdateCallback([wal](const SizeType& key, int size) {
+                wal->Append(WriteAheadLog::RecordType::PostingSize, key, &size, sizeof(size));
+            });
+            if (spdkIO != nullptr) spdkIO->SetWriteAheadLog(m_wal);
+            if (!p_replay) ForceCompaction();
+        }
+
+        bool Recovered() override { return m_recovered; }
+
+        void FinishCopy() override {
+            if (m_opt->m_enableWAL && !m_wal) OpenWriteAheadLog(false);
+        }
+
+        int GetPostingSize(SizeType postingID) override { return m_postingSizes.GetSize(postingID); }
+
         void GetDBStats() override { 
             db->GetStat();
-            LOG(Helper::LogLevel::LL_Info, "remain splitJobs: %d, reassignJobs: %d, running split: %d, running reassign: %d\n", m_splitThreadPool->jobsize(), m_reassignThreadPool->jobsize(), m_splitThreadPool->runningJobs(), m_reassignThreadPool->runningJobs());
+            if (m_wal) m_wal->GetStat();
+            if (m_deltaBuffer.Enabled()) LOG(Helper::LogLevel::LL_Info, "delta buffer: %zu bytes, remain flushJobs: %d\n", m_deltaBuffer.GetBytes(), m_flushThreadPool->jobsize());
+            const char* jobClassNames[] = { "split", "merge", "reassign", "gc" };
+            for (int c = 0; c < (int)JobClass::Count; c++) {
+                LOG(Helper::LogLevel::LL_Info, "%s jobs: queued %zu, running %u, avg wait %.3lf ms\n",
+                    jobClassNames[c], m_backgroundPool->jobsize(c), m_backgroundPool->runningJobs(c), m_backgroundPool->averageWait(c));
+            }
+            if (m_backgroundPool->Throttled()) LOG(Helper::LogLevel::LL_Info, "background throttled, search latency p99: %.3lf ms\n", m_backgroundPool->LatencyP99());
             LOG(Helper::LogLevel::LL_Info, "current posting num in postingSizes: %d\n", m_postingSizes.GetPostingNum());
         }
 
@@ -1892,12 +2766,24 @@ namespace SPTAG::SPANN {
 
         void GetWritePosting(SizeType pid, std::string& posting, bool write = false) override { 
             if (write) {
+                if (m_quantizedIO) {
+                    // the copied postings hold [VID][version][vector] records, their codes are added here
+                    std::size_t rawInfoSize = m_metaDataSize + sizeof(ValueType) * m_opt->m_dim;
+                    std::size_t num = posting.size() / rawInfoSize;
+                    std::string records(num * m_vectorInfoSize, '\0');
+                    for (std::size_t i = 0; i < num; i++) {
+                        memcpy(&records[i * m_vectorInfoSize], posting.data() + i * rawInfoSize, rawInfoSize);
+                        m_quantizedIO->FillCode(&records[i * m_vectorInfoSize]);
+                    }
+                    posting.swap(records);
+                }
                 db->Put(pid, posting);
                 m_postingSizes.UpdateSize(pid, posting.size() / m_vectorInfoSize);
                 // LOG(Helper::LogLevel::LL_Info, "PostingSize: %d\n", m_postingSizes.GetSize(pid));
                 // exit(1);
             } else {
                 db->Get(pid, &posting);
+                m_deltaBuffer.Get(pid, &posting);
             }
         }
 
@@ -2022,11 +2908,18 @@ namespace SPTAG::SPANN {
     private:
 
         int m_metaDataSize = 0;
+
+        // size of a posting record on the storage, m_vectorInfoSize unless postings are quantized
+        int m_storedInfoSize = 0;
+        int m_codeInfoSize = 0;
         
         int m_vectorInfoSize = 0;
 
         int m_postingSizeLimit = INT_MAX;
 
+        // most vectors one Append may carry, so a batched append never overruns the spare blocks of a posting
+        int m_appendBatchLimit = INT_MAX;
+
         std::chrono::microseconds m_hardLatencyLimit = std::chrono::microseconds(2000);
 
         int m_mergeThreshold = 10;
@@ -30,14 +30,18 @@ namespace SPTAG::SPANN
             bool FullMergeV2(const rocksdb::MergeOperator::MergeOperationInput& merge_in,
                 rocksdb::MergeOperator::MergeOperationOutput* merge_out) const override
             {
-                size_t length = (merge_in.existing_value)->size();
+                // existing_value is null when the first write to a posting is a merge
+                size_t existingSize = (merge_in.existing_value != nullptr) ? (merge_in.existing_value)->size() : 0;
+                size_t length = existingSize;
                 for (const rocksdb::Slice& s : merge_in.operand_list) {
                     length += s.size();
                 }
                 (merge_out->new_value).resize(length);
-                memcpy((char*)((merge_out->new_value).c_str()), 
-                    (merge_in.existing_value)->data(), (merge_in.existing_value)->size());
-                size_t start = (merge_in.existing_value)->size();
+                if (existingSize > 0) {
+                    memcpy((char*)((merge_out->new_value).c_str()),
+                        (merge_in.existing_value)->data(), existingSize);
+                }
+                size_t start = existingSize;
                 for (const rocksdb::Slice& s : merge_in.operand_list) {
                     memcpy((char*)((merge_out->new_value).c_str() + start), s.data(), s.size());
                     start += s.size();
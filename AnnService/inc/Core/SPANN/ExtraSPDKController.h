@@ -8,12 +8,18 @@
 #include "inc/Core/Common/Dataset.h"
 #include "inc/Core/VectorIndex.h"
 #include "inc/Helper/ThreadPool.h"
+#include "inc/Core/SPANN/WriteAheadLog.h"
 #include <cstdlib>
+#include <deque>
 #include <memory>
 #include <atomic>
 #include <mutex>
 #include <tbb/concurrent_queue.h>
 #include <tbb/concurrent_hash_map.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 extern "C" {
 #include "spdk/env.h"
@@ -39,8 +45,16 @@ namespace SPTAG::SPANN
             static constexpr const char* kSpdkBdevNameEnv = "SPFRESH_SPDK_BDEV";
             static constexpr const char* kSpdkIoDepth = "SPFRESH_SPDK_IO_DEPTH";
             static constexpr int kSsdSpdkDefaultIoDepth = 1024;
+            static constexpr const char* kSpdkMaxIoPagesEnv = "SPFRESH_SPDK_MAX_IO_PAGES";
+            static constexpr int kSpdkDefaultMaxIoPages = 8; // 32KB
 
+            // released blocks, reused first by single page allocations
             tbb::concurrent_queue<AddressType> m_blockAddresses;
+            // blocks in [m_nextFreshBlock, m_maxNumBlocks) have never been handed out, multi-page allocations cut contiguous extents from here
+            std::atomic<AddressType> m_nextFreshBlock = 0;
+            AddressType m_maxNumBlocks = 0;
+            // adjacent blocks are coalesced into one I/O of at most m_maxIoPages pages
+            int m_maxIoPages = kSpdkDefaultMaxIoPages;
 
             bool m_useSsdImpl = false;
             const char* m_ssdSpdkBdevName = nullptr;
@@ -57,8 +71,10 @@ namespace SPTAG::SPANN
                 tbb::concurrent_queue<SubIoRequest *>* completed_sub_io_requests;
                 void* app_buff;
                 void* dma_buff;
+                void* io_buff; // when set the device transfers straight from/to here instead of dma_buff
                 AddressType real_size;
                 AddressType offset;
+                AddressType blocks;
                 bool is_read;
                 BlockController* ctrl;
                 int posting_id;
@@ -80,9 +96,16 @@ namespace SPTAG::SPANN
             std::mutex m_initMutex;
             int m_numInitCalled = 0;
 
+            std::mutex m_ioBufferMutex;
+            std::vector<void*> m_ioBuffers;
+
             int m_batchSize;
-            static int m_ioCompleteCount;
-            int m_preIOCompleteCount = 0;
+            static std::atomic<std::int64_t> m_ioCompleteCount;
+            static std::atomic<std::int64_t> m_ioCompletePages;
+            static std::atomic<std::int64_t> m_ioMergedCount;
+            std::int64_t m_preIOCompleteCount = 0;
+            std::int64_t m_preIOCompletePages = 0;
+            std::int64_t m_preIOMergedCount = 0;
             std::chrono::time_point<std::chrono::high_resolution_clock> m_preTime = std::chrono::high_resolution_clock::now();
 
             static void* InitializeSpdk(void* args);
@@ -96,10 +119,17 @@ namespace SPTAG::SPANN
             static void SpdkBdevIoCallback(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg);
 
             static void SpdkStop(void* args);
+
+            // cut p_size contiguous blocks from the never used area
+            bool GetFreshBlocks(AddressType* p_data, int p_size);
+
+            // number of blocks starting at p_data[0] which are physically adjacent, capped by p_limit and m_maxIoPages
+            int ContiguousBlocks(AddressType* p_data, int p_limit);
         public:
             bool Initialize(int batchSize);
 
-            // get p_size blocks from front, and fill in p_data array
+            // get p_size blocks, and fill in p_data array in ascending order
+            // multi-page requests prefer a contiguous extent so that their I/Os can be coalesced
             bool GetBlocks(AddressType* p_data, int p_size);
 
             // release p_size blocks, put them at the end of the queue
@@ -113,15 +143,46 @@ namespace SPTAG::SPANN
             // parallel read a list of posting lists.
             bool ReadBlocks(std::vector<AddressType*>& p_data, std::vector<std::string>* p_values, const std::chrono::microseconds &timeout = std::chrono::microseconds::max());
 
+            // parallel read a list of posting lists straight into caller buffers, see KeyValueIO::MultiGet.
+            // buffers obtained from AllocateBuffer are DMA memory, the ssd reads into them without a bounce copy.
+            // up to m_batchSize I/Os stay in flight while p_onComplete consumes the postings that are already complete.
+            bool ReadBlocks(std::vector<AddressType*>& p_data, const std::vector<std::uint8_t*>& p_buffers, std::size_t p_bufferSize, std::vector<std::size_t>* p_sizes, const std::chrono::microseconds &timeout = std::chrono::microseconds::max(), const std::function<bool(std::size_t)>& p_onComplete = nullptr);
+
+            // page aligned buffer owned by the controller until its last ShutDown
+            std::uint8_t* AllocateBuffer(std::size_t p_size);
+
             // write p_value into p_size blocks start from p_data
             bool WriteBlocks(AddressType* p_data, int p_size, const std::string& p_value);
 
             bool IOStatistics();
 
+            // I/Os completed, pages they moved and adjacent pages merged into them, over all controllers since start
+            void IOCounters(std::int64_t* p_ios, std::int64_t* p_pages, std::int64_t* p_merged) const {
+                *p_ios = m_ioCompleteCount.load();
+                *p_pages = m_ioCompletePages.load();
+                *p_merged = m_ioMergedCount.load();
+            }
+
             bool ShutDown();
 
             int RemainBlocks() {
-                return m_blockAddresses.unsafe_size();
+                return m_blockAddresses.unsafe_size() + (m_maxNumBlocks - m_nextFreshBlock.load());
+            }
+
+            // blocks below p_end are referenced by a loaded or replayed mapping, never hand them out as fresh blocks
+            void ReserveBlocks(AddressType p_end) {
+                AddressType curr = m_nextFreshBlock.load();
+                while (curr < p_end && !m_nextFreshBlock.compare_exchange_weak(curr, p_end));
+            }
+
+            // only before the blocks are used: p_used[i] tells whether a mapping references block i, the others
+            // below p_used.size() are free again and the blocks from there on are fresh
+            void ResetFreeBlocks(const std::vector<bool>& p_used) {
+                m_blockAddresses.clear();
+                for (AddressType i = 0; i < (AddressType)p_used.size(); i++) {
+                    if (!p_used[i]) m_blockAddresses.push(i);
+                }
+                m_nextFreshBlock = (AddressType)p_used.size();
             }
         };
 
@@ -140,24 +201,264 @@ namespace SPTAG::SPANN
             }
         };
 
+        // Epoch based protection of the mapping records against reuse while they are decoded. A reader pins the
+        // global epoch in a slot of its own for the time it dereferences records, a released record is tagged with
+        // the epoch it was released in and the epoch moves on. The record may be reused once every pinned slot
+        // holds a later epoch, as no reader which could still have loaded its address is left.
+        class RecordEpochs {
+        private:
+            struct alignas(64) Slot {
+                std::atomic<std::uint64_t> m_epoch{ 0 };
+                std::atomic<bool> m_inUse{ true };
+                int m_depth = 0;
+                Slot* m_next = nullptr;
+            };
+
+            // slots are never freed, a thread takes over the slot of an exited one
+            struct SlotOwner {
+                Slot* m_slot;
+
+                SlotOwner() {
+                    for (m_slot = s_slots.load(); m_slot != nullptr; m_slot = m_slot->m_next) {
+                        bool inUse = false;
+                        if (m_slot->m_inUse.compare_exchange_strong(inUse, true)) return;
+                    }
+                    m_slot = new Slot();
+                    m_slot->m_next = s_slots.load();
+                    while (!s_slots.compare_exchange_weak(m_slot->m_next, m_slot));
+                }
+
+                ~SlotOwner() {
+                    m_slot->m_epoch.store(0);
+                    m_slot->m_inUse.store(false);
+                }
+            };
+
+            static Slot* LocalSlot() {
+                static thread_local SlotOwner owner;
+                return owner.m_slot;
+            }
+
+            static inline std::atomic<std::uint64_t> s_epoch{ 1 };
+            static inline std::atomic<Slot*> s_slots{ nullptr };
+
+        public:
+            // pins the epoch of this thread while it is alive, guards nest
+            class Guard {
+            public:
+                Guard() : m_slot(LocalSlot()) {
+                    if (m_slot->m_depth++ == 0) m_slot->m_epoch.store(s_epoch.load());
+                }
+
+                ~Guard() {
+                    if (--m_slot->m_depth == 0) m_slot->m_epoch.store(0);
+                }
+
+            private:
+                Slot* m_slot;
+            };
+
+            // tag for a record whose address no reader can load from now on
+            static std::uint64_t Retire() { return s_epoch.fetch_add(1); }
+
+            // records tagged before the returned epoch are not referenced by any reader
+            static std::uint64_t SafeEpoch() {
+                std::uint64_t safe = s_epoch.load();
+                for (Slot* slot = s_slots.load(); slot != nullptr; slot = slot->m_next) {
+                    std::uint64_t pinned = slot->m_epoch.load();
+                    if (pinned != 0 && pinned < safe) safe = pinned;
+                }
+                return safe;
+            }
+        };
+
+        // Arena for the compact per-posting mapping records. Records live in power-of-two
+        // size classes carved out of large chunks, released records are recycled per class
+        // once no reader can be decoding them any more.
+        // Record layout: [uint8 size class][varint value size][varint extent num]([varint start][varint length])*,
+        // the start of every extent but the first is zigzag encoded relative to the end of the previous one.
+        class MappingArena {
+        public:
+            static constexpr int kMinClassEx = 4; // 16 bytes
+            static constexpr int kNumClasses = 12; // up to 32KB
+            static constexpr std::size_t kChunkSize = 4 * 1024 * 1024;
+            // released records reclaimed together, scanning the reader slots once per batch
+            static constexpr std::size_t kReclaimBatch = 64;
+
+            std::uint8_t* Allocate(std::size_t p_size) {
+                int sizeClass = 0;
+                while (((std::size_t)1 << (sizeClass + kMinClassEx)) < p_size) sizeClass++;
+                if (sizeClass >= kNumClasses) return nullptr;
+
+                std::uint8_t* record;
+                if (!m_freeRecords[sizeClass].try_pop(record)) {
+                    std::size_t bytes = (std::size_t)1 << (sizeClass + kMinClassEx);
+                    std::lock_guard<std::mutex> lock(m_chunkMutex);
+                    if (m_chunks.empty() || m_chunkUsed + bytes > kChunkSize) {
+                        m_chunks.emplace_back(new std::uint8_t[kChunkSize]);
+                        m_chunkUsed = 0;
+                    }
+                    record = m_chunks.back().get() + m_chunkUsed;
+                    m_chunkUsed += bytes;
+                }
+                record[0] = (std::uint8_t)sizeClass;
+                return record;
+            }
+
+            // p_record is unlinked from the mapping, it waits until the readers which may hold it are gone
+            void Free(std::uint8_t* p_record) {
+                // records inside the mmapped mapping file are read only and never recycled
+                if (p_record >= m_readOnlyBegin && p_record < m_readOnlyEnd) return;
+                std::lock_guard<std::mutex> lock(m_retiredMutex);
+                m_retired.emplace_back(RecordEpochs::Retire(), p_record);
+                if (m_retired.size() % kReclaimBatch == 0) ReclaimLocked();
+            }
+
+            void SetReadOnlyRange(std::uint8_t* p_begin, std::uint8_t* p_end) {
+                m_readOnlyBegin = p_begin;
+                m_readOnlyEnd = p_end;
+            }
+
+            std::size_t MemoryUsage() {
+                std::lock_guard<std::mutex> lock(m_chunkMutex);
+                return m_chunks.size() * kChunkSize;
+            }
+
+            void Clear() {
+                {
+                    std::lock_guard<std::mutex> lock(m_retiredMutex);
+                    m_retired.clear();
+                }
+                std::lock_guard<std::mutex> lock(m_chunkMutex);
+                for (int i = 0; i < kNumClasses; i++) m_freeRecords[i].clear();
+                m_chunks.clear();
+                m_chunkUsed = 0;
+            }
+
+        private:
+            // caller holds m_retiredMutex, the tags are increasing along m_retired
+            void ReclaimLocked() {
+                std::uint64_t safe = RecordEpochs::SafeEpoch();
+                while (!m_retired.empty() && m_retired.front().first < safe) {
+                    std::uint8_t* record = m_retired.front().second;
+                    m_freeRecords[record[0]].push(record);
+                    m_retired.pop_front();
+                }
+            }
+
+            tbb::concurrent_queue<std::uint8_t*> m_freeRecords[kNumClasses];
+            std::mutex m_retiredMutex;
+            std::deque<std::pair<std::uint64_t, std::uint8_t*>> m_retired;
+            std::mutex m_chunkMutex;
+            std::vector<std::unique_ptr<std::uint8_t[]>> m_chunks;
+            std::size_t m_chunkUsed = 0;
+            std::uint8_t* m_readOnlyBegin = nullptr;
+            std::uint8_t* m_readOnlyEnd = nullptr;
+        };
+
+        static inline int VarintSize(std::uint64_t p_value) {
+            int size = 1;
+            while (p_value >= 0x80) { p_value >>= 7; size++; }
+            return size;
+        }
+
+        static inline std::uint8_t* EncodeVarint(std::uint8_t* p_out, std::uint64_t p_value) {
+            while (p_value >= 0x80) {
+                *p_out++ = (std::uint8_t)(p_value | 0x80);
+                p_value >>= 7;
+            }
+            *p_out++ = (std::uint8_t)p_value;
+            return p_out;
+        }
+
+        static inline const std::uint8_t* DecodeVarint(const std::uint8_t* p_in, std::uint64_t& p_value) {
+            p_value = 0;
+            int shift = 0;
+            while (*p_in & 0x80) {
+                p_value |= ((std::uint64_t)(*p_in++ & 0x7f)) << shift;
+                shift += 7;
+            }
+            p_value |= ((std::uint64_t)(*p_in++)) << shift;
+            return p_in;
+        }
+
+        static inline std::uint64_t ZigZag(std::int64_t p_value) { return ((std::uint64_t)p_value << 1) ^ (std::uint64_t)(p_value >> 63); }
+
+        static inline std::int64_t UnZigZag(std::uint64_t p_value) { return (std::int64_t)(p_value >> 1) ^ -(std::int64_t)(p_value & 1); }
+
+        // p_data[0] is the value size, p_data[1..p_blocks] are the block addresses
+        template <typename F>
+        static inline void ForEachExtent(const AddressType* p_data, int p_blocks, F p_func) {
+            int i = 0;
+            while (i < p_blocks) {
+                int length = 1;
+                while (i + length < p_blocks && p_data[1 + i + length] == p_data[i + length] + 1) length++;
+                p_func(p_data[1 + i], length);
+                i += length;
+            }
+        }
+
+        static inline std::size_t EncodedSize(const AddressType* p_data, int p_blocks) {
+            std::size_t size = 1 + VarintSize(p_data[0]);
+            int extents = 0;
+            AddressType prevEnd = 0;
+            ForEachExtent(p_data, p_blocks, [&](AddressType start, int length) {
+                size += VarintSize(extents == 0 ? (std::uint64_t)start : ZigZag(start - prevEnd)) + VarintSize(length);
+                prevEnd = start + length;
+                extents++;
+            });
+            return size + VarintSize(extents);
+        }
+
+        static inline void Encode(std::uint8_t* p_record, const AddressType* p_data, int p_blocks) {
+            int extents = 0;
+            ForEachExtent(p_data, p_blocks, [&](AddressType start, int length) { extents++; });
+
+            std::uint8_t* out = EncodeVarint(p_record + 1, p_data[0]);
+            out = EncodeVarint(out, extents);
+            AddressType prevEnd = 0;
+            bool first = true;
+            ForEachExtent(p_data, p_blocks, [&](AddressType start, int length) {
+                out = EncodeVarint(out, first ? (std::uint64_t)start : ZigZag(start - prevEnd));
+                out = EncodeVarint(out, length);
+                prevEnd = start + length;
+                first = false;
+            });
+        }
+
+        // expand a record into p_data, returns the number of blocks
+        static inline int Decode(const std::uint8_t* p_record, AddressType* p_data) {
+            std::uint64_t size, extents, start, length;
+            const std::uint8_t* in = DecodeVarint(p_record + 1, size);
+            in = DecodeVarint(in, extents);
+            p_data[0] = (AddressType)size;
+            int blocks = 0;
+            AddressType prevEnd = 0;
+            for (std::uint64_t e = 0; e < extents; e++) {
+                in = DecodeVarint(in, start);
+                in = DecodeVarint(in, length);
+                AddressType begin = (e == 0) ? (AddressType)start : prevEnd + UnZigZag(start);
+                for (std::uint64_t j = 0; j < length; j++) p_data[1 + blocks++] = begin + j;
+                prevEnd = begin + length;
+            }
+            return blocks;
+        }
+
     public:
-        SPDKIO(const char* filePath, SizeType blockSize, SizeType capacity, SizeType postingBlocks, SizeType bufferSize = 1024, int batchSize = 64, int compactionThreads = 1)
+        SPDKIO(const char* filePath, SizeType blockSize, SizeType capacity, SizeType postingBlocks, int batchSize = 64, int compactionThreads = 1)
         {
             m_mappingPath = std::string(filePath);
             m_blockLimit = postingBlocks + 1;
-            m_bufferLimit = bufferSize;
             if (fileexists(m_mappingPath.c_str())) {
                 Load(m_mappingPath, blockSize, capacity);
             }
             else {
                 m_pBlockMapping.Initialize(0, 1, blockSize, capacity);
             }
-            for (int i = 0; i < bufferSize; i++) {
-                m_buffer.push((uintptr_t)(new AddressType[m_blockLimit]));
-            }
             m_compactionThreadPool = std::make_shared<Helper::ThreadPool>();
             m_compactionThreadPool->init(compactionThreads);
             m_pBlockController.Initialize(batchSize);
+            ReserveMappedBlocks();
             m_shutdownCalled = false;
         }
 
@@ -169,14 +470,11 @@ namespace SPTAG::SPANN
             if (m_shutdownCalled) {
                 return;
             }
+            // the releases still waiting for their log records run now
+            if (m_wal) m_wal->Flush();
             Save(m_mappingPath);
-            for (int i = 0; i < m_pBlockMapping.R(); i++) {
-                if (At(i) != 0xffffffffffffffff) delete[]((AddressType*)At(i));
-            }
-            while (!m_buffer.empty()) {
-                uintptr_t ptr;
-                if (m_buffer.try_pop(ptr)) delete[]((AddressType*)ptr);
-            }
+            m_arena.Clear();
+            UnmapMappingFile();
             m_pBlockController.ShutDown();
             m_shutdownCalled = true;
         }
@@ -186,16 +484,41 @@ namespace SPTAG::SPANN
         }
 
         ErrorCode Get(SizeType key, std::string* value) override {
-            if (key >= m_pBlockMapping.R()) return ErrorCode::Fail;
-
-            if (m_pBlockController.ReadBlocks((AddressType*)At(key), value)) return ErrorCode::Success;
+            if (key >= m_pBlockMapping.R() || At(key) == 0xffffffffffffffff) return ErrorCode::Fail;
+
+            std::vector<AddressType>& blocks = DecodeBuffer(1);
+            // pinned until the blocks are copied, a concurrent update cannot recycle them before
+            RecordEpochs::Guard guard;
+            uintptr_t record = At(key);
+            if (record == 0xffffffffffffffff) return ErrorCode::Fail;
+            Decode((std::uint8_t*)record, blocks.data());
+            if (m_pBlockController.ReadBlocks(blocks.data(), value)) return ErrorCode::Success;
             return ErrorCode::Fail;
         }
 
+        ErrorCode GetSize(SizeType key, std::size_t* size) override {
+            if (key >= m_pBlockMapping.R()) return ErrorCode::Fail;
+            std::vector<AddressType>& blocks = DecodeBuffer(1);
+            RecordEpochs::Guard guard;
+            uintptr_t record = At(key);
+            if (record == 0xffffffffffffffff) return ErrorCode::Fail;
+            Decode((std::uint8_t*)record, blocks.data());
+            *size = (std::size_t)blocks[0];
+            return ErrorCode::Success;
+        }
+
         ErrorCode MultiGet(const std::vector<SizeType>& keys, std::vector<std::string>* values, const std::chrono::microseconds &timeout = std::chrono::microseconds::max()) {
+            std::vector<AddressType>& buffer = DecodeBuffer(keys.size());
             std::vector<AddressType*> blocks;
+            RecordEpochs::Guard guard;
             for (SizeType key : keys) {
-                if (key < m_pBlockMapping.R()) blocks.push_back((AddressType*)At(key));
+                if (key < m_pBlockMapping.R()) {
+                    AddressType* p_data = buffer.data() + blocks.size() * m_blockLimit;
+                    uintptr_t record = At(key);
+                    if (record == 0xffffffffffffffff) p_data[0] = 0;
+                    else Decode((std::uint8_t*)record, p_data);
+                    blocks.push_back(p_data);
+                }
                 else {
                     LOG(Helper::LogLevel::LL_Error, "Fail to read key:%d total key number:%d\n", key, m_pBlockMapping.R());
                 }
@@ -204,6 +527,26 @@ namespace SPTAG::SPANN
             return ErrorCode::Fail; 
         }
 
+        std::shared_ptr<std::uint8_t> AllocateBuffer(std::size_t p_size) override {
+            // owned by the block controller, the ssd can DMA into it directly
+            return std::shared_ptr<std::uint8_t>(m_pBlockController.AllocateBuffer(p_size), [](std::uint8_t*) {});
+        }
+
+        ErrorCode MultiGet(const std::vector<SizeType>& keys, const std::vector<std::uint8_t*>& p_buffers, std::size_t p_bufferSize, std::vector<std::size_t>* p_sizes, const std::chrono::microseconds &timeout = std::chrono::microseconds::max(), const std::function<bool(std::size_t)>& p_onComplete = nullptr) override {
+            std::vector<AddressType>& buffer = DecodeBuffer(keys.size());
+            static thread_local std::vector<AddressType*> blocks;
+            blocks.resize(keys.size());
+            RecordEpochs::Guard guard;
+            for (std::size_t i = 0; i < keys.size(); i++) {
+                blocks[i] = buffer.data() + i * m_blockLimit;
+                uintptr_t record = (keys[i] < m_pBlockMapping.R()) ? At(keys[i]) : 0xffffffffffffffff;
+                if (record == 0xffffffffffffffff) blocks[i][0] = 0;
+                else Decode((std::uint8_t*)record, blocks[i]);
+            }
+            if (m_pBlockController.ReadBlocks(blocks, p_buffers, p_bufferSize, p_sizes, timeout, p_onComplete)) return ErrorCode::Success;
+            return ErrorCode::Fail;
+        }
+
         ErrorCode Put(SizeType key, const std::string& value) override {
             int blocks = ((value.size() + PageSize - 1) >> PageSizeEx);
             if (blocks >= m_blockLimit) {
@@ -217,46 +560,28 @@ namespace SPTAG::SPANN
                     m_pBlockMapping.AddBatch(delta);
                 }
             }
-            if (At(key) == 0xffffffffffffffff) {
-                if (m_buffer.unsafe_size() > m_bufferLimit) {
-                    uintptr_t tmpblocks;
-                    while (!m_buffer.try_pop(tmpblocks));
-                    At(key) = tmpblocks;
-                }
-                else {
-                    At(key) = (uintptr_t)(new AddressType[m_blockLimit]);
-                }
-                memset((AddressType*)At(key), -1, sizeof(AddressType) * m_blockLimit);
-            }
-            int64_t* postingSize = (int64_t*)At(key);
-            if (*postingSize < 0) {
-                m_pBlockController.GetBlocks(postingSize + 1, blocks);
-                m_pBlockController.WriteBlocks(postingSize + 1, blocks, value);
-                *postingSize = value.size();
-            }
-            else {
-                uintptr_t tmpblocks;
-                while (!m_buffer.try_pop(tmpblocks));
-                m_pBlockController.GetBlocks((AddressType*)tmpblocks + 1, blocks);
-                m_pBlockController.WriteBlocks((AddressType*)tmpblocks + 1, blocks, value);
-                *((int64_t*)tmpblocks) = value.size();
-
-                m_pBlockController.ReleaseBlocks(postingSize + 1, (*postingSize + PageSize -1) >> PageSizeEx);
-                while (InterlockedCompareExchange(&At(key), tmpblocks, (uintptr_t)postingSize) != (uintptr_t)postingSize) {
-                    postingSize = (int64_t*)At(key);
-                }
-                m_buffer.push((uintptr_t)postingSize);
-            }
-            return ErrorCode::Success;
+
+            std::vector<AddressType> newBlocks(blocks + 1);
+            newBlocks[0] = value.size();
+            m_pBlockController.GetBlocks(newBlocks.data() + 1, blocks);
+            m_pBlockController.WriteBlocks(newBlocks.data() + 1, blocks, value);
+            return SwapRecord(key, newBlocks.data(), blocks, true);
         }
 
         ErrorCode Merge(SizeType key, const std::string& value) {
-            if (key >= m_pBlockMapping.R()) {
-                LOG(Helper::LogLevel::LL_Error, "Key range error: key: %d, mapping size: %d\n", key, m_pBlockMapping.R());
-                return ErrorCode::Fail;
+            // nothing to append to yet, the merge degenerates to a put
+            if (key >= m_pBlockMapping.R() || At(key) == 0xffffffffffffffff) {
+                return Put(key, value);
             }
 
-            int64_t* postingSize = (int64_t*)At(key);
+            std::vector<AddressType> postingBlocks(m_blockLimit + 1);
+            AddressType* postingSize = postingBlocks.data();
+            {
+                RecordEpochs::Guard guard;
+                uintptr_t record = At(key);
+                if (record == 0xffffffffffffffff) return Put(key, value);
+                Decode((std::uint8_t*)record, postingSize);
+            }
             auto newSize = *postingSize + value.size();
             int newblocks = ((newSize + PageSize - 1) >> PageSizeEx);
             if (newblocks >= m_blockLimit) {
@@ -268,42 +593,45 @@ namespace SPTAG::SPANN
             auto sizeInPage = (*postingSize) % PageSize;
             int oldblocks = (*postingSize >> PageSizeEx);
             int allocblocks = newblocks - oldblocks;
+            AddressType tailBlock = -1;
             if (sizeInPage != 0) {
+                // copy-on-write of the partially filled tail page
                 std::string newValue;
-                AddressType readreq[] = { sizeInPage, *(postingSize + 1 + oldblocks) };
+                tailBlock = *(postingSize + 1 + oldblocks);
+                AddressType readreq[] = { sizeInPage, tailBlock };
                 m_pBlockController.ReadBlocks(readreq, &newValue);
                 newValue += value;
 
-                uintptr_t tmpblocks;
-                while (!m_buffer.try_pop(tmpblocks));
-                memcpy((AddressType*)tmpblocks, postingSize, sizeof(AddressType) * (oldblocks + 1));
-                m_pBlockController.GetBlocks((AddressType*)tmpblocks + 1 + oldblocks, allocblocks);
-                m_pBlockController.WriteBlocks((AddressType*)tmpblocks + 1 + oldblocks, allocblocks, newValue);
-                *((int64_t*)tmpblocks) = newSize;
-
-                m_pBlockController.ReleaseBlocks(postingSize + 1 + oldblocks, 1);
-                while (InterlockedCompareExchange(&At(key), tmpblocks, (uintptr_t)postingSize) != (uintptr_t)postingSize) {
-                    postingSize = (int64_t*)At(key);
-                }
-                m_buffer.push((uintptr_t)postingSize);
+                m_pBlockController.GetBlocks(postingSize + 1 + oldblocks, allocblocks);
+                m_pBlockController.WriteBlocks(postingSize + 1 + oldblocks, allocblocks, newValue);
             }
             else {
                 m_pBlockController.GetBlocks(postingSize + 1 + oldblocks, allocblocks);
                 m_pBlockController.WriteBlocks(postingSize + 1 + oldblocks, allocblocks, value);
-                *postingSize = newSize;
             }
-            return ErrorCode::Success;
+            *postingSize = newSize;
+            std::uint64_t lsn = 0;
+            ErrorCode ret = SwapRecord(key, postingSize, newblocks, false, &lsn);
+            if (tailBlock >= 0) ReleaseWhenDurable(lsn, std::vector<AddressType>(1, tailBlock), 0);
+            return ret;
         }
 
         ErrorCode Delete(SizeType key) override {
             if (key >= m_pBlockMapping.R()) return ErrorCode::Fail;
-            int64_t* postingSize = (int64_t*)At(key);
-            if (*postingSize < 0) return ErrorCode::Fail;
+            uintptr_t record = At(key);
+            if (record == 0xffffffffffffffff) return ErrorCode::Fail;
+            while (InterlockedCompareExchange(&At(key), (uintptr_t)0xffffffffffffffff, record) != record) {
+                record = At(key);
+                if (record == 0xffffffffffffffff) return ErrorCode::Fail;
+            }
+
+            std::uint64_t lsn = m_wal ? m_wal->Append(WriteAheadLog::RecordType::MappingDelete, key, nullptr, 0) : 0;
 
-            int blocks = ((*postingSize + PageSize - 1) >> PageSizeEx);
-            m_pBlockController.ReleaseBlocks(postingSize + 1, blocks);
-            m_buffer.push((uintptr_t)postingSize);
-            At(key) = 0xffffffffffffffff;
+            std::vector<AddressType> oldBlocks(m_blockLimit + 1);
+            int blocks = Decode((std::uint8_t*)record, oldBlocks.data());
+            oldBlocks.erase(oldBlocks.begin() + 1 + blocks, oldBlocks.end());
+            oldBlocks.erase(oldBlocks.begin());
+            ReleaseWhenDurable(lsn, std::move(oldBlocks), record);
             return ErrorCode::Success;
         }
 
@@ -311,10 +639,40 @@ namespace SPTAG::SPANN
             Save(m_mappingPath);
         }
 
+        // mapping updates are logged from now on, replay the log before attaching it
+        void SetWriteAheadLog(std::shared_ptr<WriteAheadLog> p_wal) {
+            if (m_wal) m_wal->Flush();
+            // the replayed mappings may reference other blocks than the loaded ones
+            if (p_wal) ReserveMappedBlocks();
+            m_wal = p_wal;
+        }
+
+        void ReplayRecord(WriteAheadLog::RecordType p_type, SizeType p_key, const char* p_payload, std::uint16_t p_length) {
+            if (p_type == WriteAheadLog::RecordType::MappingDelete) {
+                if (p_key >= m_pBlockMapping.R() || At(p_key) == 0xffffffffffffffff) return;
+                uintptr_t record = At(p_key);
+                At(p_key) = 0xffffffffffffffff;
+                m_arena.Free((std::uint8_t*)record);
+                return;
+            }
+            if (p_type != WriteAheadLog::RecordType::Mapping) return;
+
+            if (p_key >= m_pBlockMapping.R()) m_pBlockMapping.AddBatch(p_key + 1 - m_pBlockMapping.R());
+            std::vector<AddressType> blocks(m_blockLimit + 1);
+            int num = Decode((const std::uint8_t*)p_payload, blocks.data());
+            for (int i = 1; i <= num; i++) m_pBlockController.ReserveBlocks(blocks[i] + 1);
+            SwapRecord(p_key, blocks.data(), num, false);
+        }
+
+        void GetIOCounters(std::int64_t* p_ios, std::int64_t* p_pages, std::int64_t* p_merged) const {
+            m_pBlockController.IOCounters(p_ios, p_pages, p_merged);
+        }
+
         void GetStat() {
             int remainBlocks = m_pBlockController.RemainBlocks();
             int remainGB = remainBlocks >> 20 << 2;
             LOG(Helper::LogLevel::LL_Info, "Remain %d blocks, totally %d GB\n", remainBlocks, remainGB);
+            LOG(Helper::LogLevel::LL_Info, "Mapping: %d keys, arena %zu MB, mapped file %zu MB\n", m_pBlockMapping.R(), m_arena.MemoryUsage() >> 20, m_mappedSize >> 20);
             m_pBlockController.IOStatistics();
         }
 
@@ -325,37 +683,71 @@ namespace SPTAG::SPANN
 
             SizeType CR, mycols;
             IOBINARY(ptr, ReadBinary, sizeof(SizeType), (char*)&CR);
+            if (CR == kCompactMappingMagic) {
+                ptr->ShutDown();
+                return LoadCompact(path, blockSize, capacity);
+            }
+
+            // legacy layout: m_blockLimit columns of [size, block addresses...] per key
             IOBINARY(ptr, ReadBinary, sizeof(SizeType), (char*)&mycols);
             if (mycols > m_blockLimit) m_blockLimit = mycols;
 
             m_pBlockMapping.Initialize(CR, 1, blockSize, capacity);
+            std::vector<AddressType> row(mycols);
             for (int i = 0; i < CR; i++) {
-                At(i) = (uintptr_t)(new AddressType[m_blockLimit]);
-                IOBINARY(ptr, ReadBinary, sizeof(AddressType) * mycols, (char*)At(i));
+                IOBINARY(ptr, ReadBinary, sizeof(AddressType) * mycols, (char*)row.data());
+                if (row[0] < 0) continue;
+                SwapRecord(i, row.data(), (int)((row[0] + PageSize - 1) >> PageSizeEx), false);
             }
             LOG(Helper::LogLevel::LL_Info, "Load mapping (%d,%d) Finish!\n", CR, mycols);
             return ErrorCode::Success;
         }
         
+        // compact layout: [magic][version][CR][uint64 offsets[CR + 1]][records], an empty record means no value
         ErrorCode Save(std::string path) {
             LOG(Helper::LogLevel::LL_Info, "Save mapping To %s\n", path.c_str());
+            // the mmapped file may still back some records, write to a side file and swap it in
+            std::string tmpPath = path + ".tmp";
             auto ptr = f_createIO();
-            if (ptr == nullptr || !ptr->Initialize(path.c_str(), std::ios::binary | std::ios::out)) return ErrorCode::FailedCreateFile;
+            if (ptr == nullptr || !ptr->Initialize(tmpPath.c_str(), std::ios::binary | std::ios::out)) return ErrorCode::FailedCreateFile;
 
             SizeType CR = m_pBlockMapping.R();
+            SizeType magic = kCompactMappingMagic, version = kCompactMappingVersion;
+            IOBINARY(ptr, WriteBinary, sizeof(SizeType), (char*)&magic);
+            IOBINARY(ptr, WriteBinary, sizeof(SizeType), (char*)&version);
             IOBINARY(ptr, WriteBinary, sizeof(SizeType), (char*)&CR);
-            IOBINARY(ptr, WriteBinary, sizeof(SizeType), (char*)&m_blockLimit);
-            std::vector<AddressType> empty(m_blockLimit, 0xffffffffffffffff);
+
+            std::vector<std::uint64_t> offsets(CR + 1, 0);
+            std::vector<AddressType> blocks(m_blockLimit + 1);
+            // both passes see the same records even when keys are updated meanwhile, the guard keeps them alive
+            RecordEpochs::Guard guard;
+            std::vector<uintptr_t> records(CR);
             for (int i = 0; i < CR; i++) {
-                if (At(i) == 0xffffffffffffffff) {
-                    IOBINARY(ptr, WriteBinary, sizeof(AddressType) * m_blockLimit, (char*)(empty.data()));
-                }
-                else {
-                    int64_t* postingSize = (int64_t*)At(i);
-                    IOBINARY(ptr, WriteBinary, sizeof(AddressType) * m_blockLimit, (char*)postingSize);
+                std::size_t recordSize = 0;
+                records[i] = At(i);
+                if (records[i] != 0xffffffffffffffff) {
+                    int num = Decode((std::uint8_t*)records[i], blocks.data());
+                    recordSize = EncodedSize(blocks.data(), num);
                 }
+                offsets[i + 1] = offsets[i] + recordSize;
+            }
+            IOBINARY(ptr, WriteBinary, sizeof(std::uint64_t) * (CR + 1), (char*)offsets.data());
+
+            std::vector<std::uint8_t> record;
+            for (int i = 0; i < CR; i++) {
+                if (offsets[i + 1] == offsets[i]) continue;
+                int num = Decode((std::uint8_t*)records[i], blocks.data());
+                record.resize(offsets[i + 1] - offsets[i]);
+                Encode(record.data(), blocks.data(), num);
+                record[0] = 0;
+                IOBINARY(ptr, WriteBinary, record.size(), (char*)record.data());
+            }
+            ptr->ShutDown();
+            if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+                LOG(Helper::LogLevel::LL_Error, "Fail to replace mapping file %s\n", path.c_str());
+                return ErrorCode::FailedCreateFile;
             }
-            LOG(Helper::LogLevel::LL_Info, "Save mapping (%d,%d) Finish!\n", CR, m_blockLimit);
+            LOG(Helper::LogLevel::LL_Info, "Save mapping (%d, %llu bytes) Finish!\n", CR, offsets[CR]);
             return ErrorCode::Success;
         }
 
@@ -370,11 +762,137 @@ namespace SPTAG::SPANN
         }
 
     private:
+        static constexpr SizeType kCompactMappingMagic = -2;
+        static constexpr SizeType kCompactMappingVersion = 1;
+
+        // thread local scratch for expanding mapping records of p_keys keys
+        std::vector<AddressType>& DecodeBuffer(std::size_t p_keys) {
+            static thread_local std::vector<AddressType> buffer;
+            if (buffer.size() < p_keys * m_blockLimit) buffer.resize(p_keys * m_blockLimit);
+            return buffer;
+        }
+
+        // publish a new record for key and recycle the previous one, p_release also returns its blocks.
+        // p_lsn receives the log sequence number of the new record, 0 when nothing is logged.
+        ErrorCode SwapRecord(SizeType key, AddressType* p_data, int p_blocks, bool p_release, std::uint64_t* p_lsn = nullptr) {
+            std::size_t recordSize = EncodedSize(p_data, p_blocks);
+            std::uint8_t* record = m_arena.Allocate(recordSize);
+            if (record == nullptr) {
+                LOG(Helper::LogLevel::LL_Error, "Fail to allocate mapping record for key:%d blocks:%d\n", key, p_blocks);
+                return ErrorCode::MemoryOverFlow;
+            }
+            Encode(record, p_data, p_blocks);
+
+            uintptr_t oldRecord = At(key);
+            while (InterlockedCompareExchange(&At(key), (uintptr_t)record, oldRecord) != oldRecord) {
+                oldRecord = At(key);
+            }
+            // the blocks are already written, so the logged record never points to garbage
+            std::uint64_t lsn = m_wal ? m_wal->Append(WriteAheadLog::RecordType::Mapping, key, record, (std::uint16_t)recordSize) : 0;
+            if (p_lsn != nullptr) *p_lsn = lsn;
+            if (oldRecord != 0xffffffffffffffff) {
+                std::vector<AddressType> oldBlocks;
+                if (p_release) {
+                    oldBlocks.resize(m_blockLimit + 1);
+                    int blocks = Decode((std::uint8_t*)oldRecord, oldBlocks.data());
+                    oldBlocks.erase(oldBlocks.begin() + 1 + blocks, oldBlocks.end());
+                    oldBlocks.erase(oldBlocks.begin());
+                }
+                ReleaseWhenDurable(lsn, std::move(oldBlocks), oldRecord);
+            }
+            return ErrorCode::Success;
+        }
+
+        // Returns p_blocks and p_record (0: none) once the log record with p_lsn is durable. Until then a crash
+        // replays the previous record of the key, which must still find its blocks untouched.
+        void ReleaseWhenDurable(std::uint64_t p_lsn, std::vector<AddressType>&& p_blocks, uintptr_t p_record) {
+            auto release = [this, blocks = std::move(p_blocks), p_record]() mutable {
+                if (!blocks.empty()) RetireBlocks(std::move(blocks));
+                if (p_record != 0) m_arena.Free((std::uint8_t*)p_record);
+            };
+            if (m_wal && p_lsn > 0) m_wal->DeferUntilDurable(p_lsn, std::move(release));
+            else release();
+        }
+
+        // Readers stay pinned while they copy the blocks of a record they decoded, so replaced blocks are
+        // only recycled once every reader that may still be copying them is gone.
+        void RetireBlocks(std::vector<AddressType>&& p_blocks) {
+            std::lock_guard<std::mutex> lock(m_retiredBlocksMutex);
+            m_retiredBlocks.emplace_back(RecordEpochs::Retire(), std::move(p_blocks));
+            std::uint64_t safe = RecordEpochs::SafeEpoch();
+            while (!m_retiredBlocks.empty() && m_retiredBlocks.front().first < safe) {
+                std::vector<AddressType>& blocks = m_retiredBlocks.front().second;
+                m_pBlockController.ReleaseBlocks(blocks.data(), (int)blocks.size());
+                m_retiredBlocks.pop_front();
+            }
+        }
+
+        ErrorCode LoadCompact(std::string path, SizeType blockSize, SizeType capacity) {
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0) return ErrorCode::FailedOpenFile;
+            struct stat st;
+            if (fstat(fd, &st) != 0) {
+                close(fd);
+                return ErrorCode::FailedOpenFile;
+            }
+            void* base = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (base == MAP_FAILED) return ErrorCode::FailedOpenFile;
+            m_mappedBase = (std::uint8_t*)base;
+            m_mappedSize = st.st_size;
+
+            SizeType* header = (SizeType*)m_mappedBase;
+            if (header[1] != kCompactMappingVersion) {
+                LOG(Helper::LogLevel::LL_Error, "Unsupported mapping version %d in %s\n", header[1], path.c_str());
+                UnmapMappingFile();
+                return ErrorCode::FailedParseValue;
+            }
+            SizeType CR = header[2];
+            std::uint64_t* offsets = (std::uint64_t*)(m_mappedBase + 3 * sizeof(SizeType));
+            std::uint8_t* records = (std::uint8_t*)(offsets + CR + 1);
+            m_arena.SetReadOnlyRange(records, m_mappedBase + m_mappedSize);
+
+            // records are used in place, pages of the file are only faulted in when a posting is touched
+            m_pBlockMapping.Initialize(CR, 1, blockSize, capacity);
+            for (int i = 0; i < CR; i++) {
+                if (offsets[i + 1] != offsets[i]) At(i) = (uintptr_t)(records + offsets[i]);
+            }
+            LOG(Helper::LogLevel::LL_Info, "Load compact mapping (%d, %llu bytes) Finish!\n", CR, offsets[CR]);
+            return ErrorCode::Success;
+        }
+
+        // the blocks referenced by the mapping are in use, the holes below the highest one are free again
+        void ReserveMappedBlocks() {
+            std::vector<bool> used;
+            std::vector<AddressType> blocks(m_blockLimit + 1);
+            for (int i = 0; i < m_pBlockMapping.R(); i++) {
+                if (At(i) == 0xffffffffffffffff) continue;
+                int num = Decode((std::uint8_t*)At(i), blocks.data());
+                for (int j = 1; j <= num; j++) {
+                    if (blocks[j] >= (AddressType)used.size()) used.resize(blocks[j] + 1, false);
+                    used[blocks[j]] = true;
+                }
+            }
+            m_pBlockController.ResetFreeBlocks(used);
+        }
+
+        void UnmapMappingFile() {
+            if (m_mappedBase == nullptr) return;
+            munmap(m_mappedBase, m_mappedSize);
+            m_arena.SetReadOnlyRange(nullptr, nullptr);
+            m_mappedBase = nullptr;
+            m_mappedSize = 0;
+        }
+
         std::string m_mappingPath;//mapping file path
         SizeType m_blockLimit;
-        COMMON::Dataset<uintptr_t> m_pBlockMapping;//mapping module
-        SizeType m_bufferLimit;
-        tbb::concurrent_queue<uintptr_t> m_buffer;
+        COMMON::Dataset<uintptr_t> m_pBlockMapping;//mapping module, each key points to a compact record in m_arena or in the mmapped file
+        MappingArena m_arena;
+        std::mutex m_retiredBlocksMutex;
+        std::deque<std::pair<std::uint64_t, std::vector<AddressType>>> m_retiredBlocks;
+        std::shared_ptr<WriteAheadLog> m_wal;
+        std::uint8_t* m_mappedBase = nullptr;
+        std::size_t m_mappedSize = 0;
         
         //tbb::concurrent_hash_map<SizeType, std::string> *m_pCurrentCache, *m_pNextCache;
         std::shared_ptr<Helper::ThreadPool> m_compactionThreadPool;
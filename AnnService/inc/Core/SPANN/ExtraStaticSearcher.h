@@ -102,14 +102,31 @@ namespace SPTAG
 }\
 
 #define ProcessPosting() \
-        for (int i = 0; i < listInfo->listEleCount; i++) { \
-            uint64_t offsetVectorID, offsetVector;\
-            (this->*m_parsePosting)(offsetVectorID, offsetVector, i, listInfo->listEleCount);\
-            int vectorID = *(reinterpret_cast<int*>(p_postingListFullData + offsetVectorID));\
-            if (p_exWorkSpace->m_deduper.CheckAndSet(vectorID)) continue; \
-            (this->*m_parseEncoding)(p_index, listInfo, (ValueType*)(p_postingListFullData + offsetVector));\
-            auto distance2leaf = p_index->ComputeDistance(queryResults.GetQuantizedTarget(), p_postingListFullData + offsetVector); \
-            queryResults.AddPoint(vectorID, distance2leaf); \
+        for (int begin = 0; begin < listInfo->listEleCount; begin += ScanBlock) { \
+            int end = min(begin + ScanBlock, listInfo->listEleCount); \
+            const ValueType* target = (const ValueType*)queryResults.GetQuantizedTarget(); \
+            int slots[ScanBlock]; \
+            int slotIDs[ScanBlock]; \
+            float slotDists[ScanBlock]; \
+            int live = 0; \
+            uint64_t offsetVectorID, offsetVector, offsetBlock; \
+            for (int i = begin; i < end; i++) { \
+                (this->*m_parsePosting)(offsetVectorID, offsetVector, i, listInfo->listEleCount);\
+                int vectorID = *(reinterpret_cast<int*>(p_postingListFullData + offsetVectorID));\
+                if (p_exWorkSpace->m_deduper.CheckAndSet(vectorID)) continue; \
+                (this->*m_parseEncoding)(p_index, listInfo, (ValueType*)(p_postingListFullData + offsetVector));\
+                if (distBatch == nullptr) { \
+                    queryResults.AddPoint(vectorID, p_index->ComputeDistance(target, p_postingListFullData + offsetVector)); \
+                    continue; \
+                } \
+                slots[live] = i - begin; \
+                slotIDs[live++] = vectorID; \
+            } \
+            if (live == 0) continue; \
+            (this->*m_parsePosting)(offsetVectorID, offsetBlock, begin, listInfo->listEleCount); \
+            COMMON::DistanceUtils::ComputeSlotDistances(distBatch, target, p_postingListFullData + offsetBlock, \
+                m_enablePostingListRearrange ? m_vectorInfoSize - sizeof(int) : m_vectorInfoSize, slots, live, m_iDataDimension, slotDists); \
+            for (int j = 0; j < live; j++) queryResults.AddPoint(slotIDs[j], slotDists[j]); \
         } \
 
         template <typename ValueType>
@@ -196,6 +213,9 @@ namespace SPTAG
                 const uint32_t postingListCount = static_cast<uint32_t>(p_exWorkSpace->m_postingIDs.size());
 
                 COMMON::QueryResultSet<ValueType>& queryResults = *((COMMON::QueryResultSet<ValueType>*)&p_queryResults);
+
+                // full vectors go to the strided batch kernel, a head index with its own quantizer compares them itself
+                COMMON::DistanceBatchCalcReturn<ValueType> distBatch = (p_index->m_pQuantizer == nullptr) ? COMMON::DistanceBatchCalcSelector<ValueType>(p_index->GetDistCalcMethod()) : nullptr;
  
                 int diskRead = 0;
                 int diskIO = 0;
@@ -232,7 +252,7 @@ namespace SPTAG
                     request.m_success = false;
 
 #ifdef BATCH_READ // async batch read
-                    request.m_callback = [&p_exWorkSpace, &queryResults, &p_index, &request, this](bool success)
+                    request.m_callback = [&p_exWorkSpace, &queryResults, &p_index, &request, &distBatch, this](bool success)
                     {
                         char* buffer = request.m_buffer;
                         ListInfo* listInfo = (ListInfo*)(request.m_payload);
@@ -1331,6 +1351,9 @@ namespace SPTAG
             int m_vectorInfoSize = 0;
             int m_iDataDimension = 0;
 
+            // posting vectors deduplicated before one batch distance call
+            static const int ScanBlock = 64;
+
             int m_totalListCount = 0;
 
             int m_listPerFile = 0;
@@ -16,6 +16,7 @@
 #include <chrono>
 #include <atomic>
 #include <set>
+#include <future>
 
 namespace SPTAG {
     namespace SPANN {
@@ -35,7 +36,15 @@ namespace SPTAG {
                 m_asyncLatency1(0),
                 m_asyncLatency2(0),
                 m_queueLatency(0),
-                m_sleepLatency(0)
+                m_sleepLatency(0),
+                m_compLatency(0),
+                m_diskReadLatency(0),
+                m_exSetUpLatency(0),
+                m_headPrefetchCount(0),
+                m_headPrefetchHit(0),
+                m_prefetchIOLatency(0),
+                m_prefetchWaitLatency(0),
+                m_headOverlapLatency(0)
             {
             }
 
@@ -71,6 +80,19 @@ namespace SPTAG {
 
             double m_exSetUpLatency;
 
+            // postings read ahead during the head search and how many of them were then searched
+            int m_headPrefetchCount;
+
+            int m_headPrefetchHit;
+
+            // read time of the prefetches, the part of it still pending after the head search and the part hidden behind it
+            double m_prefetchIOLatency;
+
+            double m_prefetchWaitLatency;
+
+            double m_headOverlapLatency;
+
+            // stamped by the caller when the query arrives, the background throttle is fed the latency from there
             std::chrono::steady_clock::time_point m_searchRequestTime;
 
             int m_threadID;
@@ -84,7 +106,7 @@ namespace SPTAG {
             uint32_t m_reAssignNum{ 0 };
             uint32_t m_garbageNum{ 0 };
             uint64_t m_reAssignScanNum{ 0 };
-            uint32_t m_mergeNum{ 0 };
+            std::atomic_uint32_t m_mergeNum{ 0 };
 
             //Split
             double m_splitCost{ 0 };
@@ -107,9 +129,12 @@ namespace SPTAG {
             // GC
             double m_garbageCost{ 0 };
 
+            // Merge, in ms, merges of different postings run concurrently
+            std::atomic_uint64_t m_mergeCost{ 0 };
+
             void PrintStat(int finishedInsert, bool cost = false, bool reset = false) {
                 LOG(Helper::LogLevel::LL_Info, "After %d insertion, head vectors split %d times, head missing %d times, same head %d times, reassign %d times, reassign scan %ld times, garbage collection %d times, merge %d times\n",
-                    finishedInsert, m_splitNum, m_headMiss.load(), m_theSameHeadNum, m_reAssignNum, m_reAssignScanNum, m_garbageNum, m_mergeNum);
+                    finishedInsert, m_splitNum, m_headMiss.load(), m_theSameHeadNum, m_reAssignNum, m_reAssignScanNum, m_garbageNum, m_mergeNum.load());
 
                 if (cost) {
                     LOG(Helper::LogLevel::LL_Info, "AppendTaskNum: %d, TotalCost: %.3lf us, PerCost: %.3lf us\n", m_appendTaskNum, m_appendCost, m_appendCost / m_appendTaskNum);
@@ -122,6 +147,7 @@ namespace SPTAG {
                     LOG(Helper::LogLevel::LL_Info, "SplitNum: %d, ReassignScan TotalCost: %.3lf ms, PerCost: %.3lf ms\n", m_splitNum, m_reassignScanCost, m_reassignScanCost / m_splitNum);
                     LOG(Helper::LogLevel::LL_Info, "SplitNum: %d, ReassignScanIO TotalCost: %.3lf us, PerCost: %.3lf us\n", m_splitNum, m_reassignScanIOCost, m_reassignScanIOCost / m_splitNum);
                     LOG(Helper::LogLevel::LL_Info, "GCNum: %d, TotalCost: %.3lf us, PerCost: %.3lf us\n", m_garbageNum, m_garbageCost, m_garbageCost / m_garbageNum);
+                    LOG(Helper::LogLevel::LL_Info, "MergeNum: %d, TotalCost: %.3lf ms, PerCost: %.3lf ms\n", m_mergeNum.load(), (double)m_mergeCost.load(), (double)m_mergeCost.load() / m_mergeNum.load());
                     LOG(Helper::LogLevel::LL_Info, "ReassignNum: %d, TotalCost: %.3lf us, PerCost: %.3lf us\n", m_reAssignNum, m_reAssignCost, m_reAssignCost / m_reAssignNum);
                     LOG(Helper::LogLevel::LL_Info, "ReassignNum: %d, Select TotalCost: %.3lf us, PerCost: %.3lf us\n", m_reAssignNum, m_selectCost, m_selectCost / m_reAssignNum);
                     LOG(Helper::LogLevel::LL_Info, "ReassignNum: %d, ReassignAppend TotalCost: %.3lf us, PerCost: %.3lf us\n", m_reAssignNum, m_reAssignAppendCost, m_reAssignAppendCost / m_reAssignNum);
@@ -139,6 +165,7 @@ namespace SPTAG {
                     m_splitCost = 0;
                     m_clusteringCost = 0;
                     m_garbageCost = 0;
+                    m_mergeCost = 0;
                     m_updateHeadCost = 0;
                     m_getCost = 0;
                     m_putCost = 0;
@@ -184,6 +211,9 @@ namespace SPTAG {
             // Method for SPANN Search function only
             void SetPointer(std::shared_ptr<T> pointer) { m_pageBuffer.reset(); m_pageBuffer = pointer; }
 
+            // adopt a buffer of p_size elements allocated elsewhere, e.g. by the storage backend
+            void SetPointer(std::shared_ptr<T> pointer, std::size_t p_size) { SetPointer(pointer); m_pageBufferSize = p_size; }
+
         private:
             std::shared_ptr<T> m_pageBuffer;
 
@@ -212,6 +242,7 @@ namespace SPTAG {
                 for (int pi = 0; pi < p_internalResultNum; pi++) {
                     m_diskRequests[pi].m_extension = m_processIocp.handle();
                 }
+                m_ioBufferSource = 0;
                 m_enableDataCompression = enableDataCompression;
                 if (enableDataCompression) {
                     m_decompressBuffer.ReservePageBuffer(p_maxPages);
@@ -232,6 +263,9 @@ namespace SPTAG {
 
             std::vector<int> m_postingIDs;
 
+            // head distance of every entry in m_postingIDs, ascending
+            std::vector<float> m_postingDists;
+
             COMMON::OptHashPosVector m_deduper;
 
             Helper::RequestQueue m_processIocp;
@@ -243,9 +277,26 @@ namespace SPTAG {
 
             std::vector<Helper::AsyncReadRequest> m_diskRequests;
 
+            // page buffers handed out by the extra searcher's storage, read into without copies. The workspace
+            // outlives the index on its thread, the buffers are only valid for the storage that m_ioBufferSource names.
+            std::uint64_t m_ioBufferSource;
+            std::vector<std::uint8_t*> m_readBuffers;
+            std::vector<std::size_t> m_readSizes;
+
+            // postings read ahead while the head search is still running, the reads of one
+            // PrefetchPostings call fill m_prefetchSizes from its slot offset and return their read time
+            std::vector<int> m_prefetchIDs;
+            std::vector<PageBuffer<std::uint8_t>> m_prefetchPageBuffers;
+            std::vector<std::uint8_t*> m_prefetchBuffers;
+            std::vector<std::size_t> m_prefetchSizes;
+            std::vector<std::string> m_prefetchDeltas;
+            std::vector<std::future<double>> m_prefetchReads;
+
             int m_spaceID;
 
             static std::atomic_int g_spaceCount;
+
+            static std::atomic_uint64_t g_ioBufferSources;
         };
 
         class IExtraSearcher
@@ -266,6 +317,36 @@ namespace SPTAG {
                 std::shared_ptr<VectorIndex> p_index,
                 SearchStats* p_stats, std::set<int>* truth = nullptr, std::map<int, std::set<int>>* found = nullptr) = 0;
 
+            // Searches the postings p_postingIDs[q] for every query p_queryResults[q], p_stats gets the totals of the batch.
+            // Searchers that can read a posting once for all the queries sharing it override this per query loop.
+            virtual void SearchIndexBatch(ExtraWorkSpace* p_exWorkSpace,
+                std::vector<QueryResult*>& p_queryResults,
+                const std::vector<std::vector<SizeType>>& p_postingIDs,
+                std::shared_ptr<VectorIndex> p_index,
+                SearchStats* p_stats)
+            {
+                for (std::size_t q = 0; q < p_queryResults.size(); q++)
+                {
+                    SearchStats stats;
+                    p_exWorkSpace->m_deduper.clear();
+                    p_exWorkSpace->m_postingIDs.assign(p_postingIDs[q].begin(), p_postingIDs[q].end());
+                    p_exWorkSpace->m_postingDists.clear();
+                    SearchIndex(p_exWorkSpace, *(p_queryResults[q]), p_index, &stats);
+                    if (p_stats)
+                    {
+                        p_stats->m_totalListElementsCount += stats.m_totalListElementsCount;
+                        p_stats->m_diskIOCount += stats.m_diskIOCount;
+                        p_stats->m_diskAccessCount += stats.m_diskAccessCount;
+                        p_stats->m_compLatency += stats.m_compLatency;
+                        p_stats->m_diskReadLatency += stats.m_diskReadLatency;
+                    }
+                }
+            }
+
+            // start reading the postings in the background, the next SearchIndex on the workspace scans them
+            // without another read. false if the searcher cannot prefetch or the workspace has no free slot.
+            virtual bool PrefetchPostings(ExtraWorkSpace* p_exWorkSpace, const std::vector<SizeType>& p_postingIDs) { return false; }
+
             virtual bool BuildIndex(std::shared_ptr<Helper::VectorSetReader>& p_reader, 
                 std::shared_ptr<VectorIndex> p_index, 
                 Options& p_opt, COMMON::VersionLabel& p_versionMap, SizeType upperBound = -1) = 0;
@@ -277,6 +358,7 @@ namespace SPTAG {
             virtual ErrorCode DeleteIndex(SizeType p_id) { return ErrorCode::Undefined; }
 
             virtual bool AllFinished() { return false; }
+            virtual std::size_t PendingUpdateJobs() { return 0; }
             virtual void GetDBStats() { return; }
             virtual void GetIndexStats(int finishedInsert, bool cost, bool reset) { return; }
             virtual void ForceCompaction() { return; }
@@ -294,6 +376,15 @@ namespace SPTAG {
 
             virtual void InitPostingRecord(std::shared_ptr<VectorIndex> p_index) { return; }
 
+            // true when LoadIndex restored the postings, version map and posting sizes of an earlier run,
+            // they must not be copied from the static index again
+            virtual bool Recovered() { return false; }
+
+            // persists the postings copied from the static index, updates are logged from here on
+            virtual void FinishCopy() { return; }
+
+            virtual int GetPostingSize(SizeType postingID) { return 0; }
+
             virtual void SavePostingSizesAndVersionMap() { return; }
 
             virtual void ShowPostingDistribution(int num, bool needPrint){return;}
@@ -56,6 +56,9 @@ namespace SPTAG
             std::mutex m_dataAddLock;
             COMMON::VersionLabel m_versionMap;
 
+            // picks the postings of the head results worth reading and translates the heads to vector ids
+            void SelectPostings(COMMON::QueryResultSet<T>& p_queryResults, std::vector<SizeType>& p_postingIDs, std::vector<float>& p_postingDists) const;
+
         public:
             static thread_local std::shared_ptr<ExtraWorkSpace> m_workspace;
 
@@ -71,6 +74,7 @@ namespace SPTAG
             inline std::shared_ptr<VectorIndex> GetMemoryIndex() { return m_index; }
             inline std::shared_ptr<IExtraSearcher> GetDiskIndex() { return m_extraSearcher; }
             inline Options* GetOptions() { return &m_options; }
+            inline COMMON::VersionLabel& GetVersionMap() { return m_versionMap; }
 
             inline SizeType GetNumSamples() const { return m_versionMap.Count(); }
             inline DimensionType GetFeatureDim() const { return m_pQuantizer ? m_pQuantizer->ReconstructDim() : m_index->GetFeatureDim(); }
@@ -125,7 +129,10 @@ namespace SPTAG
             ErrorCode BuildIndex(const void* p_data, SizeType p_vectorNum, DimensionType p_dimension, bool p_normalized = false, bool p_shareOwnership = false);
             ErrorCode BuildIndex(bool p_normalized = false);
             ErrorCode SearchIndex(QueryResult &p_query, bool p_searchDeleted = false) const;
+            ErrorCode SearchHeadIndex(QueryResult& p_query) const;
             ErrorCode SearchDiskIndex(QueryResult& p_query, SearchStats* p_stats = nullptr) const;
+            // searches the queries together so that a posting selected by several of them is read once, p_stats gets the batch totals
+            ErrorCode SearchIndexBatch(std::vector<QueryResult*>& p_queries, SearchStats* p_stats = nullptr) const;
             ErrorCode DebugSearchDiskIndex(QueryResult& p_query, int p_subInternalResultNum, int p_internalResultNum,
                 SearchStats* p_stats = nullptr, std::set<int>* truth = nullptr, std::map<int, std::set<int>>* found = nullptr) const;
             ErrorCode UpdateIndex();
@@ -159,6 +166,8 @@ namespace SPTAG
         public:
             bool AllFinished() { if (m_options.m_useKV || m_options.m_useSPDK) return m_extraSearcher->AllFinished(); return true; }
 
+            std::size_t GetUpdateBacklog() { if ((m_options.m_useKV || m_options.m_useSPDK) && m_extraSearcher != nullptr) return m_extraSearcher->PendingUpdateJobs(); return 0; }
+
             void GetDBStat() { 
                 if (m_options.m_useKV || m_options.m_useSPDK) m_extraSearcher->GetDBStats(); 
                 LOG(Helper::LogLevel::LL_Info, "Current Vector Num: %d, Deleted: %d .\n", GetNumSamples(), GetNumDeleted());
@@ -178,6 +187,10 @@ namespace SPTAG
 
             bool ExitBlockController() { return m_extraSearcher->ExitBlockController(); }
 
+            bool InitializeThread() { if (m_options.m_useSPDK && m_extraSearcher != nullptr) return Initialize(); return true; }
+
+            bool ExitThread() { if (m_options.m_useSPDK && m_extraSearcher != nullptr) return ExitBlockController(); return true; }
+
             ErrorCode AddIndexSPFresh(const void *p_data, SizeType p_vectorNum, DimensionType p_dimension, SizeType* VID) {
                 if ((!m_options.m_useKV &&!m_options.m_useSPDK) || m_extraSearcher == nullptr) {
                     LOG(Helper::LogLevel::LL_Error, "Only Support KV Extra Update\n");
@@ -34,6 +34,7 @@ namespace SPTAG {
             std::string m_truthPath;
             TruthFileType m_truthType;
             bool m_generateTruth;
+            SizeType m_truthBlockVectors;
             std::string m_indexDirectory;
             std::string m_headIDFile;
             std::string m_headVectorFile;
@@ -128,12 +129,24 @@ namespace SPTAG {
             int m_debugBuildInternalResultNum;
             bool m_enableADC;
             int m_iotimeout;
+            bool m_pipelinedSearch;
+            float m_earlyStopDistRatio;
+            bool m_asyncHeadSearch;
+            int m_headPrefetchInterval;
+            int m_prefetchThreadNum;
+            int m_searchBatchQueryNum;
 
             int m_searchThreadNum;
 
             // Calculating
             std::string m_truthFilePrefix;
             bool m_calTruth;
+            bool m_incrementalTruth;
+            int m_truthSlack;
+            std::string m_telemetryPath;
+            int m_telemetryQPS;
+            int m_telemetryQueryNum;
+            int m_telemetryIntervalMs;
             bool m_calAllTruth;
             int m_searchTimes;
             int m_minInternalResultNum;
@@ -147,6 +160,17 @@ namespace SPTAG {
             bool m_searchDuringUpdate;
             int m_reassignK;
             bool m_virtualHead;
+            bool m_appendThroughMerge;
+            bool m_enableWAL;
+            std::string m_walPath;
+            int m_walGroupCommitMicros;
+            int m_walCheckpointMB;
+            int m_deltaBufferMB;
+            int m_deltaFlushThreadNum;
+            std::string m_postingQuantizerFile;
+            int m_postingRerankNum;
+            std::string m_fullVectorStorePath;
+            int m_postingAlignment;
 
             // Updating(SPFresh Update Test)
             bool m_update;
@@ -155,10 +179,14 @@ namespace SPTAG {
             float m_latencyLimit;
             int m_step;
             int m_insertThreadNum;
+            int m_insertBatchSize;
             int m_endVectorNum;
             std::string m_persistentBufferPath;
             int m_appendThreadNum;
             int m_reassignThreadNum;
+            int m_gcThreadNum;
+            float m_gcGarbageRatio;
+            float m_backgroundLatencyTarget;
             int m_batch;
             std::string m_fullVectorPath;
 
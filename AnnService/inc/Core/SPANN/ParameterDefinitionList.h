@@ -23,6 +23,7 @@ DefineBasicParameter(m_warmupDelimiter, std::string, std::string("|"), "WarmupDe
 DefineBasicParameter(m_truthPath, std::string, std::string(""), "TruthPath")
 DefineBasicParameter(m_truthType, SPTAG::TruthFileType, SPTAG::TruthFileType::Undefined, "TruthType")
 DefineBasicParameter(m_generateTruth, bool, false, "GenerateTruth")
+DefineBasicParameter(m_truthBlockVectors, SPTAG::SizeType, 0, "TruthBlockVectors")
 DefineBasicParameter(m_indexDirectory, std::string, std::string("SPANN"), "IndexDirectory")
 DefineBasicParameter(m_headIDFile, std::string, std::string("SPTAGHeadVectorIDs.bin"), "HeadVectorIDs")
 DefineBasicParameter(m_deleteIDFile, std::string, std::string("DeletedIDs.bin"), "DeletedIDs")
@@ -126,12 +127,33 @@ DefineSSDParameter(m_enableADC, bool, false, "EnableADC")
 DefineSSDParameter(m_recall_analysis, bool, false, "RecallAnalysis")
 DefineSSDParameter(m_debugBuildInternalResultNum, int, 64, "DebugBuildInternalResultNum")
 DefineSSDParameter(m_iotimeout, int, 30, "IOTimeout")
+// Scan every posting as soon as its read completes instead of after the whole MultiGet
+DefineSSDParameter(m_pipelinedSearch, bool, false, "PipelinedSearch")
+// Stop reading once every unscanned posting head is farther than EarlyStopDistRatio * current worst result, 0 disables
+DefineSSDParameter(m_earlyStopDistRatio, float, 0, "EarlyStopDistRatio")
+// Read the postings of confidently near heads while the head search is still running
+DefineSSDParameter(m_asyncHeadSearch, bool, false, "AsyncHeadSearch")
+// Checked head nodes between two looks at the partial head results
+DefineSSDParameter(m_headPrefetchInterval, int, 64, "HeadPrefetchInterval")
+DefineSSDParameter(m_prefetchThreadNum, int, 2, "PrefetchThreadNum")
+// Queries searched together by one thread, a posting selected by several of them is read once. 1 searches them one by one
+DefineSSDParameter(m_searchBatchQueryNum, int, 1, "SearchBatchQueryNum")
 
 // Calculating
 // TruthFilePrefix
 DefineSSDParameter(m_truthFilePrefix, std::string, std::string(""), "TruthFilePrefix")
 // CalTruth
 DefineSSDParameter(m_calTruth, bool, true, "CalTruth")
+// Keep the truth of every update day current from the update traces instead of loading TruthFilePrefix files, needs LoadAllVectors
+DefineSSDParameter(m_incrementalTruth, bool, false, "IncrementalTruth")
+// Neighbors kept per query beyond ResultNum, so that deletes seldom force a rescan of the query
+DefineSSDParameter(m_truthSlack, int, 10, "TruthSlack")
+// Sample searches next to the updates and write their latency and recall per interval to this CSV file, JSON lines for .json
+DefineSSDParameter(m_telemetryPath, std::string, std::string(""), "TelemetryPath")
+DefineSSDParameter(m_telemetryQPS, int, 100, "TelemetryQPS")
+// Sampled queries cycle through the first TelemetryQueryNum queries
+DefineSSDParameter(m_telemetryQueryNum, int, 1000, "TelemetryQueryNum")
+DefineSSDParameter(m_telemetryIntervalMs, int, 1000, "TelemetryIntervalMs")
 DefineSSDParameter(m_onlySearchFinalBatch, bool, false, "OnlySearchFinalBatch")
 // Search multiple times for stable result
 DefineSSDParameter(m_searchTimes, int, 1, "SearchTimes")
@@ -154,6 +176,8 @@ DefineSSDParameter(m_latencyLimit, float, 2.0, "LatencyLimit")
 DefineSSDParameter(m_step, int, 0, "Step")
 // Frontend update threadnum
 DefineSSDParameter(m_insertThreadNum, int, 16, "InsertThreadNum")
+// Vectors handed to one AddIndex call by every insert thread
+DefineSSDParameter(m_insertBatchSize, int, 1, "InsertBatchSize")
 // Update limit
 DefineSSDParameter(m_endVectorNum, int, -1, "EndVectorNum")
 // Persistent buffer path
@@ -162,6 +186,12 @@ DefineSSDParameter(m_persistentBufferPath, std::string, std::string(""), "Persis
 DefineSSDParameter(m_appendThreadNum, int, 16, "AppendThreadNum")
 // Background reassign threadnum
 DefineSSDParameter(m_reassignThreadNum, int, 16, "ReassignThreadNum")
+// Background garbage collection threadnum
+DefineSSDParameter(m_gcThreadNum, int, 1, "GCThreadNum")
+// Garbage collect a posting once search finds more than this fraction of it deleted or stale, 0 disables
+DefineSSDParameter(m_gcGarbageRatio, float, 0.0F, "GCGarbageRatio")
+// Search latency p99 (ms) above which merge, reassign and GC back off, 0 disables
+DefineSSDParameter(m_backgroundLatencyTarget, float, 0, "BackgroundLatencyTargetMs")
 // Background process batch size
 DefineSSDParameter(m_batch, int, 1000, "Batch")
 // Total Vector Path
@@ -202,4 +232,21 @@ DefineSSDParameter(m_disableReassign, bool, false, "DisableReassign")
 DefineSSDParameter(m_searchDuringUpdate, bool, false, "SearchDuringUpdate")
 DefineSSDParameter(m_reassignK, int, 0, "ReassignK")
 DefineSSDParameter(m_virtualHead, bool, false, "VirtualHead")
+// Append only the new vectors through db->Merge instead of rewriting the whole posting
+DefineSSDParameter(m_appendThroughMerge, bool, false, "AppendThroughMerge")
+// Write-ahead log of mapping/version/size updates, replayed on LoadIndex. WALPath defaults to <IndexDirectory>/wal
+DefineSSDParameter(m_enableWAL, bool, false, "EnableWAL")
+DefineSSDParameter(m_walPath, std::string, std::string(""), "WALPath")
+DefineSSDParameter(m_walGroupCommitMicros, int, 1000, "WALGroupCommitMicros")
+DefineSSDParameter(m_walCheckpointMB, int, 256, "WALCheckpointMB")
+// In-memory write-back delta of every posting, flushed once it fills a page or the budget is exceeded. 0 disables it
+DefineSSDParameter(m_deltaBufferMB, int, 0, "DeltaBufferMB")
+DefineSSDParameter(m_deltaFlushThreadNum, int, 2, "DeltaFlushThreadNum")
+// Store PQ/OPQ codes instead of vectors in the dynamic postings and scan them with ADC tables. Empty disables it
+DefineSSDParameter(m_postingQuantizerFile, std::string, std::string(""), "PostingQuantizerFile")
+// Re-rank that many ADC candidates with full vectors from FullVectorStorePath (defaults to <IndexDirectory>/fullvectors.bin)
+DefineSSDParameter(m_postingRerankNum, int, 0, "PostingRerankNum")
+DefineSSDParameter(m_fullVectorStorePath, std::string, std::string(""), "FullVectorStorePath")
+// Keep posting IDs and versions ahead of vectors aligned to 32 or 64 bytes. 0 keeps the interleaved records
+DefineSSDParameter(m_postingAlignment, int, 0, "PostingAlignment")
 #endif
@@ -0,0 +1,122 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_SPANN_POSTINGDELTABUFFER_H_
+#define _SPTAG_SPANN_POSTINGDELTABUFFER_H_
+
+#include "inc/Core/Common.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace SPTAG {
+    namespace SPANN {
+        // Write-back buffer of the vectors appended to a posting but not yet written to storage.
+        // The owner serializes Append/Erase of one posting with its posting lock; the shard locks
+        // only protect the maps against concurrent readers (search) and other postings.
+        class PostingDeltaBuffer
+        {
+        public:
+            PostingDeltaBuffer() : m_budget(0), m_bytes(0) {}
+
+            void Initialize(std::size_t p_budgetBytes)
+            {
+                m_budget = p_budgetBytes;
+                m_shards.reset(new Shard[ShardCount]);
+            }
+
+            bool Enabled() const { return m_budget > 0; }
+
+            bool OverBudget() const { return m_bytes.load() > m_budget; }
+
+            std::size_t GetBytes() const { return m_bytes.load(); }
+
+            // returns the buffered bytes of the posting before the append
+            std::size_t Append(SizeType p_headID, const std::string& p_data)
+            {
+                Shard& shard = GetShard(p_headID);
+                std::lock_guard<std::mutex> lock(shard.m_lock);
+                std::string& delta = shard.m_deltas[p_headID];
+                std::size_t before = delta.size();
+                delta.append(p_data);
+                m_bytes += p_data.size();
+                return before;
+            }
+
+            // appends a copy of the buffered vectors of the posting to p_out, false if there is none
+            bool Get(SizeType p_headID, std::string* p_out)
+            {
+                if (!Enabled()) return false;
+                Shard& shard = GetShard(p_headID);
+                std::lock_guard<std::mutex> lock(shard.m_lock);
+                auto iter = shard.m_deltas.find(p_headID);
+                if (iter == shard.m_deltas.end()) return false;
+                p_out->append(iter->second);
+                return true;
+            }
+
+            // drops the buffered vectors of the posting once they are on storage
+            void Erase(SizeType p_headID)
+            {
+                Shard& shard = GetShard(p_headID);
+                std::lock_guard<std::mutex> lock(shard.m_lock);
+                auto iter = shard.m_deltas.find(p_headID);
+                if (iter == shard.m_deltas.end()) return;
+                m_bytes -= iter->second.size();
+                shard.m_deltas.erase(iter);
+            }
+
+            void GetKeys(std::vector<SizeType>& p_keys)
+            {
+                p_keys.clear();
+                for (int i = 0; i < ShardCount; i++) {
+                    std::lock_guard<std::mutex> lock(m_shards[i].m_lock);
+                    for (auto& iter : m_shards[i].m_deltas) p_keys.push_back(iter.first);
+                }
+            }
+
+            // the postings whose deltas to flush to bring the buffer down to p_targetBytes, largest deltas first
+            void GetEvictionCandidates(std::size_t p_targetBytes, std::vector<SizeType>& p_keys)
+            {
+                p_keys.clear();
+                std::size_t bytes = m_bytes.load();
+                if (bytes <= p_targetBytes) return;
+
+                std::vector<std::pair<std::size_t, SizeType>> sizes;
+                for (int i = 0; i < ShardCount; i++) {
+                    std::lock_guard<std::mutex> lock(m_shards[i].m_lock);
+                    for (auto& iter : m_shards[i].m_deltas) sizes.emplace_back(iter.second.size(), iter.first);
+                }
+                std::sort(sizes.begin(), sizes.end(), [](const std::pair<std::size_t, SizeType>& a, const std::pair<std::size_t, SizeType>& b) { return a.first > b.first; });
+
+                std::size_t freed = 0;
+                for (auto& entry : sizes) {
+                    if (freed >= bytes - p_targetBytes) break;
+                    p_keys.push_back(entry.second);
+                    freed += entry.first;
+                }
+            }
+
+        private:
+            static const int ShardCount = 256;
+
+            struct Shard
+            {
+                std::mutex m_lock;
+                std::unordered_map<SizeType, std::string> m_deltas;
+            };
+
+            inline Shard& GetShard(SizeType p_headID) { return m_shards[((std::uint32_t)p_headID) % ShardCount]; }
+
+            std::unique_ptr<Shard[]> m_shards;
+            std::size_t m_budget;
+            std::atomic<std::size_t> m_bytes;
+        };
+    }
+}
+
+#endif // _SPTAG_SPANN_POSTINGDELTABUFFER_H_
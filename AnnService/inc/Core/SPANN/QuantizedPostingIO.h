@@ -0,0 +1,158 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_SPANN_QUANTIZEDPOSTINGIO_H_
+#define _SPTAG_SPANN_QUANTIZEDPOSTINGIO_H_
+
+#include "inc/Core/Common.h"
+#include "inc/Core/Common/IQuantizer.h"
+#include "inc/Helper/KeyValueIO.h"
+#include <memory>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace SPTAG {
+    namespace SPANN {
+        // Stores postings as [VID][version][PQ/OPQ codes] while its users keep seeing [VID][version][vector][codes]
+        // records: a vector is quantized once by FillCode when its record is created, Put/Merge keep only the codes
+        // and Get/MultiGet reconstruct the vectors next to them, so rewritten postings never quantize the
+        // reconstructions again. The search path reads the codes straight from the wrapped storage and scans them
+        // with the ADC distance tables.
+        class QuantizedKeyValueIO : public Helper::KeyValueIO
+        {
+        public:
+            QuantizedKeyValueIO(std::shared_ptr<Helper::KeyValueIO> p_storage, std::shared_ptr<COMMON::IQuantizer> p_quantizer,
+                int p_metaDataSize, int p_vectorInfoSize, int p_codeInfoSize)
+                : m_storage(p_storage), m_quantizer(p_quantizer),
+                m_metaDataSize(p_metaDataSize), m_vectorInfoSize(p_vectorInfoSize), m_codeInfoSize(p_codeInfoSize),
+                m_codeOffset(p_vectorInfoSize - (p_codeInfoSize - p_metaDataSize)) {}
+
+            ~QuantizedKeyValueIO() {}
+
+            void ShutDown() override { m_storage->ShutDown(); }
+
+            ErrorCode Get(SizeType key, std::string* value) override
+            {
+                std::string codes;
+                ErrorCode ret = m_storage->Get(key, &codes);
+                if (ret == ErrorCode::Success) Decode(codes, value);
+                return ret;
+            }
+
+            ErrorCode MultiGet(const std::vector<SizeType>& keys, std::vector<std::string>* values, const std::chrono::microseconds &timeout = std::chrono::microseconds::max()) override
+            {
+                std::vector<std::string> codes;
+                ErrorCode ret = m_storage->MultiGet(keys, &codes, timeout);
+                values->resize(codes.size());
+                for (std::size_t i = 0; i < codes.size(); i++) Decode(codes[i], &((*values)[i]));
+                return ret;
+            }
+
+            ErrorCode Put(SizeType key, const std::string& value) override
+            {
+                std::string codes;
+                Encode(value, &codes);
+                return m_storage->Put(key, codes);
+            }
+
+            ErrorCode Merge(SizeType key, const std::string& value) override
+            {
+                std::string codes;
+                Encode(value, &codes);
+                return m_storage->Merge(key, codes);
+            }
+
+            ErrorCode Delete(SizeType key) override { return m_storage->Delete(key); }
+
+            void ForceCompaction() override { m_storage->ForceCompaction(); }
+
+            void GetStat() override { m_storage->GetStat(); }
+
+            bool Initialize(bool debug = false) override { return m_storage->Initialize(debug); }
+
+            bool ExitBlockController(bool debug = false) override { return m_storage->ExitBlockController(debug); }
+
+            // quantizes the vector of a [VID][version][vector][codes] record into its codes
+            void FillCode(char* p_record) const
+            {
+                m_quantizer->QuantizeVector(p_record + m_metaDataSize, (std::uint8_t*)(p_record + m_codeOffset));
+            }
+
+            void Encode(const std::string& p_records, std::string* p_codes) const
+            {
+                std::size_t num = p_records.size() / m_vectorInfoSize;
+                p_codes->resize(num * m_codeInfoSize);
+                const char* src = p_records.data();
+                char* dst = &(*p_codes)[0];
+                for (std::size_t i = 0; i < num; i++, src += m_vectorInfoSize, dst += m_codeInfoSize) {
+                    memcpy(dst, src, m_metaDataSize);
+                    memcpy(dst + m_metaDataSize, src + m_codeOffset, m_codeInfoSize - m_metaDataSize);
+                }
+            }
+
+            void Decode(const std::string& p_codes, std::string* p_records) const
+            {
+                std::size_t num = p_codes.size() / m_codeInfoSize;
+                p_records->resize(num * m_vectorInfoSize);
+                const char* src = p_codes.data();
+                char* dst = &(*p_records)[0];
+                for (std::size_t i = 0; i < num; i++, src += m_codeInfoSize, dst += m_vectorInfoSize) {
+                    memcpy(dst, src, m_metaDataSize);
+                    m_quantizer->ReconstructVector((const std::uint8_t*)(src + m_metaDataSize), dst + m_metaDataSize);
+                    memcpy(dst + m_codeOffset, src + m_metaDataSize, m_codeInfoSize - m_metaDataSize);
+                }
+            }
+
+        private:
+            std::shared_ptr<Helper::KeyValueIO> m_storage;
+            std::shared_ptr<COMMON::IQuantizer> m_quantizer;
+            int m_metaDataSize;
+            int m_vectorInfoSize;
+            int m_codeInfoSize;
+            int m_codeOffset;
+        };
+
+        // Full precision vectors indexed by VID in one flat file, read back to re-rank the quantized candidates.
+        class FullVectorStore
+        {
+        public:
+            FullVectorStore() : m_fd(-1), m_vectorSize(0) {}
+
+            ~FullVectorStore() { if (m_fd >= 0) close(m_fd); }
+
+            bool Open(const std::string& p_path, std::size_t p_vectorSize)
+            {
+                m_vectorSize = p_vectorSize;
+                m_fd = open(p_path.c_str(), O_RDWR | O_CREAT, 0644);
+                if (m_fd < 0) {
+                    LOG(Helper::LogLevel::LL_Error, "FullVectorStore: fail to open %s\n", p_path.c_str());
+                    return false;
+                }
+                return true;
+            }
+
+            ErrorCode Put(SizeType p_vid, const void* p_vector)
+            {
+                if (pwrite(m_fd, p_vector, m_vectorSize, ((off_t)p_vid) * m_vectorSize) != (ssize_t)m_vectorSize) {
+                    LOG(Helper::LogLevel::LL_Error, "FullVectorStore: fail to write vector %d\n", p_vid);
+                    return ErrorCode::DiskIOFail;
+                }
+                return ErrorCode::Success;
+            }
+
+            ErrorCode Get(SizeType p_vid, void* p_vector) const
+            {
+                if (pread(m_fd, p_vector, m_vectorSize, ((off_t)p_vid) * m_vectorSize) != (ssize_t)m_vectorSize) return ErrorCode::DiskIOFail;
+                return ErrorCode::Success;
+            }
+
+        private:
+            int m_fd;
+            std::size_t m_vectorSize;
+        };
+    }
+}
+
+#endif // _SPTAG_SPANN_QUANTIZEDPOSTINGIO_H_
@@ -0,0 +1,410 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_SPANN_WRITEAHEADLOG_H_
+#define _SPTAG_SPANN_WRITEAHEADLOG_H_
+
+#include "inc/Core/Common.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace SPTAG {
+    namespace SPANN {
+        // Append-only redo log of the in-memory update state (SPDK block mapping, version map, posting sizes).
+        // Every record carries the absolute new value of one key, so replaying a record twice is harmless.
+        // Records are group committed by a background flusher: one write + fdatasync per commit interval.
+        // The log is split into segments <prefix>.<seq>.log; an incremental checkpoint folds the sealed
+        // segments into <prefix>.ckpt keeping only the last record of every key, so recovery cost is bounded
+        // by the number of touched keys instead of the number of updates.
+        class WriteAheadLog
+        {
+        public:
+            enum class RecordType : std::uint8_t
+            {
+                Mapping = 1,
+                MappingDelete = 2,
+                Version = 3,
+                PostingSize = 4,
+            };
+
+            typedef std::function<void(RecordType, SizeType, const char*, std::uint16_t)> ReplayFunc;
+
+            WriteAheadLog() {}
+
+            ~WriteAheadLog() { Close(); }
+
+            ErrorCode Open(const std::string& p_prefix, int p_groupCommitMicros, std::uint64_t p_checkpointBytes)
+            {
+                m_prefix = p_prefix;
+                m_groupCommitMicros = p_groupCommitMicros;
+                m_checkpointBytes = p_checkpointBytes;
+
+                m_firstSegment = 0;
+                ReadCheckpoint(nullptr, &m_firstSegment);
+                m_segment = m_firstSegment;
+                while (fileexists(SegmentPath(m_segment).c_str())) m_segment++;
+
+                // never append behind a possibly torn tail, always start a fresh segment
+                if (!OpenSegment(m_segment)) return ErrorCode::FailedCreateFile;
+
+                m_stop = false;
+                m_flusher = std::thread(&WriteAheadLog::FlushLoop, this);
+                LOG(Helper::LogLevel::LL_Info, "WAL: open %s, segments [%llu, %llu), group commit %d us\n", m_prefix.c_str(), m_firstSegment, m_segment, m_groupCommitMicros);
+                return ErrorCode::Success;
+            }
+
+            void Close()
+            {
+                if (m_fd < 0) return;
+                {
+                    std::lock_guard<std::mutex> lock(m_appendMutex);
+                    m_stop = true;
+                }
+                m_flushCond.notify_all();
+                if (m_flusher.joinable()) m_flusher.join();
+                {
+                    std::lock_guard<std::mutex> lock(m_ioMutex);
+                    FlushLocked();
+                    close(m_fd);
+                    m_fd = -1;
+                }
+            }
+
+            // replay the checkpoint and every sealed segment in log order, stops a segment at its first torn record
+            ErrorCode Replay(const ReplayFunc& p_func)
+            {
+                std::uint64_t records = 0, firstSegment = 0;
+                ReadCheckpoint(&p_func, &firstSegment);
+                for (std::uint64_t seq = firstSegment; seq < m_segment; seq++) {
+                    records += ReplaySegment(SegmentPath(seq), p_func);
+                }
+                LOG(Helper::LogLevel::LL_Info, "WAL: replayed %llu records from segments [%llu, %llu)\n", records, firstSegment, m_segment);
+                return ErrorCode::Success;
+            }
+
+            // returns the log sequence number which is durable once WaitDurable(lsn) returns
+            std::uint64_t Append(RecordType p_type, SizeType p_key, const void* p_payload, std::uint16_t p_length)
+            {
+                RecordHeader header;
+                header.m_type = (std::uint8_t)p_type;
+                header.m_reserved = 0;
+                header.m_length = p_length;
+                header.m_key = p_key;
+                header.m_checksum = Checksum(header, (const char*)p_payload);
+
+                std::lock_guard<std::mutex> lock(m_appendMutex);
+                m_active.append((const char*)&header, sizeof(RecordHeader));
+                m_active.append((const char*)p_payload, p_length);
+                m_appendedLSN += sizeof(RecordHeader) + p_length;
+                m_records++;
+                return m_appendedLSN;
+            }
+
+            void WaitDurable(std::uint64_t p_lsn)
+            {
+                std::unique_lock<std::mutex> lock(m_appendMutex);
+                if (m_durableLSN >= p_lsn) return;
+                m_flushCond.notify_one();
+                m_durableCond.wait(lock, [&] { return m_durableLSN >= p_lsn || m_fd < 0; });
+            }
+
+            // Runs p_release once every record up to p_lsn is durable, on the flusher unless it already is. Resources
+            // a logged update stopped referencing must not be reused before that, or a replay after a crash could
+            // bring back a record pointing at them.
+            void DeferUntilDurable(std::uint64_t p_lsn, std::function<void()> p_release)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_appendMutex);
+                    if (m_durableLSN < p_lsn) {
+                        m_deferred.emplace_back(p_lsn, std::move(p_release));
+                        return;
+                    }
+                }
+                p_release();
+            }
+
+            void Flush()
+            {
+                std::lock_guard<std::mutex> lock(m_ioMutex);
+                FlushLocked();
+            }
+
+            // p_snapshot persists a full snapshot of the state, every record logged before it is dropped when it
+            // succeeds. Checkpoints are held off meanwhile so the first live segment only ever moves forward.
+            ErrorCode Truncate(const std::function<ErrorCode()>& p_snapshot)
+            {
+                std::lock_guard<std::mutex> lock(m_checkpointMutex);
+                std::uint64_t sealed = Rotate();
+                ErrorCode ret = p_snapshot();
+                if (ret != ErrorCode::Success) return ret;
+
+                std::unordered_map<std::uint64_t, std::string> empty;
+                ret = WriteCheckpoint(empty, sealed);
+                if (ret != ErrorCode::Success) return ret;
+                RemoveSegments(sealed);
+                return ErrorCode::Success;
+            }
+
+            ErrorCode Checkpoint()
+            {
+                std::lock_guard<std::mutex> lock(m_checkpointMutex);
+                auto begin = std::chrono::high_resolution_clock::now();
+                std::uint64_t sealed = Rotate();
+
+                // last record of every (kind, key), a mapping delete shares the slot of the mapping record
+                std::unordered_map<std::uint64_t, std::string> latest;
+                ReplayFunc fold = [&](RecordType type, SizeType key, const char* payload, std::uint16_t length) {
+                    std::uint64_t slot = ((std::uint64_t)(type == RecordType::MappingDelete ? RecordType::Mapping : type) << 32) | (std::uint32_t)key;
+                    std::string& record = latest[slot];
+                    record.resize(sizeof(RecordHeader) + length);
+                    RecordHeader* header = (RecordHeader*)&record[0];
+                    header->m_type = (std::uint8_t)type;
+                    header->m_reserved = 0;
+                    header->m_length = length;
+                    header->m_key = key;
+                    header->m_checksum = Checksum(*header, payload);
+                    memcpy(&record[sizeof(RecordHeader)], payload, length);
+                };
+                std::uint64_t firstSegment = 0;
+                ReadCheckpoint(&fold, &firstSegment);
+                for (std::uint64_t seq = m_firstSegment; seq < sealed; seq++) ReplaySegment(SegmentPath(seq), fold);
+
+                ErrorCode ret = WriteCheckpoint(latest, sealed);
+                if (ret != ErrorCode::Success) return ret;
+                RemoveSegments(sealed);
+                m_checkpoints++;
+
+                auto end = std::chrono::high_resolution_clock::now();
+                LOG(Helper::LogLevel::LL_Info, "WAL: checkpoint %zu keys up to segment %llu in %lld ms\n", latest.size(), sealed,
+                    (long long)std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count());
+                return ErrorCode::Success;
+            }
+
+            void GetStat()
+            {
+                std::uint64_t syncs = m_syncs.load();
+                LOG(Helper::LogLevel::LL_Info, "WAL: %llu records, %llu bytes, %llu group commits (%.2lf records/commit), %llu checkpoints\n",
+                    m_records.load(), m_durableLSN, syncs, syncs == 0 ? 0.0 : m_records.load() / (double)syncs, m_checkpoints.load());
+            }
+
+        private:
+#pragma pack(push, 1)
+            struct RecordHeader
+            {
+                std::uint32_t m_checksum;
+                std::uint8_t m_type;
+                std::uint8_t m_reserved;
+                std::uint16_t m_length;
+                SizeType m_key;
+            };
+#pragma pack(pop)
+
+            static constexpr std::uint32_t kCheckpointMagic = 0x4c415753; // "SWAL"
+
+            // seal the current segment, every record appended afterwards goes to the returned segment
+            std::uint64_t Rotate()
+            {
+                std::lock_guard<std::mutex> lock(m_ioMutex);
+                FlushLocked();
+                close(m_fd);
+                OpenSegment(m_segment + 1);
+                return m_segment;
+            }
+
+            static std::uint32_t Checksum(const RecordHeader& p_header, const char* p_payload)
+            {
+                // FNV-1a over everything behind the checksum field
+                std::uint32_t hash = 2166136261u;
+                const std::uint8_t* ptr = (const std::uint8_t*)&p_header + sizeof(std::uint32_t);
+                for (std::size_t i = sizeof(std::uint32_t); i < sizeof(RecordHeader); i++, ptr++) hash = (hash ^ *ptr) * 16777619u;
+                for (std::uint16_t i = 0; i < p_header.m_length; i++) hash = (hash ^ (std::uint8_t)p_payload[i]) * 16777619u;
+                return hash;
+            }
+
+            std::string SegmentPath(std::uint64_t p_segment) const { return m_prefix + "." + std::to_string(p_segment) + ".log"; }
+
+            std::string CheckpointPath() const { return m_prefix + ".ckpt"; }
+
+            bool OpenSegment(std::uint64_t p_segment)
+            {
+                m_segment = p_segment;
+                m_segmentBytes = 0;
+                m_fd = open(SegmentPath(p_segment).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                if (m_fd < 0) {
+                    LOG(Helper::LogLevel::LL_Error, "WAL: fail to create segment %s\n", SegmentPath(p_segment).c_str());
+                    return false;
+                }
+                return true;
+            }
+
+            // caller holds m_ioMutex
+            void FlushLocked()
+            {
+                std::uint64_t lsn;
+                {
+                    std::lock_guard<std::mutex> lock(m_appendMutex);
+                    m_writing.swap(m_active);
+                    lsn = m_appendedLSN;
+                }
+                if (!m_writing.empty()) {
+                    std::size_t written = 0;
+                    while (written < m_writing.size()) {
+                        ssize_t ret = write(m_fd, m_writing.data() + written, m_writing.size() - written);
+                        if (ret < 0) {
+                            LOG(Helper::LogLevel::LL_Error, "WAL: fail to write segment %llu\n", m_segment);
+                            exit(1);
+                        }
+                        written += ret;
+                    }
+                    fdatasync(m_fd);
+                    m_segmentBytes += m_writing.size();
+                    m_writing.clear();
+                    m_syncs++;
+                }
+                std::vector<std::function<void()>> releases;
+                {
+                    std::lock_guard<std::mutex> lock(m_appendMutex);
+                    m_durableLSN = lsn;
+                    auto durable = std::partition(m_deferred.begin(), m_deferred.end(), [lsn](const std::pair<std::uint64_t, std::function<void()>>& p) { return p.first > lsn; });
+                    for (auto it = durable; it != m_deferred.end(); it++) releases.push_back(std::move(it->second));
+                    m_deferred.erase(durable, m_deferred.end());
+                }
+                m_durableCond.notify_all();
+                for (auto& release : releases) release();
+            }
+
+            void FlushLoop()
+            {
+                while (true) {
+                    {
+                        std::unique_lock<std::mutex> lock(m_appendMutex);
+                        m_flushCond.wait_for(lock, std::chrono::microseconds(m_groupCommitMicros), [&] { return m_stop; });
+                        if (m_stop) return;
+                    }
+                    bool needCheckpoint;
+                    {
+                        std::lock_guard<std::mutex> lock(m_ioMutex);
+                        FlushLocked();
+                        needCheckpoint = m_checkpointBytes > 0 && m_segmentBytes >= m_checkpointBytes;
+                    }
+                    if (needCheckpoint) Checkpoint();
+                }
+            }
+
+            std::uint64_t ReplaySegment(const std::string& p_path, const ReplayFunc& p_func, std::uint64_t p_offset = 0)
+            {
+                FILE* fp = fopen(p_path.c_str(), "rb");
+                if (fp == nullptr) return 0;
+                fseek(fp, (long)p_offset, SEEK_SET);
+
+                std::uint64_t records = 0;
+                RecordHeader header;
+                std::string payload;
+                while (fread(&header, sizeof(RecordHeader), 1, fp) == 1) {
+                    payload.resize(header.m_length);
+                    if (header.m_length > 0 && fread(&payload[0], header.m_length, 1, fp) != 1) break;
+                    if (Checksum(header, payload.data()) != header.m_checksum) {
+                        LOG(Helper::LogLevel::LL_Warning, "WAL: torn record in %s after %llu records, ignore the rest\n", p_path.c_str(), records);
+                        break;
+                    }
+                    p_func((RecordType)header.m_type, header.m_key, payload.data(), header.m_length);
+                    records++;
+                }
+                fclose(fp);
+                return records;
+            }
+
+            // checkpoint layout: [magic][uint64 first live segment][records]
+            void ReadCheckpoint(const ReplayFunc* p_func, std::uint64_t* p_firstSegment)
+            {
+                FILE* fp = fopen(CheckpointPath().c_str(), "rb");
+                if (fp == nullptr) return;
+                std::uint32_t magic = 0;
+                std::uint64_t firstSegment = 0;
+                bool valid = fread(&magic, sizeof(magic), 1, fp) == 1 && magic == kCheckpointMagic && fread(&firstSegment, sizeof(firstSegment), 1, fp) == 1;
+                fclose(fp);
+                if (!valid) {
+                    LOG(Helper::LogLevel::LL_Error, "WAL: invalid checkpoint %s\n", CheckpointPath().c_str());
+                    return;
+                }
+                *p_firstSegment = firstSegment;
+                if (p_func != nullptr) ReplaySegment(CheckpointPath(), *p_func, sizeof(magic) + sizeof(firstSegment));
+            }
+
+            ErrorCode WriteCheckpoint(const std::unordered_map<std::uint64_t, std::string>& p_records, std::uint64_t p_firstSegment)
+            {
+                std::string tmpPath = CheckpointPath() + ".tmp";
+                int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                if (fd < 0) {
+                    LOG(Helper::LogLevel::LL_Error, "WAL: fail to create checkpoint %s\n", tmpPath.c_str());
+                    return ErrorCode::FailedCreateFile;
+                }
+                std::string buffer;
+                buffer.append((const char*)&kCheckpointMagic, sizeof(kCheckpointMagic));
+                buffer.append((const char*)&p_firstSegment, sizeof(p_firstSegment));
+                for (auto& record : p_records) buffer += record.second;
+
+                std::size_t written = 0;
+                while (written < buffer.size()) {
+                    ssize_t ret = write(fd, buffer.data() + written, buffer.size() - written);
+                    if (ret < 0) {
+                        close(fd);
+                        return ErrorCode::DiskIOFail;
+                    }
+                    written += ret;
+                }
+                fdatasync(fd);
+                close(fd);
+                if (std::rename(tmpPath.c_str(), CheckpointPath().c_str()) != 0) return ErrorCode::FailedCreateFile;
+                return ErrorCode::Success;
+            }
+
+            void RemoveSegments(std::uint64_t p_before)
+            {
+                for (std::uint64_t seq = m_firstSegment; seq < p_before; seq++) std::remove(SegmentPath(seq).c_str());
+                m_firstSegment = p_before;
+            }
+
+            std::string m_prefix;
+            int m_groupCommitMicros = 1000;
+            std::uint64_t m_checkpointBytes = 0;
+
+            std::mutex m_appendMutex;
+            std::condition_variable m_flushCond;
+            std::condition_variable m_durableCond;
+            std::string m_active;
+            std::uint64_t m_appendedLSN = 0;
+            std::uint64_t m_durableLSN = 0;
+            bool m_stop = false;
+            // releases waiting for their record to become durable
+            std::vector<std::pair<std::uint64_t, std::function<void()>>> m_deferred;
+
+            std::mutex m_ioMutex;
+            std::string m_writing;
+            int m_fd = -1;
+            std::uint64_t m_segment = 0;
+            std::uint64_t m_segmentBytes = 0;
+
+            std::mutex m_checkpointMutex;
+            std::uint64_t m_firstSegment = 0;
+
+            std::thread m_flusher;
+            std::atomic<std::uint64_t> m_records{ 0 };
+            std::atomic<std::uint64_t> m_syncs{ 0 };
+            std::atomic<std::uint64_t> m_checkpoints{ 0 };
+        };
+    }
+}
+
+#endif // _SPTAG_SPANN_WRITEAHEADLOG_H_
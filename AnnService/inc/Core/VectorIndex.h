@@ -10,6 +10,7 @@
 #include "MetadataSet.h"
 #include "inc/Helper/SimpleIniReader.h"
 #include <unordered_set>
+#include <functional>
 #include "inc/Core/Common/IQuantizer.h"
 
 namespace SPTAG
@@ -38,6 +39,15 @@ public:
     virtual ErrorCode DeleteIndex(const void* p_vectors, SizeType p_vectorNum) = 0;
 
     virtual ErrorCode SearchIndex(QueryResult& p_results, bool p_searchDeleted = false) const = 0;
+
+    // search while p_progress(partial results, distance of the search frontier) is called every p_interval checked nodes,
+    // indexes without incremental results report once at the end
+    virtual ErrorCode SearchIndexWithProgress(QueryResult& p_results, int p_interval, std::function<void(QueryResult&, float)> p_progress) const
+    {
+        ErrorCode ret = SearchIndex(p_results);
+        if (ret == ErrorCode::Success && p_progress) p_progress(p_results, MaxDist);
+        return ret;
+    }
     
     virtual ErrorCode RefineSearchIndex(QueryResult &p_query, bool p_searchDeleted = false) const = 0;
 
@@ -66,6 +76,14 @@ public:
     virtual bool IsReady() const { return m_bReady; }
     virtual void SetReady(bool p_ready) { m_bReady = p_ready; }
 
+    // Number of queued background update jobs (splits, reassigns) the index has not run yet.
+    virtual std::size_t GetUpdateBacklog() { return 0; }
+
+    // Per-thread I/O state for indexes whose postings live on a block device. A thread that
+    // updates the index from outside calls InitializeThread once before and ExitThread once when it is done.
+    virtual bool InitializeThread() { return true; }
+    virtual bool ExitThread() { return true; }
+
     virtual std::shared_ptr<std::vector<std::uint64_t>> CalculateBufferSize() const;
 
     virtual ErrorCode SaveIndex(std::string& p_config, const std::vector<ByteArray>& p_indexBlobs);
@@ -3,6 +3,7 @@
 
 #include "inc/Core/Common.h"
 #include <chrono>
+#include <functional>
 
 namespace SPTAG
 {
@@ -24,12 +25,40 @@ namespace SPTAG
 
             virtual ErrorCode MultiGet(const std::vector<SizeType>& keys, std::vector<std::string>* values, const std::chrono::microseconds &timeout = std::chrono::microseconds::max()) = 0;
 
+            // buffers for the MultiGet below, a backend may hand out memory its device can read into directly
+            virtual std::shared_ptr<std::uint8_t> AllocateBuffer(std::size_t p_size)
+            {
+                return std::shared_ptr<std::uint8_t>((std::uint8_t*)PAGE_ALLOC(p_size), [](std::uint8_t* ptr) { PAGE_FREE(ptr); });
+            }
+
+            // read keys[i] into the caller owned p_buffers[i] of p_bufferSize bytes, (*p_sizes)[i] receives the value size.
+            // a value larger than p_bufferSize is not read but still reports its size, a missing or timed out value reports 0.
+            // p_onComplete(i) is called as soon as keys[i] is readable, returning false cancels the reads not issued yet.
+            virtual ErrorCode MultiGet(const std::vector<SizeType>& keys, const std::vector<std::uint8_t*>& p_buffers, std::size_t p_bufferSize, std::vector<std::size_t>* p_sizes, const std::chrono::microseconds &timeout = std::chrono::microseconds::max(), const std::function<bool(std::size_t)>& p_onComplete = nullptr)
+            {
+                std::vector<std::string> values;
+                ErrorCode ret = MultiGet(keys, &values, timeout);
+                p_sizes->resize(keys.size());
+                for (std::size_t i = 0; i < keys.size(); i++) {
+                    (*p_sizes)[i] = (i < values.size()) ? values[i].size() : 0;
+                    if ((*p_sizes)[i] <= p_bufferSize) memcpy(p_buffers[i], values[i].data(), (*p_sizes)[i]);
+                }
+                // no completion order to exploit here, hand the values over in key order
+                for (std::size_t i = 0; p_onComplete && i < keys.size(); i++) {
+                    if (!p_onComplete(i)) break;
+                }
+                return ret;
+            }
+
             virtual ErrorCode Put(const std::string& key, const std::string& value) { return ErrorCode::Undefined; }
 
             virtual ErrorCode Put(SizeType key, const std::string& value) = 0;
 
             virtual  ErrorCode Merge(SizeType key, const std::string& value) = 0;
 
+            // stored bytes of key without reading them, Undefined when the storage cannot tell
+            virtual ErrorCode GetSize(SizeType key, std::size_t* size) { return ErrorCode::Undefined; }
+
             virtual ErrorCode Delete(SizeType key) = 0;
 
             virtual void ForceCompaction() {}
@@ -0,0 +1,281 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_HELPER_PRIORITYTHREADPOOL_H_
+#define _SPTAG_HELPER_PRIORITYTHREADPOOL_H_
+
+#include "inc/Helper/ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+
+namespace SPTAG
+{
+    namespace Helper
+    {
+        // Background scheduler with job classes served in priority order, class 0 first, and a cap on
+        // the running jobs of every class. Each worker owns one deque per class: jobs added by a worker
+        // go to its own deque and are taken from the back, idle workers steal from the front of others.
+        // While the p99 of the recently reported foreground latencies is above the target, every class but
+        // the first runs at most one job at a time. The throttle lapses once no latency was reported for
+        // LatencyExpiryMs, so background work does not stay capped after the searches stop.
+        class PriorityThreadPool
+        {
+        public:
+            typedef ThreadPool::Job Job;
+
+            PriorityThreadPool() : m_workerNum(0), m_classNum(0), m_next(0), m_pending(0), m_stop(false),
+                m_latencyTarget(0), m_latencyP99(0), m_latencyCount(0), m_lastReport(0), m_throttled(false) {}
+
+            ~PriorityThreadPool()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_sleepLock);
+                    m_stop = true;
+                }
+                m_cond.notify_all();
+                for (auto&& t : m_threads) t.join();
+                m_threads.clear();
+            }
+
+            void init(int p_numberOfThreads, const std::vector<int>& p_classLimits,
+                std::function<void()> p_threadInit = nullptr, std::function<void()> p_threadExit = nullptr)
+            {
+                m_workerNum = max(1, p_numberOfThreads);
+                m_classNum = (int)p_classLimits.size();
+                m_classes.reset(new ClassState[m_classNum]);
+                for (int c = 0; c < m_classNum; c++) m_classes[c].m_limit = max(1, p_classLimits[c]);
+                m_workers.reset(new Worker[m_workerNum]);
+                for (int i = 0; i < m_workerNum; i++) m_workers[i].m_queues.resize(m_classNum);
+
+                for (int i = 0; i < m_workerNum; i++)
+                {
+                    m_threads.emplace_back([this, i, p_threadInit, p_threadExit] {
+                        CurrentWorker() = std::make_pair(this, i);
+                        if (p_threadInit) p_threadInit();
+                        Run(i);
+                        if (p_threadExit) p_threadExit();
+                    });
+                }
+            }
+
+            void add(Job* j, int p_class)
+            {
+                auto& current = CurrentWorker();
+                int index = (current.first == this) ? current.second : (int)(m_next.fetch_add(1) % m_workerNum);
+                // counted before the push so the counters never drop below the queued jobs
+                m_classes[p_class].m_queued++;
+                {
+                    std::lock_guard<std::mutex> lock(m_sleepLock);
+                    m_pending++;
+                }
+                {
+                    std::lock_guard<std::mutex> lock(m_workers[index].m_lock);
+                    m_workers[index].m_queues[p_class].push_back(Entry{ j, std::chrono::steady_clock::now() });
+                }
+                m_cond.notify_one();
+            }
+
+            // target p99 of ReportLatency in ms, 0 disables the throttle
+            void SetLatencyTarget(double p_target) { m_latencyTarget = p_target; }
+
+            // takes no lock: every report claims a ring slot, and the one that fills the LatencyRefresh-th slot
+            // recomputes the p99 over the samples of the last LatencyExpiryMs. A sample read while it is being
+            // replaced may pair the new time with the old latency, which the estimate tolerates.
+            void ReportLatency(double p_latency)
+            {
+                if (m_latencyTarget <= 0) return;
+                std::int64_t now = NowMs();
+                std::size_t slot = m_latencyCount.fetch_add(1);
+                Sample& sample = m_latencies[slot % LatencyWindow];
+                sample.m_latency.store(p_latency, std::memory_order_relaxed);
+                sample.m_time.store(now, std::memory_order_release);
+                m_lastReport.store(now, std::memory_order_relaxed);
+                if ((slot + 1) % LatencyRefresh != 0) return;
+
+                std::vector<double> window;
+                window.reserve(LatencyWindow);
+                for (int i = 0; i < LatencyWindow; i++) {
+                    std::int64_t time = m_latencies[i].m_time.load(std::memory_order_acquire);
+                    if (time >= 0 && now - time <= LatencyExpiryMs) window.push_back(m_latencies[i].m_latency.load(std::memory_order_relaxed));
+                }
+                if (window.empty()) return;
+                std::size_t pos = window.size() * 99 / 100;
+                std::nth_element(window.begin(), window.begin() + pos, window.end());
+                m_latencyP99 = window[pos];
+                m_throttled = m_latencyP99 > m_latencyTarget;
+            }
+
+            inline bool Throttled() const { return m_throttled && NowMs() - m_lastReport.load(std::memory_order_relaxed) <= LatencyExpiryMs; }
+
+            inline double LatencyP99() const { return m_latencyP99; }
+
+            inline size_t jobsize(int p_class) const { return m_classes[p_class].m_queued; }
+
+            inline size_t jobsize() const { return m_pending; }
+
+            inline uint32_t runningJobs(int p_class) const { return (uint32_t)m_classes[p_class].m_running; }
+
+            uint32_t runningJobs() const
+            {
+                uint32_t running = 0;
+                for (int c = 0; c < m_classNum; c++) running += runningJobs(c);
+                return running;
+            }
+
+            inline bool allClear() const { return jobsize() == 0 && runningJobs() == 0; }
+
+            // average time the finished jobs of the class spent queued, in ms
+            double averageWait(int p_class) const
+            {
+                std::uint64_t done = m_classes[p_class].m_done;
+                return done == 0 ? 0 : m_classes[p_class].m_waitUs / (double)done / 1000;
+            }
+
+        private:
+            static const int LatencyWindow = 1024;
+            static const int LatencyRefresh = 64;
+            static const std::int64_t LatencyExpiryMs = 1000;
+
+            struct Sample
+            {
+                std::atomic<double> m_latency{ 0 };
+                std::atomic<std::int64_t> m_time{ -1 };
+            };
+
+            struct Entry
+            {
+                Job* m_job;
+                std::chrono::steady_clock::time_point m_enqueueTime;
+            };
+
+            struct Worker
+            {
+                std::mutex m_lock;
+                std::vector<std::deque<Entry>> m_queues;
+            };
+
+            struct ClassState
+            {
+                int m_limit = 1;
+                std::atomic_int m_running{ 0 };
+                std::atomic_size_t m_queued{ 0 };
+                std::atomic_uint64_t m_done{ 0 };
+                std::atomic_uint64_t m_waitUs{ 0 };
+            };
+
+            static std::int64_t NowMs()
+            {
+                return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+            }
+
+            static std::pair<PriorityThreadPool*, int>& CurrentWorker()
+            {
+                static thread_local std::pair<PriorityThreadPool*, int> current(nullptr, -1);
+                return current;
+            }
+
+            bool TryPop(int p_worker, int p_class, bool p_back, Entry& p_entry)
+            {
+                std::lock_guard<std::mutex> lock(m_workers[p_worker].m_lock);
+                auto& queue = m_workers[p_worker].m_queues[p_class];
+                if (queue.empty()) return false;
+                if (p_back) {
+                    p_entry = queue.back();
+                    queue.pop_back();
+                }
+                else {
+                    p_entry = queue.front();
+                    queue.pop_front();
+                }
+                return true;
+            }
+
+            // reserves a running slot of the highest class with work under its cap and takes one of its jobs
+            bool Take(int p_worker, Entry& p_entry, int& p_class)
+            {
+                bool throttled = Throttled();
+                for (int c = 0; c < m_classNum; c++)
+                {
+                    ClassState& state = m_classes[c];
+                    if (state.m_queued == 0) continue;
+
+                    int limit = (c > 0 && throttled) ? 1 : state.m_limit;
+                    int running = state.m_running;
+                    do {
+                        if (running >= limit) break;
+                    } while (!state.m_running.compare_exchange_weak(running, running + 1));
+                    if (running >= limit) continue;
+
+                    bool found = TryPop(p_worker, c, true, p_entry);
+                    for (int k = 1; !found && k < m_workerNum; k++) found = TryPop((p_worker + k) % m_workerNum, c, false, p_entry);
+                    if (found) {
+                        state.m_queued--;
+                        m_pending--;
+                        p_class = c;
+                        return true;
+                    }
+                    state.m_running--;
+                }
+                return false;
+            }
+
+            void Run(int p_worker)
+            {
+                while (!m_stop)
+                {
+                    Entry entry;
+                    int c;
+                    if (!Take(p_worker, entry, c))
+                    {
+                        std::unique_lock<std::mutex> lock(m_sleepLock);
+                        if (m_stop) return;
+                        // queued work held back by the caps or the throttle is looked at again shortly
+                        if (m_pending > 0) m_cond.wait_for(lock, std::chrono::milliseconds(1));
+                        else m_cond.wait(lock, [this] { return m_stop || m_pending > 0; });
+                        continue;
+                    }
+
+                    auto start = std::chrono::steady_clock::now();
+                    m_classes[c].m_waitUs += std::chrono::duration_cast<std::chrono::microseconds>(start - entry.m_enqueueTime).count();
+                    try
+                    {
+                        entry.m_job->exec(&m_abort);
+                    }
+                    catch (std::exception& e) {
+                        LOG(Helper::LogLevel::LL_Error, "PriorityThreadPool: exception in %s %s\n", typeid(*entry.m_job).name(), e.what());
+                    }
+                    delete entry.m_job;
+                    m_classes[c].m_done++;
+                    m_classes[c].m_running--;
+                    m_cond.notify_one();
+                }
+            }
+
+            int m_workerNum;
+            int m_classNum;
+            std::unique_ptr<Worker[]> m_workers;
+            std::unique_ptr<ClassState[]> m_classes;
+            std::atomic_size_t m_next;
+            std::atomic_size_t m_pending;
+
+            std::atomic_bool m_stop;
+            ThreadPool::Abort m_abort{ false };
+            std::mutex m_sleepLock;
+            std::condition_variable m_cond;
+            std::vector<std::thread> m_threads;
+
+            double m_latencyTarget;
+            std::atomic<double> m_latencyP99;
+            Sample m_latencies[LatencyWindow];
+            std::atomic_size_t m_latencyCount;
+            std::atomic<std::int64_t> m_lastReport;
+            std::atomic_bool m_throttled;
+        };
+    }
+}
+
+#endif // _SPTAG_HELPER_PRIORITYTHREADPOOL_H_
@@ -2,6 +2,7 @@
 #include <inc/Core/Common/DistanceUtils.h>
 #include <inc/Core/Common/IQuantizer.h>
 #include <inc/Core/Common/PQQuantizer.h>
+#include <inc/Core/Common/PQFastScanQuantizer.h>
 
 #include <memory>
 #include <inc/Core/VectorSet.h>
@@ -58,10 +59,10 @@ public:
     float m_KmeansLambda;
 };
 
+// numCentroids is 256 for PQQuantizer codebooks and 16 for PQFastScanQuantizer ones
 template <typename T>
-std::unique_ptr<T[]> TrainPQQuantizer(std::shared_ptr<QuantizerOptions> options, std::shared_ptr<VectorSet> raw_vectors, std::shared_ptr<VectorSet> quantized_vectors)
+std::unique_ptr<T[]> TrainPQQuantizer(std::shared_ptr<QuantizerOptions> options, std::shared_ptr<VectorSet> raw_vectors, std::shared_ptr<VectorSet> quantized_vectors, SizeType numCentroids = 256)
 {
-    SizeType numCentroids = 256;
     if (raw_vectors->Dimension() % options->m_quantizedDim != 0) {
         LOG(Helper::LogLevel::LL_Error, "Only n_codebooks that divide dimension are supported.\n");
         exit(1);
@@ -3,6 +3,8 @@
 
 #include "inc/Core/Common.h"
 #include "inc/Core/Common/TruthSet.h"
+#include "inc/Core/Common/IncrementalTruthSet.h"
+#include "inc/SPFresh/SearchTelemetry.h"
 #include "inc/Core/SPANN/Index.h"
 #include "inc/Core/VectorIndex.h"
 #include "inc/Helper/SimpleIniReader.h"
@@ -296,8 +298,9 @@ namespace SPTAG {
                         index = queriesSent.fetch_add(1);
                         if (index < numQueries)
                         {
+                            p_stats[index].m_searchRequestTime = std::chrono::steady_clock::now();
                             double startTime = threadws.getElapsedMs();
-                            p_index->GetMemoryIndex()->SearchIndex(p_results[index]);
+                            p_index->SearchHeadIndex(p_results[index]);
                             double endTime = threadws.getElapsedMs();
 
                             p_stats[index].m_totalLatency = endTime - startTime;
@@ -366,6 +369,41 @@ namespace SPTAG {
                     },
                     "%.3lf");
 
+                if (std::any_of(stats.begin(), stats.end(), [](const SPANN::SearchStats& ss) { return ss.m_headPrefetchCount > 0; }))
+                {
+                    LOG(Helper::LogLevel::LL_Info, "\nHead Prefetch Hit Distribution:\n");
+                    PrintPercentiles<double, SPANN::SearchStats>(stats,
+                        [](const SPANN::SearchStats& ss) -> double
+                        {
+                            return ss.m_headPrefetchHit;
+                        },
+                        "%.3lf");
+
+                    LOG(Helper::LogLevel::LL_Info, "\nHead Prefetch Wasted Distribution:\n");
+                    PrintPercentiles<double, SPANN::SearchStats>(stats,
+                        [](const SPANN::SearchStats& ss) -> double
+                        {
+                            return ss.m_headPrefetchCount - ss.m_headPrefetchHit;
+                        },
+                        "%.3lf");
+
+                    LOG(Helper::LogLevel::LL_Info, "\nPrefetch Wait Latency Distribution:\n");
+                    PrintPercentiles<double, SPANN::SearchStats>(stats,
+                        [](const SPANN::SearchStats& ss) -> double
+                        {
+                            return ss.m_prefetchWaitLatency;
+                        },
+                        "%.3lf");
+
+                    LOG(Helper::LogLevel::LL_Info, "\nHead Search Overlap Latency Distribution:\n");
+                    PrintPercentiles<double, SPANN::SearchStats>(stats,
+                        [](const SPANN::SearchStats& ss) -> double
+                        {
+                            return ss.m_headOverlapLatency;
+                        },
+                        "%.3lf");
+                }
+
                 LOG(Helper::LogLevel::LL_Info, "\nEx Latency Distribution:\n");
                 PrintPercentiles<double, SPANN::SearchStats>(stats,
                     [](const SPANN::SearchStats& ss) -> double
@@ -600,7 +638,8 @@ namespace SPTAG {
                 std::string& truthFileName,
                 SPANN::Options& p_opts,
                 double second = 0,
-                bool showStatus = true)
+                bool showStatus = true,
+                std::shared_ptr<COMMON::IncrementalTruthSet<ValueType>> p_truth = nullptr)
             {
                 if (avgStatsNum == 0) return;
                 int numQueries = querySet->Count();
@@ -634,7 +673,8 @@ namespace SPTAG {
                     if (p_opts.m_searchResult.empty()) {
                         std::vector<std::set<SizeType>> truth;
                         int truthK = p_opts.m_resultNum;
-                        LoadTruth(p_opts, truth, numQueries, truthFileName, truthK);
+                        if (p_truth != nullptr) p_truth->GetTruth(truth);
+                        else LoadTruth(p_opts, truth, numQueries, truthFileName, truthK);
                         CalculateRecallSPFresh<ValueType>((p_index->GetMemoryIndex()).get(), results, truth, p_opts.m_resultNum, truthK, querySet, vectorSet, numQueries);
                     } else {
                         OutputResult<ValueType>(p_opts.m_searchResult + std::to_string(second), results, p_opts.m_resultNum);
@@ -642,6 +682,52 @@ namespace SPTAG {
                 }
             }
 
+            // null unless IncrementalTruth is on, then the truth of the first p_liveNum vectors is built for the queries
+            template <typename ValueType>
+            std::shared_ptr<COMMON::IncrementalTruthSet<ValueType>> CreateIncrementalTruth(SPANN::Options& p_opts,
+                std::shared_ptr<SPTAG::VectorSet> querySet,
+                std::shared_ptr<SPTAG::VectorSet> vectorSet,
+                SizeType p_liveNum)
+            {
+                if (!p_opts.m_incrementalTruth || !p_opts.m_calTruth) return nullptr;
+                if (vectorSet == nullptr) {
+                    LOG(Helper::LogLevel::LL_Error, "IncrementalTruth needs LoadAllVectors and FullVectorPath, loading truth files instead.\n");
+                    return nullptr;
+                }
+                auto truth = std::make_shared<COMMON::IncrementalTruthSet<ValueType>>(querySet, vectorSet, p_opts.m_distCalcMethod, p_opts.m_resultNum, p_opts.m_truthSlack);
+                truth->Build(0, p_liveNum);
+                return truth;
+            }
+
+            // null unless TelemetryPath is set, then a sampler searching next to the updates is running
+            template <typename ValueType>
+            std::unique_ptr<SearchTelemetry<ValueType>> StartTelemetry(SPANN::Index<ValueType>* p_index,
+                SPANN::Options& p_opts,
+                std::shared_ptr<SPTAG::VectorSet> querySet,
+                std::shared_ptr<SPTAG::VectorSet> vectorSet)
+            {
+                if (p_opts.m_telemetryPath.empty()) return nullptr;
+                std::unique_ptr<SearchTelemetry<ValueType>> telemetry(new SearchTelemetry<ValueType>(p_index, querySet, vectorSet, p_opts));
+                if (!telemetry->Start()) return nullptr;
+                return telemetry;
+            }
+
+            // gives the sampler the truth its recall is measured against from now on
+            template <typename ValueType>
+            void SetTelemetryTruth(SearchTelemetry<ValueType>* p_telemetry,
+                SPANN::Options& p_opts,
+                std::shared_ptr<COMMON::IncrementalTruthSet<ValueType>> p_truth,
+                std::string truthFileName,
+                int numQueries)
+            {
+                if (p_telemetry == nullptr || !p_opts.m_calTruth) return;
+                std::vector<std::set<SizeType>> truth;
+                if (p_truth != nullptr) p_truth->GetTruth(truth);
+                else if (fileexists(truthFileName.c_str())) LoadTruth(p_opts, truth, numQueries, truthFileName, p_opts.m_resultNum);
+                else return;
+                p_telemetry->SetTruth(truth);
+            }
+
             void LoadUpdateMapping(std::string fileName, std::vector<SizeType>& reverseIndices)
             {
                 LOG(Helper::LogLevel::LL_Info, "Loading %s\n", fileName.c_str());
@@ -914,6 +1000,8 @@ namespace SPTAG {
 
                 int curCount = p_index->GetNumSamples();
 
+                auto incrementalTruth = CreateIncrementalTruth<ValueType>(p_opts, querySet, vectorSet, curCount);
+
                 bool calTruthOrigin = p_opts.m_calTruth;
 
                 p_index->ForceCompaction();
@@ -925,12 +1013,12 @@ namespace SPTAG {
                     {
                         for (int iterInternalResultNum = p_opts.m_minInternalResultNum; iterInternalResultNum <= p_opts.m_maxInternalResultNum; iterInternalResultNum += p_opts.m_stepInternalResultNum) 
                         {
-                            StableSearch(p_index, numThreads, querySet, vectorSet, searchTimes, p_opts.m_queryCountLimit, iterInternalResultNum, p_opts.m_truthPath, p_opts, sw.getElapsedSec());
+                            StableSearch(p_index, numThreads, querySet, vectorSet, searchTimes, p_opts.m_queryCountLimit, iterInternalResultNum, p_opts.m_truthPath, p_opts, sw.getElapsedSec(), true, incrementalTruth);
                         }
                     }
                     else 
                     {
-                        StableSearch(p_index, numThreads, querySet, vectorSet, searchTimes, p_opts.m_queryCountLimit, internalResultNum, p_opts.m_truthPath, p_opts, sw.getElapsedSec());
+                        StableSearch(p_index, numThreads, querySet, vectorSet, searchTimes, p_opts.m_queryCountLimit, internalResultNum, p_opts.m_truthPath, p_opts, sw.getElapsedSec(), true, incrementalTruth);
                     }
                 }
                 // exit(1);
@@ -940,6 +1028,9 @@ namespace SPTAG {
 
                 int insertThreads = p_opts.m_insertThreadNum;
 
+                auto telemetry = StartTelemetry<ValueType>(p_index, p_opts, querySet, vectorSet);
+                SetTelemetryTruth(telemetry.get(), p_opts, incrementalTruth, p_opts.m_truthPath, querySet->Count());
+
                 LOG(Helper::LogLevel::LL_Info, "Updating: numThread: %d, total days: %d.\n", insertThreads, days);
 
                 LOG(Helper::LogLevel::LL_Info, "Start updating...\n");
@@ -1020,7 +1111,11 @@ namespace SPTAG {
                     if (!p_opts.m_stressTest) truthFileName = p_opts.m_truthFilePrefix + std::to_string(i);
                     else truthFileName = p_opts.m_truthPath;
 
+                    // a stress test day reinserts the vectors it deletes, the live set stays the same
+                    if (incrementalTruth != nullptr && !p_opts.m_stressTest) incrementalTruth->Update(deleteSet, insertSet);
+
                     p_opts.m_calTruth = calTruthOrigin;
+                    SetTelemetryTruth(telemetry.get(), p_opts, incrementalTruth, truthFileName, querySet->Count());
                     if (p_opts.m_onlySearchFinalBatch && days - 1 != i) continue;
                     p_index->StopMerge();
                     if (p_opts.m_maxInternalResultNum != -1) 
@@ -1028,12 +1123,12 @@ namespace SPTAG {
                         LOG(Helper::LogLevel::LL_Info, "Latency & Recall Tradeoff\n");
                         for (int iterInternalResultNum = p_opts.m_minInternalResultNum; iterInternalResultNum <= p_opts.m_maxInternalResultNum; iterInternalResultNum += p_opts.m_stepInternalResultNum) 
                         {
-                            StableSearch(p_index, numThreads, querySet, vectorSet, searchTimes, p_opts.m_queryCountLimit, iterInternalResultNum, truthFileName, p_opts, sw.getElapsedSec());
+                            StableSearch(p_index, numThreads, querySet, vectorSet, searchTimes, p_opts.m_queryCountLimit, iterInternalResultNum, truthFileName, p_opts, sw.getElapsedSec(), true, incrementalTruth);
                         }
                     }
                     else 
                     {
-                        StableSearch(p_index, numThreads, querySet, vectorSet, searchTimes, p_opts.m_queryCountLimit, internalResultNum, truthFileName, p_opts, sw.getElapsedSec());
+                        StableSearch(p_index, numThreads, querySet, vectorSet, searchTimes, p_opts.m_queryCountLimit, internalResultNum, truthFileName, p_opts, sw.getElapsedSec(), true, incrementalTruth);
                     }
                     p_index->OpenMerge();
                 }
@@ -1052,6 +1147,7 @@ namespace SPTAG {
 
                 std::atomic_size_t vectorsSent(0);
                 std::vector<double> latency_vector(step);
+                size_t batchSize = max(1, p_opts.m_insertBatchSize);
 
                 auto func = [&]()
                 {
@@ -1064,17 +1160,20 @@ namespace SPTAG {
                             cv.wait(lock, [] { return !pause_flag; });
                         }
 
-                        index = vectorsSent.fetch_add(1);
+                        index = vectorsSent.fetch_add(batchSize);
                         if (index < step)
                         {
-                            if ((index & ((1 << 14) - 1)) == 0)
+                            size_t count = min(batchSize, step - index);
+                            if ((index >> 14) != ((index + count - 1) >> 14) || (index & ((1 << 14) - 1)) == 0)
                             {
                                 LOG(Helper::LogLevel::LL_Info, "Sent %.2lf%%...\n", index * 100.0 / step);
                             }
                             auto insertBegin = std::chrono::high_resolution_clock::now();
-                            p_index->AddIndex(vectorSet->GetVector((SizeType)(index + curCount)), 1, p_opts.m_dim, nullptr);
+                            p_index->AddIndex(vectorSet->GetVector((SizeType)(index + curCount)), (SizeType)count, p_opts.m_dim, nullptr);
                             auto insertEnd = std::chrono::high_resolution_clock::now();
-                            latency_vector[index] = std::chrono::duration_cast<std::chrono::microseconds>(insertEnd - insertBegin).count();
+                            // every vector of a batch sees the latency of the whole batch
+                            double batchLatency = std::chrono::duration_cast<std::chrono::microseconds>(insertEnd - insertBegin).count();
+                            for (size_t i = index; i < index + count; i++) latency_vector[i] = batchLatency;
                         }
                         else
                         {
@@ -1137,6 +1236,8 @@ namespace SPTAG {
                 int curCount = p_index->GetNumSamples();
                 int insertCount = vectorSet->Count() - curCount;
 
+                auto incrementalTruth = CreateIncrementalTruth<ValueType>(p_opts, querySet, vectorSet, curCount);
+
                 bool calTruthOrigin = p_opts.m_calTruth;
 
                 if (p_opts.m_endVectorNum != -1)
@@ -1153,12 +1254,12 @@ namespace SPTAG {
                     {
                         for (int iterInternalResultNum = p_opts.m_minInternalResultNum; iterInternalResultNum <= p_opts.m_maxInternalResultNum; iterInternalResultNum += p_opts.m_stepInternalResultNum) 
                         {
-                            StableSearch(p_index, numThreads, querySet, vectorSet, searchTimes, p_opts.m_queryCountLimit, iterInternalResultNum, p_opts.m_truthPath, p_opts, sw.getElapsedSec());
+                            StableSearch(p_index, numThreads, querySet, vectorSet, searchTimes, p_opts.m_queryCountLimit, iterInternalResultNum, p_opts.m_truthPath, p_opts, sw.getElapsedSec(), true, incrementalTruth);
                         }
                     }
                     else 
                     {
-                        StableSearch(p_index, numThreads, querySet, vectorSet, searchTimes, p_opts.m_queryCountLimit, internalResultNum, p_opts.m_truthPath, p_opts, sw.getElapsedSec());
+                        StableSearch(p_index, numThreads, querySet, vectorSet, searchTimes, p_opts.m_queryCountLimit, internalResultNum, p_opts.m_truthPath, p_opts, sw.getElapsedSec(), true, incrementalTruth);
                     }
                 }
 
@@ -1177,6 +1278,9 @@ namespace SPTAG {
 
                 LOG(Helper::LogLevel::LL_Info, "Updating: numThread: %d, step: %d, insertCount: %d, totalBatch: %d.\n", insertThreads, step, insertCount, batch);
 
+                auto telemetry = StartTelemetry<ValueType>(p_index, p_opts, querySet, vectorSet);
+                SetTelemetryTruth(telemetry.get(), p_opts, incrementalTruth, p_opts.m_truthPath, querySet->Count());
+
                 LOG(Helper::LogLevel::LL_Info, "Start updating...\n");
                 for (int i = 0; i < 1; i++)
                 {   
@@ -1200,6 +1304,12 @@ namespace SPTAG {
                         }
                     }while (insert_status != std::future_status::ready);
 
+                    if (incrementalTruth != nullptr) {
+                        std::vector<SizeType> inserted(step);
+                        for (int j = 0; j < step; j++) inserted[j] = curCount + j;
+                        incrementalTruth->Update(std::vector<SizeType>(), inserted);
+                    }
+
                     curCount += step;
                     finishedInsert += step;
                     LOG(Helper::LogLevel::LL_Info, "Total Vector num %d \n", curCount);
@@ -1211,6 +1321,7 @@ namespace SPTAG {
                     std::string truthFileName = p_opts.m_truthFilePrefix + std::to_string(i);
 
                     p_opts.m_calTruth = calTruthOrigin;
+                    SetTelemetryTruth(telemetry.get(), p_opts, incrementalTruth, truthFileName, querySet->Count());
                     if (p_opts.m_onlySearchFinalBatch && batch - 1 != i) continue;
                     // p_index->ForceGC();
                     // p_index->ForceCompaction();
@@ -1219,12 +1330,12 @@ namespace SPTAG {
                     {
                         for (int iterInternalResultNum = p_opts.m_minInternalResultNum; iterInternalResultNum <= p_opts.m_maxInternalResultNum; iterInternalResultNum += p_opts.m_stepInternalResultNum) 
                         {
-                            StableSearch(p_index, numThreads, querySet, vectorSet, searchTimes, p_opts.m_queryCountLimit, iterInternalResultNum, truthFileName, p_opts, sw.getElapsedSec());
+                            StableSearch(p_index, numThreads, querySet, vectorSet, searchTimes, p_opts.m_queryCountLimit, iterInternalResultNum, truthFileName, p_opts, sw.getElapsedSec(), true, incrementalTruth);
                         }
                     }
                     else 
                     {
-                        StableSearch(p_index, numThreads, querySet, vectorSet, searchTimes, p_opts.m_queryCountLimit, internalResultNum, truthFileName, p_opts, sw.getElapsedSec());
+                        StableSearch(p_index, numThreads, querySet, vectorSet, searchTimes, p_opts.m_queryCountLimit, internalResultNum, truthFileName, p_opts, sw.getElapsedSec(), true, incrementalTruth);
                     }
                     p_index->OpenMerge();
                 }
@@ -1245,6 +1356,7 @@ namespace SPTAG {
 
                 std::atomic_size_t vectorsSent(0);
                 std::vector<double> latency_vector(step);
+                size_t batchSize = max(1, p_opts.m_insertBatchSize);
 
                 auto func = [&]()
                 {
@@ -1252,17 +1364,20 @@ namespace SPTAG {
                     size_t index = 0;
                     while (true)
                     {
-                        index = vectorsSent.fetch_add(1);
+                        index = vectorsSent.fetch_add(batchSize);
                         if (index < step)
                         {
-                            if ((index & ((1 << 14) - 1)) == 0)
+                            size_t count = min(batchSize, step - index);
+                            if ((index >> 14) != ((index + count - 1) >> 14) || (index & ((1 << 14) - 1)) == 0)
                             {
                                 LOG(Helper::LogLevel::LL_Info, "Sent %.2lf%%...\n", index * 100.0 / step);
                             }
                             auto insertBegin = std::chrono::high_resolution_clock::now();
-                            p_index->AddIndex(vectorSet->GetVector((SizeType)(index + curCount)), 1, p_opts.m_dim, nullptr);
+                            p_index->AddIndex(vectorSet->GetVector((SizeType)(index + curCount)), (SizeType)count, p_opts.m_dim, nullptr);
                             auto insertEnd = std::chrono::high_resolution_clock::now();
-                            latency_vector[index] = std::chrono::duration_cast<std::chrono::microseconds>(insertEnd - insertBegin).count();
+                            // every vector of a batch sees the latency of the whole batch
+                            double batchLatency = std::chrono::duration_cast<std::chrono::microseconds>(insertEnd - insertBegin).count();
+                            for (size_t i = index; i < index + count; i++) latency_vector[i] = batchLatency;
                         }
                         else
                         {
@@ -1371,6 +1486,15 @@ namespace SPTAG {
                         p_index->GetDiskIndex()->calculatePostingSizeMSE();
                         LOG(Helper::LogLevel::LL_Info, "Before %d insertion the current vector num is: %d \n", (m + step - p_opts.m_startNum) / step, p_index->GetNumSamples());
                         p_index->GetDiskIndex()->ShowPostingDistribution(m, false);
+
+                        std::string truthFileName = p_opts.m_truthFilePrefix +"_"+ std::to_string(m);
+                        p_opts.m_calTruth = true;
+
+                        // with telemetry the sampler searches next to the inserts of this split instead of pausing them for
+                        // a full StableSearch, it stops after the inserts since the future below is destroyed first
+                        auto telemetry = StartTelemetry<ValueType>(p_index, p_opts, subQuerySet, subBaseSet);
+                        SetTelemetryTruth<ValueType>(telemetry.get(), p_opts, nullptr, truthFileName, subQuerySet->Count());
+
                         std::future<void> insert_future =
                             std::async(std::launch::async, ConcurrentInsertVectors<ValueType>, p_index,
                                 insertThreads, subBaseSet, curVectorCount, insertCount, std::ref(p_opts));//here: vectorSet should contain the old vectors and all the new current vectors.
@@ -1380,8 +1504,6 @@ namespace SPTAG {
                         //     std::async(std::launch::async, ConcurrentInsertVectors<ValueType>, p_index,
                         //         insertThreads, subBaseSet, curVectorCount, insertCount, std::ref(p_opts)));
                         
-                        std::string truthFileName = p_opts.m_truthFilePrefix +"_"+ std::to_string(m);
-                        p_opts.m_calTruth = true;
                         bool notSearch = true;
                         if(p_opts.m_streamingUpdate){
                             do {
@@ -1394,7 +1516,7 @@ namespace SPTAG {
                                     LOG(Helper::LogLevel::LL_Info, "Current Vector num: %d, target vector num: %d, all new inserted vector num: %d, the percent is %.2lf \n", p_index->GetNumSamples(), split_index+1, insertCount, (p_index->GetNumSamples()-split_index-1+insertCount)/static_cast<double>(insertCount));
                                     
                                     //here: the parameter vectorSet of StableSearch is the current vector set with all current vectors
-                                    if (p_opts.m_searchDuringUpdate/*BuildSSDIndex -> SearchDuringUpdate*/){
+                                    if (p_opts.m_searchDuringUpdate/*BuildSSDIndex -> SearchDuringUpdate*/ && telemetry == nullptr){
                                         
                                         //p_index->StopMerge();
                                         pause_threads();
@@ -1434,7 +1556,7 @@ namespace SPTAG {
                                     LOG(Helper::LogLevel::LL_Info, "Epoch num:%d, Current Vector num: %d, target vector num: %d, all new inserted vector num: %d, the percent is %.2lf \n", time_count, p_index->GetNumSamples(), split_index+1, insertCount, (p_index->GetNumSamples()-split_index-1+insertCount)/static_cast<double>(insertCount));
                                     
                                     //here: the parameter vectorSet of StableSearch is the current vector set with all current vectors
-                                    if (p_opts.m_searchDuringUpdate/*BuildSSDIndex -> SearchDuringUpdate*/){
+                                    if (p_opts.m_searchDuringUpdate/*BuildSSDIndex -> SearchDuringUpdate*/ && telemetry == nullptr){
                                         
                                         //p_index->StopMerge();
                                         pause_threads();                                   
@@ -1462,7 +1584,7 @@ namespace SPTAG {
                             } while (insert_status != std::future_status::ready);
                         }
                         
-                        if(notSearch){
+                        if(notSearch && telemetry == nullptr){
                             LOG(Helper::LogLevel::LL_Info, "Current Vector num: %d, target vector num: %d, all new inserted vector num: %d, the percent is %.2lf \n", p_index->GetNumSamples(), split_index+1, insertCount, (p_index->GetNumSamples()-split_index-1+insertCount)/static_cast<double>(insertCount));
                             //p_index->StopMerge();
                             pause_threads();
@@ -1572,6 +1694,7 @@ namespace SPTAG {
                             auto end = std::chrono::high_resolution_clock::now();
                             double duration = std::chrono::duration_cast<std::chrono::seconds>(end - start).count();
                             LOG(Helper::LogLevel::LL_Info, "All background threads finish in %.2lf seconds\n", duration);
+                            telemetry.reset();
                             ShowMemoryStatus(subBaseSet, sw.getElapsedSec());
                             StableSearch(
                                 p_index,
@@ -0,0 +1,296 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_SPFRESH_SEARCHTELEMETRY_H_
+#define _SPTAG_SPFRESH_SEARCHTELEMETRY_H_
+
+#include "inc/Core/Common.h"
+#include "inc/Core/SPANN/Index.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace SPTAG {
+    namespace SSDServing {
+        namespace SPFresh {
+            // Log-linear latency histogram in microseconds. Values below 2^c_subBits are kept exactly, every power of
+            // two above that is split into 2^c_subBits buckets, so a percentile is within 1/2^c_subBits of the truth.
+            class LatencyHistogram
+            {
+            public:
+                LatencyHistogram() : m_counts((c_maxShift + 2) << c_subBits, 0), m_total(0), m_max(0) {}
+
+                void Record(double p_ms)
+                {
+                    std::uint64_t value = (std::uint64_t)max(p_ms * 1000, 0.0);
+                    m_counts[Bucket(value)]++;
+                    m_total++;
+                    m_max = max(m_max, p_ms);
+                }
+
+                // upper bound in ms of the bucket holding the p_ratio percentile, 0 when empty
+                double Percentile(double p_ratio) const
+                {
+                    if (m_total == 0) return 0;
+                    std::uint64_t rank = (std::uint64_t)(p_ratio * (m_total - 1)) + 1, seen = 0;
+                    for (std::size_t b = 0; b < m_counts.size(); b++)
+                    {
+                        seen += m_counts[b];
+                        if (seen >= rank) return min(BucketUpper(b) / 1000.0, m_max);
+                    }
+                    return m_max;
+                }
+
+                inline double Max() const { return m_max; }
+
+                inline std::uint64_t Count() const { return m_total; }
+
+                void Reset()
+                {
+                    std::fill(m_counts.begin(), m_counts.end(), 0);
+                    m_total = 0;
+                    m_max = 0;
+                }
+
+                // bucket holding p_value microseconds, values past 2^(c_maxShift + c_subBits + 1) share the last one
+                static std::size_t Bucket(std::uint64_t p_value)
+                {
+                    if (p_value < (1ULL << c_subBits)) return (std::size_t)p_value;
+                    int shift = 0;
+                    while ((p_value >> shift) >= (2ULL << c_subBits)) shift++;
+                    if (shift > c_maxShift) return (((std::size_t)c_maxShift + 2) << c_subBits) - 1;
+                    return (((std::size_t)shift + 1) << c_subBits) + (std::size_t)((p_value >> shift) - (1ULL << c_subBits));
+                }
+
+                // largest value in microseconds of p_bucket
+                static std::uint64_t BucketUpper(std::size_t p_bucket)
+                {
+                    if (p_bucket < (1ULL << c_subBits)) return p_bucket;
+                    int shift = (int)(p_bucket >> c_subBits) - 1;
+                    std::uint64_t sub = p_bucket & ((1ULL << c_subBits) - 1);
+                    return (((1ULL << c_subBits) + sub + 1) << shift) - 1;
+                }
+
+            private:
+                static const int c_subBits = 6;
+                static const int c_maxShift = 34;
+
+                std::vector<std::uint64_t> m_counts;
+                std::uint64_t m_total;
+                double m_max;
+            };
+
+            // Searches a rotating subset of the queries at a fixed rate next to the updates, without pausing them, and
+            // appends one row per interval to a CSV file, or JSON lines when the path ends with ".json": latency
+            // percentiles of the whole search, the head search, the disk reads and the posting compute, and the mean
+            // recall of the interval against the last truth given to SetTruth, -1 without a truth or the vectors.
+            template <typename ValueType>
+            class SearchTelemetry
+            {
+            public:
+                SearchTelemetry(SPANN::Index<ValueType>* p_index, std::shared_ptr<VectorSet> p_querySet, std::shared_ptr<VectorSet> p_vectorSet, SPANN::Options& p_opts)
+                    : m_index(p_index), m_querySet(p_querySet), m_vectorSet(p_vectorSet), m_opts(p_opts), m_stop(false)
+                {
+                    m_json = p_opts.m_telemetryPath.size() >= 5 && p_opts.m_telemetryPath.compare(p_opts.m_telemetryPath.size() - 5, 5, ".json") == 0;
+                }
+
+                ~SearchTelemetry() { Stop(); }
+
+                bool Start()
+                {
+                    if (m_opts.m_telemetryQPS <= 0 || m_querySet == nullptr || m_querySet->Count() == 0)
+                    {
+                        LOG(Helper::LogLevel::LL_Error, "Telemetry needs a positive TelemetryQPS and queries.\n");
+                        return false;
+                    }
+                    m_out.open(m_opts.m_telemetryPath, std::ios::out | std::ios::trunc);
+                    if (!m_out.is_open())
+                    {
+                        LOG(Helper::LogLevel::LL_Error, "Failed to create telemetry file %s.\n", m_opts.m_telemetryPath.c_str());
+                        return false;
+                    }
+                    if (!m_json)
+                    {
+                        m_out << "time_s,vectors,deleted,samples,qps,search_p50_ms,search_p90_ms,search_p99_ms,search_p999_ms,search_max_ms,"
+                            "head_p50_ms,head_p99_ms,disk_read_p50_ms,disk_read_p99_ms,compute_p50_ms,compute_p99_ms,recall,recall_samples" << std::endl;
+                    }
+                    m_stop = false;
+                    m_thread = std::thread(&SearchTelemetry::Run, this);
+                    LOG(Helper::LogLevel::LL_Info, "Telemetry: %d queries/s over %d queries into %s.\n", m_opts.m_telemetryQPS,
+                        min((SizeType)m_opts.m_telemetryQueryNum, m_querySet->Count()), m_opts.m_telemetryPath.c_str());
+                    return true;
+                }
+
+                void Stop()
+                {
+                    if (!m_thread.joinable()) return;
+                    {
+                        std::lock_guard<std::mutex> lock(m_lock);
+                        m_stop = true;
+                    }
+                    m_wakeUp.notify_all();
+                    m_thread.join();
+                    m_out.close();
+                }
+
+                // truth of every query in m_querySet, IDs of m_vectorSet
+                void SetTruth(const std::vector<std::set<SizeType>>& p_truth)
+                {
+                    std::lock_guard<std::mutex> lock(m_lock);
+                    m_truth = p_truth;
+                }
+
+            private:
+                void Run()
+                {
+                    m_index->Initialize();
+                    SizeType queryNum = (m_opts.m_telemetryQueryNum > 0) ? min((SizeType)m_opts.m_telemetryQueryNum, m_querySet->Count()) : m_querySet->Count();
+                    QueryResult result(nullptr, max(m_opts.m_searchInternalResultNum, m_opts.m_resultNum), false);
+                    auto period = std::chrono::nanoseconds(1000000000LL / m_opts.m_telemetryQPS);
+                    auto window = std::chrono::milliseconds(max(m_opts.m_telemetryIntervalMs, 1));
+                    auto begin = std::chrono::steady_clock::now();
+                    auto next = begin, windowEnd = begin + window;
+                    SizeType cursor = 0;
+
+                    while (true)
+                    {
+                        {
+                            std::unique_lock<std::mutex> lock(m_lock);
+                            if (m_wakeUp.wait_until(lock, next, [this]() { return m_stop; })) break;
+                        }
+
+                        SPANN::SearchStats stats;
+                        result.SetTarget(m_querySet->GetVector(cursor));
+                        result.Reset();
+                        auto start = std::chrono::steady_clock::now();
+                        stats.m_searchRequestTime = start;
+                        m_index->SearchHeadIndex(result);
+                        auto headEnd = std::chrono::steady_clock::now();
+                        m_index->SearchDiskIndex(result, &stats);
+                        auto end = std::chrono::steady_clock::now();
+
+                        m_search.Record(std::chrono::duration<double, std::milli>(end - start).count());
+                        m_head.Record(std::chrono::duration<double, std::milli>(headEnd - start).count());
+                        m_diskRead.Record(stats.m_diskReadLatency);
+                        m_compute.Record(stats.m_compLatency);
+                        AddRecall(cursor, result);
+                        cursor = (cursor + 1) % queryNum;
+
+                        // a late sample is not made up with a burst, the rate stays what the updates see
+                        next += period;
+                        if (next < end) next = end;
+                        if (end >= windowEnd)
+                        {
+                            Flush(std::chrono::duration<double>(end - begin).count(), std::chrono::duration<double>(end - windowEnd + window).count());
+                            windowEnd = end + window;
+                        }
+                    }
+                    m_index->ExitBlockController();
+                }
+
+                // Results carry index VIDs and a truth ID is matched by its distance, which needs the vectors. Without
+                // them nothing is counted and the interval reports a recall of -1.
+                void AddRecall(SizeType p_query, QueryResult& p_result)
+                {
+                    if (m_vectorSet == nullptr) return;
+                    std::lock_guard<std::mutex> lock(m_lock);
+                    if (p_query >= (SizeType)m_truth.size() || m_truth[p_query].empty()) return;
+
+                    int K = m_opts.m_resultNum;
+                    std::vector<bool> visited(K, false);
+                    float hits = 0;
+                    for (SizeType id : m_truth[p_query])
+                    {
+                        float truthDist = COMMON::DistanceUtils::ComputeDistance((const ValueType*)m_querySet->GetVector(p_query),
+                            (const ValueType*)m_vectorSet->GetVector(id), m_vectorSet->Dimension(), m_opts.m_distCalcMethod);
+                        for (int j = 0; j < K; j++)
+                        {
+                            const BasicResult* res = p_result.GetResult(j);
+                            if (visited[j] || res->VID < 0) continue;
+                            bool match = (m_opts.m_distCalcMethod == DistCalcMethod::Cosine) ? fabs(res->Dist - truthDist) < Epsilon : fabs(res->Dist - truthDist) < Epsilon * (res->Dist + Epsilon);
+                            if (match)
+                            {
+                                hits += 1;
+                                visited[j] = true;
+                                break;
+                            }
+                        }
+                    }
+                    m_recallSum += hits / m_truth[p_query].size();
+                    m_recallNum++;
+                }
+
+                void Flush(double p_second, double p_windowSecond)
+                {
+                    double recall;
+                    std::uint64_t recallNum;
+                    {
+                        std::lock_guard<std::mutex> lock(m_lock);
+                        recall = (m_recallNum > 0) ? m_recallSum / m_recallNum : -1;
+                        recallNum = m_recallNum;
+                        m_recallSum = 0;
+                        m_recallNum = 0;
+                    }
+
+                    std::uint64_t samples = m_search.Count();
+                    double qps = samples / max(p_windowSecond, 1e-9);
+                    SizeType vectors = m_index->GetNumSamples(), deleted = m_index->GetNumDeleted();
+                    if (m_json)
+                    {
+                        m_out << "{\"time_s\":" << p_second << ",\"vectors\":" << vectors << ",\"deleted\":" << deleted << ",\"samples\":" << samples << ",\"qps\":" << qps
+                            << ",\"search_ms\":{\"p50\":" << m_search.Percentile(0.5) << ",\"p90\":" << m_search.Percentile(0.9) << ",\"p99\":" << m_search.Percentile(0.99)
+                            << ",\"p999\":" << m_search.Percentile(0.999) << ",\"max\":" << m_search.Max() << "}"
+                            << ",\"head_ms\":{\"p50\":" << m_head.Percentile(0.5) << ",\"p99\":" << m_head.Percentile(0.99) << "}"
+                            << ",\"disk_read_ms\":{\"p50\":" << m_diskRead.Percentile(0.5) << ",\"p99\":" << m_diskRead.Percentile(0.99) << "}"
+                            << ",\"compute_ms\":{\"p50\":" << m_compute.Percentile(0.5) << ",\"p99\":" << m_compute.Percentile(0.99) << "}"
+                            << ",\"recall\":" << recall << ",\"recall_samples\":" << recallNum << "}" << std::endl;
+                    }
+                    else
+                    {
+                        m_out << p_second << "," << vectors << "," << deleted << "," << samples << "," << qps << ","
+                            << m_search.Percentile(0.5) << "," << m_search.Percentile(0.9) << "," << m_search.Percentile(0.99) << ","
+                            << m_search.Percentile(0.999) << "," << m_search.Max() << ","
+                            << m_head.Percentile(0.5) << "," << m_head.Percentile(0.99) << ","
+                            << m_diskRead.Percentile(0.5) << "," << m_diskRead.Percentile(0.99) << ","
+                            << m_compute.Percentile(0.5) << "," << m_compute.Percentile(0.99) << ","
+                            << recall << "," << recallNum << std::endl;
+                    }
+                    m_search.Reset();
+                    m_head.Reset();
+                    m_diskRead.Reset();
+                    m_compute.Reset();
+                }
+
+                SPANN::Index<ValueType>* m_index;
+                std::shared_ptr<VectorSet> m_querySet;
+                std::shared_ptr<VectorSet> m_vectorSet;
+                SPANN::Options& m_opts;
+                bool m_json;
+
+                std::thread m_thread;
+                std::mutex m_lock;
+                std::condition_variable m_wakeUp;
+                bool m_stop;
+                std::ofstream m_out;
+
+                // guarded by m_lock, the rest belongs to the sampling thread
+                std::vector<std::set<SizeType>> m_truth;
+                double m_recallSum = 0;
+                std::uint64_t m_recallNum = 0;
+
+                LatencyHistogram m_search;
+                LatencyHistogram m_head;
+                LatencyHistogram m_diskRead;
+                LatencyHistogram m_compute;
+            };
+        }
+    }
+}
+
+#endif // _SPTAG_SPFRESH_SEARCHTELEMETRY_H_
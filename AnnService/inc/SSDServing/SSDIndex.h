@@ -122,6 +122,35 @@ namespace SPTAG {
 
                         Utils::StopW threadws;
                         size_t index = 0;
+                        int batchNum = p_index->GetOptions()->m_searchBatchQueryNum;
+                        std::vector<QueryResult*> batch;
+                        while (batchNum > 1)
+                        {
+                            index = queriesSent.fetch_add(batchNum);
+                            if (index >= numQueries) return;
+
+                            size_t end = min(index + batchNum, (size_t)numQueries);
+                            batch.clear();
+                            for (size_t q = index; q < end; q++) batch.push_back(&p_results[q]);
+
+                            SPANN::SearchStats batchStats;
+                            batchStats.m_searchRequestTime = std::chrono::steady_clock::now();
+                            double startTime = threadws.getElapsedMs();
+                            p_index->SearchIndexBatch(batch, &batchStats);
+                            double endTime = threadws.getElapsedMs();
+
+                            // every query waited for the whole batch and gets an even share of its reads and comparisons
+                            int num = (int)batch.size();
+                            for (size_t q = index; q < end; q++)
+                            {
+                                p_stats[q].m_totalListElementsCount = batchStats.m_totalListElementsCount / num;
+                                p_stats[q].m_diskIOCount = batchStats.m_diskIOCount / num;
+                                p_stats[q].m_diskAccessCount = batchStats.m_diskAccessCount / num;
+                                p_stats[q].m_compLatency = batchStats.m_compLatency / num;
+                                p_stats[q].m_diskReadLatency = batchStats.m_diskReadLatency / num;
+                                p_stats[q].m_exLatency = p_stats[q].m_totalLatency = p_stats[q].m_totalSearchLatency = endTime - startTime;
+                            }
+                        }
                         while (true)
                         {
                             index = queriesSent.fetch_add(1);
@@ -132,8 +161,9 @@ namespace SPTAG {
                                     LOG(Helper::LogLevel::LL_Info, "Sent %.2lf%%...\n", index * 100.0 / numQueries);
                                 }
 
+                                p_stats[index].m_searchRequestTime = std::chrono::steady_clock::now();
                                 double startTime = threadws.getElapsedMs();
-                                p_index->GetMemoryIndex()->SearchIndex(p_results[index]);
+                                p_index->SearchHeadIndex(p_results[index]);
                                 double endTime = threadws.getElapsedMs();
                                 p_index->SearchDiskIndex(p_results[index], &(p_stats[index]));
                                 double exEndTime = threadws.getElapsedMs();
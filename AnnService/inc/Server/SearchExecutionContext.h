@@ -35,7 +35,10 @@ public:
 
     ErrorCode ExtractVector(VectorValueType p_targetType);
 
-    void AddResults(std::string p_indexName, QueryResult& p_results);
+    // Takes the options and vectors of a binary query, the vectors are shared and not copied.
+    ErrorCode ExtractBinaryQuery(const Socket::RemoteQuery& p_query);
+
+    void AddResults(std::string p_indexName, QueryResult& p_results, std::uint32_t p_queryID = 0);
 
     std::vector<SearchResult>& GetResults();
 
@@ -47,12 +50,19 @@ public:
 
     const SizeType GetVectorDimension() const;
 
+    const std::uint32_t GetQueryNum() const;
+
+    const VectorValueType GetInputValueType() const;
+
     const std::vector<QueryParser::OptionPair>& GetOptions() const;
 
     const SizeType GetResultNum() const;
 
     const bool GetExtractMetadata() const;
 
+private:
+    void ApplyOption(const char* p_name, const char* p_value);
+
 private:
     const std::shared_ptr<const ServiceSettings> c_serviceSettings;
 
@@ -64,6 +74,8 @@ private:
 
     SizeType m_vectorDimension;
 
+    std::uint32_t m_queryNum;
+
     std::vector<SearchResult> m_results;
 
     VectorValueType m_inputValueType;
@@ -27,6 +27,10 @@ public:
                    std::shared_ptr<ServiceContext> p_serviceContext,
                    const CallBack& p_callback);
 
+    SearchExecutor(Socket::RemoteQuery p_query,
+                   std::shared_ptr<ServiceContext> p_serviceContext,
+                   const CallBack& p_callback);
+
     ~SearchExecutor();
 
     void Execute();
@@ -43,7 +47,7 @@ private:
 
     std::shared_ptr<SearchExecutionContext> m_executionContext;
 
-    std::string m_queryString;
+    Socket::RemoteQuery m_query;
 
     std::vector<std::shared_ptr<VectorIndex>> m_selectedIndex;
 };
@@ -6,6 +6,7 @@
 
 #include "ServiceContext.h"
 #include "../Socket/Server.h"
+#include "../Socket/RemoteSearchQuery.h"
 
 #include <boost/asio.hpp>
 
@@ -32,6 +33,12 @@ public:
 
     void Run();
 
+    // Deletes the vectors of p_request from p_index one at a time. Ok when all are deleted, otherwise p_result holds
+    // the status of every vector in request order: Ok when it was deleted, Failed when p_index does not hold it.
+    static Socket::PacketProcessStatus DeleteVectors(VectorIndex* p_index,
+                                                     const Socket::RemoteUpdateRequest& p_request,
+                                                     Socket::RemoteUpdateResult& p_result);
+
 private:
     void RunSocketMode();
 
@@ -42,6 +49,12 @@ private:
     void SearchHanlderCallback(std::shared_ptr<SearchExecutionContext> p_exeContext,
                                Socket::Packet p_srcPacket);
 
+    void UpdateHandler(Socket::ConnectionID p_localConnectionID, Socket::Packet p_packet);
+
+    Socket::PacketProcessStatus ExecuteUpdate(Socket::PacketType p_type,
+                                              const Socket::RemoteUpdateRequest& p_request,
+                                              Socket::RemoteUpdateResult& p_result);
+
 private:
     enum class ServeMode : std::uint8_t
     {
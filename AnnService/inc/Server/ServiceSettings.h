@@ -28,6 +28,9 @@ struct ServiceSettings
     SizeType m_threadNum;
 
     SizeType m_socketThreadNum;
+
+    // Add and delete requests are dropped while an index has more queued split/reassign jobs, 0 disables the check.
+    std::size_t m_updateBacklogLimit;
 };
 
 
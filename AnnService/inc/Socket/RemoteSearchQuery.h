@@ -6,6 +6,7 @@
 
 #include "inc/Core/CommonDataStructure.h"
 #include "inc/Core/SearchQuery.h"
+#include "Packet.h"
 
 #include <cstdint>
 #include <memory>
@@ -23,11 +24,14 @@ namespace Socket
 struct RemoteQuery
 {
     static constexpr std::uint16_t MajorVersion() { return 1; }
-    static constexpr std::uint16_t MirrorVersion() { return 0; }
+    static constexpr std::uint16_t MirrorVersion() { return 1; }
 
     enum class QueryType : std::uint8_t
     {
-        String = 0
+        String = 0,
+
+        // Typed vectors of a batch of queries with their options, no text parsing on the server.
+        Binary = 1
     };
 
     RemoteQuery();
@@ -36,27 +40,106 @@ struct RemoteQuery
 
     std::uint8_t* Write(std::uint8_t* p_buffer) const;
 
+    // For binary queries m_vectors points into p_buffer, which has to outlive it.
     const std::uint8_t* Read(const std::uint8_t* p_buffer);
 
 
     QueryType m_type;
 
     std::string m_queryString;
+
+    VectorValueType m_valueType;
+
+    DimensionType m_dimension;
+
+    std::uint32_t m_queryNum;
+
+    SizeType m_resultNum;
+
+    bool m_extractMetadata;
+
+    // The $name:value options of a string query, e.g. indexname.
+    std::vector<std::pair<std::string, std::string>> m_params;
+
+    // m_queryNum * m_dimension values of m_valueType.
+    ByteArray m_vectors;
+};
+
+
+// Body of AddRequest and DeleteRequest packets. The reply carries PacketProcessStatus:
+// Ok, Failed, or Dropped when the server is behind on its background updates and the batch should be retried.
+// A reply that does not hold for every vector of the batch adds a RemoteUpdateResult body, see below.
+struct RemoteUpdateRequest
+{
+    static constexpr std::uint16_t MajorVersion() { return 1; }
+    static constexpr std::uint16_t MirrorVersion() { return 0; }
+
+    RemoteUpdateRequest();
+
+    std::size_t EstimateBufferSize() const;
+
+    std::uint8_t* Write(std::uint8_t* p_buffer) const;
+
+    // m_vectors points into p_buffer, which has to outlive it.
+    const std::uint8_t* Read(const std::uint8_t* p_buffer);
+
+
+    // Empty for a server with a single index.
+    std::string m_indexName;
+
+    VectorValueType m_valueType;
+
+    DimensionType m_dimension;
+
+    std::uint32_t m_vectorNum;
+
+    // m_vectorNum * m_dimension values of m_valueType, empty for a delete by metadata.
+    ByteArray m_vectors;
+
+    // One entry per vector, or empty.
+    std::vector<ByteArray> m_metadata;
+};
+
+
+// Body of an AddResponse from the aggregator when its shards did not all succeed, or of a DeleteResponse by
+// vector when not every vector was deleted: the status of every vector of the request in request order, so
+// that only the vectors which were not applied are sent again. An empty body means the header status holds
+// for the whole batch.
+struct RemoteUpdateResult
+{
+    static constexpr std::uint16_t MajorVersion() { return 1; }
+    static constexpr std::uint16_t MirrorVersion() { return 0; }
+
+    RemoteUpdateResult();
+
+    std::size_t EstimateBufferSize() const;
+
+    std::uint8_t* Write(std::uint8_t* p_buffer) const;
+
+    const std::uint8_t* Read(const std::uint8_t* p_buffer);
+
+
+    std::vector<PacketProcessStatus> m_vectorStatus;
 };
 
 
 struct IndexSearchResult
 {
+    IndexSearchResult() : m_queryID(0) {}
+
     std::string m_indexName;
 
     QueryResult m_results;
+
+    // Position of the query in a binary batch, 0 for a single query.
+    std::uint32_t m_queryID;
 };
 
 
 struct RemoteSearchResult
 {
     static constexpr std::uint16_t MajorVersion() { return 1; }
-    static constexpr std::uint16_t MirrorVersion() { return 0; }
+    static constexpr std::uint16_t MirrorVersion() { return 1; }
 
     enum class ResultStatus : std::uint8_t
     {
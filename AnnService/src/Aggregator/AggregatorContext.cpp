@@ -29,12 +29,16 @@ AggregatorContext::AggregatorContext(const std::string& p_filePath)
 
     m_settings->m_listenAddr = iniReader.GetParameter("Service", "ListenAddr", std::string("0.0.0.0"));
     m_settings->m_listenPort = iniReader.GetParameter("Service", "ListenPort", std::string("8100"));
+    m_settings->m_searchTimeout = iniReader.GetParameter("Service", "SearchTimeout", static_cast<std::uint32_t>(100));
+    m_settings->m_partialResultOnTimeout = iniReader.GetParameter("Service", "PartialResultOnTimeout", false);
     m_settings->m_threadNum = iniReader.GetParameter("Service", "ThreadNumber", static_cast<std::uint32_t>(8));
     m_settings->m_socketThreadNum = iniReader.GetParameter("Service", "SocketThreadNumber", static_cast<std::uint32_t>(8));
     m_settings->m_centers = iniReader.GetParameter("Service", "Centers", std::string("centers"));
     m_settings->m_valueType = iniReader.GetParameter("Service", "ValueType", VectorValueType::Float);
     m_settings->m_topK = iniReader.GetParameter("Service", "TopK", static_cast<SizeType>(-1));
     m_settings->m_distMethod = iniReader.GetParameter("Service", "DistCalcMethod", DistCalcMethod::L2);
+    m_settings->m_centerIndexThreshold = iniReader.GetParameter("Service", "CenterIndexThreshold", static_cast<SizeType>(4096));
+    m_settings->m_centerIndexMaxCheck = iniReader.GetParameter("Service", "CenterIndexMaxCheck", 2048);
     const std::string emptyStr;
 
     SizeType serverNum = iniReader.GetParameter("Servers", "Number", static_cast<SizeType>(0));
@@ -80,6 +84,13 @@ AggregatorContext::AggregatorContext(const std::string& p_filePath)
         inputStream.close();
 
         m_centers.reset(new BasicVectorSet(vectorSet, m_settings->m_valueType, col, row));
+        m_router.reset(new CenterRouter);
+        m_router->Initialize(m_centers,
+                             m_settings->m_distMethod,
+                             m_settings->m_centerIndexThreshold,
+                             m_settings->m_centerIndexMaxCheck,
+                             m_settings->m_threadNum);
+        LOG(Helper::LogLevel::LL_Info, "Route to %d centers with %s.\n", row, m_router->UseIndex() ? "BKT index" : "SIMD scan");
     }
     m_initialized = true;
 }
@@ -114,4 +125,11 @@ const std::shared_ptr<VectorSet>&
 AggregatorContext::GetCenters() const
 {
     return m_centers;
+}
+
+
+const std::shared_ptr<CenterRouter>&
+AggregatorContext::GetRouter() const
+{
+    return m_router;
 }
\ No newline at end of file
@@ -8,7 +8,8 @@ using namespace SPTAG::Aggregator;
 
 AggregatorExecutionContext::AggregatorExecutionContext(std::size_t p_totalServerNumber,
                                                        Socket::PacketHeader p_requestHeader)
-    : m_requestHeader(std::move(p_requestHeader))
+    : m_requestHeader(std::move(p_requestHeader)),
+      m_finished(false)
 {
     m_results.clear();
     m_results.resize(p_totalServerNumber);
@@ -49,3 +50,31 @@ AggregatorExecutionContext::IsCompletedAfterFinsh(std::uint32_t p_finishedCount)
     auto lastCount = m_unfinishedCount.fetch_sub(p_finishedCount);
     return lastCount <= p_finishedCount;
 }
+
+
+bool
+AggregatorExecutionContext::SetResult(std::size_t p_num, AggregatorResult p_result)
+{
+    std::lock_guard<std::mutex> guard(m_resultsMutex);
+    if (m_finished)
+    {
+        return false;
+    }
+
+    m_results[p_num] = std::move(p_result);
+    return true;
+}
+
+
+bool
+AggregatorExecutionContext::Finish()
+{
+    std::lock_guard<std::mutex> guard(m_resultsMutex);
+    if (m_finished)
+    {
+        return false;
+    }
+
+    m_finished = true;
+    return true;
+}
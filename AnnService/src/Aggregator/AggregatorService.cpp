@@ -3,9 +3,13 @@
 
 #include "inc/Aggregator/AggregatorService.h"
 #include "inc/Server/QueryParser.h"
-#include "inc/Core/Common/DistanceUtils.h"
 #include "inc/Helper/Base64Encode.h"
 
+#include <map>
+#include <queue>
+#include <set>
+#include <unordered_set>
+
 using namespace SPTAG;
 using namespace SPTAG::Aggregator;
 
@@ -60,6 +64,17 @@ AggregatorService::StartClient()
                                                         std::move(p_packet)));
                         });
 
+    auto updateResponseHandler = [this](Socket::ConnectionID p_srcID, Socket::Packet p_packet)
+                                 {
+                                     boost::asio::post(*m_threadPool,
+                                                       std::bind(&AggregatorService::UpdateResponseHandler,
+                                                                 this,
+                                                                 p_srcID,
+                                                                 std::move(p_packet)));
+                                 };
+    handlerMap->emplace(Socket::PacketType::AddResponse, updateResponseHandler);
+    handlerMap->emplace(Socket::PacketType::DeleteResponse, updateResponseHandler);
+
 
     m_socketClient.reset(new Socket::Client(handlerMap,
                                             context->GetSettings()->m_socketThreadNum,
@@ -102,6 +117,17 @@ AggregatorService::StartListen()
                                                         std::move(p_packet)));
                         });
 
+    auto updateRequestHandler = [this](Socket::ConnectionID p_srcID, Socket::Packet p_packet)
+                                {
+                                    boost::asio::post(*m_threadPool,
+                                                      std::bind(&AggregatorService::UpdateRequestHandler,
+                                                                this,
+                                                                p_srcID,
+                                                                std::move(p_packet)));
+                                };
+    handlerMap->emplace(Socket::PacketType::AddRequest, updateRequestHandler);
+    handlerMap->emplace(Socket::PacketType::DeleteRequest, updateRequestHandler);
+
     m_socketServer.reset(new Socket::Server(context->GetSettings()->m_listenAddr,
                                             context->GetSettings()->m_listenPort,
                                             handlerMap,
@@ -212,50 +238,66 @@ AggregatorService::SearchRequestHanlder(Socket::ConnectionID p_localConnectionID
     std::vector<Socket::ConnectionID> remoteServers;
     remoteServers.reserve(context->GetRemoteServers().size());
 
-	if (context->GetSettings()->m_topK > 0 && context->GetRemoteServers().size() == context->GetCenters()->Count()) {
+	bool routed = false;
+	if (context->GetSettings()->m_topK > 0 && nullptr != context->GetRouter() && context->GetRemoteServers().size() == context->GetCenters()->Count()) {
 		Socket::RemoteQuery remoteQuery;
-		remoteQuery.Read(p_packet.Body());
+		bool validQuery = (nullptr != remoteQuery.Read(p_packet.Body()));
 
-		Service::QueryParser queryParser;
-		queryParser.Parse(remoteQuery.m_queryString, "|");
 		ByteArray vector;
-		size_t vectorSize;
 		SizeType vectorDimension = 0;
-		std::vector<BasicResult> servers;
-		switch (context->GetSettings()->m_valueType)
-		{
+		SizeType queryNum = 1;
+		if (Socket::RemoteQuery::QueryType::Binary == remoteQuery.m_type) {
+			// binary queries of another value type are not routed
+			if (validQuery && remoteQuery.m_valueType == context->GetSettings()->m_valueType) {
+				vector = remoteQuery.m_vectors;
+				vectorDimension = remoteQuery.m_dimension;
+				queryNum = static_cast<SizeType>(remoteQuery.m_queryNum);
+			}
+		}
+		else {
+			Service::QueryParser queryParser;
+			queryParser.Parse(remoteQuery.m_queryString, "|");
+			size_t vectorSize;
+			switch (context->GetSettings()->m_valueType)
+			{
 #define DefineVectorValueType(Name, Type) \
-        case VectorValueType::Name: \
-            if (!queryParser.GetVectorElements().empty()) { \
-			    Service::ConvertVectorFromString<Type>(queryParser.GetVectorElements(), vector, vectorDimension); \
-			} else if (queryParser.GetVectorBase64() != nullptr && queryParser.GetVectorBase64Length() != 0) { \
-                vector = ByteArray::Alloc(Helper::Base64::CapacityForDecode(queryParser.GetVectorBase64Length())); \
-                Helper::Base64::Decode(queryParser.GetVectorBase64(), queryParser.GetVectorBase64Length(), vector.Data(), vectorSize); \
-                vectorDimension = (SizeType)(vectorSize / GetValueTypeSize(context->GetSettings()->m_valueType)); \
-            } \
-            for (int i = 0; i < context->GetCenters()->Count(); i++) { \
-                servers.push_back(BasicResult(i, COMMON::DistanceUtils::ComputeDistance((Type*)vector.Data(), \
-                    (Type*)context->GetCenters()->GetVector(i), vectorDimension, context->GetSettings()->m_distMethod))); \
-			} \
-            break; \
+            case VectorValueType::Name: \
+                if (!queryParser.GetVectorElements().empty()) { \
+			        Service::ConvertVectorFromString<Type>(queryParser.GetVectorElements(), vector, vectorDimension); \
+			    } else if (queryParser.GetVectorBase64() != nullptr && queryParser.GetVectorBase64Length() != 0) { \
+                    vector = ByteArray::Alloc(Helper::Base64::CapacityForDecode(queryParser.GetVectorBase64Length())); \
+                    Helper::Base64::Decode(queryParser.GetVectorBase64(), queryParser.GetVectorBase64Length(), vector.Data(), vectorSize); \
+                    vectorDimension = (SizeType)(vectorSize / GetValueTypeSize(context->GetSettings()->m_valueType)); \
+                } \
+                break; \
 
 #include "inc/Core/DefinitionList.h"
 #undef DefineVectorValueType
 
-		default:
-			break;
+			default:
+				break;
+			}
 		}
-		std::sort(servers.begin(), servers.end(), [](const BasicResult& a, const BasicResult& b) { return a.Dist < b.Dist; });
-		for (int i = 0; i < context->GetSettings()->m_topK; i++) {
-			auto& server = context->GetRemoteServers().at(servers[i].VID);
-			if (RemoteMachineStatus::Connected != server->m_status)
-			{
-				continue;
+
+		// a query that does not match the centers is sent to every server, a batch to the servers of all its queries
+		if (vectorDimension == context->GetCenters()->Dimension()) {
+			std::vector<SizeType> servers;
+			context->GetRouter()->Route(vector.Data(), queryNum, context->GetSettings()->m_topK, servers);
+			std::vector<bool> selected(context->GetRemoteServers().size(), false);
+			for (SizeType serverID : servers) {
+				if (serverID < 0 || selected[serverID]) continue;
+				selected[serverID] = true;
+				auto& server = context->GetRemoteServers().at(serverID);
+				if (RemoteMachineStatus::Connected != server->m_status)
+				{
+					continue;
+				}
+				remoteServers.push_back(server->m_connectionID);
 			}
-			remoteServers.push_back(server->m_connectionID);
+			routed = true;
 		}
 	}
-	else {
+	if (!routed) {
 		for (const auto& server : context->GetRemoteServers())
 		{
 			if (RemoteMachineStatus::Connected != server->m_status)
@@ -279,16 +321,29 @@ AggregatorService::SearchRequestHanlder(Socket::ConnectionID p_localConnectionID
     {
         AggregatorCallback callback = [this, executionContext, i](Socket::RemoteSearchResult p_result)
         {
-            executionContext->GetResult(i).reset(new Socket::RemoteSearchResult(std::move(p_result)));
-            if (executionContext->IsCompletedAfterFinsh(1))
+            // late responses of a request already answered on its deadline are dropped
+            if (!executionContext->SetResult(i, std::make_shared<Socket::RemoteSearchResult>(std::move(p_result))))
+            {
+                return;
+            }
+
+            if (executionContext->IsCompletedAfterFinsh(1) && executionContext->Finish())
             {
                 this->AggregateResults(std::move(executionContext));
             }
         };
 
-        auto timeoutCallback = [](std::shared_ptr<AggregatorCallback> p_callback)
+        bool partialResult = context->GetSettings()->m_partialResultOnTimeout;
+        auto timeoutCallback = [this, executionContext, partialResult](std::shared_ptr<AggregatorCallback> p_callback)
         {
-            if (nullptr != p_callback)
+            if (partialResult)
+            {
+                if (executionContext->Finish())
+                {
+                    this->AggregateResults(executionContext);
+                }
+            }
+            else if (nullptr != p_callback)
             {
                 Socket::RemoteSearchResult result;
                 result.m_status = Socket::RemoteSearchResult::ResultStatus::Timeout;
@@ -351,6 +406,376 @@ AggregatorService::SearchResponseHanlder(Socket::ConnectionID p_localConnectionI
 }
 
 
+void
+AggregatorService::UpdateRequestHandler(Socket::ConnectionID p_localConnectionID, Socket::Packet p_packet)
+{
+    auto context = GetContext();
+
+    Socket::PacketHeader requestHeader = p_packet.Header();
+    if (Socket::c_invalidConnectionID == requestHeader.m_connectionID)
+    {
+        requestHeader.m_connectionID = p_localConnectionID;
+    }
+
+    Socket::RemoteUpdateRequest request;
+    if (0 == p_packet.Header().m_bodyLength || nullptr == request.Read(p_packet.Body()))
+    {
+        LOG(Helper::LogLevel::LL_Error, "Failed to read update request!\n");
+        SendUpdateResponse(requestHeader, Socket::PacketProcessStatus::Failed);
+        return;
+    }
+
+    std::vector<Socket::ConnectionID> remoteServers;
+    std::vector<Socket::RemoteUpdateRequest> subRequests;
+    std::shared_ptr<std::vector<std::vector<std::uint32_t>>> routed;
+    if (Socket::PacketType::AddRequest == requestHeader.m_packetType)
+    {
+        // every vector is inserted into the shard of its nearest center only
+        if (nullptr == context->GetRouter()
+            || context->GetRemoteServers().size() != context->GetCenters()->Count()
+            || request.m_valueType != context->GetSettings()->m_valueType
+            || request.m_dimension != context->GetCenters()->Dimension())
+        {
+            LOG(Helper::LogLevel::LL_Error, "Cannot route the inserted vectors without matching centers!\n");
+            SendUpdateResponse(requestHeader, Socket::PacketProcessStatus::Failed);
+            return;
+        }
+
+        std::vector<SizeType> owners;
+        context->GetRouter()->Route(request.m_vectors.Data(), static_cast<SizeType>(request.m_vectorNum), 1, owners);
+
+        std::vector<std::vector<std::uint32_t>> members(context->GetRemoteServers().size());
+        for (std::uint32_t i = 0; i < request.m_vectorNum; ++i)
+        {
+            if (owners[i] < 0)
+            {
+                SendUpdateResponse(requestHeader, Socket::PacketProcessStatus::Failed);
+                return;
+            }
+            members[owners[i]].push_back(i);
+        }
+
+        routed.reset(new std::vector<std::vector<std::uint32_t>>());
+        std::size_t vectorSize = GetValueTypeSize(request.m_valueType) * request.m_dimension;
+        for (std::size_t serverID = 0; serverID < members.size(); ++serverID)
+        {
+            if (members[serverID].empty())
+            {
+                continue;
+            }
+
+            const auto& server = context->GetRemoteServers().at(serverID);
+            if (RemoteMachineStatus::Connected != server->m_status)
+            {
+                LOG(Helper::LogLevel::LL_Error, "Shard %s:%s of the inserted vectors is not connected!\n", server->m_address.c_str(), server->m_port.c_str());
+                SendUpdateResponse(requestHeader, Socket::PacketProcessStatus::Failed);
+                return;
+            }
+
+            Socket::RemoteUpdateRequest subRequest;
+            subRequest.m_indexName = request.m_indexName;
+            subRequest.m_valueType = request.m_valueType;
+            subRequest.m_dimension = request.m_dimension;
+            subRequest.m_vectorNum = static_cast<std::uint32_t>(members[serverID].size());
+            subRequest.m_vectors = ByteArray::Alloc(vectorSize * members[serverID].size());
+            for (std::size_t j = 0; j < members[serverID].size(); ++j)
+            {
+                std::uint32_t vid = members[serverID][j];
+                memcpy(subRequest.m_vectors.Data() + vectorSize * j, request.m_vectors.Data() + vectorSize * vid, vectorSize);
+                if (!request.m_metadata.empty())
+                {
+                    subRequest.m_metadata.push_back(request.m_metadata[vid]);
+                }
+            }
+
+            remoteServers.push_back(server->m_connectionID);
+            subRequests.emplace_back(std::move(subRequest));
+            routed->emplace_back(std::move(members[serverID]));
+        }
+    }
+    else
+    {
+        // a deleted vector may live in any shard
+        for (const auto& server : context->GetRemoteServers())
+        {
+            if (RemoteMachineStatus::Connected != server->m_status)
+            {
+                continue;
+            }
+
+            remoteServers.push_back(server->m_connectionID);
+        }
+    }
+
+    if (remoteServers.empty())
+    {
+        SendUpdateResponse(requestHeader, Socket::PacketProcessStatus::Failed);
+        return;
+    }
+
+    std::shared_ptr<AggregatorExecutionContext> executionContext(
+        new AggregatorExecutionContext(remoteServers.size(), requestHeader));
+    std::shared_ptr<std::vector<Socket::RemoteUpdateResult>> shardResults(new std::vector<Socket::RemoteUpdateResult>(remoteServers.size()));
+
+    // a delete by metadata has no vector status, its shards skip what they do not hold
+    std::uint32_t vectorNum = (request.m_vectors.Length() > 0) ? request.m_vectorNum : 0;
+    for (std::uint32_t i = 0; i < remoteServers.size(); ++i)
+    {
+        UpdateCallback callback = [this, executionContext, routed, shardResults, vectorNum, i](Socket::PacketProcessStatus p_status, Socket::RemoteUpdateResult p_result)
+        {
+            Socket::RemoteSearchResult result;
+            switch (p_status)
+            {
+            case Socket::PacketProcessStatus::Ok:
+                result.m_status = Socket::RemoteSearchResult::ResultStatus::Success;
+                break;
+
+            case Socket::PacketProcessStatus::Dropped:
+                result.m_status = Socket::RemoteSearchResult::ResultStatus::Dropped;
+                break;
+
+            case Socket::PacketProcessStatus::Timeout:
+                result.m_status = Socket::RemoteSearchResult::ResultStatus::Timeout;
+                break;
+
+            default:
+                result.m_status = Socket::RemoteSearchResult::ResultStatus::FailedExecute;
+                break;
+            }
+
+            // every server replies once, its slot is written before the last reply aggregates them
+            (*shardResults)[i] = std::move(p_result);
+            if (!executionContext->SetResult(i, std::make_shared<Socket::RemoteSearchResult>(std::move(result))))
+            {
+                return;
+            }
+
+            if (executionContext->IsCompletedAfterFinsh(1) && executionContext->Finish())
+            {
+                this->AggregateUpdateResults(std::move(executionContext), std::move(routed), std::move(shardResults), vectorNum);
+            }
+        };
+
+        auto timeoutCallback = [](std::shared_ptr<UpdateCallback> p_callback)
+        {
+            if (nullptr != p_callback)
+            {
+                (*p_callback)(Socket::PacketProcessStatus::Timeout, Socket::RemoteUpdateResult());
+            }
+        };
+
+        auto connectCallback = [callback](bool p_connectSucc)
+        {
+            if (!p_connectSucc)
+            {
+                callback(Socket::PacketProcessStatus::Failed, Socket::RemoteUpdateResult());
+            }
+        };
+
+        Socket::Packet packet;
+        packet.Header().m_packetType = requestHeader.m_packetType;
+        packet.Header().m_processStatus = Socket::PacketProcessStatus::Ok;
+        packet.Header().m_connectionID = Socket::c_invalidConnectionID;
+        packet.Header().m_resourceID = m_updateCallbackManager.Add(std::make_shared<UpdateCallback>(std::move(callback)),
+                                                                   context->GetSettings()->m_searchTimeout,
+                                                                   std::move(timeoutCallback));
+
+        if (subRequests.empty())
+        {
+            packet.Header().m_bodyLength = p_packet.Header().m_bodyLength;
+            packet.AllocateBuffer(packet.Header().m_bodyLength);
+            memcpy(packet.Body(), p_packet.Body(), packet.Header().m_bodyLength);
+        }
+        else
+        {
+            packet.AllocateBuffer(static_cast<std::uint32_t>(subRequests[i].EstimateBufferSize()));
+            packet.Header().m_bodyLength = static_cast<std::uint32_t>(subRequests[i].Write(packet.Body()) - packet.Body());
+        }
+        packet.Header().WriteBuffer(packet.HeaderBuffer());
+
+        m_socketClient->SendPacket(remoteServers[i], std::move(packet), connectCallback);
+    }
+}
+
+
+void
+AggregatorService::UpdateResponseHandler(Socket::ConnectionID p_localConnectionID, Socket::Packet p_packet)
+{
+    auto callback = m_updateCallbackManager.GetAndRemove(p_packet.Header().m_resourceID);
+    if (nullptr == callback)
+    {
+        return;
+    }
+
+    Socket::RemoteUpdateResult result;
+    if (p_packet.Header().m_bodyLength > 0 && nullptr == result.Read(p_packet.Body()))
+    {
+        LOG(Helper::LogLevel::LL_Error, "Failed to read update result!\n");
+        result.m_vectorStatus.clear();
+    }
+
+    (*callback)(p_packet.Header().m_processStatus, std::move(result));
+}
+
+
+void
+AggregatorService::AggregateUpdateResults(std::shared_ptr<AggregatorExecutionContext> p_exectionContext,
+                                          std::shared_ptr<std::vector<std::vector<std::uint32_t>>> p_routed,
+                                          std::shared_ptr<std::vector<Socket::RemoteUpdateResult>> p_shardResults,
+                                          std::uint32_t p_vectorNum)
+{
+    if (nullptr == p_exectionContext)
+    {
+        return;
+    }
+
+    // a dropped shard asks the client to back off and retry, which wins over a plain failure
+    Socket::PacketProcessStatus status = Socket::PacketProcessStatus::Ok;
+    std::vector<Socket::PacketProcessStatus> serverStatus(p_exectionContext->GetServerNumber(), Socket::PacketProcessStatus::Ok);
+    for (std::size_t i = 0; i < p_exectionContext->GetServerNumber(); ++i)
+    {
+        const auto& result = p_exectionContext->GetResult(i);
+        auto resultStatus = (nullptr == result) ? Socket::RemoteSearchResult::ResultStatus::Timeout : result->m_status;
+        switch (resultStatus)
+        {
+        case Socket::RemoteSearchResult::ResultStatus::Success:
+            break;
+
+        case Socket::RemoteSearchResult::ResultStatus::Dropped:
+            serverStatus[i] = Socket::PacketProcessStatus::Dropped;
+            status = Socket::PacketProcessStatus::Dropped;
+            break;
+
+        case Socket::RemoteSearchResult::ResultStatus::Timeout:
+            serverStatus[i] = Socket::PacketProcessStatus::Timeout;
+            if (Socket::PacketProcessStatus::Dropped != status)
+            {
+                status = Socket::PacketProcessStatus::Timeout;
+            }
+            break;
+
+        default:
+            serverStatus[i] = Socket::PacketProcessStatus::Failed;
+            if (Socket::PacketProcessStatus::Ok == status)
+            {
+                status = Socket::PacketProcessStatus::Failed;
+            }
+            break;
+        }
+    }
+
+    // a deleted vector lives in one shard only, the others not holding it is no error
+    if (nullptr == p_routed && p_vectorNum > 0)
+    {
+        Socket::RemoteUpdateResult deleteResult;
+        status = MergeDeleteResults(serverStatus, *p_shardResults, p_vectorNum, deleteResult);
+        SendUpdateResponse(p_exectionContext->GetRequestHeader(), status, deleteResult.m_vectorStatus.empty() ? nullptr : &deleteResult);
+        return;
+    }
+
+    // the shards that succeeded have applied their part of an insert, so resending the whole batch would
+    // duplicate it: tell the client which vectors are in
+    if (Socket::PacketProcessStatus::Ok != status && nullptr != p_routed)
+    {
+        Socket::RemoteUpdateResult updateResult;
+        updateResult.m_vectorStatus.resize(p_vectorNum, Socket::PacketProcessStatus::Failed);
+        for (std::size_t i = 0; i < p_routed->size() && i < serverStatus.size(); ++i)
+        {
+            for (std::uint32_t vid : p_routed->at(i))
+            {
+                updateResult.m_vectorStatus[vid] = serverStatus[i];
+            }
+        }
+
+        SendUpdateResponse(p_exectionContext->GetRequestHeader(), status, &updateResult);
+        return;
+    }
+
+    SendUpdateResponse(p_exectionContext->GetRequestHeader(), status);
+}
+
+
+void
+AggregatorService::SendUpdateResponse(const Socket::PacketHeader& p_requestHeader,
+                                      Socket::PacketProcessStatus p_status,
+                                      const Socket::RemoteUpdateResult* p_result)
+{
+    Socket::Packet packet;
+    packet.Header().m_packetType = Socket::PacketTypeHelper::GetCrosspondingResponseType(p_requestHeader.m_packetType);
+    packet.Header().m_processStatus = p_status;
+    packet.Header().m_connectionID = p_requestHeader.m_connectionID;
+    packet.Header().m_resourceID = p_requestHeader.m_resourceID;
+    if (nullptr == p_result)
+    {
+        packet.Header().m_bodyLength = 0;
+        packet.AllocateBuffer(0);
+    }
+    else
+    {
+        packet.AllocateBuffer(static_cast<std::uint32_t>(p_result->EstimateBufferSize()));
+        packet.Header().m_bodyLength = static_cast<std::uint32_t>(p_result->Write(packet.Body()) - packet.Body());
+    }
+    packet.Header().WriteBuffer(packet.HeaderBuffer());
+
+    m_socketServer->SendPacket(p_requestHeader.m_connectionID, std::move(packet), nullptr);
+}
+
+
+Socket::PacketProcessStatus
+AggregatorService::MergeDeleteResults(const std::vector<Socket::PacketProcessStatus>& p_shardStatus,
+                                      const std::vector<Socket::RemoteUpdateResult>& p_shardResults,
+                                      std::uint32_t p_vectorNum,
+                                      Socket::RemoteUpdateResult& p_merged)
+{
+    // the lower the rank, the more likely a retry applies the vector
+    auto rank = [](Socket::PacketProcessStatus p_status)
+    {
+        switch (p_status)
+        {
+        case Socket::PacketProcessStatus::Ok:
+            return 0;
+
+        case Socket::PacketProcessStatus::Dropped:
+            return 1;
+
+        case Socket::PacketProcessStatus::Timeout:
+            return 2;
+
+        default:
+            return 3;
+        }
+    };
+
+    Socket::PacketProcessStatus status = Socket::PacketProcessStatus::Ok;
+    p_merged.m_vectorStatus.assign(p_vectorNum, Socket::PacketProcessStatus::Failed);
+    for (std::uint32_t vid = 0; vid < p_vectorNum; ++vid)
+    {
+        auto& merged = p_merged.m_vectorStatus[vid];
+        for (std::size_t i = 0; i < p_shardStatus.size(); ++i)
+        {
+            const auto& vectorStatus = p_shardResults[i].m_vectorStatus;
+            auto shardStatus = (vid < vectorStatus.size()) ? vectorStatus[vid] : p_shardStatus[i];
+            if (rank(shardStatus) < rank(merged))
+            {
+                merged = shardStatus;
+            }
+        }
+
+        if (Socket::PacketProcessStatus::Ok != merged
+            && (Socket::PacketProcessStatus::Ok == status || rank(merged) < rank(status)))
+        {
+            status = merged;
+        }
+    }
+
+    if (Socket::PacketProcessStatus::Ok == status)
+    {
+        p_merged.m_vectorStatus.clear();
+    }
+    return status;
+}
+
+
 std::shared_ptr<AggregatorContext>
 AggregatorService::GetContext()
 {
@@ -360,48 +785,138 @@ AggregatorService::GetContext()
 
 
 void
-AggregatorService::AggregateResults(std::shared_ptr<AggregatorExecutionContext> p_exectionContext)
+AggregatorService::MergeIndexResults(const std::vector<const QueryResult*>& p_shards, QueryResult& p_merged)
 {
-    if (nullptr == p_exectionContext)
+    // every server answers with its own top K sorted by distance, the merged list keeps the best K of them
+    int resultNum = 0;
+    bool withMeta = false;
+    for (const auto shard : p_shards)
     {
-        return;
+        resultNum = max(resultNum, shard->GetResultNum());
+        withMeta = withMeta || shard->WithMeta();
     }
 
-    Socket::Packet packet;
-    packet.Header().m_packetType = Socket::PacketType::SearchResponse;
-    packet.Header().m_processStatus = Socket::PacketProcessStatus::Ok;
-    packet.Header().m_resourceID = p_exectionContext->GetRequestHeader().m_resourceID;
+    p_merged.Init(nullptr, resultNum, withMeta);
+    p_merged.Reset();
 
-    Socket::RemoteSearchResult remoteResult;
-    remoteResult.m_status = Socket::RemoteSearchResult::ResultStatus::Success;
+    typedef std::pair<float, std::pair<std::size_t, int>> Cursor;
+    std::priority_queue<Cursor, std::vector<Cursor>, std::greater<Cursor>> heap;
+    for (std::size_t s = 0; s < p_shards.size(); ++s)
+    {
+        if (p_shards[s]->GetResultNum() > 0)
+        {
+            heap.emplace(p_shards[s]->GetResult(0)->Dist, std::make_pair(s, 0));
+        }
+    }
 
-    std::size_t resultNum = 0;
-    for (std::size_t i = 0; i < p_exectionContext->GetServerNumber(); ++i)
+    // the same vector returned by several servers is identified by its metadata. VIDs are local to a server,
+    // without metadata only repeats from the same server are dropped.
+    std::unordered_set<std::string> seenMeta;
+    std::set<std::pair<std::size_t, SizeType>> seenVID;
+    int count = 0;
+    while (count < resultNum && !heap.empty())
     {
-        const auto& result = p_exectionContext->GetResult(i);
-        if (nullptr == result)
+        std::size_t s = heap.top().second.first;
+        int pos = heap.top().second.second;
+        heap.pop();
+
+        const QueryResult* shard = p_shards[s];
+        if (pos + 1 < shard->GetResultNum())
+        {
+            heap.emplace(shard->GetResult(pos + 1)->Dist, std::make_pair(s, pos + 1));
+        }
+
+        const BasicResult* res = shard->GetResult(pos);
+        if (res->VID < 0)
         {
             continue;
         }
 
-        resultNum += result->m_allIndexResults.size();
+        const ByteArray& meta = shard->GetMetadata(pos);
+        bool unique = (meta.Length() > 0) ?
+            seenMeta.emplace(reinterpret_cast<const char*>(meta.Data()), meta.Length()).second :
+            seenVID.emplace(s, res->VID).second;
+        if (!unique)
+        {
+            continue;
+        }
+
+        p_merged.SetResult(count, res->VID, res->Dist);
+        p_merged.SetMetadata(count, meta);
+        ++count;
     }
+}
 
-    remoteResult.m_allIndexResults.reserve(resultNum);
-    for (std::size_t i = 0; i < p_exectionContext->GetServerNumber(); ++i)
+
+void
+AggregatorService::MergeSearchResults(const std::vector<AggregatorResult>& p_results, Socket::RemoteSearchResult& p_merged)
+{
+    p_merged.m_status = Socket::RemoteSearchResult::ResultStatus::Success;
+    p_merged.m_allIndexResults.clear();
+
+    // group the answers of every query and index, keeping the order they were first seen in
+    std::vector<std::vector<const QueryResult*>> indexShards;
+    std::map<std::pair<std::uint32_t, std::string>, std::size_t> indexPos;
+    std::size_t answered = 0;
+    for (const auto& result : p_results)
     {
-        const auto& result = p_exectionContext->GetResult(i);
-        if (nullptr == result)
+        if (nullptr == result || Socket::RemoteSearchResult::ResultStatus::Success != result->m_status)
         {
             continue;
         }
 
-        for (auto& indexRes : result->m_allIndexResults)
+        ++answered;
+        for (const auto& indexRes : result->m_allIndexResults)
         {
-            remoteResult.m_allIndexResults.emplace_back(std::move(indexRes));
+            auto key = std::make_pair(indexRes.m_queryID, indexRes.m_indexName);
+            auto iter = indexPos.find(key);
+            if (iter == indexPos.end())
+            {
+                iter = indexPos.emplace(key, p_merged.m_allIndexResults.size()).first;
+                p_merged.m_allIndexResults.emplace_back();
+                p_merged.m_allIndexResults.back().m_indexName = indexRes.m_indexName;
+                p_merged.m_allIndexResults.back().m_queryID = indexRes.m_queryID;
+                indexShards.emplace_back();
+            }
+
+            indexShards[iter->second].push_back(&(indexRes.m_results));
         }
     }
 
+    if (0 == answered && p_results.size() > 0)
+    {
+        p_merged.m_status = Socket::RemoteSearchResult::ResultStatus::Timeout;
+    }
+
+    for (std::size_t i = 0; i < indexShards.size(); ++i)
+    {
+        MergeIndexResults(indexShards[i], p_merged.m_allIndexResults[i].m_results);
+    }
+}
+
+
+void
+AggregatorService::AggregateResults(std::shared_ptr<AggregatorExecutionContext> p_exectionContext)
+{
+    if (nullptr == p_exectionContext)
+    {
+        return;
+    }
+
+    Socket::Packet packet;
+    packet.Header().m_packetType = Socket::PacketType::SearchResponse;
+    packet.Header().m_processStatus = Socket::PacketProcessStatus::Ok;
+    packet.Header().m_resourceID = p_exectionContext->GetRequestHeader().m_resourceID;
+
+    std::vector<AggregatorResult> results;
+    for (std::size_t i = 0; i < p_exectionContext->GetServerNumber(); ++i)
+    {
+        results.push_back(p_exectionContext->GetResult(i));
+    }
+
+    Socket::RemoteSearchResult remoteResult;
+    MergeSearchResults(results, remoteResult);
+
     std::uint32_t cap = static_cast<std::uint32_t>(remoteResult.EstimateBufferSize());
     packet.AllocateBuffer(cap);
     packet.Header().m_bodyLength = static_cast<std::uint32_t>(remoteResult.Write(packet.Body()) - packet.Body());
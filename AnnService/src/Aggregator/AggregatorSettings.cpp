@@ -8,7 +8,10 @@ using namespace SPTAG::Aggregator;
 
 AggregatorSettings::AggregatorSettings()
     : m_searchTimeout(100),
+      m_partialResultOnTimeout(false),
       m_threadNum(8),
-      m_socketThreadNum(8)
+      m_socketThreadNum(8),
+      m_centerIndexThreshold(4096),
+      m_centerIndexMaxCheck(2048)
 {
 }
@@ -318,6 +318,11 @@ namespace SPTAG
                         p_space.m_NGQueue.insert(NodeDistPair(nn_index, distance2leaf));
                     }
                 }
+                if (p_space.m_progress && p_space.m_iNumberOfCheckedLeaves >= p_space.m_iNextProgress)
+                {
+                    p_space.m_iNextProgress = p_space.m_iNumberOfCheckedLeaves + p_space.m_iProgressInterval;
+                    p_space.m_progress(p_query, p_space.m_NGQueue.empty() ? MaxDist : p_space.m_NGQueue.Top().distance);
+                }
                 if (p_space.m_NGQueue.Top().distance > p_space.m_SPTQueue.Top().distance)
                 {
                     m_pTrees.SearchTrees(m_pSamples, m_fComputeDistance, p_query, p_space, m_iNumberOfOtherDynamicPivots + p_space.m_iNumberOfCheckedLeaves);
@@ -430,6 +435,22 @@ namespace SPTAG
             return ErrorCode::Success;
         }
 
+        template<typename T>
+        ErrorCode Index<T>::SearchIndexWithProgress(QueryResult &p_query, int p_interval, std::function<void(QueryResult&, float)> p_progress) const
+        {
+            if (!m_bReady) return ErrorCode::EmptyIndex;
+
+            if (m_workspace.get() == nullptr) {
+                m_workspace.reset(new COMMON::WorkSpace());
+                m_workspace->Initialize(max(m_iMaxCheck, m_pGraph.m_iMaxCheckForRefineGraph), m_iHashTableExp);
+            }
+            m_workspace->Reset(m_iMaxCheck, p_query.GetResultNum());
+            m_workspace->SetProgress(p_interval, std::move(p_progress));
+            SearchIndex(*((COMMON::QueryResultSet<T>*)&p_query), *m_workspace, false, true);
+            m_workspace->m_progress = nullptr;
+            return ErrorCode::Success;
+        }
+
         template<typename T>
         ErrorCode Index<T>::RefineSearchIndex(QueryResult &p_query, bool p_searchDeleted) const
         {
@@ -605,18 +626,22 @@ namespace SPTAG
         template <typename T>
         ErrorCode Index<T>::DeleteIndex(const void* p_vectors, SizeType p_vectorNum) {
             const T* ptr_v = (const T*)p_vectors;
+            std::atomic_bool notFound(false);
 #pragma omp parallel for schedule(dynamic)
             for (SizeType i = 0; i < p_vectorNum; i++) {
                 COMMON::QueryResultSet<T> query(ptr_v + i * GetFeatureDim(), m_pGraph.m_iCEF);
                 SearchIndex(query);
 
+                bool found = false;
                 for (int i = 0; i < m_pGraph.m_iCEF; i++) {
                     if (query.GetResult(i)->Dist < 1e-6) {
                         DeleteIndex(query.GetResult(i)->VID);
+                        found = true;
                     }
                 }
+                if (!found) notFound = true;
             }
-            return ErrorCode::Success;
+            return notFound ? ErrorCode::VectorNotFound : ErrorCode::Success;
         }
 
         template <typename T>
@@ -1044,3 +1044,82 @@ float DistanceUtils::ComputeCosineDistance_AVX512(const float* pX, const float*
     while (pX < pEnd1) diff += (*pX++) * (*pY++);
     return 1 - diff;
 }
+
+// The codes of 16 sub-quantizers of vectors v and v + 16 share a register, four rounds of byte unpacks transpose
+// the 16 registers so register k holds sub-quantizer k of all 32 vectors. Each one then picks its distances from the
+// 16 entry table with one shuffle per 128-bit lane, widened to 16 bits before they are added up so nothing saturates.
+void DistanceUtils::ComputeFastScan_AVX(const std::uint8_t* pLut, const std::uint8_t* const* pCodes, int count, DimensionType subvectors, std::uint16_t* pSums)
+{
+    static const std::uint8_t missing[16] = { 0 };
+    const std::uint8_t* codes[FastScanBlock];
+    for (int v = 0; v < FastScanBlock; v++) codes[v] = (v < count) ? pCodes[v] : missing;
+
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i sumLo = _mm256_setzero_si256();
+    __m256i sumHi = _mm256_setzero_si256();
+    __m256i rows[16], next[16];
+    DimensionType i = 0;
+    for (; i + 16 <= subvectors; i += 16, pLut += 256)
+    {
+        for (int v = 0; v < 16; v++)
+        {
+            std::size_t offset = (codes[v] == missing) ? 0 : i;
+            std::size_t offsetHigh = (codes[v + 16] == missing) ? 0 : i;
+            rows[v] = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(codes[v] + offset))),
+                _mm_loadu_si128((const __m128i*)(codes[v + 16] + offsetHigh)), 1);
+        }
+        for (int round = 0; round < 4; round++)
+        {
+            for (int r = 0; r < 8; r++)
+            {
+                next[2 * r] = _mm256_unpacklo_epi8(rows[r], rows[r + 8]);
+                next[2 * r + 1] = _mm256_unpackhi_epi8(rows[r], rows[r + 8]);
+            }
+            for (int r = 0; r < 16; r++) rows[r] = next[r];
+        }
+        for (int k = 0; k < 16; k++)
+        {
+            __m256i lut = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)(pLut + 16 * k)));
+            __m256i dist = _mm256_shuffle_epi8(lut, rows[k]);
+            sumLo = _mm256_add_epi16(sumLo, _mm256_unpacklo_epi8(dist, zero));
+            sumHi = _mm256_add_epi16(sumHi, _mm256_unpackhi_epi8(dist, zero));
+        }
+    }
+    // the unpacks work per 128-bit lane: sumLo holds vectors 0-7 and 16-23, sumHi vectors 8-15 and 24-31
+    std::uint16_t sums[FastScanBlock];
+    _mm256_storeu_si256((__m256i*)sums, _mm256_permute2x128_si256(sumLo, sumHi, 0x20));
+    _mm256_storeu_si256((__m256i*)(sums + 16), _mm256_permute2x128_si256(sumLo, sumHi, 0x31));
+    for (int v = 0; v < count; v++)
+    {
+        const std::uint8_t* pLutRow = pLut;
+        std::uint16_t sum = sums[v];
+        for (DimensionType j = i; j < subvectors; j++, pLutRow += 16) sum += pLutRow[pCodes[v][j]];
+        pSums[v] = sum;
+    }
+}
+
+// The batch kernels call the single vector kernels of this file directly so they are inlined into the loop.
+#define DefineDistanceBatch(Name, Type) \
+void DistanceUtils::Name##Batch##_SSE(const Type* pX, const void* pY, std::size_t stride, int num, DimensionType length, float* pDists) \
+{ \
+    ComputeStridedDistances<Type, &DistanceUtils::Name##_SSE>(pX, pY, stride, num, length, pDists); \
+} \
+void DistanceUtils::Name##Batch##_AVX(const Type* pX, const void* pY, std::size_t stride, int num, DimensionType length, float* pDists) \
+{ \
+    ComputeStridedDistances<Type, &DistanceUtils::Name##_AVX>(pX, pY, stride, num, length, pDists); \
+} \
+void DistanceUtils::Name##Batch##_AVX512(const Type* pX, const void* pY, std::size_t stride, int num, DimensionType length, float* pDists) \
+{ \
+    ComputeStridedDistances<Type, &DistanceUtils::Name##_AVX512>(pX, pY, stride, num, length, pDists); \
+} \
+
+DefineDistanceBatch(ComputeL2Distance, std::int8_t)
+DefineDistanceBatch(ComputeL2Distance, std::uint8_t)
+DefineDistanceBatch(ComputeL2Distance, std::int16_t)
+DefineDistanceBatch(ComputeL2Distance, float)
+DefineDistanceBatch(ComputeCosineDistance, std::int8_t)
+DefineDistanceBatch(ComputeCosineDistance, std::uint8_t)
+DefineDistanceBatch(ComputeCosineDistance, std::int16_t)
+DefineDistanceBatch(ComputeCosineDistance, float)
+
+#undef DefineDistanceBatch
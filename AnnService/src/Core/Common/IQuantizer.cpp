@@ -1,6 +1,7 @@
 #include <inc/Core/Common/IQuantizer.h>
 #include <inc/Core/Common/PQQuantizer.h>
 #include <inc/Core/Common/OPQQuantizer.h>
+#include <inc/Core/Common/PQFastScanQuantizer.h>
 #include <inc/Helper/StringConvert.h>
 
 namespace SPTAG
@@ -48,6 +49,19 @@ namespace SPTAG
                 }
                 if (ret->LoadQuantizer(p_in) != ErrorCode::Success) ret.reset();
                 return ret;
+            case QuantizerType::PQFastScanQuantizer:
+                switch (reconstructType) {
+#define DefineVectorValueType(Name, Type) \
+                    case VectorValueType::Name: \
+                        ret.reset(new PQFastScanQuantizer<Type>()); \
+                        break;
+
+#include "inc/Core/DefinitionList.h"
+#undef DefineVectorValueType
+                default: break;
+                }
+                if (ret && ret->LoadQuantizer(p_in) != ErrorCode::Success) ret.reset();
+                return ret;
             }
             return ret;
         }
@@ -96,6 +110,19 @@ namespace SPTAG
 
                 if (ret->LoadQuantizer(raw_bytes) != ErrorCode::Success) ret.reset();
                 return ret;
+            case QuantizerType::PQFastScanQuantizer:
+                switch (reconstructType) {
+#define DefineVectorValueType(Name, Type) \
+                    case VectorValueType::Name: \
+                        ret.reset(new PQFastScanQuantizer<Type>()); \
+                        break;
+
+#include "inc/Core/DefinitionList.h"
+#undef DefineVectorValueType
+                default: break;
+                }
+                if (ret && ret->LoadQuantizer(raw_bytes) != ErrorCode::Success) ret.reset();
+                return ret;
             }
             return ret;
         }
@@ -5,6 +5,8 @@
 #include "inc/Core/VectorIndex.h"
 #include "inc/Core/Common/QueryResultSet.h"
 
+#include <future>
+
 #if defined(GPU)
 #include <cuda.h>
 #include <cuda_runtime.h>
@@ -39,29 +41,7 @@ namespace SPTAG
             LOG(Helper::LogLevel::LL_Info, "Start to write truth file...\n");
             writeTruthFile(truthFile, querySet->Count(), K, truthset, distset, p_truthFileType);
 
-            auto ptr = SPTAG::f_createIO();
-            if (ptr == nullptr || !ptr->Initialize((truthFile + ".dist.bin").c_str(), std::ios::out | std::ios::binary)) {
-                LOG(Helper::LogLevel::LL_Error, "Fail to create the file:%s\n", (truthFile + ".dist.bin").c_str());
-                exit(1);
-            }
-
-            int int32_queryNumber = (int)querySet->Count();
-            ptr->WriteBinary(4, (char*)&int32_queryNumber);
-            ptr->WriteBinary(4, (char*)&K);
-
-            for (size_t i = 0; i < int32_queryNumber; i++)
-            {
-                for (int k = 0; k < K; k++) {
-                    if (ptr->WriteBinary(4, (char*)(&(truthset[i][k]))) != 4) {
-                        LOG(Helper::LogLevel::LL_Error, "Fail to write the truth dist file!\n");
-                        exit(1);
-                    }
-                    if (ptr->WriteBinary(4, (char*)(&(distset[i][k]))) != 4) {
-                        LOG(Helper::LogLevel::LL_Error, "Fail to write the truth dist file!\n");
-                        exit(1);
-                    }
-                }
-            }
+            writeTruthDistFile(truthFile, querySet->Count(), K, truthset, distset);
         }
 #else
         template<typename T>
@@ -74,103 +54,129 @@ namespace SPTAG
             }
 
             LOG(Helper::LogLevel::LL_Info, "Begin to generate truth for query(%d,%d) and doc(%d,%d)...\n", querySet->Count(), querySet->Dimension(), vectorSet->Count(), vectorSet->Dimension());
-            std::vector< std::vector<SPTAG::SizeType> > truthset(querySet->Count(), std::vector<SPTAG::SizeType>(K, 0));
-            std::vector< std::vector<float> > distset(querySet->Count(), std::vector<float>(K, 0));
-            auto fComputeDistance = quantizer ? quantizer->DistanceCalcSelector<T>(distMethod) : COMMON::DistanceCalcSelector<T>(distMethod);
-#pragma omp parallel for
-            for (int i = 0; i < querySet->Count(); ++i)
+            std::vector<std::unique_ptr<QueryResultSet<T>>> queries;
+            InitTruthQueries<T>(querySet, K, quantizer, queries);
+            ScanTruthBlock<T>(queries, vectorSet, 0, distMethod, quantizer);
+            WriteTruth<T>(queries, truthFile, K, p_truthFileType);
+        }
+
+#endif // (GPU)
+
+        template<typename T>
+        void TruthSet::GenerateTruth(std::shared_ptr<VectorSet> querySet, std::shared_ptr<Helper::VectorSetReader> vectorReader, SizeType p_blockVectors, const std::string truthFile,
+            const SPTAG::DistCalcMethod distMethod, const int K, const SPTAG::TruthFileType p_truthFileType, const std::shared_ptr<IQuantizer>& quantizer) {
+            if (p_blockVectors <= 0)
+            {
+                LOG(Helper::LogLevel::LL_Error, "Truth block size must be positive, got %d.\n", p_blockVectors);
+                exit(1);
+            }
+
+            LOG(Helper::LogLevel::LL_Info, "Begin to generate truth for query(%d,%d) streaming doc blocks of %d...\n", querySet->Count(), querySet->Dimension(), p_blockVectors);
+            std::vector<std::unique_ptr<QueryResultSet<T>>> queries;
+            InitTruthQueries<T>(querySet, K, quantizer, queries);
+
+            // the next block is read while the current one is scanned
+            auto readBlock = [&vectorReader, p_blockVectors](SizeType begin) { return vectorReader->GetVectorSet(begin, begin + p_blockVectors); };
+            std::future<std::shared_ptr<VectorSet>> next = std::async(std::launch::async, readBlock, 0);
+            SizeType begin = 0;
+            for (std::shared_ptr<VectorSet> block; (block = next.get())->Count() > 0; begin += block->Count())
             {
-                SPTAG::COMMON::QueryResultSet<T> query((const T*)(querySet->GetVector(i)), K);
-                query.SetTarget((const T*)(querySet->GetVector(i)), quantizer);
-                for (SPTAG::SizeType j = 0; j < vectorSet->Count(); j++)
+                next = std::async(std::launch::async, readBlock, begin + block->Count());
+                if (querySet->Dimension() != block->Dimension() && !quantizer)
                 {
-                    float dist = fComputeDistance(query.GetQuantizedTarget(), reinterpret_cast<T*>(vectorSet->GetVector(j)), vectorSet->Dimension());
-                    query.AddPoint(j, dist);
-                    //LOG(Helper::LogLevel::LL_Info, "j = %d\n", j);
+                    LOG(Helper::LogLevel::LL_Error, "query and vector have different dimensions.");
+                    exit(1);
                 }
-                
-                query.SortResult();
-                
-                //LOG(Helper::LogLevel::LL_Info, "query.m_results.Length = %d\n", query.GetResult(10));
-                for (int k = 0; k < K; k++)
+                if (distMethod == DistCalcMethod::Cosine && !quantizer) block->Normalize(omp_get_max_threads());
+
+                ScanTruthBlock<T>(queries, block, begin, distMethod, quantizer);
+                LOG(Helper::LogLevel::LL_Info, "Scanned %d doc vectors.\n", begin + block->Count());
+            }
+            WriteTruth<T>(queries, truthFile, K, p_truthFileType);
+        }
+
+        template<typename T>
+        void TruthSet::InitTruthQueries(std::shared_ptr<VectorSet> querySet, const int K, const std::shared_ptr<IQuantizer>& quantizer, std::vector<std::unique_ptr<QueryResultSet<T>>>& queries)
+        {
+            queries.resize(querySet->Count());
+            for (SizeType i = 0; i < querySet->Count(); i++)
+            {
+                queries[i].reset(new QueryResultSet<T>((const T*)(querySet->GetVector(i)), K));
+                queries[i]->SetTarget((const T*)(querySet->GetVector(i)), quantizer);
+            }
+        }
+
+        template<typename T>
+        void TruthSet::ScanTruthBlock(std::vector<std::unique_ptr<QueryResultSet<T>>>& queries, std::shared_ptr<VectorSet> block, SizeType blockBegin,
+            const SPTAG::DistCalcMethod distMethod, const std::shared_ptr<IQuantizer>& quantizer, const std::uint8_t* live)
+        {
+            // a tile of queries shares every tile of doc vectors while it is in cache, each thread owns the heaps of its
+            // query tiles so no locking is needed
+            SizeType queryNum = (SizeType)queries.size();
+            SizeType docNum = block->Count();
+            DimensionType dim = block->Dimension();
+            std::size_t docSize = block->PerVectorDataSize();
+            int docTile = (int)max((std::size_t)1, c_truthDocTileBytes / docSize);
+            auto fComputeDistance = quantizer ? quantizer->DistanceCalcSelector<T>(distMethod) : COMMON::DistanceCalcSelector<T>(distMethod);
+            auto fComputeDistances = COMMON::DistanceBatchCalcSelector<T>(distMethod);
+
+#pragma omp parallel for schedule(dynamic)
+            for (SizeType queryBegin = 0; queryBegin < queryNum; queryBegin += c_truthQueryTile)
+            {
+                SizeType queryEnd = min(queryBegin + c_truthQueryTile, queryNum);
+                std::vector<float> dists(docTile);
+                for (SizeType docBegin = 0; docBegin < docNum; docBegin += docTile)
                 {
-                    /*bool existEqual = false;
-                    int min_ = 0;
-                    if (k < vectorSet->Count() - 1 && (query.GetResult(k))->Dist == (query.GetResult(k + 1))->Dist) {
-                        existEqual = true;
-                        
-                        if ((query.GetResult(k + 1))->VID < (query.GetResult(k))->VID) {
-                            min_ = k + 1;
+                    int count = (int)min((SizeType)docTile, docNum - docBegin);
+                    const T* docs = (const T*)(block->GetVector(docBegin));
+                    for (SizeType i = queryBegin; i < queryEnd; i++)
+                    {
+                        QueryResultSet<T>& query = *queries[i];
+                        if (quantizer)
+                        {
+                            for (int j = 0; j < count; j++) dists[j] = fComputeDistance(query.GetQuantizedTarget(), (const T*)((const char*)docs + j * docSize), dim);
                         }
-                        else {
-                            min_ = k;
+                        else
+                        {
+                            fComputeDistances(query.GetTarget(), docs, docSize, count, dim, dists.data());
                         }
-                        
-                        for (int x = k + 1 ; x < vectorSet->Count() - 1; x++) {
-                            if (x < vectorSet->Count() - 2 && (query.GetResult(x))->Dist == (query.GetResult(x + 1))->Dist) {
-                                if ((query.GetResult(x + 1))->VID < (query.GetResult(min_))->VID) 
-                                    min_ = x + 1;
-                                
-                            }
-                            else {
-                                break;
-                            }
+                        for (int j = 0; j < count; j++)
+                        {
+                            SizeType vid = blockBegin + docBegin + j;
+                            if (live == nullptr || live[vid]) query.AddPoint(vid, dists[j]);
                         }
                     }
-                    
-                    if(existEqual)
-                        LOG(Helper::LogLevel::LL_Info, "equal=%d, top %d id is %d, min_ is %d, dis is %f\n", existEqual, k, (query.GetResult(min_))->VID, min_, (query.GetResult(min_))->Dist);
-                    else
-                        LOG(Helper::LogLevel::LL_Info, "equal=%d, top %d id is %d, dis is %f\n", existEqual, k, (query.GetResult(k))->VID, (query.GetResult(k))->Dist);
-                    
-                    //truthset[i][k] = existEqual ? (query.GetResult(min_))->VID : (query.GetResult(k))->VID;//truthset stores the id of vector
-                    //distset[i][k] = existEqual ? (query.GetResult(min_))->Dist : (query.GetResult(k))->Dist;//distset stores the distance of the top k vectors
-                    
-                    if (existEqual) {
-                        SizeType tmp_min_vid = (query.GetResult(min_))->VID;
-                        float tmp_min_dist = (query.GetResult(min_))->Dist;
-                    
-                        query.SetResult(min_, (query.GetResult(k))->VID, (query.GetResult(k))->Dist);
-                        query.SetResult(k, tmp_min_vid, tmp_min_dist);
-                    }*/
-                    
-                    
-                    
-                    truthset[i][k] = (query.GetResult(k))->VID;//truthset stores the id of vector
-                    distset[i][k] = (query.GetResult(k))->Dist;//distset stores the distance of the top k vectors
-                    //LOG(Helper::LogLevel::LL_Info, "i = %d, k = %d, vid = %d, dis = %f\n", i, k, truthset[i][k], distset[i][k]);
                 }
-
-            }
-            LOG(Helper::LogLevel::LL_Info, "Start to write truth file...\n");
-            writeTruthFile(truthFile, querySet->Count(), K, truthset, distset, p_truthFileType);
-
-            auto ptr = SPTAG::f_createIO();
-            if (ptr == nullptr || !ptr->Initialize((truthFile + ".dist.bin").c_str(), std::ios::out | std::ios::binary)) {
-                LOG(Helper::LogLevel::LL_Error, "Fail to create the file:%s\n", (truthFile + ".dist.bin").c_str());
-                exit(1);
             }
+        }
 
-            int int32_queryNumber = (int)querySet->Count();
-            ptr->WriteBinary(4, (char*)&int32_queryNumber);
-            ptr->WriteBinary(4, (char*)&K);
-
-            for (size_t i = 0; i < int32_queryNumber; i++)
+        template<typename T>
+        void TruthSet::WriteTruth(std::vector<std::unique_ptr<QueryResultSet<T>>>& queries, const std::string truthFile, const int K, const SPTAG::TruthFileType p_truthFileType)
+        {
+            SizeType queryNum = (SizeType)queries.size();
+            std::vector< std::vector<SPTAG::SizeType> > truthset(queryNum, std::vector<SPTAG::SizeType>(K, 0));
+            std::vector< std::vector<float> > distset(queryNum, std::vector<float>(K, 0));
+            for (SizeType i = 0; i < queryNum; i++)
             {
-                for (int k = 0; k < K; k++) {
-                    if (ptr->WriteBinary(4, (char*)(&(truthset[i][k]))) != 4) {
-                        LOG(Helper::LogLevel::LL_Error, "Fail to write the truth dist file!\n");
-                        exit(1);
-                    }
-                    if (ptr->WriteBinary(4, (char*)(&(distset[i][k]))) != 4) {
-                        LOG(Helper::LogLevel::LL_Error, "Fail to write the truth dist file!\n");
-                        exit(1);
-                    }
+                queries[i]->SortResult();
+                for (int k = 0; k < K; k++)
+                {
+                    truthset[i][k] = queries[i]->GetResult(k)->VID;
+                    distset[i][k] = queries[i]->GetResult(k)->Dist;
                 }
             }
+            LOG(Helper::LogLevel::LL_Info, "Start to write truth file...\n");
+            writeTruthFile(truthFile, queryNum, K, truthset, distset, p_truthFileType);
+            writeTruthDistFile(truthFile, queryNum, K, truthset, distset);
         }
 
-#endif // (GPU)
+#define DefineVectorValueType(Name, Type) \
+        template void TruthSet::InitTruthQueries<Type>(std::shared_ptr<VectorSet> querySet, const int K, const std::shared_ptr<IQuantizer>& quantizer, std::vector<std::unique_ptr<QueryResultSet<Type>>>& queries); \
+        template void TruthSet::ScanTruthBlock<Type>(std::vector<std::unique_ptr<QueryResultSet<Type>>>& queries, std::shared_ptr<VectorSet> block, SizeType blockBegin, const SPTAG::DistCalcMethod distMethod, const std::shared_ptr<IQuantizer>& quantizer, const std::uint8_t* live); \
+        template void TruthSet::GenerateTruth<Type>(std::shared_ptr<VectorSet> querySet, std::shared_ptr<Helper::VectorSetReader> vectorReader, SizeType p_blockVectors, const std::string truthFile, const SPTAG::DistCalcMethod distMethod, const int K, const SPTAG::TruthFileType p_truthFileType, const std::shared_ptr<IQuantizer>& quantizer);
+#include "inc/Core/DefinitionList.h"
+#undef DefineVectorValueType
+
 
 #define DefineVectorValueType(Name, Type) template void TruthSet::GenerateTruth<Type>(std::shared_ptr<VectorSet> querySet, std::shared_ptr<VectorSet> vectorSet, const std::string truthFile, const SPTAG::DistCalcMethod distMethod, const int K, const SPTAG::TruthFileType p_truthFileType, const std::shared_ptr<IQuantizer>& quantizer);
 #include "inc/Core/DefinitionList.h"
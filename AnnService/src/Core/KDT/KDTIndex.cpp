@@ -456,18 +456,22 @@ case VectorValueType::Name: \
         template <typename T>
         ErrorCode Index<T>::DeleteIndex(const void* p_vectors, SizeType p_vectorNum) {
             const T* ptr_v = (const T*)p_vectors;
+            std::atomic_bool notFound(false);
 #pragma omp parallel for schedule(dynamic)
             for (SizeType i = 0; i < p_vectorNum; i++) {
                 COMMON::QueryResultSet<T> query(ptr_v + i * GetFeatureDim(), m_pGraph.m_iCEF);
                 SearchIndex(query);
 
+                bool found = false;
                 for (int i = 0; i < m_pGraph.m_iCEF; i++) {
                     if (query.GetResult(i)->Dist < 1e-6) {
                         DeleteIndex(query.GetResult(i)->VID);
+                        found = true;
                     }
                 }
+                if (!found) notFound = true;
             }
-            return ErrorCode::Success;
+            return notFound ? ErrorCode::VectorNotFound : ErrorCode::Success;
         }
 
         template <typename T>
@@ -2,13 +2,16 @@
 // Licensed under the MIT License.
 
 #include "inc/Core/SPANN/ExtraSPDKController.h"
+#include <algorithm>
 
 namespace SPTAG::SPANN
 {
 
 thread_local struct SPDKIO::BlockController::IoContext SPDKIO::BlockController::m_currIoContext;
 int SPDKIO::BlockController::m_ssdInflight = 0;
-int SPDKIO::BlockController::m_ioCompleteCount = 0;
+std::atomic<std::int64_t> SPDKIO::BlockController::m_ioCompleteCount(0);
+std::atomic<std::int64_t> SPDKIO::BlockController::m_ioCompletePages(0);
+std::atomic<std::int64_t> SPDKIO::BlockController::m_ioMergedCount(0);
 std::unique_ptr<char[]> SPDKIO::BlockController::m_memBuffer;
 
 void SPDKIO::BlockController::SpdkBdevEventCallback(enum spdk_bdev_event_type type, struct spdk_bdev *bdev, void *event_ctx) {
@@ -19,6 +22,7 @@ void SPDKIO::BlockController::SpdkBdevIoCallback(struct spdk_bdev_io *bdev_io, b
     SubIoRequest* currSubIo = (SubIoRequest *)cb_arg;
     if (success) {
         m_ioCompleteCount++;
+        m_ioCompletePages += currSubIo->blocks;
         spdk_bdev_free_io(bdev_io);
         currSubIo->completed_sub_io_requests->push(currSubIo);
         m_ssdInflight--;
@@ -43,14 +47,15 @@ void SPDKIO::BlockController::SpdkIoLoop(void *arg) {
     SubIoRequest* currSubIo = nullptr;
     while (!ctrl->m_ssdSpdkThreadExiting) {
         if (ctrl->m_submittedSubIoRequests.try_pop(currSubIo)) {
+            void* buff = currSubIo->io_buff != nullptr ? currSubIo->io_buff : currSubIo->dma_buff;
             if (currSubIo->is_read) {
                 rc = spdk_bdev_read(
                     ctrl->m_ssdSpdkBdevDesc, ctrl->m_ssdSpdkBdevIoChannel,
-                    currSubIo->dma_buff, currSubIo->offset, PageSize, SpdkBdevIoCallback, currSubIo);
+                    buff, currSubIo->offset, currSubIo->blocks * PageSize, SpdkBdevIoCallback, currSubIo);
             } else {
                 rc = spdk_bdev_write(
                     ctrl->m_ssdSpdkBdevDesc, ctrl->m_ssdSpdkBdevIoChannel,
-                    currSubIo->dma_buff, currSubIo->offset, PageSize, SpdkBdevIoCallback, currSubIo);
+                    buff, currSubIo->offset, currSubIo->blocks * PageSize, SpdkBdevIoCallback, currSubIo);
             }
             if (rc && rc != -ENOMEM) {
                 fprintf(stderr, "SPDKIO::BlockController::SpdkStart %s failed: %d, shutting down, offset: %ld\n",
@@ -135,22 +140,22 @@ bool SPDKIO::BlockController::Initialize(int batchSize) {
     m_useMemImpl = useMemImplEnvStr && !strcmp(useMemImplEnvStr, "1");
     const char* useSsdImplEnvStr = getenv(kUseSsdImplEnv);
     m_useSsdImpl = useSsdImplEnvStr && !strcmp(useSsdImplEnvStr, "1");
+    const char* maxIoPagesEnvStr = getenv(kSpdkMaxIoPagesEnv);
+    if (maxIoPagesEnvStr && atoi(maxIoPagesEnvStr) > 0) m_maxIoPages = atoi(maxIoPagesEnvStr);
     if (m_useMemImpl) {
         if (m_numInitCalled == 1) {
             if (m_memBuffer == nullptr) {
                 m_memBuffer.reset(new char[kMemImplMaxNumBlocks * PageSize]);
             }
-            for (AddressType i = 0; i < kMemImplMaxNumBlocks; i++) {
-                m_blockAddresses.push(i);
-            }
+            m_maxNumBlocks = kMemImplMaxNumBlocks;
+            m_nextFreshBlock = 0;
         }
         return true;
     } else if (m_useSsdImpl) {
         if (m_numInitCalled == 1) {
             m_batchSize = batchSize;
-            for (AddressType i = 0; i < kSsdImplMaxNumBlocks; i++) {
-                m_blockAddresses.push(i);
-            }
+            m_maxNumBlocks = kSsdImplMaxNumBlocks;
+            m_nextFreshBlock = 0;
             pthread_create(&m_ssdSpdkTid, NULL, &InitializeSpdk, this);
             while (!m_ssdSpdkThreadReady && !m_ssdSpdkThreadStartFailed);
             if (m_ssdSpdkThreadStartFailed) {
@@ -166,7 +171,8 @@ bool SPDKIO::BlockController::Initialize(int batchSize) {
         for (auto &sr : m_currIoContext.sub_io_requests) {
             sr.completed_sub_io_requests = &(m_currIoContext.completed_sub_io_requests);
             sr.app_buff = nullptr;
-            sr.dma_buff = spdk_dma_zmalloc(PageSize, buf_align, NULL);
+            sr.io_buff = nullptr;
+            sr.dma_buff = spdk_dma_zmalloc(PageSize * m_maxIoPages, buf_align, NULL);
             sr.ctrl = this;
             m_currIoContext.free_sub_io_requests.push_back(&sr);
         }
@@ -177,14 +183,27 @@ bool SPDKIO::BlockController::Initialize(int batchSize) {
     }
 }
 
-// get p_size blocks from front, and fill in p_data array
+bool SPDKIO::BlockController::GetFreshBlocks(AddressType* p_data, int p_size) {
+    AddressType start = m_nextFreshBlock.load();
+    while (start + p_size <= m_maxNumBlocks && !m_nextFreshBlock.compare_exchange_weak(start, start + p_size));
+    if (start + p_size > m_maxNumBlocks) return false;
+    for (int i = 0; i < p_size; i++) {
+        p_data[i] = start + i;
+    }
+    return true;
+}
+
+// get p_size blocks, and fill in p_data array in ascending order
 bool SPDKIO::BlockController::GetBlocks(AddressType* p_data, int p_size) {
     AddressType currBlockAddress = 0;
     if (m_useMemImpl || m_useSsdImpl) {
+        if (p_size > 1 && GetFreshBlocks(p_data, p_size)) return true;
         for (int i = 0; i < p_size; i++) {
-            while (!m_blockAddresses.try_pop(currBlockAddress));
+            while (!m_blockAddresses.try_pop(currBlockAddress) && !GetFreshBlocks(&currBlockAddress, 1));
             p_data[i] = currBlockAddress;
         }
+        // recycled blocks are scattered, keep them sorted so that neighbours can still be coalesced
+        std::sort(p_data, p_data + p_size);
         return true;
     } else {
         fprintf(stderr, "SPDKIO::BlockController::GetBlocks failed\n");
@@ -205,6 +224,13 @@ bool SPDKIO::BlockController::ReleaseBlocks(AddressType* p_data, int p_size) {
     }
 }
 
+int SPDKIO::BlockController::ContiguousBlocks(AddressType* p_data, int p_limit) {
+    int blocks = 1;
+    if (p_limit > m_maxIoPages) p_limit = m_maxIoPages;
+    while (blocks < p_limit && p_data[blocks] == p_data[blocks - 1] + 1) blocks++;
+    return blocks;
+}
+
 // read a posting list. p_data[0] is the total data size,
 // p_data[1], p_data[2], ..., p_data[((p_data[0] + PageSize - 1) >> PageSizeEx)] are the addresses of the blocks
 // concat all the block contents together into p_value string.
@@ -214,10 +240,15 @@ bool SPDKIO::BlockController::ReadBlocks(AddressType* p_data, std::string* p_val
         AddressType currOffset = 0;
         AddressType dataIdx = 1;
         while (currOffset < p_data[0]) {
-            AddressType readSize = (p_data[0] - currOffset) < PageSize ? (p_data[0] - currOffset) : PageSize;
+            int blocks = ContiguousBlocks(p_data + dataIdx, (int)((p_data[0] - currOffset + PageSize - 1) >> PageSizeEx));
+            AddressType ioSize = (AddressType)blocks * PageSize;
+            AddressType readSize = (p_data[0] - currOffset) < ioSize ? (p_data[0] - currOffset) : ioSize;
             memcpy(p_value->data() + currOffset, m_memBuffer.get() + p_data[dataIdx] * PageSize, readSize);
-            currOffset += PageSize;
-            dataIdx++;
+            m_ioCompleteCount++;
+            m_ioCompletePages += blocks;
+            m_ioMergedCount += blocks - 1;
+            currOffset += ioSize;
+            dataIdx += blocks;
         }
         return true;
     } else if (m_useSsdImpl) {
@@ -230,6 +261,7 @@ bool SPDKIO::BlockController::ReadBlocks(AddressType* p_data, std::string* p_val
         while (m_currIoContext.in_flight) {
             if (m_currIoContext.completed_sub_io_requests.try_pop(currSubIo)) {
                 currSubIo->app_buff = nullptr;
+                currSubIo->io_buff = nullptr;
                 m_currIoContext.free_sub_io_requests.push_back(currSubIo);
                 m_currIoContext.in_flight--;
             }
@@ -246,19 +278,24 @@ bool SPDKIO::BlockController::ReadBlocks(AddressType* p_data, std::string* p_val
             if (currOffset < p_data[0] && m_currIoContext.free_sub_io_requests.size()) {
                 currSubIo = m_currIoContext.free_sub_io_requests.back();
                 m_currIoContext.free_sub_io_requests.pop_back();
+                int blocks = ContiguousBlocks(p_data + dataIdx, (int)((p_data[0] - currOffset + PageSize - 1) >> PageSizeEx));
+                AddressType ioSize = (AddressType)blocks * PageSize;
                 currSubIo->app_buff = p_value->data() + currOffset;
-                currSubIo->real_size = (p_data[0] - currOffset) < PageSize ? (p_data[0] - currOffset) : PageSize;
+                currSubIo->real_size = (p_data[0] - currOffset) < ioSize ? (p_data[0] - currOffset) : ioSize;
                 currSubIo->is_read = true;
                 currSubIo->offset = p_data[dataIdx] * PageSize;
+                currSubIo->blocks = blocks;
+                m_ioMergedCount += blocks - 1;
                 m_submittedSubIoRequests.push(currSubIo);
-                currOffset += PageSize;
-                dataIdx++;
+                currOffset += ioSize;
+                dataIdx += blocks;
                 m_currIoContext.in_flight++;
             }
             // Try complete
             if (m_currIoContext.in_flight && m_currIoContext.completed_sub_io_requests.try_pop(currSubIo)) {
                 memcpy(currSubIo->app_buff, currSubIo->dma_buff, currSubIo->real_size);
                 currSubIo->app_buff = nullptr;
+                currSubIo->io_buff = nullptr;
                 m_currIoContext.free_sub_io_requests.push_back(currSubIo);
                 m_currIoContext.in_flight--;
             }
@@ -297,15 +334,19 @@ bool SPDKIO::BlockController::ReadBlocks(std::vector<AddressType*>& p_data, std:
 
             while (currOffset < p_data_i[0]) {
                 SubIoRequest currSubIo;
+                int blocks = ContiguousBlocks(p_data_i + dataIdx, (int)((p_data_i[0] - currOffset + PageSize - 1) >> PageSizeEx));
+                AddressType ioSize = (AddressType)blocks * PageSize;
                 currSubIo.app_buff = p_value->data() + currOffset;
-                currSubIo.real_size = (p_data_i[0] - currOffset) < PageSize ? (p_data_i[0] - currOffset) : PageSize;
+                currSubIo.real_size = (p_data_i[0] - currOffset) < ioSize ? (p_data_i[0] - currOffset) : ioSize;
                 currSubIo.is_read = true;
                 currSubIo.offset = p_data_i[dataIdx] * PageSize;
+                currSubIo.blocks = blocks;
                 currSubIo.posting_id = i;
                 subIoRequests.push_back(currSubIo);
                 subIoRequestCount[i]++;
-                currOffset += PageSize;
-                dataIdx++;
+                m_ioMergedCount += blocks - 1;
+                currOffset += ioSize;
+                dataIdx += blocks;
             }
         }
 
@@ -314,6 +355,7 @@ bool SPDKIO::BlockController::ReadBlocks(std::vector<AddressType*>& p_data, std:
             SubIoRequest* currSubIo;
             if (m_currIoContext.completed_sub_io_requests.try_pop(currSubIo)) {
                 currSubIo->app_buff = nullptr;
+                currSubIo->io_buff = nullptr;
                 m_currIoContext.free_sub_io_requests.push_back(currSubIo);
                 m_currIoContext.in_flight--;
             }
@@ -337,6 +379,7 @@ bool SPDKIO::BlockController::ReadBlocks(std::vector<AddressType*>& p_data, std:
                     currSubIo->real_size = subIoRequests[currSubIoIdx].real_size;
                     currSubIo->is_read = true;
                     currSubIo->offset = subIoRequests[currSubIoIdx].offset;
+                    currSubIo->blocks = subIoRequests[currSubIoIdx].blocks;
                     currSubIo->posting_id = subIoRequests[currSubIoIdx].posting_id;
                     m_submittedSubIoRequests.push(currSubIo);
                     m_currIoContext.in_flight++;
@@ -346,6 +389,7 @@ bool SPDKIO::BlockController::ReadBlocks(std::vector<AddressType*>& p_data, std:
                 if (m_currIoContext.in_flight && m_currIoContext.completed_sub_io_requests.try_pop(currSubIo)) {
                     memcpy(currSubIo->app_buff, currSubIo->dma_buff, currSubIo->real_size);
                     currSubIo->app_buff = nullptr;
+                    currSubIo->io_buff = nullptr;
                     subIoRequestCount[currSubIo->posting_id]--;
                     m_currIoContext.free_sub_io_requests.push_back(currSubIo);
                     m_currIoContext.in_flight--;
@@ -370,11 +414,163 @@ bool SPDKIO::BlockController::ReadBlocks(std::vector<AddressType*>& p_data, std:
     }
 }
 
+// parallel read a list of posting lists into caller owned buffers.
+bool SPDKIO::BlockController::ReadBlocks(std::vector<AddressType*>& p_data, const std::vector<std::uint8_t*>& p_buffers, std::size_t p_bufferSize, std::vector<std::size_t>* p_sizes, const std::chrono::microseconds &timeout, const std::function<bool(std::size_t)>& p_onComplete) {
+    p_sizes->resize(p_data.size());
+    if (m_useMemImpl) {
+        for (size_t i = 0; i < p_data.size(); i++) {
+            AddressType* p_data_i = p_data[i];
+            (*p_sizes)[i] = p_data_i[0];
+            if ((std::size_t)p_data_i[0] <= p_bufferSize) {
+                AddressType currOffset = 0;
+                AddressType dataIdx = 1;
+                while (currOffset < p_data_i[0]) {
+                    int blocks = ContiguousBlocks(p_data_i + dataIdx, (int)((p_data_i[0] - currOffset + PageSize - 1) >> PageSizeEx));
+                    AddressType ioSize = (AddressType)blocks * PageSize;
+                    AddressType readSize = (p_data_i[0] - currOffset) < ioSize ? (p_data_i[0] - currOffset) : ioSize;
+                    memcpy(p_buffers[i] + currOffset, m_memBuffer.get() + p_data_i[dataIdx] * PageSize, readSize);
+                    m_ioCompleteCount++;
+                    m_ioCompletePages += blocks;
+                    m_ioMergedCount += blocks - 1;
+                    currOffset += ioSize;
+                    dataIdx += blocks;
+                }
+            }
+            if (p_onComplete && !p_onComplete(i)) {
+                for (size_t j = i + 1; j < p_data.size(); j++) (*p_sizes)[j] = 0;
+                break;
+            }
+        }
+        return true;
+    } else if (m_useSsdImpl) {
+        auto t1 = std::chrono::high_resolution_clock::now();
+
+        // reused across queries so that the hot search path does not allocate
+        static thread_local std::vector<SubIoRequest> subIoRequests;
+        static thread_local std::vector<int> subIoRequestCount;
+        subIoRequests.clear();
+        subIoRequestCount.assign(p_data.size(), 0);
+        for (size_t i = 0; i < p_data.size(); i++) {
+            AddressType* p_data_i = p_data[i];
+            (*p_sizes)[i] = p_data_i[0];
+            if ((std::size_t)p_data_i[0] > p_bufferSize) continue;
+
+            // page granular reads land in place, so the buffer must hold the value rounded up to pages
+            bool zeroCopy = ((((std::size_t)p_data_i[0] + PageSize - 1) >> PageSizeEx) << PageSizeEx) <= p_bufferSize &&
+                spdk_vtophys(p_buffers[i], nullptr) != SPDK_VTOPHYS_ERROR;
+            AddressType currOffset = 0;
+            AddressType dataIdx = 1;
+            while (currOffset < p_data_i[0]) {
+                SubIoRequest currSubIo;
+                int blocks = ContiguousBlocks(p_data_i + dataIdx, (int)((p_data_i[0] - currOffset + PageSize - 1) >> PageSizeEx));
+                AddressType ioSize = (AddressType)blocks * PageSize;
+                currSubIo.app_buff = p_buffers[i] + currOffset;
+                currSubIo.io_buff = zeroCopy ? currSubIo.app_buff : nullptr;
+                currSubIo.real_size = (p_data_i[0] - currOffset) < ioSize ? (p_data_i[0] - currOffset) : ioSize;
+                currSubIo.is_read = true;
+                currSubIo.offset = p_data_i[dataIdx] * PageSize;
+                currSubIo.blocks = blocks;
+                currSubIo.posting_id = i;
+                subIoRequests.push_back(currSubIo);
+                subIoRequestCount[i]++;
+                m_ioMergedCount += blocks - 1;
+                currOffset += ioSize;
+                dataIdx += blocks;
+            }
+        }
+
+        // Clear timeout I/Os
+        while (m_currIoContext.in_flight) {
+            SubIoRequest* currSubIo;
+            if (m_currIoContext.completed_sub_io_requests.try_pop(currSubIo)) {
+                currSubIo->app_buff = nullptr;
+                currSubIo->io_buff = nullptr;
+                m_currIoContext.free_sub_io_requests.push_back(currSubIo);
+                m_currIoContext.in_flight--;
+            }
+        }
+
+        // postings without any I/O (empty or not fitting) are complete already
+        bool stopped = false;
+        for (size_t i = 0; i < p_data.size() && p_onComplete && !stopped; i++) {
+            if (subIoRequestCount[i] == 0) stopped = !p_onComplete(i);
+        }
+
+        // keep a window of m_batchSize I/Os in flight, completed postings are consumed while the rest are still being read.
+        // on cancel or timeout the I/Os in flight are left behind and cleared by the next call.
+        size_t currSubIoIdx = 0;
+        SubIoRequest* currSubIo;
+        while (!stopped && (currSubIoIdx < subIoRequests.size() || m_currIoContext.in_flight)) {
+            auto t2 = std::chrono::high_resolution_clock::now();
+            if (std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1) > timeout) {
+                break;
+            }
+            // Try submit
+            if (currSubIoIdx < subIoRequests.size() && m_currIoContext.in_flight < m_batchSize && m_currIoContext.free_sub_io_requests.size()) {
+                currSubIo = m_currIoContext.free_sub_io_requests.back();
+                m_currIoContext.free_sub_io_requests.pop_back();
+                currSubIo->app_buff = subIoRequests[currSubIoIdx].app_buff;
+                currSubIo->io_buff = subIoRequests[currSubIoIdx].io_buff;
+                currSubIo->real_size = subIoRequests[currSubIoIdx].real_size;
+                currSubIo->is_read = true;
+                currSubIo->offset = subIoRequests[currSubIoIdx].offset;
+                currSubIo->blocks = subIoRequests[currSubIoIdx].blocks;
+                currSubIo->posting_id = subIoRequests[currSubIoIdx].posting_id;
+                m_submittedSubIoRequests.push(currSubIo);
+                m_currIoContext.in_flight++;
+                currSubIoIdx++;
+            }
+            // Try complete
+            if (m_currIoContext.in_flight && m_currIoContext.completed_sub_io_requests.try_pop(currSubIo)) {
+                if (currSubIo->io_buff == nullptr) memcpy(currSubIo->app_buff, currSubIo->dma_buff, currSubIo->real_size);
+                int postingID = currSubIo->posting_id;
+                currSubIo->app_buff = nullptr;
+                currSubIo->io_buff = nullptr;
+                m_currIoContext.free_sub_io_requests.push_back(currSubIo);
+                m_currIoContext.in_flight--;
+                if (--subIoRequestCount[postingID] == 0 && p_onComplete) stopped = !p_onComplete(postingID);
+            }
+        }
+
+        for (int i = 0; i < subIoRequestCount.size(); i++) {
+            if (subIoRequestCount[i] != 0) {
+                (*p_sizes)[i] = 0;
+            }
+        }
+        return true;
+    } else {
+        fprintf(stderr, "SPDKIO::BlockController::ReadBlocks buffers failed\n");
+        return false;
+    }
+}
+
+std::uint8_t* SPDKIO::BlockController::AllocateBuffer(std::size_t p_size) {
+    void* buffer;
+    if (m_useSsdImpl) {
+        buffer = spdk_dma_zmalloc(p_size, PageSize, NULL);
+    } else {
+        buffer = PAGE_ALLOC(p_size);
+    }
+    if (buffer == nullptr) return nullptr;
+    std::lock_guard<std::mutex> lock(m_ioBufferMutex);
+    m_ioBuffers.push_back(buffer);
+    return (std::uint8_t*)buffer;
+}
+
 // write p_value into p_size blocks start from p_data
 bool SPDKIO::BlockController::WriteBlocks(AddressType* p_data, int p_size, const std::string& p_value) {
     if (m_useMemImpl) {
-        for (int i = 0; i < p_size; i++) {
-            memcpy(m_memBuffer.get() + p_data[i] * PageSize, p_value.data() + i * PageSize, PageSize);
+        AddressType totalSize = p_value.size();
+        for (int i = 0; i < p_size;) {
+            int blocks = ContiguousBlocks(p_data + i, p_size - i);
+            AddressType ioSize = (AddressType)blocks * PageSize;
+            AddressType currOffset = (AddressType)i * PageSize;
+            AddressType writeSize = (currOffset + ioSize) > totalSize ? (totalSize - currOffset) : ioSize;
+            memcpy(m_memBuffer.get() + p_data[i] * PageSize, p_value.data() + currOffset, writeSize);
+            m_ioCompleteCount++;
+            m_ioCompletePages += blocks;
+            m_ioMergedCount += blocks - 1;
+            i += blocks;
         }
         return true;
     } else if (m_useSsdImpl) {
@@ -388,18 +584,23 @@ bool SPDKIO::BlockController::WriteBlocks(AddressType* p_data, int p_size, const
             if (currBlockIdx < p_size && m_currIoContext.free_sub_io_requests.size()) {
                 currSubIo = m_currIoContext.free_sub_io_requests.back();
                 m_currIoContext.free_sub_io_requests.pop_back();
+                int blocks = ContiguousBlocks(p_data + currBlockIdx, p_size - currBlockIdx);
+                AddressType ioSize = (AddressType)blocks * PageSize;
                 currSubIo->app_buff = const_cast<char *>(p_value.data()) + currBlockIdx * PageSize;
-                currSubIo->real_size = (PageSize * (currBlockIdx + 1)) > totalSize ? (totalSize - currBlockIdx * PageSize): PageSize;
+                currSubIo->real_size = (currBlockIdx * PageSize + ioSize) > totalSize ? (totalSize - currBlockIdx * PageSize): ioSize;
                 currSubIo->is_read = false;
                 currSubIo->offset = p_data[currBlockIdx] * PageSize;
+                currSubIo->blocks = blocks;
                 memcpy(currSubIo->dma_buff, currSubIo->app_buff, currSubIo->real_size);
+                m_ioMergedCount += blocks - 1;
                 m_submittedSubIoRequests.push(currSubIo);
-                currBlockIdx++;
+                currBlockIdx += blocks;
                 inflight++;
             }
             // Try complete
             if (inflight && m_currIoContext.completed_sub_io_requests.try_pop(currSubIo)) {
                 currSubIo->app_buff = nullptr;
+                currSubIo->io_buff = nullptr;
                 m_currIoContext.free_sub_io_requests.push_back(currSubIo);
                 inflight--;
             }
@@ -412,18 +613,26 @@ bool SPDKIO::BlockController::WriteBlocks(AddressType* p_data, int p_size, const
 }
 
 bool SPDKIO::BlockController::IOStatistics() {
-    int currIOCount = m_ioCompleteCount;
-    int diffIOCount = currIOCount - m_preIOCompleteCount;
+    std::int64_t currIOCount = m_ioCompleteCount;
+    std::int64_t diffIOCount = currIOCount - m_preIOCompleteCount;
     m_preIOCompleteCount = currIOCount;
 
+    std::int64_t currIOPages = m_ioCompletePages;
+    std::int64_t diffIOPages = currIOPages - m_preIOCompletePages;
+    m_preIOCompletePages = currIOPages;
+
+    std::int64_t currIOMerged = m_ioMergedCount;
+    std::int64_t diffIOMerged = currIOMerged - m_preIOMergedCount;
+    m_preIOMergedCount = currIOMerged;
+
     auto currTime = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::microseconds>(currTime - m_preTime);
     m_preTime = currTime;
 
     double currIOPS = (double)diffIOCount * 1000 / duration.count();
-    double currBandWidth = (double)diffIOCount * PageSize / 1024 * 1000 / 1024 * 1000 / duration.count();
+    double currBandWidth = (double)diffIOPages * PageSize / 1024 * 1000 / 1024 * 1000 / duration.count();
 
-    std::cout << "IOPS: " << currIOPS << "k Bandwidth: " << currBandWidth << "MB/s" << std::endl;
+    std::cout << "IOPS: " << currIOPS << "k Bandwidth: " << currBandWidth << "MB/s Merged IOs: " << diffIOMerged << "/" << diffIOPages << std::endl;
 
     return true;
 }
@@ -438,10 +647,19 @@ bool SPDKIO::BlockController::ShutDown() {
                 AddressType currBlockAddress;
                 m_blockAddresses.try_pop(currBlockAddress);
             }
+            m_nextFreshBlock = 0;
+            std::lock_guard<std::mutex> bufferLock(m_ioBufferMutex);
+            for (void* buffer : m_ioBuffers) PAGE_FREE(buffer);
+            m_ioBuffers.clear();
         }
         return true;
     } else if (m_useSsdImpl) {
         if (m_numInitCalled == 0) {
+            {
+                std::lock_guard<std::mutex> bufferLock(m_ioBufferMutex);
+                for (void* buffer : m_ioBuffers) spdk_free(buffer);
+                m_ioBuffers.clear();
+            }
             m_ssdSpdkThreadExiting = true;
             spdk_app_start_shutdown();
             pthread_join(m_ssdSpdkTid, NULL);
@@ -449,12 +667,14 @@ bool SPDKIO::BlockController::ShutDown() {
                 AddressType currBlockAddress;
                 m_blockAddresses.try_pop(currBlockAddress);
             }
+            m_nextFreshBlock = 0;
         }
 
         SubIoRequest* currSubIo;
         while (m_currIoContext.in_flight) {
             if (m_currIoContext.completed_sub_io_requests.try_pop(currSubIo)) {
                 currSubIo->app_buff = nullptr;
+                currSubIo->io_buff = nullptr;
                 m_currIoContext.free_sub_io_requests.push_back(currSubIo);
                 m_currIoContext.in_flight--;
             }
@@ -18,6 +18,7 @@ namespace SPTAG
     namespace SPANN
     {
         std::atomic_int ExtraWorkSpace::g_spaceCount(0);
+        std::atomic_uint64_t ExtraWorkSpace::g_ioBufferSources(0);
         EdgeCompare Selection::g_edgeComparer;
         template <typename T>
         thread_local std::shared_ptr<ExtraWorkSpace> Index<T>::m_workspace;
@@ -163,7 +164,9 @@ namespace SPTAG
 
             omp_set_num_threads(m_options.m_iSSDNumberOfThreads);
 
-            if (m_options.m_useSPDK) {
+            if (m_options.m_useSPDK && m_extraSearcher->Recovered()) {
+                LOG(Helper::LogLevel::LL_Info, "SPDK postings recovered, skip copying data from static\n");
+            } else if (m_options.m_useSPDK) {
                 int m_vectorLimit = m_options.m_postingPageLimit * PageSize / (sizeof(T) * m_options.m_dim + sizeof(int) + sizeof(uint8_t));
                 m_versionMap.Initialize(m_options.m_vectorSize, m_index->m_iDataBlockSize, m_index->m_iDataCapacity);
                 int m_vectorInfoSize = sizeof(T) * m_options.m_dim + sizeof(int) + sizeof(uint8_t);
@@ -234,6 +237,7 @@ namespace SPTAG
                 };
             for (int j = 0; j < m_options.m_iSSDNumberOfThreads; j++) { threads.emplace_back(func); }
             for (auto& thread : threads) { thread.join(); }
+            m_extraSearcher->FinishCopy();
             } else {
                 m_versionMap.Load(m_options.m_deleteIDFile, m_index->m_iDataBlockSize, m_index->m_iDataCapacity);
             }
@@ -317,13 +321,16 @@ namespace SPTAG
         {
             if (!m_bReady) return ErrorCode::EmptyIndex;
 
+            SearchStats stats;
+            stats.m_searchRequestTime = std::chrono::steady_clock::now();
+
             COMMON::QueryResultSet<T>* p_queryResults;
             if (p_query.GetResultNum() >= m_options.m_searchInternalResultNum)
                 p_queryResults = (COMMON::QueryResultSet<T>*) & p_query;
             else
                 p_queryResults = new COMMON::QueryResultSet<T>((const T*)p_query.GetTarget(), m_options.m_searchInternalResultNum);
 
-            m_index->SearchIndex(*p_queryResults);
+            SearchHeadIndex(*p_queryResults);
 
             if (m_extraSearcher != nullptr) {
                 if (m_workspace.get() == nullptr) {
@@ -331,31 +338,8 @@ namespace SPTAG
                     m_workspace->Initialize(m_options.m_maxCheck, m_options.m_hashExp, m_options.m_searchInternalResultNum, min(m_options.m_postingPageLimit, m_options.m_searchPostingPageLimit + 1) << PageSizeEx, m_options.m_enableDataCompression);
                 }
                 m_workspace->m_deduper.clear();
-                m_workspace->m_postingIDs.clear();
-
-                float limitDist = p_queryResults->GetResult(0)->Dist * m_options.m_maxDistRatio;
-                for (int i = 0; i < p_queryResults->GetResultNum(); ++i)
-                {
-                    auto res = p_queryResults->GetResult(i);
-                    if (res->VID == -1) break;
-                    
-                    auto postingID = res->VID;
-                    if (m_vectorTranslateMap.get() != nullptr) res->VID = static_cast<SizeType>((m_vectorTranslateMap.get())[res->VID]);
-                    else {
-                        res->VID = -1;
-                        res->Dist = MaxDist;
-                    }
-
-                    // Don't do disk reads for irrelevant pages
-                    if (m_workspace->m_postingIDs.size() >= m_options.m_searchInternalResultNum ||
-                        (limitDist > 0.1 && res->Dist > limitDist) ||
-                        !m_extraSearcher->CheckValidPosting(postingID))
-                        continue;
-                    m_workspace->m_postingIDs.emplace_back(postingID);
-                }
-
-                if (m_vectorTranslateMap.get() != nullptr) p_queryResults->Reverse();
-                m_extraSearcher->SearchIndex(m_workspace.get(), *p_queryResults, m_index, nullptr);
+                SelectPostings(*p_queryResults, m_workspace->m_postingIDs, m_workspace->m_postingDists);
+                m_extraSearcher->SearchIndex(m_workspace.get(), *p_queryResults, m_index, &stats);
                 p_queryResults->SortResult();
             }
 
@@ -375,6 +359,122 @@ namespace SPTAG
             return ErrorCode::Success;
         }
 
+        template <typename T>
+        void Index<T>::SelectPostings(COMMON::QueryResultSet<T>& p_queryResults, std::vector<SizeType>& p_postingIDs, std::vector<float>& p_postingDists) const
+        {
+            p_postingIDs.clear();
+            p_postingDists.clear();
+
+            float limitDist = p_queryResults.GetResult(0)->Dist * m_options.m_maxDistRatio;
+            for (int i = 0; i < p_queryResults.GetResultNum(); ++i)
+            {
+                auto res = p_queryResults.GetResult(i);
+                if (res->VID == -1) break;
+
+                auto postingID = res->VID;
+                float postingDist = res->Dist;
+                if (m_vectorTranslateMap.get() != nullptr) res->VID = static_cast<SizeType>((m_vectorTranslateMap.get())[res->VID]);
+                else {
+                    res->VID = -1;
+                    res->Dist = MaxDist;
+                }
+
+                // Don't do disk reads for irrelevant pages
+                if (p_postingIDs.size() >= m_options.m_searchInternalResultNum ||
+                    (limitDist > 0.1 && postingDist > limitDist) ||
+                    !m_extraSearcher->CheckValidPosting(postingID))
+                    continue;
+                p_postingIDs.emplace_back(postingID);
+                p_postingDists.emplace_back(postingDist);
+            }
+
+            if (m_vectorTranslateMap.get() != nullptr) p_queryResults.Reverse();
+        }
+
+        template <typename T>
+        ErrorCode Index<T>::SearchIndexBatch(std::vector<QueryResult*>& p_queries, SearchStats* p_stats) const
+        {
+            if (!m_bReady) return ErrorCode::EmptyIndex;
+
+            SearchStats stats;
+            if (p_stats == nullptr) p_stats = &stats;
+            if (p_stats->m_searchRequestTime.time_since_epoch().count() == 0) p_stats->m_searchRequestTime = std::chrono::steady_clock::now();
+
+            std::size_t queryNum = p_queries.size();
+            std::vector<std::unique_ptr<COMMON::QueryResultSet<T>>> internalResults(queryNum);
+            std::vector<QueryResult*> queryResults(queryNum);
+            std::vector<std::vector<SizeType>> postingIDs(queryNum);
+            std::vector<float> postingDists;
+            for (std::size_t q = 0; q < queryNum; q++)
+            {
+                COMMON::QueryResultSet<T>* p_queryResults;
+                if (p_queries[q]->GetResultNum() >= m_options.m_searchInternalResultNum)
+                    p_queryResults = (COMMON::QueryResultSet<T>*)p_queries[q];
+                else {
+                    internalResults[q].reset(new COMMON::QueryResultSet<T>((const T*)p_queries[q]->GetTarget(), m_options.m_searchInternalResultNum));
+                    p_queryResults = internalResults[q].get();
+                }
+                queryResults[q] = p_queryResults;
+
+                // postings prefetched during the head search belong to one query, the batch reads its own
+                m_index->SearchIndex(*p_queryResults);
+                if (m_extraSearcher != nullptr) SelectPostings(*p_queryResults, postingIDs[q], postingDists);
+            }
+
+            if (m_extraSearcher != nullptr) {
+                if (m_workspace.get() == nullptr) {
+                    m_workspace.reset(new ExtraWorkSpace());
+                    m_workspace->Initialize(m_options.m_maxCheck, m_options.m_hashExp, m_options.m_searchInternalResultNum, min(m_options.m_postingPageLimit, m_options.m_searchPostingPageLimit + 1) << PageSizeEx, m_options.m_enableDataCompression);
+                }
+                m_extraSearcher->SearchIndexBatch(m_workspace.get(), queryResults, postingIDs, m_index, p_stats);
+                for (std::size_t q = 0; q < queryNum; q++) ((COMMON::QueryResultSet<T>*)queryResults[q])->SortResult();
+            }
+
+            for (std::size_t q = 0; q < queryNum; q++)
+            {
+                QueryResult& query = *(p_queries[q]);
+                if (internalResults[q]) std::copy(internalResults[q]->GetResults(), internalResults[q]->GetResults() + query.GetResultNum(), query.GetResults());
+
+                if (query.WithMeta() && nullptr != m_pMetadata)
+                {
+                    for (int i = 0; i < query.GetResultNum(); ++i)
+                    {
+                        SizeType result = query.GetResult(i)->VID;
+                        query.SetMetadata(i, (result < 0) ? ByteArray::c_empty : m_pMetadata->GetMetadataCopy(result));
+                    }
+                }
+            }
+            return ErrorCode::Success;
+        }
+
+        template <typename T>
+        ErrorCode Index<T>::SearchHeadIndex(QueryResult& p_query) const
+        {
+            if (!m_options.m_asyncHeadSearch || nullptr == m_extraSearcher) return m_index->SearchIndex(p_query);
+
+            if (m_workspace.get() == nullptr) {
+                m_workspace.reset(new ExtraWorkSpace());
+                m_workspace->Initialize(m_options.m_maxCheck, m_options.m_hashExp, m_options.m_searchInternalResultNum, min(m_options.m_postingPageLimit, m_options.m_searchPostingPageLimit + 1) << PageSizeEx, m_options.m_enableDataCompression);
+            }
+
+            // Heads nearer than the search frontier are rarely displaced by the rest of the graph
+            // traversal, so their postings are read while it goes on. SearchDiskIndex scans them.
+            return m_index->SearchIndexWithProgress(p_query, m_options.m_headPrefetchInterval, [this](QueryResult& p_heads, float p_frontier) {
+                static thread_local std::vector<SizeType> confident;
+                confident.clear();
+                const std::vector<int>& prefetched = m_workspace->m_prefetchIDs;
+                for (int i = 0; i < p_heads.GetResultNum(); ++i)
+                {
+                    auto res = p_heads.GetResult(i);
+                    if (res->VID < 0 || res->Dist > p_frontier) continue;
+                    if (std::find(prefetched.begin(), prefetched.end(), res->VID) != prefetched.end()) continue;
+                    if (!m_extraSearcher->CheckValidPosting(res->VID)) continue;
+                    confident.push_back(res->VID);
+                }
+                if (!confident.empty()) m_extraSearcher->PrefetchPostings(m_workspace.get(), confident);
+            });
+        }
+
         template <typename T>
         ErrorCode Index<T>::SearchDiskIndex(QueryResult& p_query, SearchStats* p_stats) const
         {
@@ -388,6 +488,7 @@ namespace SPTAG
             }
             m_workspace->m_deduper.clear();
             m_workspace->m_postingIDs.clear();
+            m_workspace->m_postingDists.clear();
 
             float limitDist = p_queryResults->GetResult(0)->Dist * m_options.m_maxDistRatio;
             int i = 0;
@@ -398,6 +499,7 @@ namespace SPTAG
                 if (m_extraSearcher->CheckValidPosting(res->VID))
                 {
                     m_workspace->m_postingIDs.emplace_back(res->VID);
+                    m_workspace->m_postingDists.emplace_back(res->Dist);
                 }
                 if (m_vectorTranslateMap.get() != nullptr) res->VID = static_cast<SizeType>((m_vectorTranslateMap.get())[res->VID]);
                 else {
@@ -458,6 +560,7 @@ namespace SPTAG
                 int subInternalResultNum = min(p_subInternalResultNum, p_internalResultNum - p_subInternalResultNum * p);
 
                 m_workspace->m_postingIDs.clear();
+                m_workspace->m_postingDists.clear();
 
                 for (int i = p * p_subInternalResultNum; i < p * p_subInternalResultNum + subInternalResultNum; i++)
                 {
@@ -465,6 +568,7 @@ namespace SPTAG
                     if (res->VID == -1 || (limitDist > 0.1 && res->Dist > limitDist)) break;
                     if (!m_extraSearcher->CheckValidPosting(res->VID)) continue;
                     m_workspace->m_postingIDs.emplace_back(res->VID);
+                    m_workspace->m_postingDists.emplace_back(res->Dist);
                 }
 
                 m_extraSearcher->SearchIndex(m_workspace.get(), *newResults, m_index, p_stats, truth, found);
@@ -860,7 +964,7 @@ namespace SPTAG
                         exit(1);
                     }
                     else {
-                        m_extraSearcher.reset(new ExtraDynamicSearcher<T>(m_options.m_spdkMappingPath.c_str(), m_options.m_dim, m_options.m_postingPageLimit, m_options.m_useDirectIO, m_options.m_latencyLimit, m_options.m_mergeThreshold, true, m_options.m_spdkBatchSize));
+                        m_extraSearcher.reset(new ExtraDynamicSearcher<T>(m_options.m_spdkMappingPath.c_str(), m_options.m_dim, m_options.m_postingPageLimit, m_options.m_useDirectIO, m_options.m_latencyLimit, m_options.m_mergeThreshold, true, m_options.m_spdkBatchSize, m_options.m_bufferLength));
                     }  
                 }
                 else {
@@ -1105,26 +1209,26 @@ namespace SPTAG
         template <typename T>
         ErrorCode Index<T>::DeleteIndex(const void* p_vectors, SizeType p_vectorNum)
         {
-            // TODO: Support batch delete
             DimensionType p_dimension = GetFeatureDim();
-            std::shared_ptr<VectorSet> vectorSet;
-            if (m_options.m_distCalcMethod == DistCalcMethod::Cosine) {
-                ByteArray arr = ByteArray::Alloc(sizeof(T) * p_vectorNum * p_dimension);
-                memcpy(arr.Data(), p_vectors, sizeof(T) * p_vectorNum * p_dimension);
-                vectorSet.reset(new BasicVectorSet(arr, GetEnumValueType<T>(), p_dimension, p_vectorNum));
-                int base = COMMON::Utils::GetBase<T>();
-                for (SizeType i = 0; i < p_vectorNum; i++) {
-                    COMMON::Utils::Normalize((T*)(vectorSet->GetVector(i)), p_dimension, base);
+            ErrorCode ret = ErrorCode::Success;
+            for (SizeType i = 0; i < p_vectorNum; i++) {
+                const T* vector = (const T*)p_vectors + (std::size_t)i * p_dimension;
+                std::shared_ptr<VectorSet> vectorSet;
+                if (m_options.m_distCalcMethod == DistCalcMethod::Cosine) {
+                    ByteArray arr = ByteArray::Alloc(sizeof(T) * p_dimension);
+                    memcpy(arr.Data(), vector, sizeof(T) * p_dimension);
+                    vectorSet.reset(new BasicVectorSet(arr, GetEnumValueType<T>(), p_dimension, 1));
+                    COMMON::Utils::Normalize((T*)(vectorSet->GetVector(0)), p_dimension, COMMON::Utils::GetBase<T>());
                 }
+                else {
+                    vectorSet.reset(new BasicVectorSet(ByteArray((std::uint8_t*)vector, sizeof(T) * p_dimension, false),
+                        GetEnumValueType<T>(), p_dimension, 1));
+                }
+                SizeType p_id = m_extraSearcher->SearchVector(vectorSet, m_index);
+                ErrorCode deleteRet = (p_id == -1) ? ErrorCode::VectorNotFound : DeleteIndex(p_id);
+                if (deleteRet != ErrorCode::Success) ret = deleteRet;
             }
-            else {
-                vectorSet.reset(new BasicVectorSet(ByteArray((std::uint8_t*)p_vectors, sizeof(T) * 1 * p_dimension, false),
-                    GetEnumValueType<T>(), p_dimension, 1));
-            }
-            SizeType p_id = m_extraSearcher->SearchVector(vectorSet, m_index);
-            if (p_id == -1) return ErrorCode::ExternalAbort;
-
-            return DeleteIndex(p_id);
+            return ret;
         }
     }
 }
@@ -8,6 +8,7 @@
 #include <inc/Core/Common/DistanceUtils.h>
 #include "inc/Quantizer/Training.h"
 
+#include <chrono>
 #include <memory>
 
 using namespace SPTAG;
@@ -15,6 +16,8 @@ using namespace SPTAG;
 void QuantizeAndSave(std::shared_ptr<SPTAG::Helper::VectorSetReader>& vectorReader, std::shared_ptr<QuantizerOptions>& options, std::shared_ptr<SPTAG::COMMON::IQuantizer>& quantizer)
 {
     std::shared_ptr<SPTAG::VectorSet> set;
+    double totalSeconds = 0;
+    SizeType totalVectors = 0;
     for (int i = 0; (set = vectorReader->GetVectorSet(i, i + options->m_trainingSamples))->Count() > 0; i += options->m_trainingSamples)
     {
         if (i % (options->m_trainingSamples *10) == 0 || i % options->m_trainingSamples != 0)
@@ -30,11 +33,18 @@ void QuantizeAndSave(std::shared_ptr<SPTAG::Helper::VectorSetReader>& vectorRead
         ByteArray PQ_vector_array = ByteArray::Alloc(sizeof(std::uint8_t) * options->m_quantizedDim * set->Count());
         quantized_vectors = std::make_shared<BasicVectorSet>(PQ_vector_array, VectorValueType::UInt8, options->m_quantizedDim, set->Count());
 
-#pragma omp parallel for
-        for (int i = 0; i < set->Count(); i++)
+        const SizeType quantizeBlock = 256;
+        auto start = std::chrono::steady_clock::now();
+#pragma omp parallel for schedule(dynamic)
+        for (SizeType begin = 0; begin < set->Count(); begin += quantizeBlock)
         {
-            quantizer->QuantizeVector(set->GetVector(i), (uint8_t*)quantized_vectors->GetVector(i));
+            quantizer->QuantizeVectors(set->GetVector(begin), set->PerVectorDataSize(), min(quantizeBlock, set->Count() - begin),
+                (uint8_t*)quantized_vectors->GetVector(begin), quantized_vectors->PerVectorDataSize());
         }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        totalSeconds += seconds;
+        totalVectors += set->Count();
+        LOG(Helper::LogLevel::LL_Info, "Quantized %d vectors in %.3f s: %.0f vectors/sec\n", set->Count(), seconds, set->Count() / max(seconds, 1e-9));
 
         ErrorCode code;
         if ((code = quantized_vectors->AppendSave(options->m_outputFile)) != ErrorCode::Success)
@@ -64,6 +74,7 @@ void QuantizeAndSave(std::shared_ptr<SPTAG::Helper::VectorSetReader>& vectorRead
             }
         }
     }
+    LOG(Helper::LogLevel::LL_Info, "Quantized %d vectors: %.0f vectors/sec\n", totalVectors, totalVectors / max(totalSeconds, 1e-9));
 }
 
 int main(int argc, char* argv[])
@@ -102,7 +113,9 @@ int main(int argc, char* argv[])
         break;
     }
     case QuantizerType::PQQuantizer:
+    case QuantizerType::PQFastScanQuantizer:
     {
+        bool fastScan = (options->m_quantizerType == QuantizerType::PQFastScanQuantizer);
         std::shared_ptr<COMMON::IQuantizer> quantizer;
         auto fp_load = SPTAG::f_createIO();
         if (fp_load == nullptr || !fp_load->Initialize(options->m_outputQuantizerFile.c_str(), std::ios::binary | std::ios::in))
@@ -116,7 +129,9 @@ int main(int argc, char* argv[])
             {
 #define DefineVectorValueType(Name, Type) \
                     case VectorValueType::Name: \
-                        quantizer.reset(new COMMON::PQQuantizer<Type>(options->m_quantizedDim, 256, (DimensionType)(options->m_dimension/options->m_quantizedDim), false, TrainPQQuantizer<Type>(options, set, quantized_vectors))); \
+                        if (fastScan) quantizer.reset(new COMMON::PQFastScanQuantizer<Type>(options->m_quantizedDim, (DimensionType)(options->m_dimension/options->m_quantizedDim), false, \
+                            TrainPQQuantizer<Type>(options, set, quantized_vectors, COMMON::PQFastScanQuantizer<Type>::KsPerSubvector))); \
+                        else quantizer.reset(new COMMON::PQQuantizer<Type>(options->m_quantizedDim, 256, (DimensionType)(options->m_dimension/options->m_quantizedDim), false, TrainPQQuantizer<Type>(options, set, quantized_vectors))); \
                         break;
 
 #include "inc/Core/DefinitionList.h"
@@ -153,12 +153,27 @@ namespace SPTAG {
 					LOG(Helper::LogLevel::LL_Error, "Failed to read query file.\n");
 					exit(1);
 				}
-				auto vectorSet = vectorReader->GetVectorSet();
 				auto querySet = queryReader->GetVectorSet(0, opts->m_querySize);
-				if (distCalcMethod == DistCalcMethod::Cosine && !index->m_pQuantizer) vectorSet->Normalize(opts->m_iSSDNumberOfThreads);
-        
-        LOG(Helper::LogLevel::LL_Info, "vector size:%d, query size:%d \n", vectorSet->Count(), querySet->Count());
 				omp_set_num_threads(opts->m_iSSDNumberOfThreads);
+				if (opts->m_truthBlockVectors > 0)
+				{
+					LOG(Helper::LogLevel::LL_Info, "query size:%d, streaming vectors in blocks of %d\n", querySet->Count(), opts->m_truthBlockVectors);
+
+#define DefineVectorValueType(Name, Type) \
+	if (opts->m_valueType == VectorValueType::Name) { \
+		COMMON::TruthSet::GenerateTruth<Type>(querySet, vectorReader, opts->m_truthBlockVectors, opts->m_truthPath, \
+			distCalcMethod, opts->m_resultNum, opts->m_truthType, index->m_pQuantizer); \
+	} \
+
+#include "inc/Core/DefinitionList.h"
+#undef DefineVectorValueType
+				}
+				else
+				{
+					auto vectorSet = vectorReader->GetVectorSet();
+					if (distCalcMethod == DistCalcMethod::Cosine && !index->m_pQuantizer) vectorSet->Normalize(opts->m_iSSDNumberOfThreads);
+
+					LOG(Helper::LogLevel::LL_Info, "vector size:%d, query size:%d \n", vectorSet->Count(), querySet->Count());
 
 #define DefineVectorValueType(Name, Type) \
 	if (opts->m_valueType == VectorValueType::Name) { \
@@ -168,6 +183,7 @@ namespace SPTAG {
 
 #include "inc/Core/DefinitionList.h"
 #undef DefineVectorValueType
+				}
 
 				LOG(Helper::LogLevel::LL_Info, "End generating truth.\n");
 			}
@@ -11,6 +11,7 @@ using namespace SPTAG::Service;
 SearchExecutionContext::SearchExecutionContext(const std::shared_ptr<const ServiceSettings>& p_serviceSettings)
     : c_serviceSettings(p_serviceSettings),
       m_vectorDimension(0),
+      m_queryNum(1),
       m_inputValueType(VectorValueType::Undefined),
       m_extractMetadata(false),
       m_resultNum(p_serviceSettings->m_defaultMaxResultNumber)
@@ -36,43 +37,78 @@ SearchExecutionContext::ExtractOption()
 {
     for (const auto& optionPair : m_queryParser.GetOptions())
     {
-        if (Helper::StrUtils::StrEqualIgnoreCase(optionPair.first, "indexname"))
+        ApplyOption(optionPair.first, optionPair.second);
+    }
+
+    return ErrorCode::Success;
+}
+
+
+void
+SearchExecutionContext::ApplyOption(const char* p_name, const char* p_value)
+{
+    if (Helper::StrUtils::StrEqualIgnoreCase(p_name, "indexname"))
+    {
+        const char* begin = p_value;
+        const char* end = p_value;
+        while (*end != '\0')
         {
-            const char* begin = optionPair.second;
-            const char* end = optionPair.second;
-            while (*end != '\0')
+            while (*end != '\0' && *end != ',')
             {
-                while (*end != '\0' && *end != ',')
-                {
-                    ++end;
-                }
-
-                if (end != begin)
-                {
-                    m_indexNames.emplace_back(begin, end - begin);
-                }
-
-                if (*end != '\0')
-                {
-                    ++end;
-                    begin = end;
-                }
+                ++end;
+            }
+
+            if (end != begin)
+            {
+                m_indexNames.emplace_back(begin, end - begin);
+            }
+
+            if (*end != '\0')
+            {
+                ++end;
+                begin = end;
             }
         }
-        else if (Helper::StrUtils::StrEqualIgnoreCase(optionPair.first, "datatype"))
-        {
-            Helper::Convert::ConvertStringTo<VectorValueType>(optionPair.second, m_inputValueType);
-        }
-        else if (Helper::StrUtils::StrEqualIgnoreCase(optionPair.first, "extractmetadata"))
-        {
-            Helper::Convert::ConvertStringTo<bool>(optionPair.second, m_extractMetadata);
-        }
-        else if (Helper::StrUtils::StrEqualIgnoreCase(optionPair.first, "resultnum"))
-        {
-            Helper::Convert::ConvertStringTo<SizeType>(optionPair.second, m_resultNum);
-        }
+    }
+    else if (Helper::StrUtils::StrEqualIgnoreCase(p_name, "datatype"))
+    {
+        Helper::Convert::ConvertStringTo<VectorValueType>(p_value, m_inputValueType);
+    }
+    else if (Helper::StrUtils::StrEqualIgnoreCase(p_name, "extractmetadata"))
+    {
+        Helper::Convert::ConvertStringTo<bool>(p_value, m_extractMetadata);
+    }
+    else if (Helper::StrUtils::StrEqualIgnoreCase(p_name, "resultnum"))
+    {
+        Helper::Convert::ConvertStringTo<SizeType>(p_value, m_resultNum);
+    }
+}
+
+
+ErrorCode
+SearchExecutionContext::ExtractBinaryQuery(const Socket::RemoteQuery& p_query)
+{
+    for (const auto& param : p_query.m_params)
+    {
+        ApplyOption(param.first.c_str(), param.second.c_str());
+    }
+
+    m_inputValueType = p_query.m_valueType;
+    m_extractMetadata = p_query.m_extractMetadata;
+    if (p_query.m_resultNum > 0)
+    {
+        m_resultNum = p_query.m_resultNum;
     }
 
+    if (0 == p_query.m_queryNum || p_query.m_vectors.Length() == 0)
+    {
+        return ErrorCode::Fail;
+    }
+
+    m_queryNum = p_query.m_queryNum;
+    m_vectorDimension = p_query.m_dimension;
+    m_vector = p_query.m_vectors;
+
     return ErrorCode::Success;
 }
 
@@ -130,11 +166,12 @@ SearchExecutionContext::GetSelectedIndexNames() const
 
 
 void
-SearchExecutionContext::AddResults(std::string p_indexName, QueryResult& p_results)
+SearchExecutionContext::AddResults(std::string p_indexName, QueryResult& p_results, std::uint32_t p_queryID)
 {
     m_results.emplace_back();
     m_results.back().m_indexName.swap(p_indexName);
     m_results.back().m_results = p_results;
+    m_results.back().m_queryID = p_queryID;
 }
 
 
@@ -166,6 +203,20 @@ SearchExecutionContext::GetVectorDimension() const
 }
 
 
+const std::uint32_t
+SearchExecutionContext::GetQueryNum() const
+{
+    return m_queryNum;
+}
+
+
+const VectorValueType
+SearchExecutionContext::GetInputValueType() const
+{
+    return m_inputValueType;
+}
+
+
 const std::vector<QueryParser::OptionPair>&
 SearchExecutionContext::GetOptions() const
 {
@@ -10,9 +10,20 @@ using namespace SPTAG::Service;
 SearchExecutor::SearchExecutor(std::string p_queryString,
                                std::shared_ptr<ServiceContext> p_serviceContext,
                                const CallBack& p_callback)
+    : m_callback(p_callback),
+      c_serviceContext(std::move(p_serviceContext))
+{
+    m_query.m_type = Socket::RemoteQuery::QueryType::String;
+    m_query.m_queryString = std::move(p_queryString);
+}
+
+
+SearchExecutor::SearchExecutor(Socket::RemoteQuery p_query,
+                               std::shared_ptr<ServiceContext> p_serviceContext,
+                               const CallBack& p_callback)
     : m_callback(p_callback),
       c_serviceContext(std::move(p_serviceContext)),
-      m_queryString(std::move(p_queryString))
+      m_query(std::move(p_query))
 {
 }
 
@@ -38,12 +49,24 @@ SearchExecutor::ExecuteInternal()
 {
     m_executionContext.reset(new SearchExecutionContext(c_serviceContext->GetServiceSettings()));
 
-    if (m_executionContext->ParseQuery(m_queryString) != ErrorCode::Success) {
-        LOG(Helper::LogLevel::LL_Error, "Failed to parse query:%s!\n", m_queryString.c_str());
-        return;
+    bool binaryQuery = (Socket::RemoteQuery::QueryType::Binary == m_query.m_type);
+    if (binaryQuery)
+    {
+        if (ErrorCode::Success != m_executionContext->ExtractBinaryQuery(m_query))
+        {
+            LOG(Helper::LogLevel::LL_Error, "Failed to extract binary query!\n");
+            return;
+        }
     }
+    else
+    {
+        if (m_executionContext->ParseQuery(m_query.m_queryString) != ErrorCode::Success) {
+            LOG(Helper::LogLevel::LL_Error, "Failed to parse query:%s!\n", m_query.m_queryString.c_str());
+            return;
+        }
 
-    m_executionContext->ExtractOption();
+        m_executionContext->ExtractOption();
+    }
 
     SelectIndex();
 
@@ -55,7 +78,16 @@ SearchExecutor::ExecuteInternal()
 
     const auto& firstIndex = m_selectedIndex.front();
 
-    if (ErrorCode::Success != m_executionContext->ExtractVector(firstIndex->GetVectorValueType()))
+    if (binaryQuery)
+    {
+        // binary vectors are searched as they are, there is no text to convert to the index type
+        if (m_executionContext->GetInputValueType() != firstIndex->GetVectorValueType())
+        {
+            LOG(Helper::LogLevel::LL_Error, "Failed to match vector value type!\n");
+            return;
+        }
+    }
+    else if (ErrorCode::Success != m_executionContext->ExtractVector(firstIndex->GetVectorValueType()))
     {
         LOG(Helper::LogLevel::LL_Error, "Failed to extract vector!\n");
         return;
@@ -67,25 +99,29 @@ SearchExecutor::ExecuteInternal()
         return;
     } 
 
-    QueryResult query(m_executionContext->GetVector().Data(),
-                      m_executionContext->GetResultNum(),
-                      m_executionContext->GetExtractMetadata());
-
-    for (const auto& vectorIndex : m_selectedIndex)
+    std::size_t vectorSize = GetValueTypeSize(firstIndex->GetVectorValueType()) * firstIndex->GetFeatureDim();
+    for (std::uint32_t q = 0; q < m_executionContext->GetQueryNum(); ++q)
     {
-        if (vectorIndex->GetVectorValueType() != firstIndex->GetVectorValueType()
-            || vectorIndex->GetFeatureDim() != firstIndex->GetFeatureDim())
-        {
-            continue;
-        }
+        QueryResult query(m_executionContext->GetVector().Data() + vectorSize * q,
+                          m_executionContext->GetResultNum(),
+                          m_executionContext->GetExtractMetadata());
 
-        query.Reset();
-        if (ErrorCode::Success == vectorIndex->SearchIndex(query))
+        for (const auto& vectorIndex : m_selectedIndex)
         {
-            m_executionContext->AddResults(vectorIndex->GetIndexName(), query);
-        }
-        else {
-            LOG(Helper::LogLevel::LL_Error, "Failed to execute SearchIndex!\n");
+            if (vectorIndex->GetVectorValueType() != firstIndex->GetVectorValueType()
+                || vectorIndex->GetFeatureDim() != firstIndex->GetFeatureDim())
+            {
+                continue;
+            }
+
+            query.Reset();
+            if (ErrorCode::Success == vectorIndex->SearchIndex(query))
+            {
+                m_executionContext->AddResults(vectorIndex->GetIndexName(), query, q);
+            }
+            else {
+                LOG(Helper::LogLevel::LL_Error, "Failed to execute SearchIndex!\n");
+            }
         }
     }
 }
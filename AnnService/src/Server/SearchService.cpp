@@ -7,6 +7,7 @@
 #include "inc/Helper/CommonHelper.h"
 #include "inc/Helper/ArgumentsParser.h"
 
+#include <algorithm>
 #include <iostream>
 
 using namespace SPTAG;
@@ -42,6 +43,41 @@ public:
     std::string m_logFile;
 };
 
+
+// Indexes the current worker thread has prepared for updates, released when the thread exits.
+class UpdateThreadState
+{
+public:
+    ~UpdateThreadState()
+    {
+        for (auto& index : m_indexes)
+        {
+            index->ExitThread();
+        }
+    }
+
+    bool Enter(const std::shared_ptr<VectorIndex>& p_index)
+    {
+        if (std::find(m_indexes.begin(), m_indexes.end(), p_index) != m_indexes.end())
+        {
+            return true;
+        }
+
+        if (!p_index->InitializeThread())
+        {
+            return false;
+        }
+
+        m_indexes.push_back(p_index);
+        return true;
+    }
+
+private:
+    std::vector<std::shared_ptr<VectorIndex>> m_indexes;
+};
+
+thread_local UpdateThreadState t_updateThreadState;
+
 }
 
 } // namespace
@@ -132,6 +168,13 @@ SearchService::RunSocketMode()
                             boost::asio::post(*m_threadPool, std::bind(&SearchService::SearchHanlder, this, p_srcID, std::move(p_packet)));
                         });
 
+    auto updateHandler = [this](Socket::ConnectionID p_srcID, Socket::Packet p_packet)
+                         {
+                             boost::asio::post(*m_threadPool, std::bind(&SearchService::UpdateHandler, this, p_srcID, std::move(p_packet)));
+                         };
+    handlerMap->emplace(Socket::PacketType::AddRequest, updateHandler);
+    handlerMap->emplace(Socket::PacketType::DeleteRequest, updateHandler);
+
     m_socketServer.reset(new Socket::Server(m_serviceContext->GetServiceSettings()->m_listenAddr,
                                             m_serviceContext->GetServiceSettings()->m_listenPort,
                                             handlerMap,
@@ -226,7 +269,7 @@ SearchService::SearchHanlder(Socket::ConnectionID p_localConnectionID, Socket::P
 
     Socket::RemoteQuery remoteQuery;
     if(remoteQuery.Read(p_packet.Body()) == nullptr) {
-        LOG(Helper::LogLevel::LL_Error, "majorVersion is not match!\n");
+        LOG(Helper::LogLevel::LL_Error, "majorVersion is not match or the query is malformed!\n");
         return;
     }
 
@@ -235,7 +278,8 @@ SearchService::SearchHanlder(Socket::ConnectionID p_localConnectionID, Socket::P
                               std::placeholders::_1,
                               std::move(p_packet));
 
-    SearchExecutor executor(std::move(remoteQuery.m_queryString),
+    // the vectors of a binary query stay in the packet, which the callback keeps alive
+    SearchExecutor executor(std::move(remoteQuery),
                             m_serviceContext,
                             callback);
     executor.Execute();
@@ -272,3 +316,184 @@ SearchService::SearchHanlderCallback(std::shared_ptr<SearchExecutionContext> p_e
 
     m_socketServer->SendPacket(p_srcPacket.Header().m_connectionID, std::move(ret), nullptr);
 }
+
+
+void
+SearchService::UpdateHandler(Socket::ConnectionID p_localConnectionID, Socket::Packet p_packet)
+{
+    if (Socket::c_invalidConnectionID == p_packet.Header().m_connectionID)
+    {
+        p_packet.Header().m_connectionID = p_localConnectionID;
+    }
+
+    Socket::PacketProcessStatus status = Socket::PacketProcessStatus::Failed;
+    Socket::RemoteUpdateRequest request;
+    Socket::RemoteUpdateResult result;
+    if (p_packet.Header().m_bodyLength == 0 || request.Read(p_packet.Body()) == nullptr)
+    {
+        LOG(Helper::LogLevel::LL_Error, "Failed to read update request!\n");
+    }
+    else
+    {
+        status = ExecuteUpdate(p_packet.Header().m_packetType, request, result);
+    }
+
+    Socket::Packet ret;
+    ret.Header().m_packetType = Socket::PacketTypeHelper::GetCrosspondingResponseType(p_packet.Header().m_packetType);
+    ret.Header().m_processStatus = status;
+    ret.Header().m_connectionID = p_packet.Header().m_connectionID;
+    ret.Header().m_resourceID = p_packet.Header().m_resourceID;
+    if (result.m_vectorStatus.empty())
+    {
+        ret.Header().m_bodyLength = 0;
+        ret.AllocateBuffer(0);
+    }
+    else
+    {
+        ret.AllocateBuffer(static_cast<std::uint32_t>(result.EstimateBufferSize()));
+        ret.Header().m_bodyLength = static_cast<std::uint32_t>(result.Write(ret.Body()) - ret.Body());
+    }
+    ret.Header().WriteBuffer(ret.HeaderBuffer());
+
+    m_socketServer->SendPacket(p_packet.Header().m_connectionID, std::move(ret), nullptr);
+}
+
+
+Socket::PacketProcessStatus
+SearchService::ExecuteUpdate(Socket::PacketType p_type,
+                             const Socket::RemoteUpdateRequest& p_request,
+                             Socket::RemoteUpdateResult& p_result)
+{
+    const auto& indexMap = m_serviceContext->GetIndexMap();
+    std::shared_ptr<VectorIndex> index;
+    if (p_request.m_indexName.empty())
+    {
+        if (indexMap.size() == 1)
+        {
+            index = indexMap.begin()->second;
+        }
+    }
+    else
+    {
+        auto iter = indexMap.find(p_request.m_indexName);
+        if (iter != indexMap.end())
+        {
+            index = iter->second;
+        }
+    }
+
+    if (nullptr == index)
+    {
+        LOG(Helper::LogLevel::LL_Error, "Cannot find index %s for update!\n", p_request.m_indexName.c_str());
+        return Socket::PacketProcessStatus::Failed;
+    }
+
+    if (!Local::t_updateThreadState.Enter(index))
+    {
+        LOG(Helper::LogLevel::LL_Error, "Failed to initialize index %s for update!\n", p_request.m_indexName.c_str());
+        return Socket::PacketProcessStatus::Failed;
+    }
+
+    // refuse new work while the background splits and reassigns are behind, the client retries later
+    std::size_t backlogLimit = m_serviceContext->GetServiceSettings()->m_updateBacklogLimit;
+    if (backlogLimit > 0 && index->GetUpdateBacklog() > backlogLimit)
+    {
+        return Socket::PacketProcessStatus::Dropped;
+    }
+
+    if (p_request.m_vectors.Length() > 0
+        && (p_request.m_valueType != index->GetVectorValueType() || p_request.m_dimension != index->GetFeatureDim()))
+    {
+        LOG(Helper::LogLevel::LL_Error, "Failed to match vector type or dimension for update!\n");
+        return Socket::PacketProcessStatus::Failed;
+    }
+
+    SizeType vectorNum = static_cast<SizeType>(p_request.m_vectorNum);
+    ErrorCode ret = ErrorCode::Fail;
+    if (Socket::PacketType::AddRequest == p_type)
+    {
+        if (p_request.m_vectors.Length() == 0)
+        {
+            return Socket::PacketProcessStatus::Failed;
+        }
+
+        std::shared_ptr<MetadataSet> metadataSet;
+        if (!p_request.m_metadata.empty())
+        {
+            std::uint64_t totalLength = 0;
+            ByteArray offsets = ByteArray::Alloc(sizeof(std::uint64_t) * (p_request.m_metadata.size() + 1));
+            std::uint64_t* offset = reinterpret_cast<std::uint64_t*>(offsets.Data());
+            for (std::size_t i = 0; i < p_request.m_metadata.size(); ++i)
+            {
+                offset[i] = totalLength;
+                totalLength += p_request.m_metadata[i].Length();
+            }
+            offset[p_request.m_metadata.size()] = totalLength;
+
+            ByteArray metadata = ByteArray::Alloc(totalLength);
+            for (std::size_t i = 0; i < p_request.m_metadata.size(); ++i)
+            {
+                memcpy(metadata.Data() + offset[i], p_request.m_metadata[i].Data(), p_request.m_metadata[i].Length());
+            }
+            metadataSet.reset(new MemMetadataSet(metadata, offsets, vectorNum));
+        }
+
+        ret = index->AddIndex(p_request.m_vectors.Data(), vectorNum, p_request.m_dimension, metadataSet, index->HasMetaMapping());
+    }
+    else if (p_request.m_vectors.Length() > 0)
+    {
+        // an aggregator sends the batch to every shard, each reports which of the vectors it held
+        return DeleteVectors(index.get(), p_request, p_result);
+    }
+    else
+    {
+        ret = ErrorCode::Success;
+        for (const auto& meta : p_request.m_metadata)
+        {
+            ErrorCode deleteRet = index->DeleteIndex(meta);
+            if (ErrorCode::Success != deleteRet && ErrorCode::VectorNotFound != deleteRet)
+            {
+                ret = deleteRet;
+            }
+        }
+    }
+
+    if (ErrorCode::Success != ret)
+    {
+        LOG(Helper::LogLevel::LL_Error, "Failed to execute update, error code %d!\n", static_cast<int>(ret));
+        return Socket::PacketProcessStatus::Failed;
+    }
+
+    return Socket::PacketProcessStatus::Ok;
+}
+
+
+Socket::PacketProcessStatus
+SearchService::DeleteVectors(VectorIndex* p_index,
+                             const Socket::RemoteUpdateRequest& p_request,
+                             Socket::RemoteUpdateResult& p_result)
+{
+    std::size_t vectorSize = GetValueTypeSize(p_request.m_valueType) * p_request.m_dimension;
+    if (p_request.m_vectors.Length() < vectorSize * p_request.m_vectorNum)
+    {
+        LOG(Helper::LogLevel::LL_Error, "Delete request holds fewer than %u vectors!\n", p_request.m_vectorNum);
+        return Socket::PacketProcessStatus::Failed;
+    }
+
+    Socket::PacketProcessStatus status = Socket::PacketProcessStatus::Ok;
+    p_result.m_vectorStatus.assign(p_request.m_vectorNum, Socket::PacketProcessStatus::Ok);
+    for (std::uint32_t i = 0; i < p_request.m_vectorNum; ++i)
+    {
+        if (ErrorCode::Success != p_index->DeleteIndex(p_request.m_vectors.Data() + vectorSize * i, 1))
+        {
+            p_result.m_vectorStatus[i] = Socket::PacketProcessStatus::Failed;
+            status = Socket::PacketProcessStatus::Failed;
+        }
+    }
+
+    if (Socket::PacketProcessStatus::Ok == status)
+    {
+        p_result.m_vectorStatus.clear();
+    }
+    return status;
+}
@@ -9,7 +9,12 @@ using namespace SPTAG::Socket;
 
 
 RemoteQuery::RemoteQuery()
-    : m_type(QueryType::String)
+    : m_type(QueryType::String),
+      m_valueType(VectorValueType::Undefined),
+      m_dimension(0),
+      m_queryNum(0),
+      m_resultNum(0),
+      m_extractMetadata(false)
 {
 }
 
@@ -23,6 +28,24 @@ RemoteQuery::EstimateBufferSize() const
     sum += SimpleSerialization::EstimateBufferSize(m_type);
     sum += SimpleSerialization::EstimateBufferSize(m_queryString);
 
+    if (QueryType::Binary == m_type)
+    {
+        sum += SimpleSerialization::EstimateBufferSize(m_valueType);
+        sum += SimpleSerialization::EstimateBufferSize(m_dimension);
+        sum += SimpleSerialization::EstimateBufferSize(m_queryNum);
+        sum += SimpleSerialization::EstimateBufferSize(m_resultNum);
+        sum += SimpleSerialization::EstimateBufferSize(m_extractMetadata);
+
+        sum += sizeof(std::uint32_t);
+        for (const auto& param : m_params)
+        {
+            sum += SimpleSerialization::EstimateBufferSize(param.first);
+            sum += SimpleSerialization::EstimateBufferSize(param.second);
+        }
+
+        sum += SimpleSerialization::EstimateBufferSize(m_vectors);
+    }
+
     return sum;
 }
 
@@ -36,6 +59,24 @@ RemoteQuery::Write(std::uint8_t* p_buffer) const
     p_buffer = SimpleSerialization::SimpleWriteBuffer(m_type, p_buffer);
     p_buffer = SimpleSerialization::SimpleWriteBuffer(m_queryString, p_buffer);
 
+    if (QueryType::Binary == m_type)
+    {
+        p_buffer = SimpleSerialization::SimpleWriteBuffer(m_valueType, p_buffer);
+        p_buffer = SimpleSerialization::SimpleWriteBuffer(m_dimension, p_buffer);
+        p_buffer = SimpleSerialization::SimpleWriteBuffer(m_queryNum, p_buffer);
+        p_buffer = SimpleSerialization::SimpleWriteBuffer(m_resultNum, p_buffer);
+        p_buffer = SimpleSerialization::SimpleWriteBuffer(m_extractMetadata, p_buffer);
+
+        p_buffer = SimpleSerialization::SimpleWriteBuffer(static_cast<std::uint32_t>(m_params.size()), p_buffer);
+        for (const auto& param : m_params)
+        {
+            p_buffer = SimpleSerialization::SimpleWriteBuffer(param.first, p_buffer);
+            p_buffer = SimpleSerialization::SimpleWriteBuffer(param.second, p_buffer);
+        }
+
+        p_buffer = SimpleSerialization::SimpleWriteBuffer(m_vectors, p_buffer);
+    }
+
     return p_buffer;
 }
 
@@ -56,6 +97,194 @@ RemoteQuery::Read(const std::uint8_t* p_buffer)
     p_buffer = SimpleSerialization::SimpleReadBuffer(p_buffer, m_type);
     p_buffer = SimpleSerialization::SimpleReadBuffer(p_buffer, m_queryString);
 
+    if (QueryType::Binary == m_type)
+    {
+        p_buffer = SimpleSerialization::SimpleReadBuffer(p_buffer, m_valueType);
+        p_buffer = SimpleSerialization::SimpleReadBuffer(p_buffer, m_dimension);
+        p_buffer = SimpleSerialization::SimpleReadBuffer(p_buffer, m_queryNum);
+        p_buffer = SimpleSerialization::SimpleReadBuffer(p_buffer, m_resultNum);
+        p_buffer = SimpleSerialization::SimpleReadBuffer(p_buffer, m_extractMetadata);
+
+        std::uint32_t paramNum = 0;
+        p_buffer = SimpleSerialization::SimpleReadBuffer(p_buffer, paramNum);
+        m_params.resize(paramNum);
+        for (auto& param : m_params)
+        {
+            p_buffer = SimpleSerialization::SimpleReadBuffer(p_buffer, param.first);
+            p_buffer = SimpleSerialization::SimpleReadBuffer(p_buffer, param.second);
+        }
+
+        // the vectors are left in the packet body instead of being copied out
+        std::uint32_t len = 0;
+        p_buffer = SimpleSerialization::SimpleReadBuffer(p_buffer, len);
+        m_vectors = ByteArray(const_cast<std::uint8_t*>(p_buffer), len, false);
+        p_buffer += len;
+
+        std::size_t valueSize = GetValueTypeSize(m_valueType);
+        if (0 == valueSize || static_cast<std::size_t>(len) != valueSize * m_dimension * m_queryNum)
+        {
+            return nullptr;
+        }
+    }
+
+    return p_buffer;
+}
+
+
+RemoteUpdateRequest::RemoteUpdateRequest()
+    : m_valueType(VectorValueType::Undefined),
+      m_dimension(0),
+      m_vectorNum(0)
+{
+}
+
+
+std::size_t
+RemoteUpdateRequest::EstimateBufferSize() const
+{
+    std::size_t sum = 0;
+    sum += SimpleSerialization::EstimateBufferSize(MajorVersion());
+    sum += SimpleSerialization::EstimateBufferSize(MirrorVersion());
+
+    sum += SimpleSerialization::EstimateBufferSize(m_indexName);
+    sum += SimpleSerialization::EstimateBufferSize(m_valueType);
+    sum += SimpleSerialization::EstimateBufferSize(m_dimension);
+    sum += SimpleSerialization::EstimateBufferSize(m_vectorNum);
+    sum += SimpleSerialization::EstimateBufferSize(m_vectors);
+
+    sum += sizeof(std::uint32_t);
+    for (const auto& meta : m_metadata)
+    {
+        sum += SimpleSerialization::EstimateBufferSize(meta);
+    }
+
+    return sum;
+}
+
+
+std::uint8_t*
+RemoteUpdateRequest::Write(std::uint8_t* p_buffer) const
+{
+    p_buffer = SimpleSerialization::SimpleWriteBuffer(MajorVersion(), p_buffer);
+    p_buffer = SimpleSerialization::SimpleWriteBuffer(MirrorVersion(), p_buffer);
+
+    p_buffer = SimpleSerialization::SimpleWriteBuffer(m_indexName, p_buffer);
+    p_buffer = SimpleSerialization::SimpleWriteBuffer(m_valueType, p_buffer);
+    p_buffer = SimpleSerialization::SimpleWriteBuffer(m_dimension, p_buffer);
+    p_buffer = SimpleSerialization::SimpleWriteBuffer(m_vectorNum, p_buffer);
+    p_buffer = SimpleSerialization::SimpleWriteBuffer(m_vectors, p_buffer);
+
+    p_buffer = SimpleSerialization::SimpleWriteBuffer(static_cast<std::uint32_t>(m_metadata.size()), p_buffer);
+    for (const auto& meta : m_metadata)
+    {
+        p_buffer = SimpleSerialization::SimpleWriteBuffer(meta, p_buffer);
+    }
+
+    return p_buffer;
+}
+
+
+const std::uint8_t*
+RemoteUpdateRequest::Read(const std::uint8_t* p_buffer)
+{
+    decltype(MajorVersion()) majorVer = 0;
+    decltype(MirrorVersion()) mirrorVer = 0;
+
+    p_buffer = SimpleSerialization::SimpleReadBuffer(p_buffer, majorVer);
+    p_buffer = SimpleSerialization::SimpleReadBuffer(p_buffer, mirrorVer);
+    if (majorVer != MajorVersion())
+    {
+        return nullptr;
+    }
+
+    p_buffer = SimpleSerialization::SimpleReadBuffer(p_buffer, m_indexName);
+    p_buffer = SimpleSerialization::SimpleReadBuffer(p_buffer, m_valueType);
+    p_buffer = SimpleSerialization::SimpleReadBuffer(p_buffer, m_dimension);
+    p_buffer = SimpleSerialization::SimpleReadBuffer(p_buffer, m_vectorNum);
+
+    std::uint32_t len = 0;
+    p_buffer = SimpleSerialization::SimpleReadBuffer(p_buffer, len);
+    m_vectors = (len > 0) ? ByteArray(const_cast<std::uint8_t*>(p_buffer), len, false) : ByteArray::c_empty;
+    p_buffer += len;
+
+    std::uint32_t metaNum = 0;
+    p_buffer = SimpleSerialization::SimpleReadBuffer(p_buffer, metaNum);
+    m_metadata.resize(metaNum);
+    for (auto& meta : m_metadata)
+    {
+        p_buffer = SimpleSerialization::SimpleReadBuffer(p_buffer, meta);
+    }
+
+    if (len > 0 && static_cast<std::size_t>(len) != GetValueTypeSize(m_valueType) * m_dimension * m_vectorNum)
+    {
+        return nullptr;
+    }
+
+    if (metaNum > 0 && metaNum != m_vectorNum)
+    {
+        return nullptr;
+    }
+
+    return p_buffer;
+}
+
+
+RemoteUpdateResult::RemoteUpdateResult()
+{
+}
+
+
+std::size_t
+RemoteUpdateResult::EstimateBufferSize() const
+{
+    std::size_t sum = 0;
+    sum += SimpleSerialization::EstimateBufferSize(MajorVersion());
+    sum += SimpleSerialization::EstimateBufferSize(MirrorVersion());
+
+    sum += sizeof(std::uint32_t);
+    sum += sizeof(PacketProcessStatus) * m_vectorStatus.size();
+
+    return sum;
+}
+
+
+std::uint8_t*
+RemoteUpdateResult::Write(std::uint8_t* p_buffer) const
+{
+    p_buffer = SimpleSerialization::SimpleWriteBuffer(MajorVersion(), p_buffer);
+    p_buffer = SimpleSerialization::SimpleWriteBuffer(MirrorVersion(), p_buffer);
+
+    p_buffer = SimpleSerialization::SimpleWriteBuffer(static_cast<std::uint32_t>(m_vectorStatus.size()), p_buffer);
+    for (auto status : m_vectorStatus)
+    {
+        p_buffer = SimpleSerialization::SimpleWriteBuffer(status, p_buffer);
+    }
+
+    return p_buffer;
+}
+
+
+const std::uint8_t*
+RemoteUpdateResult::Read(const std::uint8_t* p_buffer)
+{
+    decltype(MajorVersion()) majorVer = 0;
+    decltype(MirrorVersion()) mirrorVer = 0;
+
+    p_buffer = SimpleSerialization::SimpleReadBuffer(p_buffer, majorVer);
+    p_buffer = SimpleSerialization::SimpleReadBuffer(p_buffer, mirrorVer);
+    if (majorVer != MajorVersion())
+    {
+        return nullptr;
+    }
+
+    std::uint32_t num = 0;
+    p_buffer = SimpleSerialization::SimpleReadBuffer(p_buffer, num);
+    m_vectorStatus.resize(num);
+    for (auto& status : m_vectorStatus)
+    {
+        p_buffer = SimpleSerialization::SimpleReadBuffer(p_buffer, status);
+    }
+
     return p_buffer;
 }
 
@@ -121,6 +350,8 @@ RemoteSearchResult::EstimateBufferSize() const
         }
     }
 
+    sum += sizeof(std::uint32_t) * m_allIndexResults.size();
+
     return sum;
 }
 
@@ -155,6 +386,12 @@ RemoteSearchResult::Write(std::uint8_t* p_buffer) const
         }
     }
 
+    // appended after all the results so that readers of version 1.0 can skip them
+    for (const auto& indexRes : m_allIndexResults)
+    {
+        p_buffer = SimpleSerialization::SimpleWriteBuffer(indexRes.m_queryID, p_buffer);
+    }
+
     return p_buffer;
 }
 
@@ -206,5 +443,13 @@ RemoteSearchResult::Read(const std::uint8_t* p_buffer)
         }
     }
 
+    if (mirrorVer >= 1)
+    {
+        for (auto& indexRes : m_allIndexResults)
+        {
+            p_buffer = SimpleSerialization::SimpleReadBuffer(p_buffer, indexRes.m_queryID);
+        }
+    }
+
     return p_buffer;
 }
@@ -5,9 +5,11 @@
 #include "inc/Helper/SimpleIniReader.h"
 #include "inc/Core/VectorIndex.h"
 #include "inc/Core/Common/CommonUtils.h"
+#include "inc/Core/SPANN/Index.h"
 
 #include <unordered_set>
 #include <chrono>
+#include <fstream>
 
 template <typename T>
 void Build(SPTAG::IndexAlgoType algo, std::string distCalcMethod, std::shared_ptr<SPTAG::VectorSet>& vec, std::shared_ptr<SPTAG::MetadataSet>& meta, const std::string out)
@@ -108,6 +110,71 @@ void Search(const std::string folder, T* vec, SPTAG::SizeType n, int k, std::str
     vecIndex.reset();
 }
 
+template <typename T>
+void SearchWithProgress(const std::string folder, T* vec, SPTAG::SizeType n, int k)
+{
+    std::shared_ptr<SPTAG::VectorIndex> vecIndex;
+    BOOST_CHECK(SPTAG::ErrorCode::Success == SPTAG::VectorIndex::LoadIndex(folder, vecIndex));
+    BOOST_CHECK(nullptr != vecIndex);
+
+    for (SPTAG::SizeType i = 0; i < n; i++)
+    {
+        SPTAG::QueryResult res(vec, k, false);
+        vecIndex->SearchIndex(res);
+
+        int calls = 0;
+        SPTAG::QueryResult progressRes(vec, k, false);
+        BOOST_CHECK(SPTAG::ErrorCode::Success == vecIndex->SearchIndexWithProgress(progressRes, 1, [&](SPTAG::QueryResult& partial, float frontier) {
+            calls++;
+            BOOST_CHECK(partial.GetResultNum() == k);
+        }));
+        BOOST_CHECK(calls > 0);
+        for (int j = 0; j < k; j++)
+        {
+            BOOST_CHECK(res.GetResult(j)->VID == progressRes.GetResult(j)->VID);
+        }
+        vec += vecIndex->GetFeatureDim();
+    }
+    vecIndex.reset();
+}
+
+template <typename T>
+void CheckSearchBatch(std::shared_ptr<SPTAG::VectorIndex>& vecIndex, T* vec, SPTAG::SizeType n, int k)
+{
+    SPTAG::SPANN::Index<T>* spannIndex = dynamic_cast<SPTAG::SPANN::Index<T>*>(vecIndex.get());
+    BOOST_CHECK(nullptr != spannIndex);
+
+    std::vector<SPTAG::QueryResult> results;
+    results.reserve(n);
+    std::vector<SPTAG::QueryResult*> batch;
+    for (SPTAG::SizeType i = 0; i < n; i++)
+    {
+        results.emplace_back(vec + i * vecIndex->GetFeatureDim(), k, true);
+        batch.push_back(&results.back());
+    }
+    BOOST_CHECK(SPTAG::ErrorCode::Success == spannIndex->SearchIndexBatch(batch));
+
+    for (SPTAG::SizeType i = 0; i < n; i++)
+    {
+        SPTAG::QueryResult res(vec + i * vecIndex->GetFeatureDim(), k, true);
+        vecIndex->SearchIndex(res);
+        for (int j = 0; j < k; j++)
+        {
+            BOOST_CHECK(res.GetResult(j)->VID == results[i].GetResult(j)->VID);
+            BOOST_CHECK(res.GetResult(j)->Dist == results[i].GetResult(j)->Dist);
+        }
+    }
+}
+
+template <typename T>
+void SearchBatch(const std::string folder, T* vec, SPTAG::SizeType n, int k)
+{
+    std::shared_ptr<SPTAG::VectorIndex> vecIndex;
+    BOOST_CHECK(SPTAG::ErrorCode::Success == SPTAG::VectorIndex::LoadIndex(folder, vecIndex));
+    CheckSearchBatch<T>(vecIndex, vec, n, k);
+    vecIndex.reset();
+}
+
 template <typename T>
 void Add(const std::string folder, std::shared_ptr<SPTAG::VectorSet>& vec, std::shared_ptr<SPTAG::MetadataSet>& meta, const std::string out)
 {
@@ -200,6 +267,13 @@ void Test(SPTAG::IndexAlgoType algo, std::string distCalcMethod)
     std::string truthmeta1[] = { "0", "1", "2", "2", "1", "3", "4", "3", "5" };
     Search<T>("testindices", query.data(), q, k, truthmeta1);
 
+    if (algo != SPTAG::IndexAlgoType::SPANN) {
+        SearchWithProgress<T>("testindices", query.data(), q, k);
+    }
+    else {
+        SearchBatch<T>("testindices", query.data(), q, k);
+    }
+
     if (algo != SPTAG::IndexAlgoType::SPANN) {
         Add<T>("testindices", vecset, metaset, "testindices");
         std::string truthmeta2[] = { "0", "0", "1", "2", "2", "1", "4", "4", "3" };
@@ -225,6 +299,312 @@ void Test(SPTAG::IndexAlgoType algo, std::string distCalcMethod)
     }
 }
 
+template <typename T>
+void LineSet(SPTAG::SizeType n, SPTAG::DimensionType m, std::shared_ptr<SPTAG::VectorSet>& vecset, std::shared_ptr<SPTAG::MetadataSet>& metaset)
+{
+    SPTAG::ByteArray vec = SPTAG::ByteArray::Alloc(sizeof(T) * n * m);
+    for (SPTAG::SizeType i = 0; i < n; i++) {
+        for (SPTAG::DimensionType j = 0; j < m; j++) {
+            ((T*)vec.Data())[i * m + j] = (T)i;
+        }
+    }
+    vecset.reset(new SPTAG::BasicVectorSet(vec, SPTAG::GetEnumValueType<T>(), m, n));
+
+    std::string meta;
+    SPTAG::ByteArray metaoffset = SPTAG::ByteArray::Alloc(sizeof(std::uint64_t) * (n + 1));
+    for (SPTAG::SizeType i = 0; i < n; i++) {
+        ((std::uint64_t*)metaoffset.Data())[i] = (std::uint64_t)meta.size();
+        meta += std::to_string(i);
+    }
+    ((std::uint64_t*)metaoffset.Data())[n] = (std::uint64_t)meta.size();
+    SPTAG::ByteArray metaarr = SPTAG::ByteArray::Alloc(meta.size());
+    memcpy(metaarr.Data(), meta.data(), meta.size());
+    metaset.reset(new SPTAG::MemMetadataSet(metaarr, metaoffset, n));
+}
+
+// SPANN index with its postings on SPDK and background updates, kept in memory instead of being saved
+template <typename T>
+std::shared_ptr<SPTAG::VectorIndex> BuildDynamic(std::string distCalcMethod, std::shared_ptr<SPTAG::VectorSet>& vec, std::shared_ptr<SPTAG::MetadataSet>& meta, const std::string out,
+    const std::vector<std::pair<std::string, std::string>>& ssdParams)
+{
+    std::shared_ptr<SPTAG::VectorIndex> vecIndex = SPTAG::VectorIndex::CreateInstance(SPTAG::IndexAlgoType::SPANN, SPTAG::GetEnumValueType<T>());
+    BOOST_CHECK(nullptr != vecIndex);
+
+    vecIndex->SetParameter("IndexAlgoType", "BKT", "Base");
+    vecIndex->SetParameter("DistCalcMethod", distCalcMethod, "Base");
+    vecIndex->SetParameter("IndexDirectory", out, "Base");
+
+    vecIndex->SetParameter("isExecute", "true", "SelectHead");
+    vecIndex->SetParameter("NumberOfThreads", "4", "SelectHead");
+    vecIndex->SetParameter("Ratio", "0.2", "SelectHead");
+
+    vecIndex->SetParameter("isExecute", "true", "BuildHead");
+    vecIndex->SetParameter("RefineIterations", "3", "BuildHead");
+    vecIndex->SetParameter("NumberOfThreads", "4", "BuildHead");
+
+    std::string mappingPath = out + "_spdkmapping";
+    std::remove(mappingPath.c_str());
+    vecIndex->SetParameter("isExecute", "true", "BuildSSDIndex");
+    vecIndex->SetParameter("BuildSsdIndex", "true", "BuildSSDIndex");
+    vecIndex->SetParameter("NumberOfThreads", "4", "BuildSSDIndex");
+    vecIndex->SetParameter("PostingPageLimit", "12", "BuildSSDIndex");
+    vecIndex->SetParameter("SearchPostingPageLimit", "12", "BuildSSDIndex");
+    vecIndex->SetParameter("InternalResultNum", "64", "BuildSSDIndex");
+    vecIndex->SetParameter("SearchInternalResultNum", "64", "BuildSSDIndex");
+    vecIndex->SetParameter("ExcludeHead", "false", "BuildSSDIndex");
+    vecIndex->SetParameter("UseSPDK", "true", "BuildSSDIndex");
+    vecIndex->SetParameter("SpdkMappingPath", mappingPath, "BuildSSDIndex");
+    vecIndex->SetParameter("Update", "true", "BuildSSDIndex");
+    vecIndex->SetParameter("AppendThreadNum", "2", "BuildSSDIndex");
+    vecIndex->SetParameter("ReassignThreadNum", "2", "BuildSSDIndex");
+    for (auto& param : ssdParams) vecIndex->SetParameter(param.first, param.second, "BuildSSDIndex");
+
+    BOOST_CHECK(SPTAG::ErrorCode::Success == vecIndex->BuildIndex(vec, meta));
+    return vecIndex;
+}
+
+// Deletes nine in ten vectors so the searches queue merges of the thinned postings, which then run
+// concurrently on AppendThreadNum background threads. Reassign is off so only the merges move vectors:
+// heads must go away and every kept vector stays found.
+template <typename T>
+void DynamicMerge(int appendThreadNum)
+{
+    SPTAG::SizeType n = 2000;
+    std::shared_ptr<SPTAG::VectorSet> vecset;
+    std::shared_ptr<SPTAG::MetadataSet> metaset;
+    LineSet<T>(n, 10, vecset, metaset);
+
+    auto vecIndex = BuildDynamic<T>("L2", vecset, metaset, "testdynamicindices", { {"AppendThreadNum", std::to_string(appendThreadNum)}, {"MergeThreshold", "10"}, {"DisableReassign", "true"} });
+    SPTAG::SPANN::Index<T>* spannIndex = dynamic_cast<SPTAG::SPANN::Index<T>*>(vecIndex.get());
+    BOOST_CHECK(nullptr != spannIndex);
+    spannIndex->Initialize();
+
+    for (SPTAG::SizeType i = 0; i < n; i++) {
+        if (i % 10 != 0) BOOST_CHECK(SPTAG::ErrorCode::Success == vecIndex->DeleteIndex(i));
+    }
+    SPTAG::SizeType deletedHeads = spannIndex->GetMemoryIndex()->GetNumDeleted();
+    for (SPTAG::SizeType i = 0; i < n; i += 10) {
+        SPTAG::QueryResult res(vecset->GetVector(i), 1, false);
+        vecIndex->SearchIndex(res);
+    }
+    while (!spannIndex->AllFinished()) Sleep(10);
+    BOOST_CHECK(spannIndex->GetMemoryIndex()->GetNumDeleted() > deletedHeads);
+
+    for (SPTAG::SizeType i = 0; i < n; i += 10) {
+        SPTAG::QueryResult res(vecset->GetVector(i), 1, false);
+        vecIndex->SearchIndex(res);
+        BOOST_CHECK(res.GetResult(0)->VID == i);
+        BOOST_CHECK(res.GetResult(0)->Dist == 0);
+    }
+    spannIndex->ExitBlockController();
+}
+
+// The batched search of a dynamic index has to answer like one query at a time, also after deletes
+// and inserts went through the background updates. The queries sit between two vectors to avoid ties.
+template <typename T>
+void DynamicSearchBatch()
+{
+    SPTAG::SizeType n = 2000, q = 200;
+    SPTAG::DimensionType m = 10;
+    std::shared_ptr<SPTAG::VectorSet> vecset;
+    std::shared_ptr<SPTAG::MetadataSet> metaset;
+    LineSet<T>(n, m, vecset, metaset);
+
+    // without metadata, which has no room for the inserted vectors, and without merges, which the searches
+    // would start between the two passes
+    metaset.reset();
+    auto vecIndex = BuildDynamic<T>("L2", vecset, metaset, "testdynamicindices", { {"MergeThreshold", "0"} });
+    SPTAG::SPANN::Index<T>* spannIndex = dynamic_cast<SPTAG::SPANN::Index<T>*>(vecIndex.get());
+    BOOST_CHECK(nullptr != spannIndex);
+    spannIndex->Initialize();
+
+    for (SPTAG::SizeType i = 0; i < n; i += 7) BOOST_CHECK(SPTAG::ErrorCode::Success == vecIndex->DeleteIndex(i));
+
+    std::vector<T> added(q * m);
+    for (SPTAG::SizeType i = 0; i < q; i++) {
+        for (SPTAG::DimensionType j = 0; j < m; j++) added[i * m + j] = (T)(n + i);
+    }
+    BOOST_CHECK(SPTAG::ErrorCode::Success == vecIndex->AddIndex(added.data(), q, m, nullptr));
+    while (!spannIndex->AllFinished()) Sleep(10);
+
+    std::vector<T> query(q * m);
+    for (SPTAG::SizeType i = 0; i < q; i++) {
+        for (SPTAG::DimensionType j = 0; j < m; j++) query[i * m + j] = (T)(i * (n + q) / q + 0.3);
+    }
+    CheckSearchBatch<T>(vecIndex, query.data(), q, 5);
+    spannIndex->ExitBlockController();
+}
+
+// Postings with PostingAlignment keep their vectors in aligned segments behind the IDs. Built postings,
+// appends that split them and deletes all have to go through the segments: every current vector finds
+// itself, deleted ones are gone. Reassign is off so only the splits move vectors, 0 is the unaligned layout.
+template <typename T>
+void DynamicAligned(int alignment)
+{
+    SPTAG::SizeType n = 2000, added = 1000;
+    SPTAG::DimensionType m = 100;
+    // grid points, the first half of the dimensions hold the row and the second half the column. The
+    // inserted ones are a dense patch beyond the built rows, so the few postings next to it fill up and split.
+    SPTAG::ByteArray vec = SPTAG::ByteArray::Alloc(sizeof(T) * (n + added) * m);
+    for (SPTAG::SizeType i = 0; i < n + added; i++) {
+        int row = (i < n) ? i / 30 * 2 - 100 : 40 + (i - n) / 40;
+        int col = (i < n) ? i % 30 * 6 - 90 : 60 + (i - n) % 40;
+        for (SPTAG::DimensionType j = 0; j < m; j++) ((T*)vec.Data())[i * m + j] = (T)((j < m / 2) ? row : col);
+    }
+    std::shared_ptr<SPTAG::VectorSet> vecset(new SPTAG::BasicVectorSet(vec, SPTAG::GetEnumValueType<T>(), m, n + added));
+    std::shared_ptr<SPTAG::VectorSet> baseset(new SPTAG::BasicVectorSet(SPTAG::ByteArray(vec.Data(), sizeof(T) * n * m, false), SPTAG::GetEnumValueType<T>(), m, n));
+    std::shared_ptr<SPTAG::MetadataSet> metaset;
+
+    auto vecIndex = BuildDynamic<T>("L2", baseset, metaset, "testdynamicindices", { {"PostingAlignment", std::to_string(alignment)}, {"BufferLength", "3"}, {"DisableReassign", "true"} });
+    SPTAG::SPANN::Index<T>* spannIndex = dynamic_cast<SPTAG::SPANN::Index<T>*>(vecIndex.get());
+    BOOST_CHECK(nullptr != spannIndex);
+    spannIndex->Initialize();
+
+    // the splits run in the background, small batches keep a posting within the BufferLength spare pages meanwhile
+    SPTAG::SizeType heads = spannIndex->GetMemoryIndex()->GetNumSamples();
+    for (SPTAG::SizeType i = n; i < n + added; i += 50) {
+        BOOST_CHECK(SPTAG::ErrorCode::Success == vecIndex->AddIndex(vecset->GetVector(i), 50, m, nullptr));
+        while (!spannIndex->AllFinished()) Sleep(10);
+    }
+    for (SPTAG::SizeType i = 0; i < n; i += 5) BOOST_CHECK(SPTAG::ErrorCode::Success == vecIndex->DeleteIndex(i));
+    while (!spannIndex->AllFinished()) Sleep(10);
+    BOOST_CHECK(spannIndex->GetMemoryIndex()->GetNumSamples() > heads);
+
+    for (SPTAG::SizeType i = 0; i < n + added; i++) {
+        SPTAG::QueryResult res(vecset->GetVector(i), 1, false);
+        vecIndex->SearchIndex(res);
+        if (i < n && i % 5 == 0) {
+            BOOST_CHECK(res.GetResult(0)->VID != i);
+        }
+        else {
+            BOOST_CHECK(res.GetResult(0)->VID == i);
+            BOOST_CHECK(res.GetResult(0)->Dist == 0);
+        }
+    }
+    spannIndex->ExitBlockController();
+}
+
+// Bumping the versions of most vectors in the largest posting leaves their stored entries as stale replicas,
+// as a reassign elsewhere would. A search scanning it finds more than GCGarbageRatio garbage and queues the GC
+// job, which rewrites the posting with the current entries only.
+template <typename T>
+void DynamicGC()
+{
+    SPTAG::SizeType n = 2000;
+    SPTAG::DimensionType m = 10;
+    std::shared_ptr<SPTAG::VectorSet> vecset;
+    std::shared_ptr<SPTAG::MetadataSet> metaset;
+    LineSet<T>(n, m, vecset, metaset);
+
+    auto vecIndex = BuildDynamic<T>("L2", vecset, metaset, "testdynamicindices", { {"GCGarbageRatio", "0.3"}, {"MergeThreshold", "0"}, {"DisableReassign", "true"} });
+    SPTAG::SPANN::Index<T>* spannIndex = dynamic_cast<SPTAG::SPANN::Index<T>*>(vecIndex.get());
+    BOOST_CHECK(nullptr != spannIndex);
+    spannIndex->Initialize();
+
+    std::size_t entrySize = sizeof(int) + sizeof(std::uint8_t) + sizeof(T) * m;
+    SPTAG::SizeType headID = 0;
+    std::string posting;
+    for (SPTAG::SizeType i = 0; i < spannIndex->GetMemoryIndex()->GetNumSamples(); i++) {
+        std::string candidate;
+        spannIndex->GetDiskIndex()->GetWritePosting(i, candidate);
+        if (candidate.size() > posting.size()) { headID = i; posting.swap(candidate); }
+    }
+    int before = (int)(posting.size() / entrySize);
+    BOOST_CHECK(before >= 10);
+
+    auto& versionMap = spannIndex->GetVersionMap();
+    std::uint8_t version;
+    int stale = 0;
+    for (int i = 0; i < before; i++) {
+        if (i % 3 == 0) continue;
+        BOOST_CHECK(versionMap.IncVersion(*(int*)&posting[i * entrySize], &version));
+        stale++;
+    }
+
+    SPTAG::QueryResult res(spannIndex->GetMemoryIndex()->GetSample(headID), 1, false);
+    vecIndex->SearchIndex(res);
+    while (!spannIndex->AllFinished()) Sleep(10);
+
+    posting.clear();
+    spannIndex->GetDiskIndex()->GetWritePosting(headID, posting);
+    BOOST_CHECK((int)(posting.size() / entrySize) == before - stale);
+    for (std::size_t offset = 0; offset < posting.size(); offset += entrySize) {
+        BOOST_CHECK(versionMap.GetVersion(*(int*)&posting[offset]) == *(std::uint8_t*)&posting[offset + sizeof(int)]);
+    }
+    spannIndex->ExitBlockController();
+}
+
+// Deletes and inserts after the snapshot taken at build time reach the next run only through the write-ahead
+// log: the snapshot files are put back after the index goes away, as a crash would leave them. The reopened
+// index replays the log instead of copying the static postings again, so the version map, the posting sizes
+// and the inserted vectors all come back.
+template <typename T>
+void DynamicRecover()
+{
+    SPTAG::SizeType n = 2000, added = 20;
+    SPTAG::DimensionType m = 10;
+    std::shared_ptr<SPTAG::VectorSet> vecset;
+    std::shared_ptr<SPTAG::MetadataSet> metaset;
+    LineSet<T>(n, m, vecset, metaset);
+    SPTAG::ByteArray addvec = SPTAG::ByteArray::Alloc(sizeof(T) * added * m);
+    for (SPTAG::SizeType i = 0; i < added; i++) {
+        for (SPTAG::DimensionType j = 0; j < m; j++) ((T*)addvec.Data())[i * m + j] = (T)(i * 97 % n + 0.5);
+    }
+
+    std::string out = "testdynamicrecover";
+    std::vector<std::string> snapshots = { out + "_spdkmapping", out + "_ssdinfo", "DeletedIDs.bin" };
+    auto vecIndex = BuildDynamic<T>("L2", vecset, metaset, out, { {"EnableWAL", "true"}, {"SsdInfoFile", snapshots[1]}, {"MergeThreshold", "0"}, {"DisableReassign", "true"} });
+    SPTAG::SPANN::Index<T>* spannIndex = dynamic_cast<SPTAG::SPANN::Index<T>*>(vecIndex.get());
+    BOOST_CHECK(nullptr != spannIndex);
+    spannIndex->Initialize();
+    BOOST_CHECK(SPTAG::ErrorCode::Success == vecIndex->SaveIndex(out));
+    for (auto& file : snapshots) {
+        std::ifstream src(file, std::ios::binary);
+        std::ofstream dst(file + ".bak", std::ios::binary);
+        BOOST_CHECK(src.good());
+        dst << src.rdbuf();
+    }
+
+    for (SPTAG::SizeType i = 0; i < n; i += 7) BOOST_CHECK(SPTAG::ErrorCode::Success == vecIndex->DeleteIndex(i));
+    BOOST_CHECK(SPTAG::ErrorCode::Success == vecIndex->AddIndex(addvec.Data(), added, m, nullptr));
+    while (!spannIndex->AllFinished()) Sleep(10);
+
+    std::vector<std::uint8_t> versions(n + added);
+    for (SPTAG::SizeType i = 0; i < n + added; i++) versions[i] = spannIndex->GetVersionMap().GetVersion(i);
+    SPTAG::SizeType heads = spannIndex->GetMemoryIndex()->GetNumSamples();
+    std::vector<int> sizes(heads);
+    for (SPTAG::SizeType i = 0; i < heads; i++) sizes[i] = spannIndex->GetDiskIndex()->GetPostingSize(i);
+    spannIndex->ExitBlockController();
+    vecIndex.reset();
+
+    for (auto& file : snapshots) {
+        std::ifstream src(file + ".bak", std::ios::binary);
+        std::ofstream dst(file, std::ios::binary | std::ios::trunc);
+        dst << src.rdbuf();
+    }
+    BOOST_CHECK(SPTAG::ErrorCode::Success == SPTAG::VectorIndex::LoadIndex(out, vecIndex));
+    spannIndex = dynamic_cast<SPTAG::SPANN::Index<T>*>(vecIndex.get());
+    BOOST_REQUIRE(nullptr != spannIndex);
+    BOOST_CHECK(spannIndex->GetDiskIndex()->Recovered());
+    spannIndex->Initialize();
+
+    for (SPTAG::SizeType i = 0; i < n + added; i++) BOOST_CHECK(spannIndex->GetVersionMap().GetVersion(i) == versions[i]);
+    BOOST_CHECK(spannIndex->GetMemoryIndex()->GetNumSamples() == heads);
+    for (SPTAG::SizeType i = 0; i < heads; i++) BOOST_CHECK(spannIndex->GetDiskIndex()->GetPostingSize(i) == sizes[i]);
+    for (SPTAG::SizeType i = 0; i < added; i++) {
+        SPTAG::QueryResult res((T*)addvec.Data() + i * m, 1, false);
+        vecIndex->SearchIndex(res);
+        BOOST_CHECK(res.GetResult(0)->VID == n + i);
+        BOOST_CHECK(res.GetResult(0)->Dist == 0);
+    }
+    for (SPTAG::SizeType i = 0; i < n; i += 7) {
+        SPTAG::QueryResult res(vecset->GetVector(i), 1, false);
+        vecIndex->SearchIndex(res);
+        BOOST_CHECK(res.GetResult(0)->VID != i);
+    }
+    spannIndex->ExitBlockController();
+}
+
 BOOST_AUTO_TEST_SUITE (AlgoTest)
 
 BOOST_AUTO_TEST_CASE(KDTTest)
@@ -242,4 +622,31 @@ BOOST_AUTO_TEST_CASE(SPANNTest)
     Test<float>(SPTAG::IndexAlgoType::SPANN, "L2");
 }
 
+BOOST_AUTO_TEST_CASE(SPANNDynamicMergeTest)
+{
+    for (int appendThreadNum = 1; appendThreadNum <= 4; appendThreadNum *= 2) DynamicMerge<float>(appendThreadNum);
+}
+
+BOOST_AUTO_TEST_CASE(SPANNDynamicSearchBatchTest)
+{
+    DynamicSearchBatch<float>();
+}
+
+BOOST_AUTO_TEST_CASE(SPANNDynamicAlignedTest)
+{
+    DynamicAligned<std::int8_t>(0);
+    DynamicAligned<std::int8_t>(32);
+    DynamicAligned<std::int8_t>(64);
+}
+
+BOOST_AUTO_TEST_CASE(SPANNDynamicGCTest)
+{
+    DynamicGC<float>();
+}
+
+BOOST_AUTO_TEST_CASE(SPANNDynamicRecoverTest)
+{
+    DynamicRecover<float>();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
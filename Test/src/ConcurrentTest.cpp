@@ -5,6 +5,7 @@
 #include "inc/Helper/SimpleIniReader.h"
 #include "inc/Core/VectorIndex.h"
 #include "inc/Core/Common/CommonUtils.h"
+#include "inc/Helper/PriorityThreadPool.h"
 
 #include <thread>
 #include <unordered_set>
@@ -122,6 +123,77 @@ void CTest(SPTAG::IndexAlgoType algo, std::string distCalcMethod)
     ConcurrentAddSearchSave<T>(algo, distCalcMethod, vecset, metaset, "testindices");
 }
 
+class RecordJob : public SPTAG::Helper::ThreadPool::Job
+{
+public:
+    RecordJob(std::function<void()> p_func) : m_func(std::move(p_func)) {}
+    void exec(SPTAG::IAbortOperation* p_abort) override { m_func(); }
+private:
+    std::function<void()> m_func;
+};
+
+void PriorityTest()
+{
+    // one worker held by a gate job: the queued high priority jobs run before the earlier low priority ones
+    {
+        SPTAG::Helper::PriorityThreadPool pool;
+        pool.init(1, { 1, 1 });
+        std::atomic_bool open(false);
+        std::mutex lock;
+        std::vector<int> order;
+        pool.add(new RecordJob([&]() { while (!open) std::this_thread::sleep_for(std::chrono::milliseconds(1)); }), 0);
+        while (pool.runningJobs() == 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        for (int i = 0; i < 4; i++) pool.add(new RecordJob([&]() { std::lock_guard<std::mutex> guard(lock); order.push_back(1); }), 1);
+        for (int i = 0; i < 4; i++) pool.add(new RecordJob([&]() { std::lock_guard<std::mutex> guard(lock); order.push_back(0); }), 0);
+        open = true;
+        while (!pool.allClear()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        BOOST_CHECK(order.size() == 8);
+        for (int i = 0; i < 8; i++) BOOST_CHECK(order[i] == (i < 4 ? 0 : 1));
+    }
+
+    // the capped class never runs more jobs at once than its cap
+    {
+        SPTAG::Helper::PriorityThreadPool pool;
+        pool.init(4, { 4, 2 });
+        std::atomic_int running(0), peak(0);
+        for (int i = 0; i < 32; i++) {
+            pool.add(new RecordJob([&]() {
+                int now = ++running;
+                int seen = peak;
+                while (now > seen && !peak.compare_exchange_weak(seen, now));
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                running--;
+            }), 1);
+        }
+        while (!pool.allClear()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        BOOST_CHECK(peak <= 2);
+        BOOST_CHECK(pool.averageWait(1) > 0);
+    }
+
+    // the throttle follows the p99 of the reported latencies
+    {
+        SPTAG::Helper::PriorityThreadPool pool;
+        pool.SetLatencyTarget(5);
+        for (int i = 0; i < 64; i++) pool.ReportLatency(1);
+        BOOST_CHECK(!pool.Throttled());
+        for (int i = 0; i < 64; i++) pool.ReportLatency(10);
+        BOOST_CHECK(pool.Throttled());
+
+        // without reports the throttle lapses, and the expired slow samples no longer count
+        std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+        BOOST_CHECK(!pool.Throttled());
+        for (int i = 0; i < 64; i++) pool.ReportLatency(1);
+        BOOST_CHECK(!pool.Throttled());
+
+        // reports from many search threads at once
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; t++) threads.emplace_back([&pool]() { for (int i = 0; i < 256; i++) pool.ReportLatency(10); });
+        for (auto& thread : threads) thread.join();
+        BOOST_CHECK(pool.Throttled());
+        BOOST_CHECK(pool.LatencyP99() == 10);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE(ConcurrentTest)
 
 BOOST_AUTO_TEST_CASE(BKTTest)
@@ -134,4 +206,9 @@ BOOST_AUTO_TEST_CASE(KDTTest)
     CTest<float>(SPTAG::IndexAlgoType::KDT, "L2");
 }
 
+BOOST_AUTO_TEST_CASE(PriorityThreadPoolTest)
+{
+    PriorityTest();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -7,6 +7,8 @@
 #include <vector>
 #include "inc/Test.h"
 #include "inc/Core/Common/DistanceUtils.h"
+#include "inc/Core/Common/PQFastScanQuantizer.h"
+#include "inc/Core/Common/OPQQuantizer.h"
 
 template<typename T>
 static float ComputeCosineDistance(const T *pX, const T *pY, SPTAG::DimensionType length) {
@@ -49,6 +51,139 @@ void test(int high) {
     delete[] Y;
 }
 
+template<typename T>
+void test_batch(int high, SPTAG::DistCalcMethod calc_method) {
+    SPTAG::DimensionType dimension = random<SPTAG::DimensionType>(256, 2);
+    int num = random<int>(200, 1);
+    // posting layout: [VID][version][vector] records
+    std::size_t offset = sizeof(int) + sizeof(std::uint8_t);
+    std::size_t stride = offset + sizeof(T) * dimension;
+    std::vector<char> posting(stride * num);
+    std::vector<T> X(dimension);
+    for (SPTAG::DimensionType i = 0; i < dimension; i++) X[i] = random<T>(high, -high);
+    for (int v = 0; v < num; v++) {
+        T* Y = (T*)(posting.data() + v * stride + offset);
+        for (SPTAG::DimensionType i = 0; i < dimension; i++) Y[i] = random<T>(high, -high);
+    }
+
+    auto distFunc = SPTAG::COMMON::DistanceCalcSelector<T>(calc_method);
+    auto batchFunc = SPTAG::COMMON::DistanceBatchCalcSelector<T>(calc_method);
+    std::vector<float> dists(num);
+    batchFunc(X.data(), posting.data() + offset, stride, num, dimension, dists.data());
+    for (int v = 0; v < num; v++) {
+        BOOST_CHECK_EQUAL(distFunc(X.data(), (const T*)(posting.data() + v * stride + offset), dimension), dists[v]);
+    }
+
+    // every third vector skipped, the others in runs
+    std::vector<int> slots;
+    for (int v = 0; v < num; v++) if (v % 3 != 2) slots.push_back(v);
+    std::vector<float> slotDists(slots.size());
+    SPTAG::COMMON::DistanceUtils::ComputeSlotDistances(batchFunc, X.data(), posting.data() + offset, stride, slots.data(), (int)slots.size(), dimension, slotDists.data());
+    for (std::size_t i = 0; i < slots.size(); i++) {
+        BOOST_CHECK_EQUAL(dists[slots[i]], slotDists[i]);
+    }
+}
+
+void test_fast_scan(SPTAG::DimensionType subvectors) {
+    SPTAG::DimensionType subDim = 2;
+    int num = 75;
+    std::unique_ptr<float[]> codebooks(new float[subvectors * 16 * subDim]);
+    std::unique_ptr<float[]> pqCodebooks(new float[subvectors * 16 * subDim]);
+    for (int i = 0; i < subvectors * 16 * subDim; i++) pqCodebooks[i] = codebooks[i] = random<float>(1, -1);
+    SPTAG::COMMON::PQFastScanQuantizer<float> quantizer(subvectors, subDim, false, std::move(codebooks));
+    SPTAG::COMMON::PQQuantizer<float> pq(subvectors, 16, subDim, false, std::move(pqCodebooks));
+
+    std::vector<float> vectors((std::size_t)(num + 1) * subvectors * subDim);
+    for (auto& x : vectors) x = random<float>(1, -1);
+    std::vector<std::uint8_t> codes((std::size_t)num * subvectors);
+    std::vector<const std::uint8_t*> codePtrs(num);
+    for (int v = 0; v < num; v++) {
+        quantizer.QuantizeVector(vectors.data() + (std::size_t)v * subvectors * subDim, codes.data() + (std::size_t)v * subvectors);
+        codePtrs[v] = codes.data() + (std::size_t)v * subvectors;
+    }
+
+    quantizer.SetEnableADC(true);
+    pq.SetEnableADC(true);
+    const float* query = vectors.data() + (std::size_t)num * subvectors * subDim;
+    std::vector<std::uint8_t> table(quantizer.QuantizeSize()), pqTable(pq.QuantizeSize());
+    quantizer.QuantizeVector(query, table.data());
+    pq.QuantizeVector(query, pqTable.data());
+
+    // the block kernel against the scalar one over a partial block
+    std::uint16_t sums[SPTAG::COMMON::DistanceUtils::FastScanBlock], fastSums[SPTAG::COMMON::DistanceUtils::FastScanBlock];
+    SPTAG::COMMON::DistanceUtils::ComputeFastScan(table.data() + 16, codePtrs.data(), 29, subvectors, sums);
+    SPTAG::COMMON::FastScanCalcSelector()(table.data() + 16, codePtrs.data(), 29, subvectors, fastSums);
+    for (int v = 0; v < 29; v++) BOOST_CHECK_EQUAL(sums[v], fastSums[v]);
+
+    // batched and single lookups agree, and stay within half a table step per sub-quantizer of the float table
+    float scale = ((const float*)table.data())[1];
+    std::vector<float> dists(num);
+    quantizer.L2Distances(table.data(), codePtrs.data(), num, dists.data());
+    for (int v = 0; v < num; v++) {
+        BOOST_CHECK_CLOSE_FRACTION(quantizer.L2Distance(table.data(), codePtrs[v]), dists[v], 1e-5);
+        BOOST_CHECK_SMALL(pq.L2Distance(pqTable.data(), codePtrs[v]) - dists[v], subvectors * scale / 2 + 1e-3f);
+    }
+}
+
+// exposes the blocked batch rotation and the per-vector m_VectorMatrixMultiply rotation it replaced
+class OPQReference : public SPTAG::COMMON::OPQQuantizer<float>
+{
+public:
+    OPQReference(SPTAG::DimensionType subvectors, SPTAG::SizeType ks, SPTAG::DimensionType subDim, std::unique_ptr<float[]>&& codebooks, std::unique_ptr<float[]>&& matrix)
+        : SPTAG::COMMON::OPQQuantizer<float>(subvectors, ks, subDim, false, std::move(codebooks), std::move(matrix)) {}
+
+    void Rotate(const float* vecs, std::size_t vecStride, int num, float* rotated) const
+    {
+        for (int begin = 0; begin < num; begin += RotateBatch) {
+            m_RotateVectors((const std::uint8_t*)vecs + begin * vecStride, vecStride, std::min((int)RotateBatch, num - begin), rotated + (std::size_t)begin * m_matrixDim);
+        }
+    }
+
+    void RotateReference(const float* vec, float* rotated) const { m_VectorMatrixMultiply<float>(m_OPQMatrix_T.get(), vec, rotated); }
+
+    void QuantizeRotated(const float* rotated, std::uint8_t* code) const { SPTAG::COMMON::PQQuantizer<float>::QuantizeVector(rotated, code); }
+};
+
+void test_opq_batch(SPTAG::DimensionType subvectors, SPTAG::DimensionType subDim) {
+    SPTAG::DimensionType dim = subvectors * subDim;
+    SPTAG::SizeType ks = 256;
+    int num = 75, stride = dim + 3;
+    float tolerance = 1e-4f * dim;
+    std::unique_ptr<float[]> codebooks(new float[subvectors * ks * subDim]);
+    for (int i = 0; i < subvectors * ks * subDim; i++) codebooks[i] = random<float>(1, -1);
+    std::vector<float> centroids(codebooks.get(), codebooks.get() + subvectors * ks * subDim);
+    std::unique_ptr<float[]> matrix(new float[dim * dim]);
+    for (int i = 0; i < dim * dim; i++) matrix[i] = random<float>(1, -1);
+    OPQReference quantizer(subvectors, ks, subDim, std::move(codebooks), std::move(matrix));
+
+    // strided input, a register block short of a multiple so single vectors get rotated too
+    std::vector<float> vectors((std::size_t)num * stride);
+    for (auto& x : vectors) x = random<float>(1, -1);
+    std::vector<float> rotated((std::size_t)num * dim), reference(dim);
+    quantizer.Rotate(vectors.data(), sizeof(float) * stride, num, rotated.data());
+
+    std::vector<std::uint8_t> codes((std::size_t)num * (subvectors + 1)), refCode(subvectors);
+    quantizer.QuantizeVectors(vectors.data(), sizeof(float) * stride, num, codes.data(), subvectors + 1);
+    for (int v = 0; v < num; v++) {
+        quantizer.RotateReference(vectors.data() + (std::size_t)v * stride, reference.data());
+        for (int j = 0; j < dim; j++) BOOST_CHECK_SMALL(rotated[(std::size_t)v * dim + j] - reference[j], tolerance);
+
+        // the codes may only differ where the rounding tips a near tie between two centroids
+        quantizer.QuantizeRotated(reference.data(), refCode.data());
+        for (int i = 0; i < subvectors; i++) {
+            std::uint8_t code = codes[(std::size_t)v * (subvectors + 1) + i];
+            if (code == refCode[i]) continue;
+            auto dist = [&](std::uint8_t c) {
+                const float* centroid = centroids.data() + ((std::size_t)i * ks + c) * subDim;
+                float d = 0;
+                for (int j = 0; j < subDim; j++) d += (reference[i * subDim + j] - centroid[j]) * (reference[i * subDim + j] - centroid[j]);
+                return d;
+            };
+            BOOST_CHECK_SMALL(dist(code) - dist(refCode[i]), tolerance);
+        }
+    }
+}
+
 template <typename T>
 void test_dist_calc_performance(
     int high, 
@@ -92,6 +227,31 @@ BOOST_AUTO_TEST_CASE(TestDistanceComputation)
     test<std::int16_t>(32767);
 }
 
+BOOST_AUTO_TEST_CASE(TestBatchDistanceComputation)
+{
+    for (auto calc_method : { SPTAG::DistCalcMethod::L2, SPTAG::DistCalcMethod::Cosine })
+    {
+        test_batch<float>(1, calc_method);
+        test_batch<std::int8_t>(127, calc_method);
+        test_batch<std::uint8_t>(127, calc_method);
+        test_batch<std::int16_t>(32767, calc_method);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestFastScanDistanceComputation)
+{
+    for (SPTAG::DimensionType subvectors : { 7, 16, 40 })
+    {
+        test_fast_scan(subvectors);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TestOPQBatchQuantization)
+{
+    test_opq_batch(4, 4);
+    test_opq_batch(10, 5);
+}
+
 BOOST_AUTO_TEST_CASE(TestDistanceComputationPerformance)
 {
     std::vector<SPTAG::DimensionType> dimensions{128, 256, 512, 1024};
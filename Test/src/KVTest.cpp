@@ -4,6 +4,11 @@
 #include "inc/Test.h"
 #include "inc/Core/SPANN/ExtraRocksDBController.h"
 #include "inc/Core/SPANN/ExtraSPDKController.h"
+#include "inc/Core/SPANN/PostingDeltaBuffer.h"
+#include "inc/Core/SPANN/QuantizedPostingIO.h"
+#include "inc/Core/SPANN/AlignedPostingIO.h"
+#include "inc/Core/Common/PQQuantizer.h"
+#include "inc/Core/Common/VersionLabel.h"
 
 #include <memory>
 #include <chrono>
@@ -82,6 +87,344 @@ void Test(std::string path, std::string type, bool debug = false)
     }
 }
 
+void MergeEmptyTest(std::string path, std::string type)
+{
+    std::shared_ptr<Helper::KeyValueIO> db;
+    if (type == "RocksDB") {
+        db.reset(new RocksDBIO(path.c_str(), true));
+    } else if (type == "SPDK") {
+        db.reset(new SPDKIO(path.c_str(), 1024 * 1024, MaxSize, 64));
+    }
+
+    // appending to a posting which was never put must behave like a put
+    std::string first(PageSize + 7, 'a'), second(13, 'b'), value;
+    BOOST_CHECK(db->Merge(0, first) == ErrorCode::Success);
+    BOOST_CHECK(db->Merge(0, second) == ErrorCode::Success);
+    BOOST_CHECK(db->Get(0, &value) == ErrorCode::Success);
+    BOOST_CHECK(value == first + second);
+
+    db->ShutDown();
+}
+
+void MultiPageTest(std::string path)
+{
+    std::shared_ptr<SPDKIO> db(new SPDKIO(path.c_str(), 1024 * 1024, MaxSize, 64));
+
+    // multi-page postings are laid out on contiguous blocks and read back through coalesced I/Os
+    int totalNum = 16;
+    for (int i = 0; i < totalNum; i++) {
+        std::string val((i + 1) * PageSize - i, (char)('a' + i));
+        BOOST_CHECK(db->Put(i, val) == ErrorCode::Success);
+    }
+
+    std::vector<SizeType> keys(totalNum);
+    for (int i = 0; i < totalNum; i++) keys[i] = i;
+    std::vector<std::string> values;
+    std::int64_t ios, pages, merged, iosAfter, pagesAfter, mergedAfter;
+    db->GetIOCounters(&ios, &pages, &merged);
+    BOOST_CHECK(db->MultiGet(keys, &values) == ErrorCode::Success);
+    for (int i = 0; i < totalNum; i++) {
+        BOOST_CHECK(values[i] == std::string((i + 1) * PageSize - i, (char)('a' + i)));
+    }
+    // every page beyond the first of an I/O was merged into it, and the fresh contiguous postings take fewer I/Os than pages
+    db->GetIOCounters(&iosAfter, &pagesAfter, &mergedAfter);
+    BOOST_CHECK_EQUAL(pagesAfter - pages, totalNum * (totalNum + 1) / 2);
+    BOOST_CHECK_EQUAL(mergedAfter - merged, (pagesAfter - pages) - (iosAfter - ios));
+    BOOST_CHECK(iosAfter - ios < pagesAfter - pages);
+
+    // the same postings read in place into buffers owned by the storage, the last one does not fit
+    std::size_t bufferSize = (totalNum - 1) * PageSize;
+    std::vector<std::shared_ptr<std::uint8_t>> owners;
+    std::vector<std::uint8_t*> buffers;
+    for (int i = 0; i < totalNum; i++) {
+        owners.push_back(db->AllocateBuffer(bufferSize));
+        buffers.push_back(owners.back().get());
+    }
+    std::vector<std::size_t> sizes;
+    BOOST_CHECK(db->MultiGet(keys, buffers, bufferSize, &sizes) == ErrorCode::Success);
+    for (int i = 0; i < totalNum; i++) {
+        BOOST_CHECK(sizes[i] == values[i].size());
+        if (sizes[i] <= bufferSize) BOOST_CHECK(memcmp(buffers[i], values[i].data(), sizes[i]) == 0);
+    }
+
+    // every posting is handed to the callback once, and returning false stops the remaining reads
+    std::vector<int> completed(totalNum, 0);
+    BOOST_CHECK(db->MultiGet(keys, buffers, bufferSize, &sizes, std::chrono::microseconds(1000000),
+        [&](std::size_t i) { completed[i]++; return true; }) == ErrorCode::Success);
+    for (int i = 0; i < totalNum; i++) {
+        BOOST_CHECK(completed[i] == 1);
+        if (sizes[i] <= bufferSize) BOOST_CHECK(memcmp(buffers[i], values[i].data(), sizes[i]) == 0);
+    }
+    int calls = 0;
+    db->MultiGet(keys, buffers, bufferSize, &sizes, std::chrono::microseconds(1000000),
+        [&](std::size_t i) { return ++calls < 2; });
+    BOOST_CHECK(calls == 2);
+    db->GetStat();
+    db->ShutDown();
+}
+
+double UpdateThroughput(std::shared_ptr<SPDKIO> db, int totalNum, int mergeIters)
+{
+    auto t1 = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < totalNum; i++) {
+        int len = std::to_string(i).length();
+        db->Put(i, std::string(PageSize - len, '0'));
+        for (int j = 0; j < mergeIters; j++) db->Merge(i, std::to_string(i));
+    }
+    auto t2 = std::chrono::high_resolution_clock::now();
+    return totalNum * (mergeIters + 1) / (std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count() / 1000000.0);
+}
+
+void WALTest(std::string path)
+{
+    int totalNum = 4096;
+    int mergeIters = 3;
+
+    std::shared_ptr<SPDKIO> db(new SPDKIO(path.c_str(), 1024 * 1024, MaxSize, 64));
+    std::cout << "WAL off updates/s: " << UpdateThroughput(db, totalNum, mergeIters) << std::endl;
+
+    std::shared_ptr<WriteAheadLog> wal(new WriteAheadLog());
+    BOOST_CHECK(wal->Open(path + "_wal", 1000, 1 << 20) == ErrorCode::Success);
+    wal->Truncate([]() { return ErrorCode::Success; });
+    db->SetWriteAheadLog(wal);
+    std::cout << "WAL on updates/s: " << UpdateThroughput(db, totalNum, mergeIters) << std::endl;
+    wal->Flush();
+    wal->GetStat();
+
+    // recover the mapping from the log alone, the blocks are still alive in the first instance
+    std::remove((path + "_replay").c_str());
+    std::shared_ptr<SPDKIO> recovered(new SPDKIO((path + "_replay").c_str(), 1024 * 1024, MaxSize, 64));
+    WriteAheadLog replay;
+    BOOST_CHECK(replay.Open(path + "_wal", 1000, 0) == ErrorCode::Success);
+    replay.Replay([&](WriteAheadLog::RecordType type, SizeType key, const char* payload, std::uint16_t length) {
+        recovered->ReplayRecord(type, key, payload, length);
+    });
+    replay.Close();
+
+    std::string expected, actual;
+    for (int i = 0; i < totalNum; i++) {
+        BOOST_CHECK(db->Get(i, &expected) == ErrorCode::Success);
+        BOOST_CHECK(recovered->Get(i, &actual) == ErrorCode::Success);
+        BOOST_CHECK(expected == actual);
+    }
+    recovered->ShutDown();
+    db->SetWriteAheadLog(nullptr);
+    db->ShutDown();
+    wal->Close();
+}
+
+void DeltaBufferTest(std::string path)
+{
+    std::shared_ptr<Helper::KeyValueIO> db(new SPDKIO(path.c_str(), 1024 * 1024, MaxSize, 64));
+    PostingDeltaBuffer delta;
+    delta.Initialize(PageSize);
+
+    // appends stay in memory until they are flushed through db->Merge
+    int totalNum = 8;
+    for (int i = 0; i < totalNum; i++) {
+        BOOST_CHECK(db->Put(i, std::string(100, 'a')) == ErrorCode::Success);
+        BOOST_CHECK(delta.Append(i, std::string(100, 'b')) == 0);
+        BOOST_CHECK(delta.Append(i, std::string(100, 'c')) == 100);
+    }
+    BOOST_CHECK(delta.GetBytes() == totalNum * 200);
+    BOOST_CHECK(!delta.OverBudget());
+    delta.Append(0, std::string(PageSize, 'd'));
+    BOOST_CHECK(delta.OverBudget());
+
+    // eviction picks the largest deltas first, just enough of them to reach the target
+    std::vector<SizeType> victims;
+    delta.GetEvictionCandidates(PageSize, victims);
+    BOOST_CHECK(victims.size() == 1 && victims[0] == 0);
+    delta.GetEvictionCandidates(1000, victims);
+    BOOST_CHECK(victims.size() == 3 && victims[0] == 0);
+    delta.GetEvictionCandidates(delta.GetBytes(), victims);
+    BOOST_CHECK(victims.empty());
+
+    std::vector<SizeType> keys;
+    delta.GetKeys(keys);
+    BOOST_CHECK(keys.size() == totalNum);
+    for (SizeType key : keys) {
+        std::string buffered;
+        BOOST_CHECK(delta.Get(key, &buffered));
+        BOOST_CHECK(db->Merge(key, buffered) == ErrorCode::Success);
+        delta.Erase(key);
+    }
+    BOOST_CHECK(delta.GetBytes() == 0);
+
+    std::string value, buffered;
+    for (int i = 0; i < totalNum; i++) {
+        BOOST_CHECK(!delta.Get(i, &buffered));
+        BOOST_CHECK(db->Get(i, &value) == ErrorCode::Success);
+        std::string expected = std::string(100, 'a') + std::string(100, 'b') + std::string(100, 'c');
+        if (i == 0) expected += std::string(PageSize, 'd');
+        BOOST_CHECK(value == expected);
+    }
+    db->ShutDown();
+}
+
+void QuantizedPostingTest(std::string path)
+{
+    // 2 subvectors of 2 dims, 4 centroids each, the test vectors sit on the centroids so the codes are lossless
+    int M = 2, Ks = 4, subDim = 2, dim = M * subDim;
+    std::unique_ptr<float[]> codebooks(new float[M * Ks * subDim]);
+    for (int i = 0; i < M * Ks * subDim; i++) codebooks[i] = (float)i;
+    std::shared_ptr<COMMON::IQuantizer> quantizer(new COMMON::PQQuantizer<float>(M, Ks, subDim, false, std::move(codebooks)));
+
+    std::shared_ptr<Helper::KeyValueIO> storage(new SPDKIO(path.c_str(), 1024 * 1024, MaxSize, 64));
+    int metaDataSize = sizeof(int) + sizeof(uint8_t);
+    int vectorInfoSize = metaDataSize + dim * sizeof(float) + M;
+    int codeInfoSize = metaDataSize + M;
+    QuantizedKeyValueIO db(storage, quantizer, metaDataSize, vectorInfoSize, codeInfoSize);
+
+    int vectorNum = 16;
+    std::string posting(vectorNum * vectorInfoSize, '\0');
+    for (int i = 0; i < vectorNum; i++) {
+        char* ptr = &posting[i * vectorInfoSize];
+        *(int*)ptr = i;
+        *(uint8_t*)(ptr + sizeof(int)) = (uint8_t)(i % 3);
+        float* vector = (float*)(ptr + metaDataSize);
+        for (int m = 0; m < M; m++) {
+            int code = (i + m) % Ks;
+            for (int d = 0; d < subDim; d++) vector[m * subDim + d] = (float)((m * Ks + code) * subDim + d);
+        }
+        db.FillCode(ptr);
+        for (int m = 0; m < M; m++) BOOST_CHECK(*(std::uint8_t*)(ptr + metaDataSize + dim * sizeof(float) + m) == (i + m) % Ks);
+    }
+    BOOST_CHECK(db.Put(0, posting.substr(0, 8 * vectorInfoSize)) == ErrorCode::Success);
+    BOOST_CHECK(db.Merge(0, posting.substr(8 * vectorInfoSize)) == ErrorCode::Success);
+
+    std::string codes, decoded;
+    BOOST_CHECK(storage->Get(0, &codes) == ErrorCode::Success);
+    BOOST_CHECK(codes.size() == vectorNum * codeInfoSize);
+    BOOST_CHECK(db.Get(0, &decoded) == ErrorCode::Success);
+    BOOST_CHECK(decoded == posting);
+
+    // a rewrite keeps the codes it read instead of quantizing the reconstructed vectors again
+    std::string rewritten = decoded;
+    for (int i = 0; i < vectorNum; i++) ((float*)(&rewritten[i * vectorInfoSize + metaDataSize]))[0] += 1000.0f;
+    BOOST_CHECK(db.Put(1, rewritten) == ErrorCode::Success);
+    std::string rewrittenCodes;
+    BOOST_CHECK(storage->Get(1, &rewrittenCodes) == ErrorCode::Success);
+    BOOST_CHECK(rewrittenCodes == codes);
+
+    // ADC distances over the stored codes match the exact ones
+    quantizer->SetEnableADC(true);
+    std::vector<std::uint8_t> table(quantizer->QuantizeSize());
+    float* query = (float*)(&posting[3 * vectorInfoSize + metaDataSize]);
+    quantizer->QuantizeVector(query, table.data());
+    for (int i = 0; i < vectorNum; i++) {
+        float* vector = (float*)(&posting[i * vectorInfoSize + metaDataSize]);
+        float exact = COMMON::DistanceUtils::ComputeL2Distance(query, vector, dim);
+        float adc = quantizer->L2Distance(table.data(), (std::uint8_t*)(&codes[i * codeInfoSize + metaDataSize]));
+        BOOST_CHECK(std::fabs(exact - adc) < 1e-3);
+    }
+    storage->ShutDown();
+}
+
+void AlignedPostingTest(std::string path)
+{
+    // 7 dims so the vectors need padding, two appends leave three segments behind
+    int dim = 7, alignment = 64;
+    std::shared_ptr<Helper::KeyValueIO> storage(new SPDKIO(path.c_str(), 1024 * 1024, MaxSize, 64));
+    int metaDataSize = sizeof(int) + sizeof(uint8_t);
+    int vectorInfoSize = metaDataSize + dim * sizeof(float);
+    AlignedKeyValueIO db(storage, metaDataSize, vectorInfoSize, alignment);
+    BOOST_CHECK(db.VectorStride() == 64);
+
+    int vectorNum = 20;
+    std::string posting(vectorNum * vectorInfoSize, '\0');
+    for (int i = 0; i < vectorNum; i++) {
+        char* ptr = &posting[i * vectorInfoSize];
+        *(int*)ptr = i;
+        *(uint8_t*)(ptr + sizeof(int)) = (uint8_t)(i % 3);
+        float* vector = (float*)(ptr + metaDataSize);
+        for (int d = 0; d < dim; d++) vector[d] = (float)(i * dim + d);
+    }
+    BOOST_CHECK(db.Put(0, posting.substr(0, 8 * vectorInfoSize)) == ErrorCode::Success);
+    BOOST_CHECK(db.Merge(0, posting.substr(8 * vectorInfoSize, 1 * vectorInfoSize)) == ErrorCode::Success);
+    BOOST_CHECK(db.Merge(0, posting.substr(9 * vectorInfoSize)) == ErrorCode::Success);
+
+    std::string segments, decoded;
+    BOOST_CHECK(storage->Get(0, &segments) == ErrorCode::Success);
+    BOOST_CHECK(segments.size() == db.SegmentSize(8) + db.SegmentSize(1) + db.SegmentSize(11));
+    BOOST_CHECK(segments.size() % alignment == 0);
+    BOOST_CHECK(db.Get(0, &decoded) == ErrorCode::Success);
+    BOOST_CHECK(decoded == posting);
+
+    // the segments are scanned in place with the same IDs, versions and vectors
+    int seen = 0;
+    bool valid = db.ForEachSegment(segments.data(), segments.size(), [&](const char* p_meta, const char* p_vectors, int p_num) {
+        BOOST_CHECK((p_vectors - segments.data()) % alignment == 0);
+        for (int i = 0; i < p_num; i++, seen++) {
+            BOOST_CHECK(memcmp(p_meta + i * metaDataSize, &posting[seen * vectorInfoSize], metaDataSize) == 0);
+            BOOST_CHECK(memcmp(p_vectors + i * db.VectorStride(), &posting[seen * vectorInfoSize + metaDataSize], dim * sizeof(float)) == 0);
+        }
+    });
+    BOOST_CHECK(valid);
+    BOOST_CHECK(seen == vectorNum);
+
+    // with room for the posting as one segment and one more appended vector, single vector appends that
+    // would overflow the storage limit rewrite the posting as one segment
+    std::size_t maxBytes = db.SegmentSize(vectorNum) + db.SegmentSize(1);
+    AlignedKeyValueIO limited(storage, metaDataSize, vectorInfoSize, alignment, maxBytes);
+    BOOST_CHECK(limited.Put(1, posting.substr(0, 8 * vectorInfoSize)) == ErrorCode::Success);
+    int compactions = 0;
+    std::size_t stored = 0, lastStored = db.SegmentSize(8);
+    for (int i = 8; i < vectorNum; i++) {
+        BOOST_CHECK(limited.Merge(1, posting.substr(i * vectorInfoSize, vectorInfoSize)) == ErrorCode::Success);
+        BOOST_CHECK(limited.GetSize(1, &stored) == ErrorCode::Success);
+        BOOST_CHECK(stored <= maxBytes);
+        if (stored != lastStored + db.SegmentSize(1)) {
+            BOOST_CHECK(stored == db.SegmentSize(i + 1));
+            compactions++;
+        }
+        lastStored = stored;
+    }
+    BOOST_CHECK(compactions > 0);
+    BOOST_CHECK(limited.Get(1, &decoded) == ErrorCode::Success);
+    BOOST_CHECK(decoded == posting);
+    storage->ShutDown();
+}
+
+// Entries of every VID with stored versions 0 to 2 sit p_stride bytes apart: only the ones matching the
+// current version of a live VID are kept, deleted VIDs drop all of theirs.
+void VersionFilterTest(std::size_t stride)
+{
+    SizeType n = 100;
+    int copies = 3;
+    COMMON::VersionLabel versionMap;
+    versionMap.Initialize(n, 64, n);
+    std::uint8_t version;
+    for (SizeType i = 0; i < n; i++) {
+        versionMap.SetVersion(i, 0);
+        if (i % 3 == 0) BOOST_CHECK(versionMap.IncVersion(i, &version));
+        if (i % 7 == 1) { BOOST_CHECK(versionMap.IncVersion(i, &version)); BOOST_CHECK(versionMap.IncVersion(i, &version)); }
+        if (i % 5 == 0) BOOST_CHECK(versionMap.Delete(i));
+    }
+
+    int num = n * copies;
+    std::string entries(num * stride, '\xff');
+    for (int i = 0; i < num; i++) {
+        *(int*)&entries[i * stride] = i % n;
+        *(std::uint8_t*)&entries[i * stride + sizeof(int)] = (std::uint8_t)(i / n);
+    }
+    std::vector<int> slots(num);
+    std::vector<SizeType> ids(num);
+    int kept = versionMap.FilterCurrent(entries.data(), stride, num, slots.data(), ids.data());
+
+    int expected = 0;
+    for (int i = 0; i < num; i++) {
+        SizeType vid = i % n;
+        int current = (vid % 5 == 0) ? -1 : (vid % 3 == 0) + 2 * (vid % 7 == 1);
+        if (i / n != current) continue;
+        BOOST_REQUIRE(expected < kept);
+        BOOST_CHECK(slots[expected] == i);
+        BOOST_CHECK(ids[expected] == vid);
+        expected++;
+    }
+    BOOST_CHECK(kept == expected);
+}
+
 BOOST_AUTO_TEST_SUITE(KVTest)
 
 BOOST_AUTO_TEST_CASE(RocksDBTest)
@@ -94,4 +437,47 @@ BOOST_AUTO_TEST_CASE(SPDKTest)
     Test("tmp_spdk", "SPDK", true);
 }
 
+BOOST_AUTO_TEST_CASE(SPDKMultiPageTest)
+{
+    MultiPageTest("tmp_spdk_multipage");
+}
+
+BOOST_AUTO_TEST_CASE(SPDKWALTest)
+{
+    WALTest("tmp_spdk_wal");
+}
+
+BOOST_AUTO_TEST_CASE(SPDKDeltaBufferTest)
+{
+    DeltaBufferTest("tmp_spdk_delta");
+}
+
+BOOST_AUTO_TEST_CASE(SPDKQuantizedPostingTest)
+{
+    QuantizedPostingTest("tmp_spdk_quantized");
+}
+
+BOOST_AUTO_TEST_CASE(SPDKAlignedPostingTest)
+{
+    AlignedPostingTest("tmp_spdk_aligned");
+}
+
+BOOST_AUTO_TEST_CASE(RocksDBMergeEmptyTest)
+{
+    MergeEmptyTest("tmp_rocksdb_merge", "RocksDB");
+}
+
+BOOST_AUTO_TEST_CASE(SPDKMergeEmptyTest)
+{
+    MergeEmptyTest("tmp_spdk_merge", "SPDK");
+}
+
+BOOST_AUTO_TEST_CASE(VersionFilterStrideTest)
+{
+    // packed (VID, version) pairs, a stored record of a 10-d float vector and an aligned slot
+    for (std::size_t stride : { sizeof(int) + sizeof(std::uint8_t), sizeof(int) + sizeof(std::uint8_t) + 10 * sizeof(float), (std::size_t)64 }) {
+        VersionFilterTest(stride);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -7,6 +7,8 @@
 #include "inc/Core/Common/CommonUtils.h"
 #include "inc/Core/Common/QueryResultSet.h"
 #include "inc/Core/Common/DistanceUtils.h"
+#include "inc/Aggregator/CenterRouter.h"
+#include "inc/Core/SPANN/Index.h"
 #include <thread>
 #include <unordered_set>
 #include <ctime>
@@ -216,8 +218,180 @@ void PTest(IndexAlgoType algo, std::string distCalcMethod)
     Search<T>(vecIndex, queryset, 10, truth);
 }
 
+template <typename T>
+void RouteTest(SizeType centerNum, DimensionType dimension, SizeType queryNum, int topK, DistCalcMethod distMethod)
+{
+    std::shared_ptr<VectorSet> centers(new BasicVectorSet(ByteArray::Alloc(sizeof(T) * centerNum * dimension), GetEnumValueType<T>(), dimension, centerNum));
+    ByteArray queries = ByteArray::Alloc(sizeof(T) * queryNum * dimension);
+    for (SizeType i = 0; i < centerNum * dimension; i++) ((T*)centers->GetData())[i] = (T)COMMON::Utils::rand(127, -127);
+    for (SizeType i = 0; i < queryNum * dimension; i++) ((T*)queries.Data())[i] = (T)COMMON::Utils::rand(127, -127);
+
+    Aggregator::CenterRouter scanRouter, indexRouter;
+    BOOST_CHECK(scanRouter.Initialize(centers, distMethod, 0, 2048, 4));
+    BOOST_CHECK(indexRouter.Initialize(centers, distMethod, 1, 2048, 4));
+    BOOST_CHECK(!scanRouter.UseIndex() && indexRouter.UseIndex());
+
+    // the per query scalar loop with a full sort the aggregator used before
+    std::vector<SizeType> baseline(queryNum * topK);
+    auto t1 = std::chrono::high_resolution_clock::now();
+    for (SizeType q = 0; q < queryNum; q++)
+    {
+        const T* query = (const T*)queries.Data() + (std::size_t)q * dimension;
+        std::vector<BasicResult> servers;
+        for (SizeType c = 0; c < centerNum; c++)
+            servers.push_back(BasicResult(c, COMMON::DistanceUtils::ComputeDistance(query, (const T*)centers->GetVector(c), dimension, distMethod)));
+        std::sort(servers.begin(), servers.end(), [](const BasicResult& a, const BasicResult& b) { return a.Dist < b.Dist || (a.Dist == b.Dist && a.VID < b.VID); });
+        for (int k = 0; k < topK; k++) baseline[q * topK + k] = servers[k].VID;
+    }
+    auto t2 = std::chrono::high_resolution_clock::now();
+
+    std::vector<SizeType> scanned, indexed;
+    scanRouter.Route(queries.Data(), queryNum, topK, scanned);
+    auto t3 = std::chrono::high_resolution_clock::now();
+    indexRouter.Route(queries.Data(), queryNum, topK, indexed);
+    auto t4 = std::chrono::high_resolution_clock::now();
+
+    BOOST_CHECK(scanned == baseline);
+    float recall = 0;
+    for (SizeType q = 0; q < queryNum; q++)
+    {
+        std::unordered_set<SizeType> truth(baseline.begin() + q * topK, baseline.begin() + (q + 1) * topK);
+        for (int k = 0; k < topK; k++) recall += truth.count(indexed[q * topK + k]);
+    }
+
+    auto qps = [queryNum](std::chrono::high_resolution_clock::time_point a, std::chrono::high_resolution_clock::time_point b) {
+        return queryNum / max(1e-9, std::chrono::duration_cast<std::chrono::microseconds>(b - a).count() / 1e6);
+    };
+    LOG(Helper::LogLevel::LL_Info, "Route %d queries to top%d of %d centers: scalar %.0f qps, scan %.0f qps, index %.0f qps (recall %f)\n",
+        queryNum, topK, centerNum, qps(t1, t2), qps(t2, t3), qps(t3, t4), recall / queryNum / topK);
+}
+
+template <typename T>
+void ScanTest(int vectorNum, DimensionType dimension, int rounds, DistCalcMethod distMethod)
+{
+    // posting layout: [VID][version][vector] records
+    std::size_t offset = sizeof(int) + sizeof(std::uint8_t);
+    std::size_t stride = offset + sizeof(T) * dimension;
+    ByteArray posting = ByteArray::Alloc(stride * vectorNum);
+    std::vector<T> query(dimension);
+    for (DimensionType i = 0; i < dimension; i++) query[i] = (T)COMMON::Utils::rand(127, -127);
+    for (int v = 0; v < vectorNum; v++)
+    {
+        T* vec = (T*)(posting.Data() + v * stride + offset);
+        for (DimensionType i = 0; i < dimension; i++) vec[i] = (T)COMMON::Utils::rand(127, -127);
+    }
+
+    // the per vector path of the posting scans: one call through the std::function of the index for every vector
+    std::function<float(const T*, const T*, DimensionType)> distFunc(COMMON::DistanceCalcSelector<T>(distMethod));
+    std::vector<float> single(vectorNum), batch(vectorNum);
+    auto t1 = std::chrono::high_resolution_clock::now();
+    for (int r = 0; r < rounds; r++)
+    {
+        for (int v = 0; v < vectorNum; v++) single[v] = distFunc(query.data(), (const T*)(posting.Data() + v * stride + offset), dimension);
+    }
+    auto t2 = std::chrono::high_resolution_clock::now();
+    auto batchFunc = COMMON::DistanceBatchCalcSelector<T>(distMethod);
+    for (int r = 0; r < rounds; r++)
+    {
+        batchFunc(query.data(), posting.Data() + offset, stride, vectorNum, dimension, batch.data());
+    }
+    auto t3 = std::chrono::high_resolution_clock::now();
+
+    BOOST_CHECK(single == batch);
+    auto vps = [vectorNum, rounds](std::chrono::high_resolution_clock::time_point a, std::chrono::high_resolution_clock::time_point b) {
+        return (double)vectorNum * rounds / max(1e-9, std::chrono::duration_cast<std::chrono::microseconds>(b - a).count() / 1e6);
+    };
+    LOG(Helper::LogLevel::LL_Info, "Scan %d vectors of dimension %d: per vector %.0f vectors/s, batch %.0f vectors/s\n",
+        vectorNum, dimension, vps(t1, t2), vps(t2, t3));
+}
+
+// Merge throughput of a dynamic SPANN index on SPDK: nine in ten vectors are deleted, a search per kept
+// vector queues merges of the thinned postings and AppendThreadNum background threads run them. Reassign
+// is off and nothing is inserted, so every merge removes exactly one head.
+template <typename T>
+void MergeTest(SizeType vectorNum, DimensionType dimension, int appendThreadNum)
+{
+    ByteArray vec = ByteArray::Alloc(sizeof(T) * vectorNum * dimension);
+    for (SizeType i = 0; i < vectorNum * dimension; i++) ((T*)vec.Data())[i] = (T)COMMON::Utils::rand(127, -127);
+    std::shared_ptr<VectorSet> vecset(new BasicVectorSet(vec, GetEnumValueType<T>(), dimension, vectorNum));
+
+    std::shared_ptr<VectorIndex> vecIndex = VectorIndex::CreateInstance(IndexAlgoType::SPANN, GetEnumValueType<T>());
+    BOOST_REQUIRE(nullptr != vecIndex);
+    std::string out = "perftest_merge", mappingPath = out + "_spdkmapping";
+    std::remove(mappingPath.c_str());
+    vecIndex->SetParameter("IndexAlgoType", "BKT", "Base");
+    vecIndex->SetParameter("DistCalcMethod", "L2", "Base");
+    vecIndex->SetParameter("IndexDirectory", out, "Base");
+    vecIndex->SetParameter("isExecute", "true", "SelectHead");
+    vecIndex->SetParameter("NumberOfThreads", "8", "SelectHead");
+    vecIndex->SetParameter("Ratio", "0.1", "SelectHead");
+    vecIndex->SetParameter("isExecute", "true", "BuildHead");
+    vecIndex->SetParameter("NumberOfThreads", "8", "BuildHead");
+    vecIndex->SetParameter("isExecute", "true", "BuildSSDIndex");
+    vecIndex->SetParameter("BuildSsdIndex", "true", "BuildSSDIndex");
+    vecIndex->SetParameter("NumberOfThreads", "8", "BuildSSDIndex");
+    vecIndex->SetParameter("PostingPageLimit", "12", "BuildSSDIndex");
+    vecIndex->SetParameter("SearchPostingPageLimit", "12", "BuildSSDIndex");
+    vecIndex->SetParameter("InternalResultNum", "64", "BuildSSDIndex");
+    vecIndex->SetParameter("SearchInternalResultNum", "64", "BuildSSDIndex");
+    vecIndex->SetParameter("ExcludeHead", "false", "BuildSSDIndex");
+    vecIndex->SetParameter("UseSPDK", "true", "BuildSSDIndex");
+    vecIndex->SetParameter("SpdkMappingPath", mappingPath, "BuildSSDIndex");
+    vecIndex->SetParameter("Update", "true", "BuildSSDIndex");
+    vecIndex->SetParameter("AppendThreadNum", std::to_string(appendThreadNum), "BuildSSDIndex");
+    vecIndex->SetParameter("ReassignThreadNum", "1", "BuildSSDIndex");
+    vecIndex->SetParameter("MergeThreshold", "10", "BuildSSDIndex");
+    vecIndex->SetParameter("DisableReassign", "true", "BuildSSDIndex");
+    BOOST_REQUIRE(ErrorCode::Success == vecIndex->BuildIndex(vecset, nullptr));
+
+    SPANN::Index<T>* spannIndex = dynamic_cast<SPANN::Index<T>*>(vecIndex.get());
+    BOOST_REQUIRE(nullptr != spannIndex);
+    spannIndex->Initialize();
+    for (SizeType i = 0; i < vectorNum; i++) {
+        if (i % 10 != 0) vecIndex->DeleteIndex(i);
+    }
+    SizeType deletedHeads = spannIndex->GetMemoryIndex()->GetNumDeleted();
+
+    // the searches only queue the merges, they run on enough threads to keep the append threads busy
+    auto t1 = std::chrono::high_resolution_clock::now();
+#pragma omp parallel for num_threads(8) schedule(dynamic)
+    for (SizeType i = 0; i < vectorNum; i += 10) {
+        QueryResult res(vecset->GetVector(i), 1, false);
+        vecIndex->SearchIndex(res);
+    }
+    while (!spannIndex->AllFinished()) Sleep(1);
+    auto t2 = std::chrono::high_resolution_clock::now();
+
+    SizeType merges = spannIndex->GetMemoryIndex()->GetNumDeleted() - deletedHeads;
+    BOOST_CHECK(merges > 0);
+    double seconds = max(1e-9, std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count() / 1e6);
+    LOG(Helper::LogLevel::LL_Info, "Merge %d of %d heads with %d append threads: %.3f s, %.0f merges/s\n",
+        merges, spannIndex->GetMemoryIndex()->GetNumSamples(), appendThreadNum, seconds, merges / seconds);
+    spannIndex->ExitBlockController();
+}
+
 BOOST_AUTO_TEST_SUITE(PerfTest)
 
+BOOST_AUTO_TEST_CASE(PostingScanTest)
+{
+    ScanTest<float>(1000, 128, 1000, DistCalcMethod::L2);
+    ScanTest<float>(1000000, 128, 5, DistCalcMethod::L2);
+    ScanTest<std::int8_t>(1000, 100, 1000, DistCalcMethod::L2);
+    ScanTest<std::uint8_t>(1000000, 128, 5, DistCalcMethod::Cosine);
+}
+
+BOOST_AUTO_TEST_CASE(AggregatorRouteTest)
+{
+    RouteTest<float>(256, 128, 1000, 4, DistCalcMethod::L2);
+    RouteTest<float>(16384, 128, 1000, 4, DistCalcMethod::L2);
+    RouteTest<std::int8_t>(16384, 100, 1000, 4, DistCalcMethod::L2);
+}
+
+BOOST_AUTO_TEST_CASE(SPANNMergeTest)
+{
+    for (int appendThreadNum = 1; appendThreadNum <= 8; appendThreadNum *= 2) MergeTest<float>(20000, 64, appendThreadNum);
+}
+
 BOOST_AUTO_TEST_CASE(BKTTest)
 {
     PTest<std::int8_t>(IndexAlgoType::BKT, "Cosine");
@@ -10,7 +10,10 @@
 #include "inc/Helper/SimpleIniReader.h"
 #include "inc/Helper/StringConvert.h"
 #include "inc/Helper/VectorSetReader.h"
+#include "inc/SPFresh/SearchTelemetry.h"
 #include <future>
+#include <random>
+#include <sstream>
 
 #include <iomanip>
 #include <iostream>
@@ -275,6 +278,7 @@ namespace SPTAG {
                         index = queriesSent.fetch_add(1);
                         if (index < numQueries)
                         {
+                            p_stats[index].m_searchRequestTime = std::chrono::steady_clock::now();
                             double startTime = threadws.getElapsedMs();
                             p_index->GetMemoryIndex()->SearchIndex(p_results[index]);
                             double endTime = threadws.getElapsedMs();
@@ -1136,6 +1140,123 @@ namespace SPTAG {
 #undef DefineVectorValueType
                 return 0;
             }
+
+            // records the latencies and checks every percentile is an upper bound within 1/64 of the true one
+            void CheckPercentiles(const std::vector<double>& p_ms)
+            {
+                LatencyHistogram histogram;
+                std::vector<std::uint64_t> micros;
+                for (double ms : p_ms)
+                {
+                    histogram.Record(ms);
+                    micros.push_back((std::uint64_t)(ms * 1000));
+                }
+                std::sort(micros.begin(), micros.end());
+                BOOST_CHECK(histogram.Count() == p_ms.size());
+                BOOST_CHECK(histogram.Max() == *std::max_element(p_ms.begin(), p_ms.end()));
+
+                for (double ratio : { 0.0, 0.1, 0.5, 0.9, 0.99, 0.999, 1.0 })
+                {
+                    double truth = micros[(std::size_t)(ratio * (micros.size() - 1))] / 1000.0;
+                    double percentile = histogram.Percentile(ratio);
+                    BOOST_CHECK(percentile >= truth);
+                    BOOST_CHECK(percentile <= truth * (1 + 1.0 / 64) + 1e-9);
+                }
+
+                histogram.Reset();
+                BOOST_CHECK(histogram.Count() == 0);
+                BOOST_CHECK(histogram.Percentile(0.5) == 0);
+            }
+
+            // Samples a small SPANN index while nothing else runs, against a truth holding the 5 nearest and the 5
+            // farthest vectors of every query. The search finds the nearest ones and never the farthest, so every
+            // interval with samples reports a recall of at most 0.5.
+            template <typename T>
+            void TelemetryRecall()
+            {
+                SizeType n = 2000, queryNum = 20;
+                DimensionType m = 16;
+                std::mt19937 rng(7);
+                std::uniform_real_distribution<float> uniform(-1, 1), noise(-0.01f, 0.01f);
+                ByteArray vec = ByteArray::Alloc(sizeof(T) * n * m), query = ByteArray::Alloc(sizeof(T) * queryNum * m);
+                for (SizeType i = 0; i < n * m; i++) ((T*)vec.Data())[i] = (T)uniform(rng);
+                for (SizeType i = 0; i < queryNum * m; i++) ((T*)query.Data())[i] = ((T*)vec.Data())[i / m * 37 * m + i % m] + (T)noise(rng);
+                std::shared_ptr<VectorSet> vecset(new BasicVectorSet(vec, GetEnumValueType<T>(), m, n));
+                std::shared_ptr<VectorSet> queryset(new BasicVectorSet(query, GetEnumValueType<T>(), m, queryNum));
+
+                std::string out = "testtelemetryindex", mappingPath = out + "_spdkmapping", telemetryPath = out + ".csv";
+                std::remove(mappingPath.c_str());
+                std::shared_ptr<VectorIndex> vecIndex = VectorIndex::CreateInstance(IndexAlgoType::SPANN, GetEnumValueType<T>());
+                vecIndex->SetParameter("IndexAlgoType", "BKT", "Base");
+                vecIndex->SetParameter("DistCalcMethod", "L2", "Base");
+                vecIndex->SetParameter("IndexDirectory", out, "Base");
+                vecIndex->SetParameter("isExecute", "true", "SelectHead");
+                vecIndex->SetParameter("NumberOfThreads", "4", "SelectHead");
+                vecIndex->SetParameter("Ratio", "0.2", "SelectHead");
+                vecIndex->SetParameter("isExecute", "true", "BuildHead");
+                vecIndex->SetParameter("NumberOfThreads", "4", "BuildHead");
+                vecIndex->SetParameter("isExecute", "true", "BuildSSDIndex");
+                vecIndex->SetParameter("BuildSsdIndex", "true", "BuildSSDIndex");
+                vecIndex->SetParameter("NumberOfThreads", "4", "BuildSSDIndex");
+                vecIndex->SetParameter("PostingPageLimit", "12", "BuildSSDIndex");
+                vecIndex->SetParameter("SearchPostingPageLimit", "12", "BuildSSDIndex");
+                vecIndex->SetParameter("ExcludeHead", "false", "BuildSSDIndex");
+                vecIndex->SetParameter("UseSPDK", "true", "BuildSSDIndex");
+                vecIndex->SetParameter("SpdkMappingPath", mappingPath, "BuildSSDIndex");
+                vecIndex->SetParameter("ResultNum", "10", "BuildSSDIndex");
+                vecIndex->SetParameter("TelemetryPath", telemetryPath, "BuildSSDIndex");
+                vecIndex->SetParameter("TelemetryQPS", "200", "BuildSSDIndex");
+                vecIndex->SetParameter("TelemetryIntervalMs", "200", "BuildSSDIndex");
+                BOOST_CHECK(ErrorCode::Success == vecIndex->BuildIndex(vecset, nullptr));
+                SPANN::Index<T>* spannIndex = dynamic_cast<SPANN::Index<T>*>(vecIndex.get());
+                BOOST_CHECK(nullptr != spannIndex);
+
+                std::vector<std::set<SizeType>> truth(queryNum);
+                for (SizeType q = 0; q < queryNum; q++)
+                {
+                    std::vector<std::pair<float, SizeType>> dists;
+                    for (SizeType i = 0; i < n; i++)
+                        dists.emplace_back(COMMON::DistanceUtils::ComputeDistance((const T*)queryset->GetVector(q), (const T*)vecset->GetVector(i), m, DistCalcMethod::L2), i);
+                    std::sort(dists.begin(), dists.end());
+                    for (int k = 0; k < 5; k++)
+                    {
+                        truth[q].insert(dists[k].second);
+                        truth[q].insert(dists[n - 1 - k].second);
+                    }
+                }
+
+                {
+                    SearchTelemetry<T> telemetry(spannIndex, queryset, vecset, *spannIndex->GetOptions());
+                    telemetry.SetTruth(truth);
+                    BOOST_CHECK(telemetry.Start());
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+                    telemetry.Stop();
+                }
+
+                std::ifstream csv(telemetryPath);
+                std::string line;
+                BOOST_CHECK(std::getline(csv, line));
+                BOOST_CHECK(line == "time_s,vectors,deleted,samples,qps,search_p50_ms,search_p90_ms,search_p99_ms,search_p999_ms,search_max_ms,"
+                    "head_p50_ms,head_p99_ms,disk_read_p50_ms,disk_read_p99_ms,compute_p50_ms,compute_p99_ms,recall,recall_samples");
+                int rows = 0;
+                while (std::getline(csv, line))
+                {
+                    std::vector<double> fields;
+                    std::stringstream row(line);
+                    std::string field;
+                    while (std::getline(row, field, ',')) fields.push_back(std::stod(field));
+                    BOOST_CHECK(fields.size() == 18);
+                    if (fields.size() != 18) continue;
+                    BOOST_CHECK(fields[1] == n);
+                    BOOST_CHECK(fields[3] > 0);
+                    BOOST_CHECK(fields[5] <= fields[7] && fields[7] <= fields[9]);
+                    BOOST_CHECK(fields[17] == fields[3]);
+                    BOOST_CHECK(fields[16] >= 0.4 && fields[16] <= 0.5 + 1e-6);
+                    rows++;
+                }
+                BOOST_CHECK(rows > 0);
+                std::remove(telemetryPath.c_str());
+            }
         }
     }
 }
@@ -1149,4 +1270,45 @@ BOOST_AUTO_TEST_CASE(SPFreshUpdate)
 	SSDServing::SPFresh::UpdateTest(&my_map, configPath.data());
 }
 
-BOOST_AUTO_TEST_SUITE_END()
\ No newline at end of file
+BOOST_AUTO_TEST_CASE(LatencyHistogramBucketTest)
+{
+    using SSDServing::SPFresh::LatencyHistogram;
+    std::vector<std::uint64_t> values;
+    for (std::uint64_t v = 0; v < 200000; v++) values.push_back(v);
+    for (int shift = 6; shift <= 40; shift++)
+    {
+        values.push_back((1ULL << shift) - 1);
+        values.push_back(1ULL << shift);
+        values.push_back((1ULL << shift) + 1);
+    }
+    for (std::uint64_t v : values)
+    {
+        std::size_t bucket = LatencyHistogram::Bucket(v);
+        if (v < 64) BOOST_CHECK(bucket == v && LatencyHistogram::BucketUpper(bucket) == v);
+        BOOST_CHECK(LatencyHistogram::BucketUpper(bucket) >= v);
+        BOOST_CHECK(LatencyHistogram::BucketUpper(bucket) - v <= v / 64);
+        BOOST_CHECK(bucket == 0 || LatencyHistogram::BucketUpper(bucket - 1) < v);
+    }
+    BOOST_CHECK(LatencyHistogram::Bucket(~0ULL) == LatencyHistogram::Bucket(1ULL << 41));
+}
+
+BOOST_AUTO_TEST_CASE(LatencyHistogramPercentileTest)
+{
+    std::mt19937 rng(11);
+    std::vector<double> uniform, exponential, bimodal;
+    for (int i = 0; i < 10000; i++) uniform.push_back(i / 1000.0);
+    std::exponential_distribution<double> exp(0.5);
+    for (int i = 0; i < 10000; i++) exponential.push_back(exp(rng));
+    // a fast mode with a 1% tail 250 times slower, the tail percentiles must not fall back to the fast mode
+    for (int i = 0; i < 10000; i++) bimodal.push_back((i % 100 == 0) ? 50 + i / 1000.0 : 0.2);
+    SSDServing::SPFresh::CheckPercentiles(uniform);
+    SSDServing::SPFresh::CheckPercentiles(exponential);
+    SSDServing::SPFresh::CheckPercentiles(bimodal);
+}
+
+BOOST_AUTO_TEST_CASE(SearchTelemetryTest)
+{
+    SSDServing::SPFresh::TelemetryRecall<float>();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
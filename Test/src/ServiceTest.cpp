@@ -0,0 +1,239 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "inc/Test.h"
+#include "inc/Core/VectorIndex.h"
+#include "inc/Server/SearchService.h"
+#include "inc/Aggregator/AggregatorService.h"
+
+#include <random>
+
+using namespace SPTAG;
+
+// Shard s of the line points 0..n-1 holds the points i with i % shards == s, every dimension of point i is i.
+static std::shared_ptr<VectorIndex> BuildShard(SizeType n, DimensionType m, int shards, int s)
+{
+    std::vector<float> vec;
+    for (SizeType i = s; i < n; i += shards) {
+        for (DimensionType j = 0; j < m; j++) vec.push_back((float)i);
+    }
+    std::shared_ptr<VectorIndex> index = VectorIndex::CreateInstance(IndexAlgoType::BKT, VectorValueType::Float);
+    index->SetParameter("DistCalcMethod", "L2");
+    index->SetParameter("NumberOfThreads", "4");
+    BOOST_CHECK(ErrorCode::Success == index->BuildIndex(vec.data(), (SizeType)(vec.size() / m), m));
+    return index;
+}
+
+static Socket::RemoteUpdateRequest DeleteRequest(const std::vector<float>& p_points, DimensionType m)
+{
+    Socket::RemoteUpdateRequest request;
+    request.m_valueType = VectorValueType::Float;
+    request.m_dimension = m;
+    request.m_vectorNum = (std::uint32_t)p_points.size();
+    request.m_vectors = ByteArray::Alloc(sizeof(float) * m * p_points.size());
+    for (std::size_t i = 0; i < p_points.size(); i++) {
+        for (DimensionType j = 0; j < m; j++) ((float*)request.m_vectors.Data())[i * m + j] = p_points[i];
+    }
+    return request;
+}
+
+// every shard deletes what it holds of the batch, the aggregator merges their replies
+static Socket::PacketProcessStatus DeleteOnShards(std::vector<std::shared_ptr<VectorIndex>>& p_shards, const Socket::RemoteUpdateRequest& p_request,
+    std::vector<Socket::PacketProcessStatus>& p_shardStatus, std::vector<Socket::RemoteUpdateResult>& p_shardResults, Socket::RemoteUpdateResult& p_merged)
+{
+    p_shardStatus.resize(p_shards.size());
+    p_shardResults.assign(p_shards.size(), Socket::RemoteUpdateResult());
+    for (std::size_t s = 0; s < p_shards.size(); s++) {
+        p_shardStatus[s] = Service::SearchService::DeleteVectors(p_shards[s].get(), p_request, p_shardResults[s]);
+    }
+    return Aggregator::AggregatorService::MergeDeleteResults(p_shardStatus, p_shardResults, p_request.m_vectorNum, p_merged);
+}
+
+// The answer of one server to a query with room for K results, p_results are (VID, distance) pairs sorted by
+// distance and p_meta their metadata, if any. The slots after them stay empty like those of a short posting list.
+static QueryResult ShardResult(int K, const std::vector<std::pair<SizeType, float>>& p_results, const std::vector<std::string>& p_meta = {})
+{
+    QueryResult result(nullptr, K, !p_meta.empty());
+    result.Reset();
+    for (std::size_t i = 0; i < p_results.size(); i++) {
+        result.SetResult((int)i, p_results[i].first, p_results[i].second);
+        if (!p_meta.empty()) {
+            ByteArray meta = ByteArray::Alloc(p_meta[i].size());
+            memcpy(meta.Data(), p_meta[i].data(), p_meta[i].size());
+            result.SetMetadata((int)i, meta);
+        }
+    }
+    return result;
+}
+
+static std::string Meta(const QueryResult& p_result, int p_pos)
+{
+    const ByteArray& meta = p_result.GetMetadata(p_pos);
+    return std::string((const char*)meta.Data(), meta.Length());
+}
+
+static std::shared_ptr<Socket::RemoteSearchResult> ServerReply(Socket::RemoteSearchResult::ResultStatus p_status, const std::vector<QueryResult>& p_queries)
+{
+    std::shared_ptr<Socket::RemoteSearchResult> reply(new Socket::RemoteSearchResult);
+    reply->m_status = p_status;
+    for (std::size_t q = 0; q < p_queries.size(); q++) {
+        reply->m_allIndexResults.emplace_back();
+        reply->m_allIndexResults.back().m_indexName = "index";
+        reply->m_allIndexResults.back().m_queryID = (std::uint32_t)q;
+        reply->m_allIndexResults.back().m_results = p_queries[q];
+    }
+    return reply;
+}
+
+BOOST_AUTO_TEST_SUITE(ServiceTest)
+
+BOOST_AUTO_TEST_CASE(MergeIndexResultsOrderTest)
+{
+    // 4 servers with their own top 10 of 40 random distances, without metadata every VID is its own vector
+    int K = 10, shardNum = 4;
+    std::mt19937 rg(3);
+    std::uniform_real_distribution<float> dist(0, 100);
+    std::vector<QueryResult> shards;
+    std::vector<std::pair<float, SizeType>> all;
+    for (int s = 0; s < shardNum; s++) {
+        std::vector<std::pair<SizeType, float>> results;
+        for (int i = 0; i < K; i++) results.emplace_back((SizeType)(s * 100 + i), dist(rg));
+        std::sort(results.begin(), results.end(), [](const std::pair<SizeType, float>& a, const std::pair<SizeType, float>& b) { return a.second < b.second; });
+        for (auto& res : results) all.emplace_back(res.second, res.first);
+        shards.push_back(ShardResult(K, results));
+    }
+    std::sort(all.begin(), all.end());
+
+    std::vector<const QueryResult*> shardPtrs;
+    for (auto& shard : shards) shardPtrs.push_back(&shard);
+    QueryResult merged;
+    Aggregator::AggregatorService::MergeIndexResults(shardPtrs, merged);
+    BOOST_REQUIRE_EQUAL(merged.GetResultNum(), K);
+    for (int k = 0; k < K; k++) {
+        BOOST_CHECK_EQUAL(merged.GetResult(k)->VID, all[k].second);
+        BOOST_CHECK_EQUAL(merged.GetResult(k)->Dist, all[k].first);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(MergeIndexResultsDedupTest)
+{
+    int K = 4;
+    // "b" and "c" are replicated on two servers, only their closest copies are kept and "f" takes the last place
+    QueryResult shard0 = ShardResult(K, { {1, 1.0f}, {2, 2.0f}, {3, 4.0f}, {4, 6.0f} }, { "a", "b", "c", "e" });
+    QueryResult shard1 = ShardResult(K, { {7, 1.5f}, {8, 3.0f}, {9, 5.0f} }, { "b", "c", "f" });
+    QueryResult merged;
+    Aggregator::AggregatorService::MergeIndexResults({ &shard0, &shard1 }, merged);
+    std::vector<std::pair<SizeType, std::string>> expected = { {1, "a"}, {7, "b"}, {8, "c"}, {9, "f"} };
+    BOOST_REQUIRE_EQUAL(merged.GetResultNum(), K);
+    for (int k = 0; k < K; k++) {
+        BOOST_CHECK_EQUAL(merged.GetResult(k)->VID, expected[k].first);
+        BOOST_CHECK_EQUAL(Meta(merged, k), expected[k].second);
+    }
+
+    // without metadata VIDs are local to a server: VID 5 of both servers is kept, a repeat from one server is not
+    shard0 = ShardResult(K, { {5, 1.0f}, {5, 1.0f}, {6, 3.0f}, {8, 7.0f} });
+    shard1 = ShardResult(K, { {5, 2.0f}, {9, 4.0f} });
+    Aggregator::AggregatorService::MergeIndexResults({ &shard0, &shard1 }, merged);
+    std::vector<std::pair<SizeType, float>> expectedVIDs = { {5, 1.0f}, {5, 2.0f}, {6, 3.0f}, {9, 4.0f} };
+    BOOST_REQUIRE_EQUAL(merged.GetResultNum(), K);
+    for (int k = 0; k < K; k++) {
+        BOOST_CHECK_EQUAL(merged.GetResult(k)->VID, expectedVIDs[k].first);
+        BOOST_CHECK_EQUAL(merged.GetResult(k)->Dist, expectedVIDs[k].second);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(MergeSearchResultsTimeoutTest)
+{
+    int K = 5;
+    typedef Socket::RemoteSearchResult::ResultStatus Status;
+    // server 0 found fewer than K, server 1 timed out with stale results, server 2 never replied
+    std::vector<Aggregator::AggregatorResult> replies = {
+        ServerReply(Status::Success, { ShardResult(K, { {1, 1.0f}, {2, 3.0f} }), ShardResult(K, { {3, 2.0f} }) }),
+        ServerReply(Status::Timeout, { ShardResult(K, { {10, 0.5f}, {11, 0.7f} }), ShardResult(K, { {12, 0.1f} }) }),
+        nullptr,
+        ServerReply(Status::Success, { ShardResult(K, { {4, 2.0f} }) })
+    };
+    Socket::RemoteSearchResult merged;
+    Aggregator::AggregatorService::MergeSearchResults(replies, merged);
+    BOOST_CHECK(Status::Success == merged.m_status);
+    BOOST_REQUIRE_EQUAL(merged.m_allIndexResults.size(), (std::size_t)2);
+
+    // the answered results come first in distance order, the remaining slots stay empty
+    std::vector<std::vector<SizeType>> expected = { { 1, 4, 2, -1, -1 }, { 3, -1, -1, -1, -1 } };
+    for (std::uint32_t q = 0; q < 2; q++) {
+        const auto& indexRes = merged.m_allIndexResults[q];
+        BOOST_CHECK_EQUAL(indexRes.m_queryID, q);
+        BOOST_CHECK_EQUAL(indexRes.m_indexName, "index");
+        BOOST_REQUIRE_EQUAL(indexRes.m_results.GetResultNum(), K);
+        for (int k = 0; k < K; k++) BOOST_CHECK_EQUAL(indexRes.m_results.GetResult(k)->VID, expected[q][k]);
+    }
+
+    // nobody answered in time
+    replies.erase(replies.begin());
+    replies.pop_back();
+    Aggregator::AggregatorService::MergeSearchResults(replies, merged);
+    BOOST_CHECK(Status::Timeout == merged.m_status);
+    BOOST_CHECK(merged.m_allIndexResults.empty());
+}
+
+BOOST_AUTO_TEST_CASE(DeleteAcrossShardsTest)
+{
+    SizeType n = 300;
+    DimensionType m = 10;
+    int shardNum = 3;
+    std::vector<std::shared_ptr<VectorIndex>> shards;
+    for (int s = 0; s < shardNum; s++) shards.push_back(BuildShard(n, m, shardNum, s));
+
+    std::vector<Socket::PacketProcessStatus> shardStatus;
+    std::vector<Socket::RemoteUpdateResult> shardResults;
+    Socket::RemoteUpdateResult merged;
+
+    // each vector is on one shard only: every shard misses some of them, the batch is still deleted
+    std::vector<float> points = { 0, 1, 2, 5, 7, 8 };
+    auto request = DeleteRequest(points, m);
+    BOOST_CHECK(Socket::PacketProcessStatus::Ok == DeleteOnShards(shards, request, shardStatus, shardResults, merged));
+    BOOST_CHECK(merged.m_vectorStatus.empty());
+    for (int s = 0; s < shardNum; s++) {
+        BOOST_CHECK(Socket::PacketProcessStatus::Failed == shardStatus[s]);
+        BOOST_REQUIRE(shardResults[s].m_vectorStatus.size() == points.size());
+        for (std::size_t v = 0; v < points.size(); v++) {
+            bool held = ((int)points[v] % shardNum == s);
+            BOOST_CHECK((held ? Socket::PacketProcessStatus::Ok : Socket::PacketProcessStatus::Failed) == shardResults[s].m_vectorStatus[v]);
+        }
+    }
+
+    // a vector deleted before and one no shard ever held are reported, the others are deleted
+    points = { 3, 0, 4, 1000.5f };
+    request = DeleteRequest(points, m);
+    BOOST_CHECK(Socket::PacketProcessStatus::Failed == DeleteOnShards(shards, request, shardStatus, shardResults, merged));
+    std::vector<Socket::PacketProcessStatus> expected = { Socket::PacketProcessStatus::Ok, Socket::PacketProcessStatus::Failed,
+        Socket::PacketProcessStatus::Ok, Socket::PacketProcessStatus::Failed };
+    BOOST_CHECK(merged.m_vectorStatus == expected);
+
+    // the shard of 4 timed out: what no other shard deleted may be on it and gets retried
+    shardStatus[1] = Socket::PacketProcessStatus::Timeout;
+    shardResults[1].m_vectorStatus.clear();
+    BOOST_CHECK(Socket::PacketProcessStatus::Timeout == Aggregator::AggregatorService::MergeDeleteResults(shardStatus, shardResults, request.m_vectorNum, merged));
+    expected = { Socket::PacketProcessStatus::Ok, Socket::PacketProcessStatus::Timeout,
+        Socket::PacketProcessStatus::Timeout, Socket::PacketProcessStatus::Timeout };
+    BOOST_CHECK(merged.m_vectorStatus == expected);
+
+    // a shard asking to back off wins over the timeout
+    shardStatus[2] = Socket::PacketProcessStatus::Dropped;
+    shardResults[2].m_vectorStatus.clear();
+    BOOST_CHECK(Socket::PacketProcessStatus::Dropped == Aggregator::AggregatorService::MergeDeleteResults(shardStatus, shardResults, request.m_vectorNum, merged));
+    expected = { Socket::PacketProcessStatus::Ok, Socket::PacketProcessStatus::Dropped,
+        Socket::PacketProcessStatus::Dropped, Socket::PacketProcessStatus::Dropped };
+    BOOST_CHECK(merged.m_vectorStatus == expected);
+
+    // the deleted vectors are gone from their shards, the others are still found
+    for (float point : { 0.0f, 3.0f, 4.0f, 6.0f }) {
+        int s = (int)point % shardNum;
+        std::vector<float> query(m, point);
+        QueryResult res(query.data(), 1, false);
+        shards[s]->SearchIndex(res);
+        BOOST_CHECK((point == 6.0f) == (res.GetResult(0)->Dist == 0));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
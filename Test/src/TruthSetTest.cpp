@@ -0,0 +1,154 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "inc/Test.h"
+#include "inc/Core/Common/TruthSet.h"
+#include "inc/Core/Common/IncrementalTruthSet.h"
+#include "inc/Helper/VectorSetReaders/MemoryReader.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+
+using namespace SPTAG;
+
+// Small int8 values give exact distances with many ties, every fifth doc repeats the one before it.
+// There are more queries than a query tile and more docs than a doc tile, neither a multiple of it.
+static std::shared_ptr<VectorSet> TruthVectors(SizeType num, DimensionType dim, unsigned seed)
+{
+    std::mt19937 rg(seed);
+    std::uniform_int_distribution<int> value(-2, 2);
+    ByteArray data = ByteArray::Alloc(sizeof(std::int8_t) * num * dim);
+    std::int8_t* vecs = (std::int8_t*)data.Data();
+    for (SizeType i = 0; i < num; i++) {
+        for (DimensionType j = 0; j < dim; j++) vecs[i * dim + j] = (i % 5 == 4) ? vecs[(i - 1) * dim + j] : (std::int8_t)value(rg);
+    }
+    return std::make_shared<BasicVectorSet>(data, VectorValueType::Int8, dim, num);
+}
+
+// the top K of a full scan per query over the docs live marks, or all of them, ties go to the smaller ID
+static std::vector<NodeDistPair> FullScan(std::shared_ptr<VectorSet> queries, SizeType q, std::shared_ptr<VectorSet> docs, int K, const std::vector<std::uint8_t>* live = nullptr)
+{
+    std::vector<NodeDistPair> all;
+    for (SizeType i = 0; i < docs->Count(); i++) {
+        if (live != nullptr && !(*live)[i]) continue;
+        all.emplace_back(i, COMMON::DistanceUtils::ComputeDistance((const std::int8_t*)queries->GetVector(q), (const std::int8_t*)docs->GetVector(i), docs->Dimension(), DistCalcMethod::L2));
+    }
+    int num = min(K, (int)all.size());
+    std::partial_sort(all.begin(), all.begin() + num, all.end(), [](const NodeDistPair& a, const NodeDistPair& b) {
+        return a.distance < b.distance || (a.distance == b.distance && a.node < b.node);
+    });
+    all.resize(num);
+    return all;
+}
+
+// Random batches of deletes and inserts, some deleting most of the live vectors so queries run out of known
+// neighbors and get rescanned, some reinserting deleted IDs. After each the truth matches a full scan.
+static void IncrementalTruthTest(int slack)
+{
+    int K = 10;
+    auto queries = TruthVectors(100, 128, 5);
+    auto docs = TruthVectors(3000, 128, 6);
+    COMMON::IncrementalTruthSet<std::int8_t> truthSet(queries, docs, DistCalcMethod::L2, K, slack);
+    std::vector<std::uint8_t> live(docs->Count(), 0);
+    std::fill(live.begin(), live.begin() + 2000, 1);
+    truthSet.Build(0, 2000);
+
+    std::mt19937 rg(7);
+    SizeType rescanned = 0;
+    for (int batch = 0; batch < 8; batch++) {
+        int deleteNum = (batch % 4 == 3) ? 1500 : 150, insertNum = 200;
+        std::vector<SizeType> deletes, inserts;
+        for (int i = 0; i < deleteNum; i++) deletes.push_back((SizeType)(rg() % docs->Count()));
+        for (int i = 0; i < insertNum; i++) inserts.push_back((SizeType)(rg() % docs->Count()));
+        for (SizeType vid : deletes) live[vid] = 0;
+        for (SizeType vid : inserts) live[vid] = 1;
+        rescanned += truthSet.Update(deletes, inserts);
+
+        BOOST_CHECK_EQUAL(truthSet.LiveNum(), (SizeType)std::count(live.begin(), live.end(), 1));
+        std::vector<std::set<SizeType>> truth;
+        truthSet.GetTruth(truth);
+        for (SizeType q = 0; q < queries->Count(); q++) {
+            std::set<SizeType> expected;
+            for (auto& p : FullScan(queries, q, docs, K, &live)) expected.insert(p.node);
+            BOOST_CHECK(truth[q] == expected);
+        }
+    }
+    BOOST_CHECK(rescanned > 0);
+}
+
+static void CheckScanned(std::vector<std::unique_ptr<COMMON::QueryResultSet<std::int8_t>>>& heaps, std::shared_ptr<VectorSet> queries, std::shared_ptr<VectorSet> docs, int K)
+{
+    for (SizeType q = 0; q < queries->Count(); q++) {
+        heaps[q]->SortResult();
+        auto expected = FullScan(queries, q, docs, K);
+        std::vector<NodeDistPair> found(K);
+        for (int k = 0; k < K; k++) found[k] = NodeDistPair(heaps[q]->GetResult(k)->VID, heaps[q]->GetResult(k)->Dist);
+        std::sort(found.begin(), found.end(), [](const NodeDistPair& a, const NodeDistPair& b) {
+            return a.distance < b.distance || (a.distance == b.distance && a.node < b.node);
+        });
+        for (int k = 0; k < K; k++) {
+            BOOST_CHECK_EQUAL(found[k].node, expected[k].node);
+            BOOST_CHECK_EQUAL(found[k].distance, expected[k].distance);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(TruthSetTest)
+
+BOOST_AUTO_TEST_CASE(ScanTruthBlockTest)
+{
+    int K = 10;
+    auto queries = TruthVectors(150, 128, 1);
+    auto docs = TruthVectors(5000, 128, 2);
+
+    // the whole base as one block, tiled inside
+    std::vector<std::unique_ptr<COMMON::QueryResultSet<std::int8_t>>> heaps;
+    COMMON::TruthSet::InitTruthQueries<std::int8_t>(queries, K, nullptr, heaps);
+    COMMON::TruthSet::ScanTruthBlock<std::int8_t>(heaps, docs, 0, DistCalcMethod::L2, nullptr);
+    CheckScanned(heaps, queries, docs, K);
+
+    // blocks of 1500 with a partial last one add up to the same heaps
+    Helper::MemoryVectorReader reader(nullptr, docs);
+    COMMON::TruthSet::InitTruthQueries<std::int8_t>(queries, K, nullptr, heaps);
+    for (SizeType begin = 0; begin < docs->Count(); begin += 1500) {
+        COMMON::TruthSet::ScanTruthBlock<std::int8_t>(heaps, reader.GetVectorSet(begin, begin + 1500), begin, DistCalcMethod::L2, nullptr);
+    }
+    CheckScanned(heaps, queries, docs, K);
+}
+
+BOOST_AUTO_TEST_CASE(GenerateTruthStreamTest)
+{
+    int K = 10;
+    auto queries = TruthVectors(150, 128, 3);
+    auto docs = TruthVectors(5000, 128, 4);
+    std::string truthFile = "truthset_stream_test.bin";
+
+    std::shared_ptr<Helper::VectorSetReader> reader(new Helper::MemoryVectorReader(nullptr, docs));
+    COMMON::TruthSet::GenerateTruth<std::int8_t>(queries, reader, 1500, truthFile, DistCalcMethod::L2, K, TruthFileType::DEFAULT, nullptr);
+
+    auto ptr = f_createIO();
+    BOOST_REQUIRE(ptr != nullptr && ptr->Initialize(truthFile.c_str(), std::ios::in | std::ios::binary));
+    std::vector<std::set<SizeType>> truth;
+    SizeType queryNum = queries->Count();
+    int originalK = K;
+    COMMON::TruthSet::LoadTruth(ptr, truth, queryNum, originalK, K, TruthFileType::DEFAULT);
+    ptr->ShutDown();
+    BOOST_CHECK_EQUAL(originalK, K);
+
+    for (SizeType q = 0; q < queries->Count(); q++) {
+        std::set<SizeType> expected;
+        for (auto& p : FullScan(queries, q, docs, K)) expected.insert(p.node);
+        BOOST_CHECK(truth[q] == expected);
+    }
+    std::remove(truthFile.c_str());
+    std::remove((truthFile + ".dist.bin").c_str());
+}
+
+BOOST_AUTO_TEST_CASE(IncrementalTruthSetTest)
+{
+    IncrementalTruthTest(0);
+    IncrementalTruthTest(20);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -21,6 +21,9 @@ public:
 
     void SetTimeoutMilliseconds(int p_timeout);
 
+    // binary queries need servers of protocol 1.1, the Base64 string query is sent by default
+    void SetBinaryQuery(bool p_binary);
+
     void SetSearchParam(const char* p_name, const char* p_value);
 
     void ClearSearchParam();
@@ -30,10 +33,10 @@ public:
     bool IsConnected() const;
 
 private:
-    std::string CreateSearchQuery(const ByteArray& p_data,
-                                  int p_resultNum,
-                                  bool p_extractMetadata,
-                                  SPTAG::VectorValueType p_valueType);
+    SPTAG::Socket::RemoteQuery CreateSearchQuery(const ByteArray& p_data,
+                                                 int p_resultNum,
+                                                 bool p_extractMetadata,
+                                                 SPTAG::VectorValueType p_valueType);
 
     SPTAG::Socket::PacketHandlerMapPtr GetHandlerMap();
 
@@ -45,6 +48,8 @@ private:
 
     std::uint32_t m_timeoutInMilliseconds;
 
+    std::atomic<bool> m_binaryQuery;
+
     std::string m_server;
 
     std::string m_port;
@@ -12,7 +12,8 @@
 
 AnnClient::AnnClient(const char* p_serverAddr, const char* p_serverPort)
     : m_connectionID(SPTAG::Socket::c_invalidConnectionID),
-      m_timeoutInMilliseconds(9000)
+      m_timeoutInMilliseconds(9000),
+      m_binaryQuery(false)
 {
     using namespace SPTAG;
 
@@ -70,6 +71,13 @@ AnnClient::SetTimeoutMilliseconds(int p_timeout)
 }
 
 
+void
+AnnClient::SetBinaryQuery(bool p_binary)
+{
+    m_binaryQuery = p_binary;
+}
+
+
 void
 AnnClient::SetSearchParam(const char* p_name, const char* p_value)
 {
@@ -156,8 +164,7 @@ AnnClient::Search(ByteArray p_data, int p_resultNum, const char* p_valueType, bo
             m_timeoutInMilliseconds,
             std::move(timeoutCallback));
 
-        Socket::RemoteQuery query;
-        query.m_queryString = CreateSearchQuery(p_data, p_resultNum, p_withMetaData, valueType);
+        Socket::RemoteQuery query = CreateSearchQuery(p_data, p_resultNum, p_withMetaData, valueType);
 
         packet.Header().m_bodyLength = static_cast<std::uint32_t>(query.EstimateBufferSize());
         packet.AllocateBuffer(packet.Header().m_bodyLength);
@@ -226,12 +233,32 @@ AnnClient::SearchResponseHanlder(SPTAG::Socket::ConnectionID p_localConnectionID
 }
 
 
-std::string
+SPTAG::Socket::RemoteQuery
 AnnClient::CreateSearchQuery(const ByteArray& p_data,
                              int p_resultNum,
                              bool p_extractMetadata,
                              SPTAG::VectorValueType p_valueType)
 {
+    SPTAG::Socket::RemoteQuery query;
+    if (m_binaryQuery)
+    {
+        // sent as typed binary instead of Base64 text, the server searches the vector without parsing it
+        query.m_type = SPTAG::Socket::RemoteQuery::QueryType::Binary;
+        query.m_valueType = p_valueType;
+        query.m_dimension = static_cast<SPTAG::DimensionType>(p_data.Length() / SPTAG::GetValueTypeSize(p_valueType));
+        query.m_queryNum = 1;
+        query.m_resultNum = p_resultNum;
+        query.m_extractMetadata = p_extractMetadata;
+        query.m_vectors = p_data;
+
+        std::lock_guard<std::mutex> guard(m_paramMutex);
+        for (const auto& param : m_params)
+        {
+            query.m_params.emplace_back(param.first, param.second);
+        }
+        return query;
+    }
+
     std::stringstream out;
 
     out << "#";
@@ -250,6 +277,7 @@ AnnClient::CreateSearchQuery(const ByteArray& p_data,
         }
     }
 
-    return out.str();
+    query.m_queryString = out.str();
+    return query;
 }
 